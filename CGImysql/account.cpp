@@ -0,0 +1,82 @@
+/**
+ * @file account.cpp
+ * @brief 登录和注册接口的实现
+ */
+
+#include "account.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sql_connection_pool.h"
+
+// 用户表及其互斥锁，定义在 http_conn.cpp，启动时由 initmysql_result() 从数据库载入
+extern locker m_lock;
+extern map<string, string> users;
+
+// 将用户名和密码提取出来，请求体形如 user=123&password=123，格式不符或过长返回 false
+static bool parse_user_form(std::string_view body, char *name, char *password, size_t size) {
+    static const std::string_view user_key = "user=", password_key = "&password=";
+    if (body.substr(0, user_key.size()) != user_key) return false;
+    size_t amp = body.find(password_key, user_key.size());
+    if (amp == std::string_view::npos) return false;
+    std::string_view user = body.substr(user_key.size(), amp - user_key.size());
+    std::string_view pass = body.substr(amp + password_key.size());
+    if (user.size() >= size || pass.size() >= size) return false;
+    memcpy(name, user.data(), user.size());
+    name[user.size()] = '\0';
+    memcpy(password, pass.data(), pass.size());
+    password[pass.size()] = '\0';
+    return true;
+}
+
+// 登录：若浏览器端输入的用户名和密码在表中可以查找到，返回欢迎页面，否则返回登录错误页面
+static void login(http_request &req, http_response &res) {
+    char name[100], password[100];
+    const char *page = "/logError.html";
+    if (parse_user_form(req.body, name, password, sizeof(name))) {
+        m_lock.lock();  // users 会被注册并发修改
+        map<string, string>::iterator it = users.find(name);
+        if (it != users.end() && it->second == password) page = "/welcome.html";
+        m_lock.unlock();
+    }
+    res.send_file(page);
+}
+
+// 注册：先检测是否有重名的，没有重名的，写入数据库并加入用户表
+static void register_user(http_request &req, http_response &res) {
+    char name[100], password[100];
+    const char *page = "/registerError.html";
+    if (parse_user_form(req.body, name, password, sizeof(name))) {
+        char sql_insert[256];
+        snprintf(sql_insert, sizeof(sql_insert), "INSERT INTO user(username, passwd) VALUES('%s', '%s')", name,
+                 password);
+
+        m_lock.lock();
+        bool exists = users.find(name) != users.end();
+        m_lock.unlock();
+
+        if (!exists) {
+            // 阻塞线程池中的线程不持有连接，自己从连接池取一个
+            MYSQL *mysql = NULL;
+            connectionRAII mysqlcon(&mysql, connection_pool::GetInstance());
+            m_lock.lock();
+            // 等待数据库连接期间可能有同名用户注册成功，再检查一次
+            if (users.find(name) == users.end()) {
+                int res = mysql ? mysql_query(mysql, sql_insert) : 1;  // 执行 SQL 插入语句
+                if (!res) {
+                    users.insert(pair<string, string>(name, password));
+                    page = "/log.html";  // 如果插入成功，跳转到登录页面
+                }
+            }
+            m_lock.unlock();
+        }
+    }
+    res.send_file(page);
+}
+
+bool account_routes(http_conn::router &r) {
+    bool ok = http_conn::add_handler(r, "/2CGISQL.cgi", 1 << http_conn::POST, HANDLER_INLINE, login);
+    ok = http_conn::add_handler(r, "/3CGISQL.cgi", 1 << http_conn::POST, HANDLER_BLOCKING, register_user) && ok;
+    return ok;
+}
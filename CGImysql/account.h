@@ -0,0 +1,19 @@
+/**
+ * @file account.h
+ * @brief 登录和注册接口
+ *
+ * 基于处理函数 API 实现的第一批动态接口：
+ * 1. /2CGISQL.cgi 登录校验，只查内存中的用户表，在工作线程中直接执行
+ * 2. /3CGISQL.cgi 注册，需要写数据库，投递到阻塞线程池执行
+ * 两者都只接受 POST，请求体形如 user=xxx&password=xxx，结果以对应的静态页面返回。
+ */
+
+#ifndef ACCOUNT_H
+#define ACCOUNT_H
+
+#include "../http/http_conn.h"
+
+// 向路由表注册登录和注册接口，路由冲突时返回 false
+bool account_routes(http_conn::router &r);
+
+#endif
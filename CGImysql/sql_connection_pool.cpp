@@ -10,6 +10,8 @@
  * 4. 实现线程安全的连接池操作
  */
 
+#define LOG_MODULE LOG_MOD_SQL
+
 #include <mysql/mysql.h>
 #include <pthread.h>
 #include <stdio.h>
@@ -0,0 +1,195 @@
+/**
+ * @file compressor.cpp
+ * @brief 静态内容压缩模块的实现
+ */
+
+#include "compressor.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "../log/log.h"
+#include "file_cache.h"
+
+const char *encoding_name(CONTENT_ENCODING enc) {
+    switch (enc) {
+        case ENC_GZIP:
+            return "gzip";
+        case ENC_BROTLI:
+            return "br";
+        case ENC_ZSTD:
+            return "zstd";
+        default:
+            return "identity";
+    }
+}
+
+const char *encoding_suffix(CONTENT_ENCODING enc) {
+    switch (enc) {
+        case ENC_GZIP:
+            return ".gz";
+        case ENC_BROTLI:
+            return ".br";
+        case ENC_ZSTD:
+            return ".zst";
+        default:
+            return "";
+    }
+}
+
+bool encoding_supported(CONTENT_ENCODING enc) {
+    switch (enc) {
+        case ENC_GZIP:
+            return true;
+#ifdef USE_BROTLI
+        case ENC_BROTLI:
+            return true;
+#endif
+#ifdef USE_ZSTD
+        case ENC_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+encoded_body::~encoded_body() {
+    if (!data) return;
+    if (mapped)
+        munmap(data, size);
+    else
+        free(data);
+}
+
+// gzip：windowBits 加 16 让 zlib 输出 gzip 头而不是 zlib 头
+static size_t gzip_compress(const char *src, size_t len, char *dst, size_t cap, int level) {
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    if (deflateInit2(&zs, level < 0 ? 6 : level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return 0;
+    zs.next_in = (Bytef *)src;
+    zs.avail_in = len;
+    zs.next_out = (Bytef *)dst;
+    zs.avail_out = cap;
+    int ret = deflate(&zs, Z_FINISH);
+    size_t out = zs.total_out;
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END ? out : 0;
+}
+
+static size_t compress_bound(CONTENT_ENCODING enc, size_t len) {
+    switch (enc) {
+        case ENC_GZIP:
+            return compressBound(len) + 18;  // gzip 头尾比 zlib 多 12 字节，留些余量
+#ifdef USE_BROTLI
+        case ENC_BROTLI:
+            return BrotliEncoderMaxCompressedSize(len);
+#endif
+#ifdef USE_ZSTD
+        case ENC_ZSTD:
+            return ZSTD_compressBound(len);
+#endif
+        default:
+            return 0;
+    }
+}
+
+std::shared_ptr<encoded_body> compress_buffer(CONTENT_ENCODING enc, const char *src, size_t len, int level) {
+    size_t cap = compress_bound(enc, len);
+    if (cap == 0) return std::shared_ptr<encoded_body>();
+
+    char *dst = (char *)malloc(cap);
+    if (!dst) return std::shared_ptr<encoded_body>();
+
+    size_t out = 0;
+    switch (enc) {
+        case ENC_GZIP:
+            out = gzip_compress(src, len, dst, cap, level);
+            break;
+#ifdef USE_BROTLI
+        case ENC_BROTLI: {
+            size_t encoded = cap;
+            if (BrotliEncoderCompress(level < 0 ? 9 : level, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len,
+                    (const uint8_t *)src, &encoded, (uint8_t *)dst))
+                out = encoded;
+            break;
+        }
+#endif
+#ifdef USE_ZSTD
+        case ENC_ZSTD: {
+            size_t ret = ZSTD_compress(dst, cap, src, len, level < 0 ? 9 : level);
+            if (!ZSTD_isError(ret)) out = ret;
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+
+    // 压缩后没有变小就没必要缓存，直接发原文
+    if (out == 0 || out >= len) {
+        free(dst);
+        return std::shared_ptr<encoded_body>();
+    }
+    char *shrunk = (char *)realloc(dst, out);
+    if (shrunk) dst = shrunk;
+    return std::make_shared<encoded_body>(dst, out, false);
+}
+
+void compressor::init(int thread_num, int max_queue, int close_log) {
+    m_close_log = close_log;
+    if (thread_num <= 0 || m_queue) return;
+
+    m_queue = new block_queue<compress_job>(max_queue);
+    for (int i = 0; i < thread_num; ++i) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, this) != 0) {
+            LOG_ERROR("%s", "create compress thread failure");
+            continue;
+        }
+        pthread_detach(tid);
+    }
+}
+
+bool compressor::submit(file_cache *cache, const std::shared_ptr<file_entry> &entry, CONTENT_ENCODING enc) {
+    if (!m_queue || m_queue->full()) return false;
+    compress_job job;
+    job.cache = cache;
+    job.entry = entry;
+    job.enc = enc;
+    return m_queue->push(job);
+}
+
+void *compressor::worker(void *arg) {
+    // 压缩是可以推迟的工作，降低本线程的调度优先级，把 CPU 让给事件循环和工作线程
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+    ((compressor *)arg)->run();
+    return NULL;
+}
+
+void compressor::run() {
+    compress_job job;
+    while (m_queue->pop(job)) {
+        const file_entry *entry = job.entry.get();
+        std::shared_ptr<encoded_body> body = compress_buffer(job.enc, entry->data, entry->st.st_size);
+        if (body) LOG_INFO("compressed %s (%s): %ld -> %zu", entry->path.c_str(), encoding_name(job.enc), (long)entry->st.st_size, body->size);
+        // 压缩失败或压缩后不变小时也要回填，由缓存记住这个编码不值得再试
+        job.cache->store_variant(job.entry, job.enc, body);
+        job.entry.reset();
+    }
+}
@@ -0,0 +1,108 @@
+/**
+ * @file compressor.h
+ * @brief 静态内容压缩模块
+ *
+ * 提供 gzip / brotli / zstd 三种编码的一次性压缩函数，以及一个后台压缩线程组。
+ * 主要特点：
+ * 1. 编码器是否可用由编译开关决定（USE_BROTLI、USE_ZSTD），gzip 依赖 zlib 总是可用
+ * 2. 后台线程数量固定且降低调度优先级，压缩占用的 CPU 有上限
+ * 3. 任务通过有界阻塞队列投递，队列满时直接放弃，请求线程永远不会等待压缩器
+ */
+
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <stddef.h>
+
+#include <memory>
+
+#include "../log/block_queue.h"
+
+// 内容编码，数值同时用作 file_entry::variants 下标和 Accept-Encoding 位掩码的位号
+enum CONTENT_ENCODING {
+    ENC_IDENTITY = 0,  // 不压缩
+    ENC_GZIP,          // gzip（zlib）
+    ENC_BROTLI,        // br
+    ENC_ZSTD,          // zstd
+    ENC_COUNT
+};
+
+// 编码在 HTTP 头中的名字，如 "gzip"、"br"
+const char *encoding_name(CONTENT_ENCODING enc);
+// 预压缩兄弟文件的后缀，如 ".gz"、".br"
+const char *encoding_suffix(CONTENT_ENCODING enc);
+// 本次编译是否支持该编码的即时压缩
+bool encoding_supported(CONTENT_ENCODING enc);
+
+/**
+ * @brief 压缩后的响应体
+ *
+ * 既可以是 mmap 映射的预压缩兄弟文件，也可以是后台线程压缩出来的堆内存。
+ */
+struct encoded_body {
+    encoded_body(char *data, size_t size, bool mapped)
+        : data(data), size(size), mapped(mapped) {}
+    ~encoded_body();
+
+    char *data;   // 响应体首地址
+    size_t size;  // 响应体长度
+    bool mapped;  // true 表示 mmap 得来，需 munmap；否则 free
+};
+
+/**
+ * @brief 一次性压缩 [src, src + len)
+ * @param enc 目标编码
+ * @param level 压缩级别，<0 表示使用各编码的默认值
+ * @return 压缩结果；编码不支持、压缩失败或压缩后没有变小时返回空指针
+ */
+std::shared_ptr<encoded_body> compress_buffer(CONTENT_ENCODING enc, const char *src, size_t len, int level = -1);
+
+class file_cache;
+struct file_entry;
+
+// 后台压缩任务
+struct compress_job {
+    file_cache *cache;                  // 结果写回哪个缓存
+    std::shared_ptr<file_entry> entry;  // 被压缩的文件
+    CONTENT_ENCODING enc;               // 目标编码
+};
+
+/**
+ * @brief 后台压缩线程组（单例）
+ *
+ * 请求线程发现缓存中缺少某个编码变体时调用 submit() 投递任务并立即返回，
+ * 本次请求先发送原始内容，压缩完成后的请求命中缓存。
+ */
+class compressor {
+   public:
+    static compressor *get_instance() {
+        static compressor instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 启动后台压缩线程
+     * @param thread_num 线程数，0 表示关闭即时压缩（仍然会使用预压缩文件）
+     * @param max_queue 等待压缩的任务上限
+     * @param close_log 日志开关
+     */
+    void init(int thread_num, int max_queue, int close_log);
+
+    // 投递压缩任务，不阻塞；队列已满或未启用时返回 false
+    bool submit(file_cache *cache, const std::shared_ptr<file_entry> &entry, CONTENT_ENCODING enc);
+
+    bool enabled() const { return m_queue != NULL; }
+
+   private:
+    compressor() : m_queue(NULL), m_close_log(0) {}
+    ~compressor() {}
+
+    static void *worker(void *arg);
+    void run();
+
+   private:
+    block_queue<compress_job> *m_queue;  // 有界任务队列
+    int m_close_log;                     // 日志开关
+};
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * @file file_cache.cpp
+ * @brief 静态文件缓存的实现
+ */
+
+#include "file_cache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../log/log.h"
+
+// 小于该值的文件压缩收益抵不上 Content-Encoding 等头部的开销
+static const off_t MIN_COMPRESS_SIZE = 256;
+// 大于该值的文件不做即时压缩，避免一次压缩长时间占住后台线程
+static const off_t MAX_COMPRESS_SIZE = 4 << 20;
+
+// 判断两次 stat 是否是同一个、且未被修改过的文件
+static bool same_file(const struct stat &a, const struct stat &b) {
+    return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size &&
+           a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+// 只读映射整个文件，空文件返回 NULL
+static char *map_file(const char *path, off_t size) {
+    if (size == 0) return NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return (char *)MAP_FAILED;
+    char *addr = (char *)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return addr;
+}
+
+file_entry::~file_entry() {
+    if (data) munmap(data, st.st_size);
+}
+
+file_cache::file_cache(size_t max_entries, size_t compressed_budget, int close_log)
+    : m_max_entries(max_entries), m_compressed_budget(compressed_budget), m_compressed_bytes(0), m_close_log(close_log) {}
+
+shared_ptr<file_entry> file_cache::load(const char *path, const struct stat &st) {
+    char *data = map_file(path, st.st_size);
+    if (data == MAP_FAILED) return shared_ptr<file_entry>();
+
+    shared_ptr<file_entry> entry = make_shared<file_entry>();
+    entry->path = path;
+    entry->st = st;
+    entry->data = data;
+    entry->mime = mime_lookup(path);
+    entry->compressible = entry->mime->compressible && st.st_size >= MIN_COMPRESS_SIZE && st.st_size <= MAX_COMPRESS_SIZE;
+
+    // 探测预压缩兄弟文件：必须是比原文件新的普通可读文件，否则视为过期
+    for (int enc = ENC_GZIP; enc < ENC_COUNT; ++enc) {
+        string sibling = entry->path + encoding_suffix((CONTENT_ENCODING)enc);
+        struct stat sst;
+        if (stat(sibling.c_str(), &sst) < 0 || !S_ISREG(sst.st_mode) || !(sst.st_mode & S_IROTH) || sst.st_size == 0)
+            continue;
+        if (sst.st_mtime < st.st_mtime) continue;
+        char *sdata = map_file(sibling.c_str(), sst.st_size);
+        if (sdata == MAP_FAILED) continue;
+        entry->variants[enc] = make_shared<encoded_body>(sdata, sst.st_size, true);
+        entry->has_siblings = true;
+    }
+    return entry;
+}
+
+shared_ptr<file_entry> file_cache::acquire(const char *path, const struct stat &st) {
+    m_lock.lock();
+    unordered_map<string, shared_ptr<file_entry> >::iterator it = m_entries.find(path);
+    if (it != m_entries.end()) {
+        shared_ptr<file_entry> entry = it->second;
+        if (same_file(entry->st, st)) {
+            m_lru.splice(m_lru.begin(), m_lru, entry->lru);  // 移到表头
+            entry->checked = time(NULL);
+            m_lock.unlock();
+            return entry;
+        }
+        // 文件已变化，丢弃旧项（在途响应仍持有旧映射，不受影响）
+        drop_variants_locked(entry.get());
+        m_lru.erase(entry->lru);
+        m_entries.erase(it);
+    }
+    m_lock.unlock();
+
+    // open/mmap 放在锁外，慢速磁盘不会阻塞其他文件的命中
+    shared_ptr<file_entry> entry = load(path, st);
+    if (!entry) return entry;
+
+    m_lock.lock();
+    it = m_entries.find(path);
+    if (it != m_entries.end() && same_file(it->second->st, st)) {
+        // 其他线程抢先加载了同一个文件，用它的结果
+        entry = it->second;
+        m_lock.unlock();
+        return entry;
+    }
+    if (it != m_entries.end()) {
+        drop_variants_locked(it->second.get());
+        m_lru.erase(it->second->lru);
+        m_entries.erase(it);
+    }
+    while (m_entries.size() >= m_max_entries && !m_lru.empty()) evict_entry_locked();
+    entry->checked = time(NULL);
+    m_lru.push_front(entry);
+    entry->lru = m_lru.begin();
+    m_entries[entry->path] = entry;
+    m_lock.unlock();
+    return entry;
+}
+
+shared_ptr<file_entry> file_cache::peek(const char *path, time_t max_age) {
+    shared_ptr<file_entry> entry;
+    time_t now = time(NULL);
+    m_lock.lock();
+    unordered_map<string, shared_ptr<file_entry> >::iterator it = m_entries.find(path);
+    if (it != m_entries.end() && now - it->second->checked < max_age) {
+        entry = it->second;
+        m_lru.splice(m_lru.begin(), m_lru, entry->lru);
+    }
+    m_lock.unlock();
+    return entry;
+}
+
+shared_ptr<encoded_body> file_cache::select(const shared_ptr<file_entry> &entry, int accept_mask, CONTENT_ENCODING &enc) {
+    // 服务端偏好顺序：br 压缩率最高，zstd 解压最快，gzip 兼容性最好
+    static const CONTENT_ENCODING preference[] = {ENC_BROTLI, ENC_ZSTD, ENC_GZIP};
+
+    enc = ENC_IDENTITY;
+    if (accept_mask == 0 || (!entry->compressible && !entry->has_siblings)) return shared_ptr<encoded_body>();
+
+    shared_ptr<encoded_body> body;
+    CONTENT_ENCODING missing = ENC_IDENTITY;
+    m_lock.lock();
+    for (size_t i = 0; i < sizeof(preference) / sizeof(preference[0]); ++i) {
+        CONTENT_ENCODING e = preference[i];
+        if (!(accept_mask & (1 << e))) continue;
+        if (entry->variants[e]) {
+            body = entry->variants[e];
+            enc = e;
+            break;
+        }
+        // 记下客户端最想要、但还没有压缩过的编码
+        if (missing == ENC_IDENTITY && entry->compressible && !entry->pending[e] && encoding_supported(e)) missing = e;
+    }
+    if (missing != ENC_IDENTITY) entry->pending[missing] = true;
+    m_lock.unlock();
+
+    // 投递放在锁外；投递失败（队列满）则清掉标志，留给以后的请求再试
+    if (missing != ENC_IDENTITY && !compressor::get_instance()->submit(this, entry, missing)) {
+        m_lock.lock();
+        entry->pending[missing] = false;
+        m_lock.unlock();
+    }
+    return body;
+}
+
+void file_cache::store_variant(const shared_ptr<file_entry> &entry, CONTENT_ENCODING enc, const shared_ptr<encoded_body> &body) {
+    m_lock.lock();
+    // 压缩期间文件被替换或淘汰了，结果作废
+    unordered_map<string, shared_ptr<file_entry> >::iterator it = m_entries.find(entry->path);
+    if (it == m_entries.end() || it->second != entry) {
+        m_lock.unlock();
+        return;
+    }
+    // 压缩失败时保留 pending 标志，同一版本的文件不再重试
+    if (!body || body->size > m_compressed_budget) {
+        m_lock.unlock();
+        return;
+    }
+    // 从最久未使用的缓存项开始回收压缩结果，直到放得下
+    for (list<shared_ptr<file_entry> >::reverse_iterator r = m_lru.rbegin();
+         m_compressed_bytes + body->size > m_compressed_budget && r != m_lru.rend(); ++r) {
+        if ((*r).get() != entry.get()) drop_variants_locked(r->get());
+    }
+    if (m_compressed_bytes + body->size <= m_compressed_budget) {
+        entry->variants[enc] = body;
+        entry->compressed_bytes += body->size;
+        m_compressed_bytes += body->size;
+    } else {
+        entry->pending[enc] = false;
+    }
+    m_lock.unlock();
+}
+
+// 淘汰最久未使用的缓存项，调用者持有 m_lock
+void file_cache::evict_entry_locked() {
+    shared_ptr<file_entry> victim = m_lru.back();
+    drop_variants_locked(victim.get());
+    m_lru.pop_back();
+    m_entries.erase(victim->path);
+}
+
+// 释放缓存项的即时压缩结果（预压缩文件是 mmap，不计入预算），调用者持有 m_lock
+void file_cache::drop_variants_locked(file_entry *entry) {
+    if (entry->compressed_bytes == 0) return;
+    for (int enc = ENC_GZIP; enc < ENC_COUNT; ++enc) {
+        if (entry->variants[enc] && !entry->variants[enc]->mapped) {
+            entry->variants[enc].reset();
+            entry->pending[enc] = false;
+        }
+    }
+    m_compressed_bytes -= entry->compressed_bytes;
+    entry->compressed_bytes = 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file file_cache.h
+ * @brief 静态文件缓存
+ *
+ * 把 do_request() 每次请求都要做的 open + mmap + munmap 变成一次性的工作：
+ * 1. 以文件路径为键缓存 mmap 映射和 stat 信息，文件变化（大小/修改时间/inode）时自动重新加载
+ * 2. 加载时顺带探测 .gz/.br/.zst 预压缩兄弟文件，并解析一次 MIME 类型
+ * 3. 可压缩的文本文件由后台压缩线程补齐各编码变体，压缩结果占用的内存有上限
+ * 4. 缓存项用 shared_ptr 管理，正在发送的连接持有引用，淘汰不会影响在途响应
+ */
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "../http/mime.h"
+#include "../lock/locker.h"
+#include "compressor.h"
+
+using namespace std;
+
+/**
+ * @brief 缓存中的一个文件
+ */
+struct file_entry {
+    file_entry()
+        : data(NULL), mime(&MIME_DEFAULT), compressible(false), has_siblings(false), compressed_bytes(0), checked(0) {
+        for (int i = 0; i < ENC_COUNT; ++i) pending[i] = false;
+    }
+    ~file_entry();
+
+    string path;        // 文件绝对路径
+    struct stat st;     // 加载时的文件状态
+    char *data;         // 原始内容的 mmap 映射，空文件为 NULL
+    const mime_type *mime;  // 按扩展名解析出的 MIME 类型
+    bool compressible;  // 是否值得即时压缩（文本类型且大小合适）
+    bool has_siblings;  // 是否存在预压缩兄弟文件
+
+    // 以下成员由 file_cache 的锁保护
+    shared_ptr<encoded_body> variants[ENC_COUNT];  // 各编码变体，下标为 CONTENT_ENCODING
+    bool pending[ENC_COUNT];                       // 是否已投递后台压缩
+    size_t compressed_bytes;                       // 即时压缩变体占用的内存
+    list<shared_ptr<file_entry> >::iterator lru;   // 在 LRU 链表中的位置
+    time_t checked;                                // 最近一次用 stat 确认与磁盘一致的时间
+};
+
+class file_cache {
+   public:
+    /**
+     * @param max_entries 最多缓存的文件数
+     * @param compressed_budget 即时压缩结果最多占用的内存（字节）
+     * @param close_log 日志开关
+     */
+    file_cache(size_t max_entries = 1024, size_t compressed_budget = 32 << 20, int close_log = 0);
+    ~file_cache() {}
+
+    /**
+     * @brief 获取文件对应的缓存项，不存在或已过期时加载
+     * @param path 文件路径
+     * @param st 调用者刚刚 stat 得到的文件状态，用于判断缓存是否过期
+     * @return 缓存项；open/mmap 失败时返回空指针
+     */
+    shared_ptr<file_entry> acquire(const char *path, const struct stat &st);
+
+    /**
+     * @brief 不访问磁盘的查找，供不能阻塞的事件循环线程使用
+     * @param path 文件路径
+     * @param max_age 缓存项在最近多少秒内用 stat 确认过才算有效，文件变化最多晚这么久被发现
+     * @return 有效的缓存项；不在缓存中或太久没有确认时返回空指针，由调用者在其他线程 stat 后 acquire()
+     */
+    shared_ptr<file_entry> peek(const char *path, time_t max_age);
+
+    /**
+     * @brief 按客户端可接受的编码选出要发送的变体
+     * @param entry acquire() 返回的缓存项
+     * @param accept_mask 客户端可接受的编码位掩码（1 << CONTENT_ENCODING）
+     * @param enc 输出选中的编码，没有合适变体时为 ENC_IDENTITY
+     * @return 选中的变体；发送原始内容时返回空指针
+     *
+     * 缺少的变体会投递给后台压缩线程，本次调用不会等待。
+     */
+    shared_ptr<encoded_body> select(const shared_ptr<file_entry> &entry, int accept_mask, CONTENT_ENCODING &enc);
+
+    // 后台压缩线程回填压缩结果
+    void store_variant(const shared_ptr<file_entry> &entry, CONTENT_ENCODING enc, const shared_ptr<encoded_body> &body);
+
+   private:
+    shared_ptr<file_entry> load(const char *path, const struct stat &st);
+    void evict_entry_locked();
+    void drop_variants_locked(file_entry *entry);
+
+   private:
+    locker m_lock;                                                  // 保护以下所有成员
+    unordered_map<string, shared_ptr<file_entry> > m_entries;       // 路径 -> 缓存项
+    list<shared_ptr<file_entry> > m_lru;                            // 最近使用的在表头
+    size_t m_max_entries;                                           // 缓存项上限
+    size_t m_compressed_budget;                                     // 压缩结果内存上限
+    size_t m_compressed_bytes;                                      // 压缩结果当前占用
+    int m_close_log;                                                // 日志开关
+};
+
+#endif
@@ -22,6 +22,26 @@ Config::Config(){
     close_log = 0;      // 关闭日志,默认不关闭
 
     actor_model = 0;    // 并发模型,默认是proactor
+
+    compress_threads = 1;  // 后台压缩线程数量,默认1
+
+    handler_threads = 4;  // 阻塞处理函数线程数量,默认4
+
+    tls_port = 0;       // HTTPS 端口,默认不启用
+
+    tls_cert = "./server.crt";  // 证书链,默认项目目录下的 server.crt
+
+    tls_key = "./server.key";   // 私钥,默认项目目录下的 server.key
+
+    log_levels = "";    // 日志级别,默认所有模块 debug
+
+    log_segment_mb = 0; // 日志段大小,默认不使用日志段
+
+    log_backpressure = ""; // 环满时的处理方式,默认 DEBUG/INFO 丢弃、WARN 挤掉最旧的行、ERROR 写入溢出文件
+
+    access_format = ACCESS_OFF; // 访问日志,默认不写
+
+    ws_topics = 0;      // 主题广播接口,默认不注册
 }
 
 /* 显示帮助信息 */
@@ -30,7 +50,7 @@ void Config::display_usage() {
         "用法: server [选项]...\n"
         "选项列表:\n"
         "  -p <端口号>           设置服务器监听端口号 (默认: 9006)\n"
-        "  -l <日志写入方式>     设置日志写入方式 (0: 同步, 1: 异步, 默认: 0)\n"
+        "  -l <日志写入方式>     设置日志写入方式 (0: 同步, 1: 异步, 2: 二进制, 默认: 0)\n"
         "  -m <触发模式>         设置触发模式 (0~3, 默认: 0)\n"
         "                         0: listenfd LT + connfd LT\n"
         "                         1: listenfd LT + connfd ET\n"
@@ -41,9 +61,29 @@ void Config::display_usage() {
         "  -t <线程数>           设置线程池内线程数量 (默认: 8)\n"
         "  -c <关闭日志>         是否关闭日志 (0: 不关闭, 1: 关闭, 默认: 0)\n"
         "  -a <并发模型>         选择并发模型 (0: Proactor, 1: Reactor, 默认: 0)\n"
+        "  -z <压缩线程数>       设置后台压缩线程数量 (0: 只用预压缩文件, 默认: 1)\n"
+        "  -b <阻塞线程数>       设置阻塞处理函数线程数量 (0: 在工作线程中执行, 默认: 4)\n"
+        "  -x <前缀=上游>        反向代理，可多次指定，如 /api=127.0.0.1:8001,127.0.0.1:8002@lc\n"
+        "                         @rr: 轮询 (默认), @lc: 最少连接\n"
+        "  -f <前缀=socket>      FastCGI，可多次指定，如 /php=/run/php/php-fpm.sock\n"
+        "                         -x/-f 的前缀前加主机名时只对该虚拟主机生效，如 blog.example.com/api=127.0.0.1:8001\n"
+        "  -v <主机名=目录>      虚拟主机，可多次指定，如 blog.example.com,www.blog.example.com=/srv/blog@64:4096\n"
+        "                         @缓存MB:缓存文件数 可省略 (默认: 32MB, 1024 个)，其余请求由 ./root 回答\n"
+        "  -T <HTTPS端口>        在该端口上提供 HTTPS (默认: 0, 不启用)\n"
+        "  -C <证书>             HTTPS 证书链, PEM 格式 (默认: ./server.crt)\n"
+        "  -K <私钥>             HTTPS 私钥, PEM 格式 (默认: ./server.key)\n"
+        "  -L <级别>             日志级别，如 info 或 warn,http=debug (默认: debug)\n"
+        "                         级别: debug/info/warn/error/off, 模块: main/http/timer/pool/sql\n"
+        "  -S <段MB>             日志写入预分配的内存映射段，写满后切换并压缩旧段 (默认: 0, 用 stdio)\n"
+        "  -Q <方式>             异步日志环满时各级别的处理方式，如 info=drop-newest,error=block,wait=20\n"
+        "                         方式: drop-newest/drop-oldest/block/spill (默认: warn=drop-oldest,error=spill, 其余 drop-newest)\n"
+        "  -A <格式>             访问日志，每个请求一条，带排队/解析/处理/发送耗时 (默认: off)\n"
+        "                         格式: off/clf/json/binary, binary 用 logdecode 解码\n"
+        "  -W <主题广播>         注册 WebSocket 主题广播接口 /ws/:topic，任何客户端都能向任意主题发布 (0: 不注册, 1: 注册, 默认: 0)\n"
         "  -h                    显示此帮助信息\n"
         "示例:\n"
         "  server -p 8080 -t 16 -c 1\n"
+        "  server -p 80 -T 443 -C cert.pem -K key.pem\n"
     );
 }
 
@@ -51,7 +91,7 @@ void Config::parse_arg(int argc, char* argv[]) {
     int opt;
 
     // 设置 optstring：选项字符
-    const char *str = ":p:l:m:o:s:t:c:a:h";
+    const char *str = ":p:l:m:o:s:t:c:a:z:b:x:f:v:T:C:K:L:S:Q:A:W:h";
     while ((opt = getopt(argc, argv, str)) != -1) {
         switch (opt) {
             
@@ -147,6 +187,100 @@ void Config::parse_arg(int argc, char* argv[]) {
                 }
                 break;
 
+            case 'z':
+                {
+                    char *endptr;
+                    compress_threads = strtol(optarg, &endptr, 10);
+                    if (*endptr != '\0' || compress_threads < 0) {
+                        fprintf(stderr, "无效的压缩线程数量：%s，应为非负整数\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+
+            case 'b':
+                {
+                    char *endptr;
+                    handler_threads = strtol(optarg, &endptr, 10);
+                    if (*endptr != '\0' || handler_threads < 0) {
+                        fprintf(stderr, "无效的阻塞线程数量：%s，应为非负整数\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+
+            case 'x': // 反向代理，格式在启动路由表时校验
+                proxy_specs.push_back(optarg);
+                break;
+
+            case 'f': // FastCGI，格式在启动路由表时校验
+                fastcgi_specs.push_back(optarg);
+                break;
+
+            case 'v': // 虚拟主机，格式和目录在创建文件缓存时校验
+                vhost_specs.push_back(optarg);
+                break;
+
+            case 'T': // HTTPS 端口，0 表示不启用
+                {
+                    char *endptr;
+                    tls_port = strtol(optarg, &endptr, 10);
+                    if (*endptr != '\0' || tls_port < 0 || tls_port > 65535) {
+                        fprintf(stderr, "无效的 HTTPS 端口：%s\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+
+            case 'C': // 证书和私钥在启动监听时加载
+                tls_cert = optarg;
+                break;
+
+            case 'K':
+                tls_key = optarg;
+                break;
+
+            case 'L': // 日志级别在初始化日志时校验
+                log_levels = optarg;
+                break;
+
+            case 'Q': // 环满时的处理方式在初始化日志时校验
+                log_backpressure = optarg;
+                break;
+
+            case 'S': // 日志段大小，0 表示不使用日志段
+                {
+                    char *endptr;
+                    log_segment_mb = strtol(optarg, &endptr, 10);
+                    if (*endptr != '\0' || log_segment_mb < 0 || log_segment_mb > 4096) {
+                        fprintf(stderr, "无效的日志段大小：%s，应为 0 到 4096 之间的 MB 数\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+
+            case 'A': // 访问日志格式
+                {
+                    ::access_format format;
+                    if (!access_log::parse_format(optarg, format)) {
+                        fprintf(stderr, "无效的访问日志格式：%s，应为 off/clf/json/binary\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                    access_format = format;
+                }
+                break;
+
+            case 'W': // WebSocket 主题广播
+                {
+                    char *endptr;
+                    ws_topics = strtol(optarg, &endptr, 10);
+                    if (*endptr != '\0' || (ws_topics != 0 && ws_topics != 1)) {
+                        fprintf(stderr, "无效的主题广播选项：%s，应为 0 或 1\n", optarg);
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+
             case 'h': // 显示帮助信息
                 display_usage();
                 exit(EXIT_SUCCESS);
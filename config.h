@@ -42,6 +42,42 @@ class Config {
 
     // 并发模型选择
     int actor_model;
+
+    // 后台压缩线程数量
+    int compress_threads;
+
+    // 阻塞处理函数线程池的线程数量
+    int handler_threads;
+
+    // 反向代理配置，-x 可以出现多次
+    vector<string> proxy_specs;
+
+    // FastCGI 配置，-f 可以出现多次
+    vector<string> fastcgi_specs;
+
+    // 虚拟主机配置，-v 可以出现多次
+    vector<string> vhost_specs;
+
+    // HTTPS 端口，0 表示不启用
+    int tls_port;
+
+    // HTTPS 使用的证书链和私钥（PEM）
+    string tls_cert;
+    string tls_key;
+
+    // 日志级别，格式见 Log::set_levels()，如 "info,http=debug"
+    string log_levels;
+
+    // 日志段大小（MB），0 表示用 stdio 写日志文件
+    int log_segment_mb;
+
+    // 异步日志环满时各级别的处理方式，格式见 Log::set_backpressure()
+    string log_backpressure;
+
+    // 访问日志格式（access_format），ACCESS_OFF 表示不写访问日志
+    int access_format;
+    // 是否注册内置的 WebSocket 主题广播接口 /ws/:topic
+    int ws_topics;
 };
 
 #endif
\ No newline at end of file
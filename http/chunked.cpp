@@ -0,0 +1,112 @@
+// chunked.cpp 文件实现了分块传输编码的增量解码器和 chunk 长度行的生成。
+
+#include "chunked.h"
+
+#include <string.h>
+
+size_t chunk_size_line(char *out, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    char tmp[16];
+    int n = 0;
+    do {
+        tmp[n++] = hex[len & 0xf];
+        len >>= 4;
+    } while (len);
+    size_t i = 0;
+    while (n) out[i++] = tmp[--n];  // 倒序写出高位在前
+    out[i++] = '\r';
+    out[i++] = '\n';
+    return i;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void chunked_decoder::reset() {
+    m_state = ST_SIZE;
+    m_chunk_size = 0;
+    m_remaining = 0;
+    m_digits = 0;
+    m_decoded = 0;
+}
+
+chunked_decoder::STATUS chunked_decoder::decode(char *buf, long &pos, long end, long &out, long limit) {
+    while (pos < end) {
+        // 数据块整段复制，其余状态逐字节处理
+        if (m_state == ST_DATA) {
+            long n = end - pos;
+            if (n > m_remaining) n = m_remaining;
+            if (out != pos) memmove(buf + out, buf + pos, n);
+            out += n;
+            pos += n;
+            m_remaining -= n;
+            if (m_remaining == 0) m_state = ST_DATA_CR;
+            continue;
+        }
+
+        char c = buf[pos++];
+        switch (m_state) {
+            case ST_SIZE: {
+                int v = hex_value(c);
+                if (v >= 0) {
+                    // 长度最多 15 位十六进制，防止溢出
+                    if (++m_digits > 15) return CHUNK_ERROR;
+                    m_chunk_size = (m_chunk_size << 4) | v;
+                } else if (m_digits == 0) {
+                    return CHUNK_ERROR;  // 长度行必须以十六进制数字开头
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    m_state = ST_EXT;
+                } else if (c == '\r') {
+                    m_state = ST_SIZE_LF;
+                } else {
+                    return CHUNK_ERROR;
+                }
+                break;
+            }
+            case ST_EXT:
+                if (c == '\r') m_state = ST_SIZE_LF;
+                break;
+            case ST_SIZE_LF:
+                if (c != '\n') return CHUNK_ERROR;
+                if (m_chunk_size == 0) {
+                    m_state = ST_TRAILER_START;
+                } else {
+                    if (m_decoded + m_chunk_size > limit) return CHUNK_TOO_LARGE;
+                    m_decoded += m_chunk_size;
+                    m_remaining = m_chunk_size;
+                    m_state = ST_DATA;
+                }
+                break;
+            case ST_DATA_CR:
+                if (c != '\r') return CHUNK_ERROR;
+                m_state = ST_DATA_LF;
+                break;
+            case ST_DATA_LF:
+                if (c != '\n') return CHUNK_ERROR;
+                m_chunk_size = 0;
+                m_digits = 0;
+                m_state = ST_SIZE;
+                break;
+            case ST_TRAILER_START:
+                m_state = (c == '\r') ? ST_END_LF : ST_TRAILER;
+                break;
+            case ST_TRAILER:
+                if (c == '\r') m_state = ST_TRAILER_LF;
+                break;
+            case ST_TRAILER_LF:
+                if (c != '\n') return CHUNK_ERROR;
+                m_state = ST_TRAILER_START;
+                break;
+            case ST_END_LF:
+                if (c != '\n') return CHUNK_ERROR;
+                return CHUNK_DONE;
+            default:
+                return CHUNK_ERROR;
+        }
+    }
+    return CHUNK_MORE;
+}
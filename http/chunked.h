@@ -0,0 +1,71 @@
+// chunked.h 文件实现了 HTTP/1.1 分块传输编码（Transfer-Encoding: chunked）的编解码。
+// 解码器是增量式的：数据分几次到达时可以反复调用，每次只处理新到的字节，解出的内容原地写回缓冲区，
+// 这样请求状态机不需要为请求体另外分配内存。编码器只负责生成每个 chunk 的长度行和结束块。
+
+#ifndef CHUNKED_H
+#define CHUNKED_H
+
+#include <stddef.h>
+
+// 结束块：长度为 0 的 chunk 加上空的 trailer
+static const char CHUNK_LAST[] = "0\r\n\r\n";
+static const size_t CHUNK_LAST_LEN = sizeof(CHUNK_LAST) - 1;
+// chunk 数据之后的 CRLF
+static const char CHUNK_CRLF[] = "\r\n";
+
+// 长度行的最大长度："ffffffffffffffff\r\n"
+static const size_t CHUNK_SIZE_LINE_MAX = 18;
+
+// 把 chunk 长度写成 "<十六进制>\r\n"，返回写入的字节数，out 至少 CHUNK_SIZE_LINE_MAX 字节
+size_t chunk_size_line(char *out, size_t len);
+
+class chunked_decoder {
+   public:
+    // 解码结果
+    enum STATUS {
+        CHUNK_MORE = 0,  // 数据不完整，需要继续读取
+        CHUNK_DONE,      // 已读到结束块和 trailer，请求体完整
+        CHUNK_ERROR,     // 格式错误
+        CHUNK_TOO_LARGE  // 格式正确，但解出的数据超过 limit
+    };
+
+    chunked_decoder() { reset(); }
+
+    // 开始解码一个新的请求体
+    void reset();
+
+    /**
+     * @brief 增量解码 buf[pos, end)
+     * @param buf 缓冲区
+     * @param pos 输入起点，返回时更新为第一个未处理字节的位置
+     * @param end 输入终点
+     * @param out 输出位置，解出的数据写到 buf + out（始终有 out <= pos），返回时更新为输出末尾
+     * @param limit 解出的数据最多允许多少字节，超过时返回 CHUNK_TOO_LARGE
+     */
+    STATUS decode(char *buf, long &pos, long end, long &out, long limit);
+
+    // 已解出的请求体字节数
+    long decoded() const { return m_decoded; }
+
+   private:
+    enum STATE {
+        ST_SIZE = 0,      // 读取十六进制长度
+        ST_EXT,           // 跳过 chunk 扩展（;name=value）
+        ST_SIZE_LF,       // 长度行末尾的 \n
+        ST_DATA,          // 复制 chunk 数据
+        ST_DATA_CR,       // 数据后的 \r
+        ST_DATA_LF,       // 数据后的 \n
+        ST_TRAILER_START, // trailer 行首（\r 表示结束）
+        ST_TRAILER,       // 跳过 trailer 头部
+        ST_TRAILER_LF,    // trailer 行末尾的 \n
+        ST_END_LF         // 最后一个空行的 \n
+    };
+
+    STATE m_state;      // 当前状态
+    long m_chunk_size;  // 当前 chunk 的长度
+    long m_remaining;   // 当前 chunk 还剩多少数据未复制
+    int m_digits;       // 长度行已读到的十六进制位数
+    long m_decoded;     // 累计解出的字节数
+};
+
+#endif
@@ -0,0 +1,347 @@
+/**
+ * @file handler.cpp
+ * @brief 处理函数 API 的实现：请求对象、响应编码和阻塞线程池
+ */
+
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include "handler.h"
+
+#include <pthread.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "../cache/file_cache.h"
+#include "../log/log.h"
+#include "chunked.h"
+#include "http_conn.h"
+#include "response_head.h"
+#include "vhost.h"
+
+static const char *default_content_type = "text/plain; charset=utf-8";
+
+// 如果 v 指向 from 的存储，改为指向 to 中相同的位置
+static void rebase(std::string_view &v, const std::string &from, const std::string &to) {
+    if (v.data() >= from.data() && v.data() < from.data() + from.size())
+        v = std::string_view(to.data() + (v.data() - from.data()), v.size());
+}
+
+http_request &http_request::operator=(const http_request &other) {
+    if (this == &other) return *this;
+    method = other.method;
+    path = other.path;
+    query = other.query;
+    version = other.version;
+    body = other.body;
+    body_streamed = other.body_streamed;
+    body_length = other.body_length;
+    remote_addr = other.remote_addr;
+    tls = other.tls;
+    header_count = other.header_count;
+    for (int i = 0; i < header_count; ++i) headers[i] = other.headers[i];
+    param_count = other.param_count;
+    for (int i = 0; i < param_count; ++i) params[i] = other.params[i];
+    form = other.form;
+    m_storage = other.m_storage;
+    if (!m_storage.empty()) {
+        // 已 detach() 的请求，各字段改为指向自己的副本
+        const std::string &from = other.m_storage;
+        rebase(method, from, m_storage);
+        rebase(path, from, m_storage);
+        rebase(query, from, m_storage);
+        rebase(version, from, m_storage);
+        rebase(body, from, m_storage);
+        rebase(remote_addr, from, m_storage);
+        for (int i = 0; i < header_count; ++i) {
+            rebase(headers[i].name, from, m_storage);
+            rebase(headers[i].value, from, m_storage);
+        }
+        for (int i = 0; i < param_count; ++i) rebase(params[i].value, from, m_storage);
+    }
+    return *this;
+}
+
+std::string_view http_request::header(std::string_view name) const {
+    for (int i = 0; i < header_count; ++i) {
+        if (headers[i].name.size() == name.size() &&
+            strncasecmp(headers[i].name.data(), name.data(), name.size()) == 0)
+            return headers[i].value;
+    }
+    return std::string_view();
+}
+
+std::string_view http_request::param(std::string_view name) const {
+    for (int i = 0; i < param_count; ++i)
+        if (name == params[i].name) return params[i].value;
+    return std::string_view();
+}
+
+// 把 v 复制到 storage 末尾并指向副本，调用者保证容量足够，不会扩容
+static void keep(std::string &storage, std::string_view &v) {
+    size_t off = storage.size();
+    storage.append(v.data(), v.size());
+    v = std::string_view(storage.data() + off, v.size());
+}
+
+void http_request::detach() {
+    if (!m_storage.empty()) return;  // 已经是独立的副本
+
+    size_t total = method.size() + path.size() + query.size() + version.size() + body.size() + remote_addr.size();
+    for (int i = 0; i < header_count; ++i) total += headers[i].name.size() + headers[i].value.size();
+    for (int i = 0; i < param_count; ++i) total += params[i].value.size();
+    if (total == 0) return;
+
+    m_storage.reserve(total);  // 一次分配，之后的追加不会让已有的指针失效
+    keep(m_storage, method);
+    keep(m_storage, path);
+    keep(m_storage, query);
+    keep(m_storage, version);
+    keep(m_storage, body);
+    keep(m_storage, remote_addr);
+    for (int i = 0; i < header_count; ++i) {
+        keep(m_storage, headers[i].name);
+        keep(m_storage, headers[i].value);
+    }
+    for (int i = 0; i < param_count; ++i) keep(m_storage, params[i].value);
+}
+
+http_response::http_response(response_sink *conn, unsigned request_id, bool keep_alive, vhost *host,
+                             bool head_only)
+    : m_conn(conn),
+      m_request_id(request_id),
+      m_keep_alive(keep_alive),
+      m_head_only(head_only),
+      m_host(host),
+      m_status(200),
+      m_reason(NULL),
+      m_content_type(default_content_type),
+      m_own_date(false),
+      m_own_server(false),
+      m_content_length(-1),
+      m_state(RES_IDLE) {}
+
+// 处理函数没有完成响应时在这里收尾
+http_response::~http_response() {
+    if (m_state == RES_IDLE) {
+        set_status(500);
+        m_content_type = default_content_type;
+        m_headers.clear();
+        send("The handler did not produce a response.\n");
+    } else if (m_state == RES_STREAMING) {
+        end();
+    }
+}
+
+void http_response::set_status(int status, const char *reason) {
+    m_status = status;
+    m_reason = reason;
+}
+
+void http_response::set_content_type(std::string_view type) { m_content_type.assign(type.data(), type.size()); }
+
+void http_response::set_header(std::string_view name, std::string_view value) {
+    if (name.size() == 4 && strncasecmp(name.data(), "Date", 4) == 0) m_own_date = true;
+    if (name.size() == 6 && strncasecmp(name.data(), "Server", 6) == 0) m_own_server = true;
+    m_headers.append(name.data(), name.size());
+    m_headers.push_back(':');
+    m_headers.append(value.data(), value.size());
+    m_headers.append("\r\n", 2);
+}
+
+// 与 http_conn 一样由常量片段拼成，处理函数自定义原因短语或状态码不在表中时才逐段拼出状态行
+void http_response::build_head(std::string &out, long content_length) const {
+    char num[UINT_DIGITS_MAX];
+    size_t len;
+    const char *line = m_reason ? NULL : status_line(m_status, len);
+    out.reserve(160 + m_content_type.size() + m_headers.size());
+    if (line) {
+        out.append(line, len);
+    } else {
+        out.append("HTTP/1.1 ", 9);
+        out.append(num, format_uint(num, m_status));
+        out.push_back(' ');
+        out.append(m_reason ? m_reason : status_reason(m_status));
+        out.append("\r\n", 2);
+    }
+    if (!m_own_date) out.append(http_date::line(), http_date::LINE_LEN);
+    if (!m_own_server) out.append(HEAD_SERVER, HEAD_SERVER_LEN);
+    if (content_length >= 0) {
+        out.append("Content-Length:", 15);
+        out.append(num, format_uint(num, content_length));
+        out.append("\r\n", 2);
+    } else if (content_length == LENGTH_CHUNKED) {
+        out.append("Transfer-Encoding:chunked\r\n", 27);
+    }
+    if (!m_content_type.empty()) {
+        out.append("Content-Type:", 13);
+        out.append(m_content_type);
+        out.append("\r\n", 2);
+    }
+    out.append(m_headers);
+    if (m_keep_alive)
+        out.append(HEAD_KEEP_ALIVE, HEAD_KEEP_ALIVE_LEN);
+    else
+        out.append(HEAD_CLOSE, HEAD_CLOSE_LEN);
+    out.append("\r\n", 2);
+}
+
+bool http_response::push(const struct iovec *iov, int count, bool done) {
+    if (m_conn->stream_push(m_request_id, iov, count, done)) return true;
+    m_state = RES_DONE;  // 连接已经不属于这个请求，之后的输出都没有意义
+    return false;
+}
+
+bool http_response::send(std::string_view body) {
+    if (m_state != RES_IDLE) return false;
+    std::string head;
+    build_head(head, body.size());
+    struct iovec iov[2];
+    iov[0].iov_base = (void *)head.data();
+    iov[0].iov_len = head.size();
+    iov[1].iov_base = (void *)body.data();
+    iov[1].iov_len = m_head_only ? 0 : body.size();
+    m_state = RES_DONE;
+    return push(iov, 2, true);
+}
+
+bool http_response::send_head(long content_length) {
+    if (m_state != RES_IDLE) return false;
+    std::string head;
+    build_head(head, content_length);
+    struct iovec iov;
+    iov.iov_base = (void *)head.data();
+    iov.iov_len = head.size();
+    m_state = RES_DONE;
+    return push(&iov, 1, true);
+}
+
+bool http_response::send_file(const char *path) {
+    if (m_state != RES_IDLE) return false;
+    std::string real_file(m_host->doc_root);
+    real_file += path;
+
+    struct stat st;
+    shared_ptr<file_entry> entry;
+    if (http_conn::safe_path(path, strlen(path)) && stat(real_file.c_str(), &st) == 0 && S_ISREG(st.st_mode) && (st.st_mode & S_IROTH))
+        entry = m_host->cache.acquire(real_file.c_str(), st);
+    if (!entry) {
+        set_status(404);
+        m_content_type = default_content_type;
+        return send("The requested file was not found on this server.\n");
+    }
+
+    m_content_type = entry->mime->content_type;
+    std::string head;
+    build_head(head, st.st_size);
+    struct iovec iov[2];
+    iov[0].iov_base = (void *)head.data();
+    iov[0].iov_len = head.size();
+    iov[1].iov_base = entry->data;  // 追加进发送缓冲区时复制，之后缓存项可以被淘汰
+    iov[1].iov_len = m_head_only ? 0 : st.st_size;
+    m_state = RES_DONE;
+    return push(iov, 2, true);
+}
+
+bool http_response::write(std::string_view data) {
+    if (m_state == RES_DONE || m_state == RES_MOVED) return false;
+
+    std::string head;
+    if (m_state == RES_IDLE) {
+        build_head(head, m_content_length);
+        m_state = RES_STREAMING;
+    }
+    char line[CHUNK_SIZE_LINE_MAX];
+    struct iovec iov[4];
+    int count = 0;
+    if (!head.empty()) {
+        iov[count].iov_base = (void *)head.data();
+        iov[count++].iov_len = head.size();
+    }
+    if (m_head_only) data = std::string_view();  // HEAD 只发头部
+    if (m_content_length >= 0) {  // 长度已知，原样输出
+        if (!data.empty()) {
+            iov[count].iov_base = (void *)data.data();
+            iov[count++].iov_len = data.size();
+        }
+    } else if (!data.empty()) {  // 长度为 0 的 chunk 表示结束，普通写入不能产生
+        iov[count].iov_base = line;
+        iov[count++].iov_len = chunk_size_line(line, data.size());
+        iov[count].iov_base = (void *)data.data();
+        iov[count++].iov_len = data.size();
+        iov[count].iov_base = (void *)CHUNK_CRLF;
+        iov[count++].iov_len = 2;
+    }
+    if (count == 0) return true;
+    return push(iov, count, false);
+}
+
+bool http_response::end() {
+    if (m_state == RES_IDLE) return send(std::string_view());
+    if (m_state != RES_STREAMING) return false;
+    struct iovec iov;
+    iov.iov_base = (void *)CHUNK_LAST;
+    iov.iov_len = m_content_length >= 0 || m_head_only ? 0 : CHUNK_LAST_LEN;  // 长度已知或 HEAD 时没有结束块
+    m_state = RES_DONE;
+    return push(&iov, 1, true);
+}
+
+bool http_response::abort() {
+    if (m_state == RES_DONE || m_state == RES_MOVED) return false;
+    m_state = RES_DONE;
+    return m_conn->stream_abort(m_request_id);
+}
+
+bool http_response::attach(const std::shared_ptr<stream_owner> &owner) {
+    return m_conn->stream_attach(m_request_id, owner);
+}
+
+ssize_t http_response::splice_from(int pipe_fd, size_t len) { return m_conn->stream_splice(m_request_id, pipe_fd, len); }
+
+bool http_response::wake() { return m_conn->stream_wake(m_request_id); }
+
+bool http_response::read_body(const std::shared_ptr<body_reader> &reader) {
+    return m_conn->stream_read_body(m_request_id, reader);
+}
+
+bool http_response::resume_body() { return m_conn->stream_resume_body(m_request_id); }
+
+std::shared_ptr<http_response> http_response::defer() {
+    std::shared_ptr<http_response> moved(new http_response(*this));
+    m_state = RES_MOVED;
+    return moved;
+}
+
+size_t http_response::backlog() const { return m_conn->stream_backlog(m_request_id); }
+
+void handler_pool::init(int thread_num, int max_queue, int close_log) {
+    m_close_log = close_log;
+    if (thread_num <= 0 || m_queue) return;
+
+    m_queue = new block_queue<pool_job *>(max_queue);
+    for (int i = 0; i < thread_num; ++i) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, this) != 0) {
+            LOG_AT(LOG_MOD_POOL, LOG_LEVEL_ERROR, "%s", "create handler thread failure");
+            continue;
+        }
+        pthread_detach(tid);
+    }
+}
+
+bool handler_pool::submit(pool_job *job) {
+    if (!m_queue || m_queue->full()) return false;
+    return m_queue->push(job);
+}
+
+void *handler_pool::worker(void *arg) {
+    ((handler_pool *)arg)->run();
+    return NULL;
+}
+
+void handler_pool::run() {
+    pool_job *job;
+    while (m_queue->pop(job)) {
+        job->run();
+        delete job;  // 处理函数未完成的响应在这里收尾，推迟完成的由持有者负责
+    }
+}
@@ -0,0 +1,295 @@
+/**
+ * @file handler.h
+ * @brief 动态接口的处理函数 API
+ *
+ * 新增动态接口不再需要修改 http_conn 的解析流程，只需向路由表注册一个处理函数：
+ *     http_conn::add_handler(router, "/api/echo", 1 << http_conn::POST, HANDLER_INLINE,
+ *                            [](http_request &req, http_response &res) { res.send(req.body); });
+ * 主要特点：
+ * 1. http_request 的请求行、头部、请求体和路由参数都是指向读缓冲区的 string_view，构造时不复制
+ * 2. 用 http_conn::add_upload() 注册的接口，表单请求体在读取时流式解析，文件直接写入临时文件，结果在 http_request::form；
+ *    用 http_conn::add_body_stream() 注册的接口在请求头读完时执行，请求体由 http_response::read_body() 边读边交给接收者
+ * 3. http_response 既可以一次性 send()，也可以 write() 流式输出（chunked），或 defer() 之后在任意线程完成
+ * 4. HANDLER_INLINE 在解析请求的工作线程里直接执行，适合纯内存计算；
+ *    HANDLER_BLOCKING 投递到独立的阻塞线程池执行，数据库、磁盘等慢操作不会占住工作线程
+ * 5. 处理函数返回（或最后一个 defer() 得到的引用释放）时响应仍未结束，会自动收尾：
+ *    尚未输出任何内容时回复 500，流式响应补上结束块
+ */
+
+#ifndef HANDLER_H
+#define HANDLER_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "../log/block_queue.h"
+#include "router.h"
+
+struct vhost;
+
+class stream_owner;
+class upload_form;
+
+/**
+ * @brief 流式请求体的接收者，见 http_response::read_body()
+ *
+ * 回调在读请求的线程中执行，不能阻塞；同一个请求的回调不会并发，按请求体的顺序到达。
+ */
+class body_reader {
+   public:
+    virtual ~body_reader() {}
+    // 一段请求体（分块请求体已解码），data 只在调用期间有效。
+    // 返回 false 表示积压过多：连接暂停读客户端，直到接收者调用 http_response::resume_body()
+    virtual bool on_body(std::string_view data) = 0;
+    // 请求体结束。complete 为 false 表示请求体没有读完（连接已关闭或请求体格式错误）
+    virtual void on_body_end(bool complete) = 0;
+};
+
+/**
+ * @brief 响应的输出端：HTTP/1.1 连接（http_conn）或 HTTP/2 的流（h2_session）
+ *
+ * http_response 把编码好的 HTTP/1.1 响应交给输出端，HTTP/2 的输出端再转换成 HEADERS 和 DATA 帧。
+ * request_id 用来识别请求，输出端已关闭或已开始处理其他请求时各函数返回失败。
+ */
+class response_sink {
+   public:
+    virtual ~response_sink() {}
+    // 追加输出，done 为 true 表示响应结束，任意线程可调用
+    virtual bool stream_push(unsigned request_id, const struct iovec *iov, int count, bool done) = 0;
+    // 尚未发送出去的字节数，生产者据此做背压
+    virtual size_t stream_backlog(unsigned request_id) = 0;
+    // 设置接管者，缓冲区发空而响应尚未结束时回调
+    virtual bool stream_attach(unsigned request_id, const std::shared_ptr<stream_owner> &owner) = 0;
+    // 缓冲区为空时把管道中最多 len 字节搬给客户端，返回值与 splice() 相同
+    virtual ssize_t stream_splice(unsigned request_id, int pipe_fd, size_t len) = 0;
+    // 客户端可写且缓冲区为空时回调接管者
+    virtual bool stream_wake(unsigned request_id) = 0;
+    // 异常结束响应
+    virtual bool stream_abort(unsigned request_id) = 0;
+    // 设置流式请求体的接收者，请求体不是边读边交付时返回 false（HTTP/2 的请求体总是完整地在 http_request::body 中）
+    virtual bool stream_read_body(unsigned, const std::shared_ptr<body_reader> &) { return false; }
+    // 接收者的积压已经发下去，恢复读请求体
+    virtual bool stream_resume_body(unsigned) { return false; }
+};
+
+// 处理函数的执行方式
+enum HANDLER_MODE {
+    HANDLER_INLINE = 0,  // 在工作线程中直接执行，不能阻塞
+    HANDLER_BLOCKING     // 投递到阻塞线程池执行
+};
+
+struct http_header {
+    std::string_view name;   // 头部名，保持客户端原样的大小写
+    std::string_view value;  // 头部值，已去掉前导空白
+};
+
+/**
+ * @brief 请求对象
+ *
+ * 各字段指向连接的读缓冲区，只在处理函数执行期间有效。
+ * 投递到阻塞线程池的请求会先 detach()，复制成独立的一份。
+ */
+class http_request {
+   public:
+    static const int MAX_HEADERS = 32;  // 超出的头部不再记录
+
+    http_request() : body_streamed(false), body_length(0), tls(false), header_count(0), param_count(0) {}
+    http_request(const http_request &other) { *this = other; }
+    http_request &operator=(const http_request &other);
+
+    // 按名字查找头部（大小写不敏感），没有时返回空
+    std::string_view header(std::string_view name) const;
+    // 按名字取路由参数，没有时返回空
+    std::string_view param(std::string_view name) const;
+    // 把所有字段复制到对象自己的存储中，之后不再依赖读缓冲区
+    void detach();
+
+    std::string_view method;   // 请求方法，如 "POST"
+    std::string_view path;     // 路径，不含查询串
+    std::string_view query;    // 查询串，不含 '?'
+    std::string_view version;  // 协议版本，如 "HTTP/1.1"
+    std::string_view body;     // 请求体（分块请求体已解码）；上传接口的请求体不保留，解析结果在 form 中
+    bool body_streamed;        // 请求体还没有读，body 为空，由 http_response::read_body() 边读边交付
+    long body_length;          // body_streamed 时为 Content-Length，分块传输时为 -1；否则等于 body.size()
+    std::string_view remote_addr;  // 客户端 IP
+    bool tls;                  // 请求经 TLS 连接到达（HTTPS）
+    http_header headers[MAX_HEADERS];
+    int header_count;
+
+    struct param_view {
+        const char *name;        // 参数名，指向路由表
+        std::string_view value;  // 参数值
+    };
+    param_view params[ROUTE_MAX_PARAMS];
+    int param_count;
+
+    std::shared_ptr<upload_form> form;  // 上传接口解析出的表单，见 upload/form.h；其他路由为空
+
+   private:
+    std::string m_storage;  // detach() 后各字段指向这里
+};
+
+/**
+ * @brief 响应对象
+ *
+ * 同一个响应同一时刻只能由一个线程操作。连接关闭或被复用后，所有输出都会失败并返回 false。
+ */
+class http_response {
+   public:
+    // head_only 为真时只输出头部，响应体被丢弃，处理函数不需要区分 GET 和 HEAD
+    // host 为请求所属的虚拟主机，send_file() 在它的文档根目录和文件缓存中查找
+    http_response(response_sink *conn, unsigned request_id, bool keep_alive, vhost *host,
+                  bool head_only = false);
+    ~http_response();
+
+    // 设置状态码，reason 为空时使用标准原因短语
+    void set_status(int status, const char *reason = NULL);
+    // 设置 Content-Type，默认 text/plain; charset=utf-8
+    void set_content_type(std::string_view type);
+    // 追加一个响应头
+    void set_header(std::string_view name, std::string_view value);
+    // send_head() 的长度参数：分块传输、不输出长度相关的头部
+    enum { LENGTH_CHUNKED = -1, LENGTH_NONE = -2 };
+
+    // 预先声明响应体长度：之后的 write() 不再分块，原样输出，写满 length 字节后调用 end()
+    void set_content_length(long length) { m_content_length = length; }
+
+    // 一次性发送完整响应体（带 Content-Length），发送后响应结束
+    bool send(std::string_view body);
+    // 只发头部、没有响应体（HEAD、204、304），发送后响应结束。content_length >= 0 时原样输出
+    // Content-Length（如转发上游 HEAD 或 304 响应声明的长度），LENGTH_CHUNKED 输出 Transfer-Encoding: chunked，
+    // LENGTH_NONE 两者都不输出
+    bool send_head(long content_length = LENGTH_NONE);
+    // 发送文档根目录下的文件，path 以 '/' 开头，Content-Type 按扩展名确定；文件不存在时回复 404
+    bool send_file(const char *path);
+
+    // 流式发送：第一次调用时输出头部（Transfer-Encoding: chunked），每次调用输出一个 chunk
+    bool write(std::string_view data);
+    // 结束流式响应
+    bool end();
+    // 异常结束：已经输出的内容发完后关闭连接，客户端据此知道响应不完整
+    bool abort();
+
+    // 以下供直接写 socket 的生产者（如反向代理的 splice）使用，见 http_conn::stream_owner
+    bool attach(const std::shared_ptr<stream_owner> &owner);
+    // 把管道中的数据 splice 到客户端，返回值与 splice() 相同；缓冲区未发空时返回 -1 且 errno 为 EAGAIN
+    ssize_t splice_from(int pipe_fd, size_t len);
+    // 客户端可写且缓冲区为空时回调接管者
+    bool wake();
+
+    // 流式请求体：只能在处理函数中调用，之后读到的请求体交给 reader，读完后回调 on_body_end()。
+    // 请求体读完之前响应只缓冲不发送；响应先于请求体结束时剩下的请求体不再读，发完响应后关闭连接。
+    // 请求体不是流式读取（req.body_streamed 为假）时返回 false
+    bool read_body(const std::shared_ptr<body_reader> &reader);
+    // reader 的 on_body() 返回 false 之后，积压发下去时调用，任意线程可调用
+    bool resume_body();
+
+    // 推迟完成：返回一个接管本响应的共享引用，处理函数返回后不再自动收尾，
+    // 由持有者在任意线程稍后完成；最后一个引用释放时仍未完成则自动收尾
+    std::shared_ptr<http_response> defer();
+
+    bool finished() const { return m_state == RES_DONE; }
+    // 已输出但尚未发送到 socket 的字节数，流式生产者据此做背压
+    size_t backlog() const;
+
+   private:
+    enum STATE {
+        RES_IDLE = 0,  // 尚未输出任何内容
+        RES_STREAMING, // 头部已发出，正在流式输出
+        RES_DONE,      // 已结束
+        RES_MOVED      // 已被 defer() 接管
+    };
+
+    // 生成状态行和头部，content_length 为 LENGTH_CHUNKED 时使用分块传输编码，为 LENGTH_NONE 时不输出长度；
+    // Content-Type 为空时不输出
+    void build_head(std::string &out, long content_length) const;
+    // 把若干段数据交给连接发送，连接已关闭或已复用时响应视为结束并返回 false
+    bool push(const struct iovec *iov, int count, bool done);
+
+    // 只有 defer() 可以复制，避免两个对象同时收尾
+    http_response(const http_response &other) = default;
+    http_response &operator=(const http_response &other) = delete;
+
+   private:
+    response_sink *m_conn;      // 所属连接
+    unsigned m_request_id;      // 所属请求的编号，连接复用后不再匹配
+    bool m_keep_alive;          // 是否保持连接
+    bool m_head_only;           // HEAD 请求，不输出响应体
+    vhost *m_host;              // 所属虚拟主机
+    int m_status;               // 状态码
+    const char *m_reason;       // 原因短语
+    std::string m_content_type; // Content-Type
+    std::string m_headers;      // 额外的响应头，每个以 \r\n 结尾
+    bool m_own_date;            // 额外的响应头中已有 Date（如反向代理转发的上游响应头）
+    bool m_own_server;          // 额外的响应头中已有 Server
+    long m_content_length;      // 预先声明的响应体长度，-1 表示分块传输
+    STATE m_state;              // 输出状态
+};
+
+// 处理函数
+typedef std::function<void(http_request &req, http_response &res)> handler_fn;
+
+// 投递到阻塞线程池的任务
+struct pool_job {
+    virtual ~pool_job() {}
+    virtual void run() = 0;
+};
+
+// 执行阻塞处理函数的任务
+struct handler_job : pool_job {
+    handler_job(const handler_fn *fn, const http_request &req, response_sink *conn, unsigned request_id, bool keep_alive,
+                vhost *host)
+        : fn(fn), req(req), res(conn, request_id, keep_alive, host, req.method == "HEAD") {
+        this->req.detach();
+    }
+
+    void run() override { (*fn)(req, res); }
+
+    const handler_fn *fn;  // 处理函数，指向路由表，服务器运行期间有效
+    http_request req;      // 已 detach() 的请求
+    http_response res;     // 响应
+};
+
+/**
+ * @brief 阻塞处理函数的线程池（单例）
+ *
+ * 与处理 HTTP 连接的线程池分开，慢处理函数积压时不影响静态文件和 INLINE 处理函数。
+ */
+class handler_pool {
+   public:
+    static handler_pool *get_instance() {
+        static handler_pool instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 启动阻塞线程池
+     * @param thread_num 线程数，0 表示不启用，BLOCKING 处理函数退化为在工作线程中执行
+     * @param max_queue 等待执行的任务上限
+     * @param close_log 日志开关
+     */
+    void init(int thread_num, int max_queue, int close_log);
+
+    // 投递任务，不阻塞；队列已满时返回 false，任务仍归调用者所有
+    bool submit(pool_job *job);
+
+    bool enabled() const { return m_queue != NULL; }
+
+   private:
+    handler_pool() : m_queue(NULL), m_close_log(0) {}
+    ~handler_pool() {}
+
+    static void *worker(void *arg);
+    void run();
+
+   private:
+    block_queue<pool_job *> *m_queue;     // 有界任务队列
+    int m_close_log;                      // 日志开关
+};
+
+#endif
@@ -1,11 +1,16 @@
 // http_conn.cpp 文件实现了 http_conn 类的具体功能，包括处理 HTTP 请求、解析请求行、请求头和请求体、生成 HTTP 响应、管理内存映射等。通过这个类，Web 服务器可以高效地处理多个并发连接。
 
 
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include <limits.h>       // 包含 LONG_MAX
 #include <mysql/mysql.h>  // 包含 MySQL 相关的头文件，用于数据库操作
 
+#include <algorithm>  // 包含 std::min
 #include <fstream>  // 包含文件流操作相关的头文件，用于文件读写
 
 #include "http_conn.h"  // 包含 http_conn 类的头文件
+#include "vhost.h"      // 包含虚拟主机表
 
 // 定义 HTTP 响应的一些状态信息
 const char *ok_200_title = "OK";              // HTTP 200 响应的状态信息
@@ -26,6 +31,16 @@ const char *error_500_form =
     "There was an unusual problem serving the request "
     "file.\n";  // HTTP 500 响应的详细描述
 
+const char *error_405_title = "Method Not Allowed";  // HTTP 405 响应的状态信息
+const char *error_405_form = "The request method is not supported by this resource.\n";  // HTTP 405 响应的详细描述
+
+const char *error_413_title = "Payload Too Large";  // HTTP 413 响应的状态信息
+const char *error_413_form = "The request body exceeds the limit of this server.\n";  // HTTP 413 响应的详细描述
+
+// 错误页面和空文件占位页面的 Content-Type
+const char *error_content_type = "text/plain; charset=utf-8";
+const char *empty_page_content_type = "text/html; charset=utf-8";
+
 locker m_lock;              // 定义互斥锁，用于线程同步
 map<string, string> users;  // 定义用户信息映射，存储用户名和密码
 
@@ -33,6 +48,7 @@ map<string, string> users;  // 定义用户信息映射，存储用户名和密
 //代码块功能：对两个重要的类内静态变量的初始化
 int http_conn::m_user_count = 0;  // 初始化用户数量为 0
 int http_conn::m_epollfd = -1;    // 初始化 epoll 文件描述符为 -1
+vhost_table *http_conn::m_vhosts = NULL;  // 虚拟主机表由 webserver 创建
 /*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
 
 
@@ -44,8 +60,8 @@ void http_conn::initmysql_result(connection_pool *connPool) {
 
     // 在 user 表中检索 username 和 passwd 数据，浏览器端输入
     if (mysql_query(mysql, "SELECT username,passwd FROM user")) {
-        LOG_ERROR("SELECT error:%s\n", mysql_errno(mysql),
-                  mysql_error(mysql));  // 如果查询失败，记录错误日志
+        LOG_AT(LOG_MOD_SQL, LOG_LEVEL_ERROR, "SELECT error:%u %s", mysql_errno(mysql),
+               mysql_error(mysql));  // 如果查询失败，记录错误日志
     }
 
     // 从表中检索完整的结果集
@@ -116,10 +132,61 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode) {//ev是事件类型，TRI
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);  // 修改 epoll 实例中的事件
 }
 
+// 解析 Accept-Encoding 头，返回可接受编码的位掩码（1 << CONTENT_ENCODING）
+// 例如 "gzip, deflate, br;q=0.8, zstd;q=0"，q=0 表示明确拒绝；"*" 匹配所有未列出的编码
+int http_conn::parse_accept_encoding(const char *text) {
+    int accept = 0, reject = 0;
+    bool star = false;
+    while (*text) {
+        text += strspn(text, " \t,");
+        const char *name = text;
+        size_t name_len = strcspn(text, " \t;,");
+        text += strcspn(text, ",");  // 本项结束位置
+
+        // 在 name 之后、逗号之前查找 q 参数
+        double q = 1.0;
+        for (const char *param = name + name_len; param < text; ++param) {
+            if ((*param == 'q' || *param == 'Q') && param[1] == '=') {
+                q = atof(param + 2);
+                break;
+            }
+        }
+
+        int bit = 0;
+        if ((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) || (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0))
+            bit = 1 << ENC_GZIP;
+        else if (name_len == 2 && strncasecmp(name, "br", 2) == 0)
+            bit = 1 << ENC_BROTLI;
+        else if (name_len == 4 && strncasecmp(name, "zstd", 4) == 0)
+            bit = 1 << ENC_ZSTD;
+        else if (name_len == 1 && *name == '*')
+            star = q > 0;
+
+        if (bit) {
+            if (q > 0)
+                accept |= bit;
+            else
+                reject |= bit;
+        }
+    }
+    if (star) accept |= ((1 << ENC_COUNT) - 1) & ~(1 << ENC_IDENTITY);
+    return accept & ~reject;
+}
+
+// 定时器关闭超时连接前调用，此时 socket 仍属于这个连接
+void http_conn::close_tls() {
+    tls_free(m_ssl, true);
+    m_ssl = NULL;
+}
+
 // 关闭连接，关闭一个连接，客户总量减一
 void http_conn::close_conn(bool real_close) {
     if (real_close && (m_sockfd != -1)) {
         printf("close %d\n", m_sockfd);  // 打印关闭的连接
+        unmap();                        // 释放对缓存项的引用
+        m_upload.reset();               // 上传中途断开，临时文件不再需要
+        drop_body();                    // 流式请求体的接收者不再等待后面的数据
+        close_tls();                    // 在 socket 关闭前发送 close_notify
         removefd(m_epollfd, m_sockfd);  // 从 epoll 实例中删除文件描述符
         m_sockfd = -1;                  // 将文件描述符设置为 -1
         m_user_count--;                 // 用户数量减一
@@ -131,19 +198,23 @@ void http_conn::close_conn(bool real_close) {
 // •	请求处理状态重置：所有与 HTTP 请求处理相关的变量和缓冲区都被重置，对象的HTTP请求相关状态已重置，可以开始处理新的 HTTP 请求。
 // •	配置和数据库信息已设置：文档根目录、触发模式、日志状态等配置已设置，数据库连接信息已保存，配置和数据库已就绪，可以在处理请求时使用。
 
-void http_conn::init(int sockfd, const sockaddr_in &addr, char *root,
+void http_conn::init(int sockfd, const sockaddr_in &addr,
                      int TRIGMode, int close_log, string user, string passwd,
-                     string sqlname) {
+                     string sqlname, SSL *ssl) {
     m_sockfd = sockfd;  // 设置 socket 文件描述符
     m_address = addr;   // 设置地址信息
+    m_detached = false;
+    // 定时器关闭的连接没有经过 close_conn()，残留的 TLS 状态属于已关闭的旧 socket，不能再向它发送
+    tls_free(m_ssl, false);
+    m_ssl = ssl;
+    unmap();
+    inet_ntop(AF_INET, &addr.sin_addr, m_remote_ip, sizeof(m_remote_ip));
+    m_reuse = 0;
 
     addfd(m_epollfd, sockfd, true,
           m_TRIGMode);  // 将 socket 添加到 epoll 实例中
     m_user_count++;     // 用户数量加一
 
-    // 当浏览器出现连接重置时，可能是网站根目录出错或 http
-    // 响应格式出错或者访问的文件中内容完全为空
-    doc_root = root;          // 设置文档根目录
     m_TRIGMode = TRIGMode;    // 设置触发模式
     m_close_log = close_log;  // 设置是否关闭日志
 
@@ -167,11 +238,48 @@ void http_conn::init() {
     m_version = 0;         // 初始化 HTTP 版本为 NULL
     m_content_length = 0;  // 初始化内容长度为 0
     m_host = 0;            // 初始化主机为 NULL
+    m_vhost = m_vhosts ? m_vhosts->default_host() : NULL;  // 请求头读完前按默认主机处理
     m_start_line = 0;      // 初始化行起始位置为 0
     m_checked_idx = 0;     // 初始化已检查索引为 0
     m_read_idx = 0;        // 初始化读索引为 0
     m_write_idx = 0;       // 初始化写索引为 0
     cgi = 0;               // 初始化是否启用 CGI 为 0
+    m_string = NULL;       // 初始化请求体为空
+    m_accept_encoding = 0;                // 初始化为只接受原文
+    m_content_encoding = ENC_IDENTITY;    // 初始化响应编码为原文
+    m_vary = false;                       // 初始化为不输出 Vary
+    m_allow = 0;                          // 初始化为没有 Allow 头
+    m_file_size = 0;                      // 初始化响应体长度为 0
+    m_content_type = error_content_type;  // 初始化为错误页面的类型
+    m_chunked = false;                    // 初始化为非分块请求体
+    m_body_start = 0;                     // 初始化请求体起始位置
+    m_chunk_decoder.reset();              // 重置分块解码器
+    m_upload.reset();                     // 释放上一个上传请求的表单，未保存的临时文件随之删除
+    m_upload_received = 0;
+    drop_body();                          // 被放弃的流式请求体，接收者已经不需要了
+    m_body_full = false;
+    m_expect_continue = false;
+    m_header_count = 0;                   // 清空记录的请求头部
+    m_upgrade_websocket = false;          // 初始化为普通请求
+    m_upgrade.reset();                    // 释放未交出的握手信息
+    m_upgrade_h2c = false;
+    m_h2_upgrade.reset();
+    m_stream_lock.lock();
+    ++m_request_id;                       // 新的请求，之前请求的异步响应全部作废
+    m_streaming = false;                  // 初始化为普通响应
+    m_stream_done = false;
+    m_stream_sent = 0;
+    m_stream_owner.reset();               // 释放上一个请求的接管者
+    m_body_stream = false;
+    m_body_paused = false;
+    m_body_resume = false;
+    m_timing = access_timing();           // 上一个请求已写过访问日志，或没有完成
+    if (m_stream_buf.capacity() > WRITE_BUFFER_SIZE * 64)
+        string().swap(m_stream_buf);      // 大块缓冲区不长期占用
+    else
+        m_stream_buf.clear();
+    m_stream_lock.unlock();
+    unmap();                              // 释放上一个请求持有的缓存项
     m_state = 0;     // 初始化状态为 0（0 表示读，1 表示写）
     timer_flag = 0;  // 初始化定时器标志为 0
     improv = 0;      // 初始化改进标志为 0
@@ -223,6 +331,17 @@ bool http_conn::read_once() {
     }
     int bytes_read = 0;
 
+    // TLS 连接不论触发模式都读到 EAGAIN：已解密但没读走的数据留在 OpenSSL 内部，不会再触发读事件
+    if (m_ssl) {
+        while (m_read_idx < READ_BUFFER_SIZE) {
+            bytes_read = tls_read(m_ssl, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx);
+            if (bytes_read < 0 && errno == EAGAIN) break;
+            if (bytes_read <= 0) return false;  // 对端关闭或 TLS 错误
+            m_read_idx += bytes_read;
+        }
+        return true;
+    }
+
     // LT 读取数据
     if (0 == m_TRIGMode) {  // 如果是水平触发模式
         bytes_read = recv(m_sockfd, m_read_buf + m_read_idx,
@@ -237,7 +356,9 @@ bool http_conn::read_once() {
     }
     // ET 读数据
     else {  // 如果是边缘触发模式
-        while (true) {
+        // 读缓冲区满时先停下：上传的请求体由 process() 交给解析器腾出空间，重新注册 EPOLLIN 时
+        // 剩余的数据会再次触发读事件；其他请求下次进入本函数时读缓冲区仍是满的，连接被关闭
+        while (m_read_idx < READ_BUFFER_SIZE) {
             bytes_read = recv(m_sockfd, m_read_buf + m_read_idx,
                               READ_BUFFER_SIZE - m_read_idx, 0);  // 读取数据
             if (bytes_read == -1) {  // 如果读取失败
@@ -254,8 +375,24 @@ bool http_conn::read_once() {
     }
 }
 
+// 请求方法名，下标与 METHOD 一致
+static const char *method_names[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"};
+
+// 静态文件接受的请求方法，也是 OPTIONS * 的回答。POST 沿用原来的行为，按 GET 返回文件
+static const int static_methods = (1 << http_conn::GET) | (1 << http_conn::HEAD) | (1 << http_conn::POST) |
+                                  (1 << http_conn::OPTIONS);
+
 // 解析 HTTP 请求行，获得请求方法，目标 URL 及 HTTP 版本号
 http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
+    // HTTP/2 连接前言的第一行，之后的数据原样交给 h2_server。h2_server 只处理明文连接
+    if (!m_ssl && strcmp(text, "PRI * HTTP/2.0") == 0) {
+        m_h2_upgrade.reset(new h2_upgrade);
+        m_h2_upgrade->prior_knowledge = true;
+        m_h2_upgrade->remote_addr = m_remote_ip;
+        m_h2_upgrade->pending = "PRI * HTTP/2.0\r\n";
+        m_h2_upgrade->pending.append(m_read_buf + m_checked_idx, m_read_idx - m_checked_idx);
+        return UPGRADE_REQUEST;
+    }
     m_url = strpbrk(text, " \t");  // 查找第一个空格或制表符
     if (!m_url) {                  // 如果没有找到
         return BAD_REQUEST;        // 返回错误请求
@@ -267,15 +404,29 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
     else if (strcasecmp(method, "POST") == 0) {  // 如果是 POST 请求
         m_method = POST;                         // 设置请求方法为 POST
         cgi = 1;                                 // 启用 CGI
-    } else
+    } else if (strcasecmp(method, "HEAD") == 0)  // HEAD 与 GET 相同，只是不发响应体
+        m_method = HEAD;
+    else if (strcasecmp(method, "OPTIONS") == 0)
+        m_method = OPTIONS;
+    else
         return BAD_REQUEST;              // 返回错误请求
     m_url += strspn(m_url, " \t");       // 跳过空格或制表符
     m_version = strpbrk(m_url, " \t");   // 查找第一个空格或制表符
     if (!m_version) return BAD_REQUEST;  // 如果没有找到
     *m_version++ = '\0';  // 将空格或制表符替换为字符串结束符，并移动指针
     m_version += strspn(m_version, " \t");  // 跳过空格或制表符
-    if (strcasecmp(m_version, "HTTP/1.1") != 0)
-        return BAD_REQUEST;  // 如果不是 HTTP/1.1 版本
+    // HTTP/1.1 默认保持连接，HTTP/1.0 只有带 Connection: keep-alive 才保持；响应的状态行一律是 HTTP/1.1
+    if (strcasecmp(m_version, "HTTP/1.1") == 0)
+        m_linger = true;
+    else if (strcasecmp(m_version, "HTTP/1.0") == 0)
+        m_linger = false;
+    else
+        return BAD_REQUEST;  // 其他版本
+    // OPTIONS * 询问的是整个服务器
+    if (m_method == OPTIONS && strcmp(m_url, "*") == 0) {
+        m_check_state = CHECK_STATE_HEADER;
+        return NO_REQUEST;
+    }
     if (strncasecmp(m_url, "http://", 7) == 0) {  // 如果 URL 以 http:// 开头
         m_url += 7;                               // 跳过 http://
         m_url = strchr(m_url, '/');               // 查找第一个斜杠
@@ -298,19 +449,43 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
 // 解析 HTTP 请求的一个头部信息
 http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
     if (text[0] == '\0') {                        // 如果当前行为空行
-        if (m_content_length != 0) {              // 如果内容长度不为 0
+        m_vhost = m_vhosts->find(m_host);         // 按 Host 选择虚拟主机，之后的路由和静态文件都在它里面查找
+        // 同时带 Content-Length 和 chunked 的请求可能被前后端解析成不同边界，直接拒绝以防请求走私
+        if (m_chunked && m_content_length != 0) return BAD_REQUEST;
+        if (m_chunked || m_content_length != 0) {  // 有请求体
+            m_body_start = m_checked_idx;         // 请求体从空行之后开始
             m_check_state = CHECK_STATE_CONTENT;  // 设置检查状态为解析请求体
-            return NO_REQUEST;                    // 返回无请求
+            return begin_body();
         }
         return GET_REQUEST;  // 返回获取请求成功
-    } else if (strncasecmp(text, "Connection:", 11) ==
+    }
+    // 记下每个头部的位置，处理函数通过 http_request::header() 访问，不复制
+    const char *colon = strchr(text, ':');
+    if (colon && m_header_count < http_request::MAX_HEADERS) {
+        const char *value = colon + 1;
+        value += strspn(value, " \t");
+        m_headers[m_header_count].name = std::string_view(text, colon - text);
+        m_headers[m_header_count].value = std::string_view(value);
+        ++m_header_count;
+    }
+    if (strncasecmp(text, "Connection:", 11) ==
                0) {                   // 如果当前行是 Connection 头部
         text += 11;                   // 跳过 "Connection:"
-        text += strspn(text, " \t");  // 跳过空格或制表符
-        if (strcasecmp(text, "keep-alive") ==
-            0) {              // 如果 Connection 为 keep-alive
-            m_linger = true;  // 设置保持连接为 true
+        // 值是逗号分隔的选项列表，如 "keep-alive, Upgrade"；同时出现时 close 优先
+        bool keep_alive = false, close = false;
+        while (*text) {
+            text += strspn(text, " \t,");
+            size_t len = strcspn(text, " \t,");
+            if (len == 10 && strncasecmp(text, "keep-alive", 10) == 0)
+                keep_alive = true;
+            else if (len == 5 && strncasecmp(text, "close", 5) == 0)
+                close = true;
+            text += len;
         }
+        if (close)
+            m_linger = false;
+        else if (keep_alive)
+            m_linger = true;
     } else if (strncasecmp(text, "Content-length:", 15) ==
                0) {  // 如果当前行是 Content-length 头部
         text += 15;  // 跳过 "Content-length:"
@@ -320,6 +495,20 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
         text += 5;                                    // 跳过 "Host:"
         text += strspn(text, " \t");  // 跳过空格或制表符
         m_host = text;                // 存储主机名
+    } else if (strncasecmp(text, "Transfer-Encoding:", 18) == 0) {  // 如果当前行是 Transfer-Encoding 头部
+        text += 18;                                                   // 跳过 "Transfer-Encoding:"
+        text += strspn(text, " \t");                                 // 跳过空格或制表符
+        // 只支持 chunked，其他传输编码无法确定请求体的边界
+        if (strcasecmp(text, "chunked") != 0) return BAD_REQUEST;
+        m_chunked = true;
+    } else if (strncasecmp(text, "Expect:", 7) == 0) {  // 如果当前行是 Expect 头部
+        m_expect_continue = strcasestr(text + 7, "100-continue") != NULL;
+    } else if (strncasecmp(text, "Accept-Encoding:", 16) == 0) {  // 如果当前行是 Accept-Encoding 头部
+        m_accept_encoding = parse_accept_encoding(text + 16);       // 记录客户端可接受的压缩编码
+    } else if (strncasecmp(text, "Upgrade:", 8) == 0) {  // 如果当前行是 Upgrade 头部
+        // 只认 websocket 和 h2c，其他协议升级按普通请求处理
+        m_upgrade_websocket = strcasestr(text + 8, "websocket") != NULL;
+        m_upgrade_h2c = strcasestr(text + 8, "h2c") != NULL;
     } else {
         LOG_INFO("oop!unknow header: %s", text);  // 记录未知头部信息
     }
@@ -328,6 +517,9 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
 
 // 判断 HTTP 请求是否被完整读入
 http_conn::HTTP_CODE http_conn::parse_content(char *text) {
+    if (m_upload) return parse_upload_content();    // 上传接口的请求体边读边解析
+    if (m_body_stream) return parse_stream_content();  // 流式请求体边读边交给处理函数
+    if (m_chunked) return parse_chunked_content();  // 分块请求体单独处理
     if (m_read_idx >=
         (m_content_length +
          m_checked_idx)) {  // 如果已读取的数据长度大于等于内容长度
@@ -339,6 +531,175 @@ http_conn::HTTP_CODE http_conn::parse_content(char *text) {
     return NO_REQUEST;  // 返回无请求
 }
 
+// 增量解码分块请求体：每次只处理新读入的字节，解出的数据原地紧跟在 m_body_start 之后，
+// 尚未处理的原始字节随之前移，读缓冲区因此能继续接收后面的 chunk
+http_conn::HTTP_CODE http_conn::parse_chunked_content() {
+    long pos = m_checked_idx;                    // 未处理的原始数据起点
+    long out = m_body_start + m_content_length;  // 已解码数据的末尾
+    chunked_decoder::STATUS status = m_chunk_decoder.decode(m_read_buf, pos, m_read_idx, out,
+        READ_BUFFER_SIZE - 1 - m_body_start);     // 解码后还要留一个字节放结束符
+    if (pos != out) {
+        memmove(m_read_buf + out, m_read_buf + pos, m_read_idx - pos);  // 剩余原始字节前移
+        m_read_idx -= pos - out;
+    }
+    m_checked_idx = out;
+    m_content_length = out - m_body_start;  // 之后的处理把它当作普通请求体长度使用
+
+    if (status == chunked_decoder::CHUNK_ERROR) return BAD_REQUEST;
+    if (status == chunked_decoder::CHUNK_TOO_LARGE) return TOO_LARGE_REQUEST;  // 与 Content-Length 超限一样回复 413
+    if (status == chunked_decoder::CHUNK_DONE) {
+        m_read_buf[out] = '\0';               // 在内容末尾添加字符串结束符
+        m_string = m_read_buf + m_body_start;  // 存储请求体内容
+        return GET_REQUEST;
+    }
+    return NO_REQUEST;  // 等待后续 chunk
+}
+
+// 请求头已读完、请求体尚未开始时决定请求体的去向
+http_conn::HTTP_CODE http_conn::begin_body() {
+    if (m_content_length < 0) return BAD_REQUEST;
+    route_params params;
+    const route *r = m_vhost->router.find(m_url, strcspn(m_url, "?"), params);
+    if (r && r->upload && (r->methods & (1 << m_method))) {
+        // 声明的长度已经超限就不必再读，带 Expect: 100-continue 的客户端也不会发送请求体
+        if (m_content_length > (long)r->upload->max_body) return TOO_LARGE_REQUEST;
+        std::string_view type;
+        for (int i = 0; i < m_header_count; ++i) {
+            const http_header &h = m_headers[i];
+            if (h.name.size() == 12 && strncasecmp(h.name.data(), "Content-Type", 12) == 0) type = h.value;
+        }
+        m_upload.reset(new upload_session(*r->upload));
+        if (!m_upload->start(type)) return BAD_REQUEST;  // 不是表单，或 multipart 缺少 boundary
+    } else if (r && r->stream_body && (r->methods & (1 << m_method))) {
+        // 处理函数现在就执行，请求体随后边读边交给它，不必放进读缓冲区
+        m_stream_lock.lock();
+        m_body_stream = true;
+        m_stream_lock.unlock();
+        if (m_expect_continue) send_continue();
+        return GET_REQUEST;
+    } else if (!m_chunked && m_content_length >= READ_BUFFER_SIZE - m_body_start) {
+        return TOO_LARGE_REQUEST;  // 其他请求体整个放在读缓冲区中，放不下时读缓冲区会被填满
+    }
+    if (m_expect_continue) send_continue();
+    return NO_REQUEST;
+}
+
+// 上传接口的请求体：每轮把读缓冲区中的请求体交给 m_upload 后丢弃，读缓冲区只用来周转，
+// 请求体多大都只占用读缓冲区和 upload_session 的写缓冲区
+http_conn::HTTP_CODE http_conn::parse_upload_content() {
+    UPLOAD_STATUS st;
+    if (m_chunked) {
+        long pos = m_checked_idx, out = m_body_start;
+        chunked_decoder::STATUS cs = m_chunk_decoder.decode(m_read_buf, pos, m_read_idx, out, LONG_MAX);
+        if (cs == chunked_decoder::CHUNK_ERROR) {
+            st = UPLOAD_BAD;
+        } else {
+            st = m_upload->feed(m_read_buf + m_body_start, out - m_body_start);
+            if (st == UPLOAD_MORE && cs == chunked_decoder::CHUNK_DONE) st = m_upload->finish();
+        }
+        // 还没解码的原始字节（如不完整的长度行）移到请求体起点，和后面读入的数据接上
+        memmove(m_read_buf + m_body_start, m_read_buf + pos, m_read_idx - pos);
+        m_read_idx = m_body_start + (m_read_idx - pos);
+    } else {
+        long n = std::min(m_read_idx - m_checked_idx, m_content_length - m_upload_received);
+        st = m_upload->feed(m_read_buf + m_checked_idx, n);
+        m_upload_received += n;
+        m_read_idx = m_checked_idx;
+        if (st == UPLOAD_MORE && m_upload_received == m_content_length) st = m_upload->finish();
+    }
+    m_checked_idx = m_body_start;
+
+    switch (st) {
+        case UPLOAD_MORE:
+            return NO_REQUEST;
+        case UPLOAD_DONE:
+            return GET_REQUEST;
+        case UPLOAD_TOO_LARGE:
+            return TOO_LARGE_REQUEST;
+        case UPLOAD_BAD:
+            m_linger = false;  // 请求体的剩余部分没有读，连接不能再用
+            return BAD_REQUEST;
+        default:
+            m_linger = false;
+            return INTERNAL_ERROR;
+    }
+}
+
+// 流式请求体：与上传接口一样，每轮把读缓冲区中的请求体交给接收者后丢弃，读缓冲区只用来周转。
+// 接收者积压过多时记下 m_body_full，由 wait_body() 暂停读客户端
+http_conn::HTTP_CODE http_conn::parse_stream_content() {
+    long pos = m_checked_idx;  // 未处理的原始数据起点
+    const char *data = m_read_buf + m_checked_idx;
+    long len;
+    bool done;
+    if (m_chunked) {
+        long out = m_body_start;
+        chunked_decoder::STATUS cs = m_chunk_decoder.decode(m_read_buf, pos, m_read_idx, out, LONG_MAX);
+        if (cs == chunked_decoder::CHUNK_ERROR) {
+            m_linger = false;
+            return CLOSED_CONNECTION;  // 响应已交给处理函数，只能断开连接，接收者由 drop_body() 通知
+        }
+        data = m_read_buf + m_body_start;
+        len = out - m_body_start;
+        done = cs == chunked_decoder::CHUNK_DONE;
+    } else {
+        len = std::min(m_read_idx - m_checked_idx, m_content_length - m_upload_received);
+        pos = m_read_idx;
+        m_upload_received += len;
+        done = m_upload_received == m_content_length;
+    }
+    if (len > 0 && m_body_reader && !m_body_reader->on_body(std::string_view(data, len))) m_body_full = true;
+    // 还没解码的原始字节（如不完整的长度行）移到请求体起点，和后面读入的数据接上
+    memmove(m_read_buf + m_body_start, m_read_buf + pos, m_read_idx - pos);
+    m_read_idx = m_body_start + (m_read_idx - pos);
+    m_checked_idx = m_body_start;
+    if (!done) return NO_REQUEST;
+
+    m_stream_lock.lock();
+    m_body_stream = false;
+    m_stream_lock.unlock();
+    shared_ptr<body_reader> reader;
+    reader.swap(m_body_reader);
+    if (reader) reader->on_body_end(true);
+    return STREAM_REQUEST;  // 请求体已读完，处理函数的输出现在可以发送
+}
+
+// 流式请求体还没读完。读请求的线程是唯一会重新注册读事件的一方，暂停后由 stream_resume_body() 接手
+void http_conn::wait_body() {
+    bool full = m_body_full;
+    m_body_full = false;
+    m_stream_lock.lock();
+    if (m_stream_done) {
+        // 响应先于请求体结束（如上游出错）：不再读剩下的请求体，发完响应后关闭连接
+        m_body_stream = false;
+        m_linger = false;
+        modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+    } else if (full && !m_body_resume) {
+        m_body_paused = true;  // 不注册任何事件
+    } else {
+        m_body_resume = false;
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+    }
+    m_stream_lock.unlock();
+}
+
+void http_conn::drop_body() {
+    shared_ptr<body_reader> reader;
+    reader.swap(m_body_reader);
+    if (reader) reader->on_body_end(false);
+}
+
+void http_conn::send_continue() {
+    static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    // 此时发送缓冲区是空的，写不出去也无妨：客户端等不到 100 会在超时后照常发送请求体
+    if (m_ssl) {
+        struct iovec iv = {(void *)cont, sizeof(cont) - 1};
+        tls_writev(m_ssl, &iv, 1);
+    } else {
+        send(m_sockfd, cont, sizeof(cont) - 1, MSG_NOSIGNAL);
+    }
+}
+
 // 处理读取的 HTTP 请求，解析请求行、请求头和请求体
 http_conn::HTTP_CODE http_conn::process_read() {
     LINE_STATUS line_status = LINE_OK;  // 初始化行状态为 LINE_OK
@@ -349,27 +710,37 @@ http_conn::HTTP_CODE http_conn::process_read() {
            ((line_status = parse_line()) == LINE_OK)) {  // 循环解析每一行
         text = get_line();                               // 获取当前行
         m_start_line = m_checked_idx;  // 更新行起始位置
-        LOG_INFO("%s", text);          // 记录当前行
+        if (m_check_state != CHECK_STATE_CONTENT) LOG_INFO("%s", text);  // 记录当前行，请求体不是文本行
         switch (m_check_state) {       // 根据当前检查状态进行处理
             case CHECK_STATE_REQUESTLINE: {  // 如果当前状态是解析请求行
                 ret = parse_request_line(text);  // 解析请求行
                 if (ret == BAD_REQUEST)
                     return BAD_REQUEST;  // 如果解析失败，返回错误请求
+                else if (ret == UPGRADE_REQUEST)
+                    return UPGRADE_REQUEST;  // HTTP/2 连接前言
                 break;
             }
             case CHECK_STATE_HEADER: {  // 如果当前状态是解析请求头
                 ret = parse_headers(text);  // 解析请求头
-                if (ret == BAD_REQUEST)
-                    return BAD_REQUEST;  // 如果解析失败，返回错误请求
-                else if (ret == GET_REQUEST) {
-                    return do_request();  // 如果解析成功，处理请求
+                if (ret == GET_REQUEST) {
+                    access_log::stamp(m_timing.handler);  // 解析到此结束，之后算作处理时间
+                    ret = do_request();  // 如果解析成功，处理请求
+                    // 流式请求体的处理函数已经执行，接着把与请求头一起读到的请求体交给它
+                    if (ret == STREAM_REQUEST && m_body_stream) return parse_stream_content();
+                    return ret;
                 }
+                else if (ret != NO_REQUEST)
+                    return ret;  // 错误请求或请求体过大
                 break;
             }
             case CHECK_STATE_CONTENT: {  // 如果当前状态是解析请求体
                 ret = parse_content(text);  // 解析请求体
-                if (ret == GET_REQUEST)
+                if (ret == GET_REQUEST) {
+                    access_log::stamp(m_timing.handler);
                     return do_request();  // 如果解析成功，处理请求
+                }
+                else if (ret != NO_REQUEST)
+                    return ret;  // 请求体格式错误、过大或写入失败
                 line_status = LINE_OPEN;  // 设置行状态为 LINE_OPEN
                 break;
             }
@@ -380,153 +751,380 @@ http_conn::HTTP_CODE http_conn::process_read() {
     return NO_REQUEST;  // 返回无请求
 }
 
-// 处理请求，根据请求方法执行相应的操作
+// 注册内置路由。表单页面里的 action 都是相对路径，所以这些路由挂在根目录下
+bool http_conn::default_routes(router &r) {
+    static const struct {
+        const char *path;
+        const char *file;
+    } pages[] = {
+        {"/0", "/register.html"},  // 新用户，跳转注册页面
+        {"/1", "/log.html"},       // 已有账号，跳转登录页面
+        {"/5", "/picture.html"},   // 图片请求页面
+        {"/6", "/video.html"},     // 视频请求页面
+        {"/7", "/fans.html"},      // 关注页面
+    };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(pages) / sizeof(pages[0]); ++i) {
+        route page;
+        page.kind = ROUTE_FILE;
+        page.methods = (1 << GET) | (1 << POST);
+        page.target = pages[i].file;
+        ok = r.add(pages[i].path, page) && ok;
+    }
+    return ok;
+}
+
+bool http_conn::add_handler(router &r, const char *pattern, int methods, HANDLER_MODE mode, const handler_fn &fn) {
+    route h;
+    h.kind = ROUTE_HANDLER;
+    h.methods = methods;
+    h.handler = fn;
+    h.mode = mode;
+    return r.add(pattern, h);
+}
+
+bool http_conn::add_upload(router &r, const char *pattern, int methods, HANDLER_MODE mode,
+                           const upload_limits &limits, const handler_fn &fn) {
+    route h;
+    h.kind = ROUTE_HANDLER;
+    h.methods = methods;
+    h.handler = fn;
+    h.mode = mode;
+    h.upload = make_shared<upload_limits>(limits);
+    return r.add(pattern, h);
+}
+
+bool http_conn::add_body_stream(router &r, const char *pattern, int methods, const handler_fn &fn) {
+    route h;
+    h.kind = ROUTE_HANDLER;
+    h.methods = methods;
+    h.handler = fn;
+    h.mode = HANDLER_INLINE;  // 请求体到达之前处理函数必须已经设置好接收者
+    h.stream_body = true;
+    return r.add(pattern, h);
+}
+
+bool http_conn::add_websocket(router &r, const char *pattern, const ws_endpoint &endpoint) {
+    route w;
+    w.kind = ROUTE_WEBSOCKET;
+    w.methods = 1 << GET;
+    w.ws = make_shared<ws_endpoint>(endpoint);
+    return r.add(pattern, w);
+}
+
+int http_conn::route_allow(const route &r) {
+    int allow = r.methods;
+    if (allow & (1 << GET)) allow |= 1 << HEAD;  // 与 do_request() 一致，接受 GET 的路由也接受 HEAD
+    return allow;
+}
+
+// 处理请求，按路由表分派，未命中路由的请求当作文档根目录下的静态文件
 http_conn::HTTP_CODE http_conn::do_request() {
-    strcpy(m_real_file, doc_root);  // 将文档根目录复制到实际文件路径
-    int len = strlen(doc_root);  // 获取文档根目录的长度
-    // printf("m_url:%s\n", m_url);
-    const char *p = strrchr(m_url, '/');  // 查找 URL 中最后一个斜杠
-
-    // 处理 CGI
-    if (cgi == 1 &&
-        (*(p + 1) == '2' ||
-         *(p + 1) == '3')) {  // 如果启用 CGI 并且 URL 以 /2 或 /3 结尾
-        // 根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];  // 获取标志
-
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);  // 分配内存
-        strcpy(m_url_real, "/");                                // 复制斜杠
-        strcat(m_url_real, m_url + 2);                          // 拼接 URL
-        strncpy(m_real_file + len, m_url_real,
-                FILENAME_LEN - len - 1);  // 复制到实际文件路径
-        free(m_url_real);                 // 释放内存
-
-        // 将用户名和密码提取出来
-        // user=123&passwd=123
-        char name[100], password[100];  // 定义用户名和密码数组
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];  // 提取用户名
-        name[i - 5] = '\0';             // 添加字符串结束符
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];  // 提取密码
-        password[j] = '\0';             // 添加字符串结束符
-
-        if (*(p + 1) == '3') {  // 如果是注册
-            // 如果是注册，先检测数据库中是否有重名的
-            // 没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);  // 分配内存
-            strcpy(sql_insert,
-                   "INSERT INTO user(username, passwd) VALUES(");  // 拼接 SQL
-                                                                   // 插入语句
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end()) {  // 如果用户名不存在
-                m_lock.lock();                      // 加锁
-                int res = mysql_query(mysql, sql_insert);  // 执行 SQL 插入语句
-                users.insert(
-                    pair<string, string>(name, password));  // 插入用户名和密码
-                m_lock.unlock();                            // 解锁
-
-                if (!res)
-                    strcpy(m_url, "/log.html");  // 如果插入成功，跳转到登录页面
-                else
-                    strcpy(
-                        m_url,
-                        "/registerError.html");  // 如果插入失败，跳转到注册错误页面
-            } else
-                strcpy(
-                    m_url,
-                    "/registerError.html");  // 如果用户名已存在，跳转到注册错误页面
+    size_t path_len = strcspn(m_url, "?");  // 路由和文件查找都只看路径部分，忽略查询串
+
+    // 带请求体的升级请求按 HTTP/1.1 处理，与 RFC 7540 3.2 允许的做法一致
+    if (m_upgrade_h2c && !m_upgrade_websocket && m_content_length == 0 && !m_chunked && !m_ssl) {
+        HTTP_CODE ret = upgrade_h2c();
+        if (ret != NO_REQUEST) return ret;
+    }
+
+    if (m_method == OPTIONS && strcmp(m_url, "*") == 0) {
+        m_allow = static_methods;
+        return OPTIONS_REQUEST;
+    }
+
+    route_params params;
+    const route *r = m_vhost->router.find(m_url, path_len, params);
+    // HEAD 可以访问所有接受 GET 的路由，处理函数输出的响应体由 http_response 丢弃
+    int method_bit = 1 << m_method;
+    if (m_method == HEAD) method_bit |= 1 << GET;
+    if (r && (r->methods & method_bit)) {
+        switch (r->kind) {
+            case ROUTE_FILE:
+                return serve_file("", 0, r->target.data(), r->target.size());
+            case ROUTE_STATIC: {
+                // 前缀路由的最后一个参数是余下的路径
+                const route_param &rest = params.items[params.count - 1];
+                return serve_file(r->target.data(), r->target.size(), rest.value, rest.len);
+            }
+            case ROUTE_HANDLER:
+                return dispatch(*r, params, path_len);
+            case ROUTE_WEBSOCKET:
+                if (m_method != GET) return BAD_REQUEST;
+                return upgrade(*r, params, path_len);
         }
-        // 如果是登录，直接判断
-        // 若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2') {  // 如果是登录
-            if (users.find(name) != users.end() &&
-                users[name] == password)  // 如果用户名和密码匹配
-                strcpy(m_url, "/welcome.html");  // 跳转到欢迎页面
-            else
-                strcpy(m_url, "/logError.html");  // 跳转到登录错误页面
+    }
+    // 没有路由接受 OPTIONS 时由服务器回答：路由接受的方法加上按静态文件处理时接受的方法
+    if (m_method == OPTIONS) {
+        m_allow = static_methods | (r ? r->methods : 0);
+        if (m_allow & (1 << GET)) m_allow |= 1 << HEAD;
+        return OPTIONS_REQUEST;
+    }
+    // 命中路由但方法不被接受，不再退回静态文件
+    if (r) {
+        m_allow = route_allow(*r);
+        return METHOD_NOT_ALLOWED;
+    }
+    return serve_file("", 0, m_url, path_len);
+}
+
+// 把文档根目录 + dir + path 拼成 m_real_file，然后从缓存取出文件
+http_conn::HTTP_CODE http_conn::serve_file(const char *dir, size_t dir_len, const char *path, size_t path_len) {
+    static_file f;
+    HTTP_CODE ret = find_static(*m_vhost, dir, dir_len, path, path_len, m_accept_encoding, m_real_file, f);
+    if (ret != FILE_REQUEST) return ret;
+    m_file = f.file;
+    m_encoded = f.encoded;
+    m_content_encoding = f.encoding;
+    m_vary = f.vary;
+    m_content_type = f.content_type;
+    m_file_address = (char *)f.data;
+    m_file_size = f.size;
+    return FILE_REQUEST;  // 返回文件请求
+}
+
+bool http_conn::safe_path(const char *path, size_t len) {
+    for (size_t i = 0; i + 1 < len; ++i) {
+        if (path[i] == '.' && path[i + 1] == '.' && (i == 0 || path[i - 1] == '/') &&
+            (i + 2 == len || path[i + 2] == '/'))
+            return false;
+    }
+    return true;
+}
+
+// 静态文件查找，HTTP/2 的请求也经过这里，与 HTTP/1.1 共用各虚拟主机的文件缓存
+http_conn::HTTP_CODE http_conn::find_static(vhost &host, const char *dir, size_t dir_len, const char *path,
+                                            size_t path_len, int accept_encoding, char *real_file, static_file &out,
+                                            bool cached_only) {
+    if (!safe_path(path, path_len)) return FORBIDDEN_REQUEST;  // 防止访问文档根目录之外的文件
+
+    const char *root = host.doc_root.data();
+    size_t root_len = host.doc_root.size();
+    bool need_slash = dir_len > 0 && (path_len == 0 || path[0] != '/');  // 前缀路由余下的路径不带 '/'
+    if (root_len + dir_len + need_slash + path_len >= (size_t)FILENAME_LEN) return BAD_REQUEST;  // 路径过长
+    char *p = real_file;
+    memcpy(p, root, root_len);
+    p += root_len;
+    memcpy(p, dir, dir_len);
+    p += dir_len;
+    if (need_slash) *p++ = '/';
+    memcpy(p, path, path_len);
+    p[path_len] = '\0';
+
+    if (cached_only) {
+        // 不 stat：缓存项只在可读的普通文件上建立，最近确认过就直接用
+        out.file = host.cache.peek(real_file, STATIC_CACHE_VALID);
+        if (!out.file) return NO_REQUEST;
+    } else {
+        struct stat st;
+        if (stat(real_file, &st) < 0)
+            return NO_RESOURCE;  // 获取文件状态，如果失败返回资源不存在
+
+        if (!(st.st_mode & S_IROTH))
+            return FORBIDDEN_REQUEST;  // 如果文件不可读，返回禁止访问
+
+        if (S_ISDIR(st.st_mode))
+            return BAD_REQUEST;  // 如果文件是目录，返回错误请求
+
+        // 从缓存取出文件映射，未命中或文件已修改时由缓存重新 open + mmap
+        out.file = host.cache.acquire(real_file, st);
+        if (!out.file) return INTERNAL_ERROR;  // 打开或映射失败
+    }
+
+    // 内容协商：按 Accept-Encoding 选择预压缩或已缓存的压缩变体，没有则发原文
+    out.encoded = host.cache.select(out.file, accept_encoding, out.encoding);
+    out.vary = out.file->compressible || out.file->has_siblings;  // 响应可能随 Accept-Encoding 变化
+    out.content_type = out.file->mime->content_type;              // MIME 类型在缓存项加载时已解析
+    if (out.encoded) {
+        out.data = out.encoded->data;
+        out.size = out.encoded->size;
+    } else {
+        out.data = out.file->data;
+        out.size = out.file->st.st_size;
+    }
+    return FILE_REQUEST;
+}
+
+bool http_conn::error_page(HTTP_CODE code, int &status, const char *&title, const char *&form) {
+    switch (code) {
+        case BAD_REQUEST:
+            status = 400, title = error_400_title, form = error_400_form;
+            return true;
+        case FORBIDDEN_REQUEST:
+            status = 403, title = error_403_title, form = error_403_form;
+            return true;
+        case TOO_LARGE_REQUEST:
+            status = 413, title = error_413_title, form = error_413_form;
+            return true;
+        case METHOD_NOT_ALLOWED:
+            status = 405, title = error_405_title, form = error_405_form;
+            return true;
+        case NO_RESOURCE:
+            status = 404, title = error_404_title, form = error_404_form;
+            return true;
+        case INTERNAL_ERROR:
+            status = 500, title = error_500_title, form = error_500_form;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 执行处理函数。响应一律走流式发送缓冲区：INLINE 处理函数返回时通常已经写完，
+// BLOCKING 处理函数和推迟完成的响应稍后由其他线程经 stream_push() 写入
+http_conn::HTTP_CODE http_conn::dispatch(const route &r, const route_params &params, size_t path_len) {
+    http_request req;
+    req.method = method_names[m_method];
+    req.path = std::string_view(m_url, path_len);
+    if (m_url[path_len] == '?') req.query = std::string_view(m_url + path_len + 1);
+    req.version = m_version;
+    req.remote_addr = m_remote_ip;
+    req.tls = m_ssl != NULL;
+    if (m_string) req.body = std::string_view(m_string, m_content_length);
+    req.body_streamed = m_body_stream;
+    req.body_length = m_body_stream ? (m_chunked ? -1 : m_content_length) : (long)req.body.size();
+    if (m_upload) req.form = m_upload->form();
+    req.header_count = m_header_count;
+    for (int i = 0; i < m_header_count; ++i) req.headers[i] = m_headers[i];
+    req.param_count = params.count;
+    for (int i = 0; i < params.count; ++i) {
+        req.params[i].name = params.items[i].name;
+        req.params[i].value = std::string_view(params.items[i].value, params.items[i].len);
+    }
+
+    m_stream_lock.lock();
+    m_streaming = true;
+    m_stream_done = false;
+    m_stream_sent = 0;
+    m_stream_buf.clear();
+    unsigned id = m_request_id;
+    m_stream_lock.unlock();
+
+    if (r.mode == HANDLER_BLOCKING && handler_pool::get_instance()->enabled()) {
+        handler_job *job = new handler_job(&r.handler, req, this, id, m_linger, m_vhost);
+        if (!handler_pool::get_instance()->submit(job)) {
+            job->res.set_status(503);  // 阻塞线程池积压已满
+            job->res.send("Server is busy, please retry later.\n");
+            delete job;
         }
+        return STREAM_REQUEST;
+    }
+
+    http_response res(this, id, m_linger, m_vhost, m_method == HEAD);
+    r.handler(req, res);
+    return STREAM_REQUEST;  // res 析构时为未完成的响应收尾
+}
+
+// WebSocket 握手（RFC 6455 4.2）：请求必须是带 Upgrade: websocket、版本 13 和 Sec-WebSocket-Key 的 GET。
+// 101 响应和普通响应一样经 write() 发出，之后连接由 WebServer 交给 ws_server
+http_conn::HTTP_CODE http_conn::upgrade(const route &r, const route_params &params, size_t path_len) {
+    std::string_view key, version;
+    for (int i = 0; i < m_header_count; ++i) {
+        const http_header &h = m_headers[i];
+        if (h.name.size() == 17 && strncasecmp(h.name.data(), "Sec-WebSocket-Key", 17) == 0)
+            key = h.value;
+        else if (h.name.size() == 21 && strncasecmp(h.name.data(), "Sec-WebSocket-Version", 21) == 0)
+            version = h.value;
+    }
+    if (!m_upgrade_websocket || key.size() != 24 || version != "13") return BAD_REQUEST;
+    if (m_ssl) return BAD_REQUEST;  // ws_server 直接读写 socket，不支持 wss
+
+    char accept[WS_ACCEPT_LEN + 1];
+    ws_accept_key(key, accept);
+    if (!add_status_line(101, "Switching Protocols") ||
+        !add_response("Upgrade:websocket\r\nConnection:Upgrade\r\nSec-WebSocket-Accept:") ||
+        !add_response(accept, WS_ACCEPT_LEN) || !add_response("\r\n\r\n", 4))
+        return INTERNAL_ERROR;
+
+    m_upgrade.reset(new ws_upgrade);
+    m_upgrade->endpoint = r.ws.get();
+    m_upgrade->path.assign(m_url, path_len);
+    if (m_url[path_len] == '?') m_upgrade->query = m_url + path_len + 1;
+    m_upgrade->remote_addr = m_remote_ip;
+    for (int i = 0; i < params.count; ++i)
+        m_upgrade->params.push_back(make_pair(string(params.items[i].name),
+                                              string(params.items[i].value, params.items[i].len)));
+    if (m_read_idx > m_checked_idx)  // 客户端没等 101 就发来的帧
+        m_upgrade->pending.assign(m_read_buf + m_checked_idx, m_read_idx - m_checked_idx);
+    return UPGRADE_REQUEST;
+}
+
+// h2c 升级（RFC 7540 3.2）：HTTP2-Settings 必须存在且能解码，否则忽略 Upgrade 按普通请求处理。
+// 原请求转换成流 1 的头部，101 响应发完后由 h2_server 回复
+http_conn::HTTP_CODE http_conn::upgrade_h2c() {
+    std::unique_ptr<h2_upgrade> up(new h2_upgrade);
+    bool has_settings = false;
+    for (int i = 0; i < m_header_count; ++i) {
+        const http_header &h = m_headers[i];
+        if (h.name.size() == 14 && strncasecmp(h.name.data(), "HTTP2-Settings", 14) == 0)
+            has_settings = h2_settings_decode(h.value, up->settings);
+    }
+    if (!has_settings) return NO_REQUEST;
+
+    static const char *dropped[] = {"connection", "upgrade", "http2-settings", "host", "keep-alive",
+                                    "transfer-encoding", "proxy-connection", "te"};
+    up->headers.push_back(hpack_header{":method", method_names[m_method]});
+    up->headers.push_back(hpack_header{":scheme", "http"});
+    up->headers.push_back(hpack_header{":path", m_url});
+    if (m_host) up->headers.push_back(hpack_header{":authority", m_host});
+    for (int i = 0; i < m_header_count; ++i) {
+        std::string name(m_headers[i].name);
+        for (size_t j = 0; j < name.size(); ++j) name[j] = tolower((unsigned char)name[j]);
+        bool skip = false;
+        for (size_t j = 0; j < sizeof(dropped) / sizeof(dropped[0]) && !skip; ++j) skip = name == dropped[j];
+        if (!skip) up->headers.push_back(hpack_header{name, std::string(m_headers[i].value)});
     }
 
-    if (*(p + 1) == '0') {  // 如果 URL 以 /0 结尾
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);  // 分配内存
-        strcpy(m_url_real, "/register.html");  // 复制注册页面路径
-        strncpy(m_real_file + len, m_url_real,
-                strlen(m_url_real));  // 复制到实际文件路径
-        free(m_url_real);             // 释放内存
-    } else if (*(p + 1) == '1') {     // 如果 URL 以 /1 结尾
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);  // 分配内存
-        strcpy(m_url_real, "/log.html");  // 复制登录页面路径
-        strncpy(m_real_file + len, m_url_real,
-                strlen(m_url_real));  // 复制到实际文件路径
-        free(m_url_real);             // 释放内存
-    } else if (*(p + 1) == '5') {     // 如果 URL 以 /5 结尾
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);  // 分配内存
-        strcpy(m_url_real, "/picture.html");  // 复制图片页面路径
-        strncpy(m_real_file + len, m_url_real,
-                strlen(m_url_real));  // 复制到实际文件路径
-        free(m_url_real);             // 释放内存
-    } else if (*(p + 1) == '6') {     // 如果 URL 以 /6 结尾
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);  // 分配内存
-        strcpy(m_url_real, "/video.html");  // 复制视频页面路径
-        strncpy(m_real_file + len, m_url_real,
-                strlen(m_url_real));  // 复制到实际文件路径
-        free(m_url_real);             // 释放内存
-    } else if (*(p + 1) == '7') {     // 如果 URL 以 /7 结尾
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);  // 分配内存
-        strcpy(m_url_real, "/fans.html");  // 复制粉丝页面路径
-        strncpy(m_real_file + len, m_url_real,
-                strlen(m_url_real));  // 复制到实际文件路径
-        free(m_url_real);             // 释放内存
-    } else
-        strncpy(m_real_file + len, m_url,
-                FILENAME_LEN - len - 1);  // 否则直接复制 URL 到实际文件路径
-
-    if (stat(m_real_file, &m_file_stat) < 0)
-        return NO_RESOURCE;  // 获取文件状态，如果失败返回资源不存在
-
-    if (!(m_file_stat.st_mode & S_IROTH))
-        return FORBIDDEN_REQUEST;  // 如果文件不可读，返回禁止访问
-
-    if (S_ISDIR(m_file_stat.st_mode))
-        return BAD_REQUEST;  // 如果文件是目录，返回错误请求
-
-    int fd = open(m_real_file, O_RDONLY);  // 打开文件
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ,
-                                  MAP_PRIVATE, fd, 0);  // 将文件映射到内存
-    close(fd);                                          // 关闭文件描述符
-    return FILE_REQUEST;                                // 返回文件请求
-}
-
-// 解除内存映射
+    if (!add_status_line(101, "Switching Protocols") || !add_response("Connection:Upgrade\r\nUpgrade:h2c\r\n\r\n"))
+        return INTERNAL_ERROR;
+    up->remote_addr = m_remote_ip;
+    if (m_read_idx > m_checked_idx)  // 客户端没等 101 就发来的连接前言
+        up->pending.assign(m_read_buf + m_checked_idx, m_read_idx - m_checked_idx);
+    m_h2_upgrade = std::move(up);
+    return UPGRADE_REQUEST;
+}
+
+void http_conn::handoff() {
+    int sockfd = m_sockfd;
+    m_sockfd = -1;
+    m_detached = false;
+    if (m_h2_upgrade)
+        h2_server::get_instance()->adopt(sockfd, std::move(m_h2_upgrade));
+    else
+        ws_server::get_instance()->adopt(sockfd, std::move(m_upgrade));
+}
+
+// 释放对缓存项的引用，映射本身由文件缓存负责回收
 void http_conn::unmap() {
-    if (m_file_address) {  // 如果文件地址不为空
-        munmap(m_file_address, m_file_stat.st_size);  // 解除内存映射
-        m_file_address = 0;  // 将文件地址置为空
+    m_file_address = 0;  // 将文件地址置为空
+    if (m_file_fd >= 0) {  // SSL_sendfile 使用的文件
+        close(m_file_fd);
+        m_file_fd = -1;
     }
+    m_encoded.reset();   // 释放压缩变体
+    m_file.reset();      // 释放缓存项
 }
 
 // 写入数据，用于将写缓冲区中的数据写入 socket
 bool http_conn::write() {
     int temp = 0;
 
-    if (bytes_to_send == 0) {  // 如果写入缓冲区完成，已经没有数据需要发送
+    if (m_streaming) return write_stream();  // 流式响应走单独的发送逻辑
+
+    // 没有待发送的数据：响应发完时已经初始化过，这里只可能是异步响应结束后迟到的写事件，
+    // 不能再次 init()，否则会清掉已读入的下一个请求
+    if (bytes_to_send == 0) {
+        if (m_upgrade || m_h2_upgrade) {  // HTTP/2 连接前言没有 101 响应，直接交出
+            m_detached = true;
+            return true;
+        }
         modfd(m_epollfd, m_sockfd, EPOLLIN,
               m_TRIGMode);  // 此时不再需要发送数据，而是需要监听读事件，以便读取客户端发送的数据
-        init();             // 初始化连接
         return true;        // 返回写入成功
     }
 
     while (1) {
-        temp = writev(m_sockfd, m_iv, m_iv_count);  // 使用 writev 写入数据
+        temp = send_iov();  // 使用 writev 写入数据
 
         if (temp < 0) {             // temp变量是writev()的返回值，如果小于0，则写入失败
             if (errno == EAGAIN) {  // 如果是非阻塞模式下的 EAGAIN 错误
@@ -556,6 +1154,11 @@ bool http_conn::write() {
 
         if (bytes_to_send <= 0) {  // 如果写入缓冲区完成，已经没有数据需要发送
             unmap();               // 解除内存映射
+            log_access(bytes_have_send);
+            if (m_upgrade || m_h2_upgrade) {  // 101 响应已发完，等待主循环交出连接
+                m_detached = true;
+                return true;
+            }
             modfd(m_epollfd, m_sockfd, EPOLLIN,
                   m_TRIGMode);  // 此时不再需要发送数据，而是需要监听读事件，以便读取客户端发送的数据
 
@@ -569,54 +1172,296 @@ bool http_conn::write() {
     }
 }
 
-// 添加响应内容
-bool http_conn::add_response(const char *format, ...) {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
-        return false;  // 如果写缓冲区已满，返回 false
-    va_list arg_list;
-    va_start(arg_list, format);  // 初始化可变参数列表
-    int len = vsnprintf(m_write_buf + m_write_idx,
-                        WRITE_BUFFER_SIZE - 1 - m_write_idx, format,
-                        arg_list);  // 格式化字符串
-    if (len >= (WRITE_BUFFER_SIZE - 1 -
-                m_write_idx)) {  // 如果格式化后的字符串长度超过缓冲区剩余空间
-        va_end(arg_list);  // 结束可变参数列表
-        return false;      // 返回 false
+ssize_t http_conn::send_iov() {
+    if (!m_ssl) return writev(m_sockfd, m_iv, m_iv_count);
+    if (m_file_fd < 0) return tls_writev(m_ssl, m_iv, m_iv_count);
+    // 内核 TLS：响应头发完后文件部分从页缓存直接发送
+    if (m_iv[0].iov_len > 0) return tls_writev(m_ssl, m_iv, 1);
+    return tls_sendfile(m_ssl, m_file_fd, bytes_have_send - m_write_idx, bytes_to_send);
+}
+
+// 追加处理函数的输出并通知事件循环发送。连接已关闭或已开始处理下一个请求时丢弃
+bool http_conn::stream_push(unsigned request_id, const struct iovec *iov, int count, bool done) {
+    m_stream_lock.lock();
+    if (request_id != m_request_id || !m_streaming || m_stream_done || m_sockfd < 0) {
+        m_stream_lock.unlock();
+        return false;
+    }
+    if (m_timing.ready == 0 && access_log::enabled()) {
+        // 第一段响应：处理函数的耗时算到这里，状态码取自状态行 "HTTP/1.1 200 ..."
+        long long now = access_log::now_us();
+        if (m_timing.handler) m_timing.handler_us = now - m_timing.handler;
+        m_timing.ready = now;
+        const char *line = count > 0 ? (const char *)iov[0].iov_base : NULL;
+        if (line && iov[0].iov_len >= 12 && memcmp(line, "HTTP/1.", 7) == 0)
+            m_timing.status = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+    }
+    for (int i = 0; i < count; ++i) m_stream_buf.append((const char *)iov[i].iov_base, iov[i].iov_len);
+    m_stream_done = done;
+    int sockfd = m_sockfd;
+    bool hold = hold_response();
+    m_stream_lock.unlock();
+
+    if (!hold) modfd(m_epollfd, sockfd, EPOLLOUT, m_TRIGMode);  // 有数据可发，注册写事件
+    return true;
+}
+
+// 请求体读完之前响应只缓冲，由读请求的线程在 wait_body() 或请求体读完时注册写事件。
+// 连接正暂停读请求体时没有这样的线程：响应一结束就在这里放弃剩下的请求体
+bool http_conn::hold_response() {
+    if (!m_body_stream) return false;
+    if (!m_stream_done || !m_body_paused) return true;
+    m_body_stream = false;
+    m_body_paused = false;
+    m_linger = false;  // 剩下的请求体没有读，连接不能再用
+    return false;
+}
+
+bool http_conn::stream_read_body(unsigned request_id, const shared_ptr<body_reader> &reader) {
+    m_stream_lock.lock();
+    bool ok = request_id == m_request_id && m_body_stream;
+    m_stream_lock.unlock();
+    if (ok) m_body_reader = reader;  // 处理函数在读请求的线程中执行，之后只有这个线程访问
+    return ok;
+}
+
+bool http_conn::stream_resume_body(unsigned request_id) {
+    m_stream_lock.lock();
+    bool ok = request_id == m_request_id && m_body_stream && m_sockfd >= 0;
+    if (ok && m_body_paused) {
+        m_body_paused = false;
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+    } else if (ok) {
+        m_body_resume = true;  // 读请求的线程还没来得及暂停，由 wait_body() 处理
+    }
+    m_stream_lock.unlock();
+    return ok;
+}
+
+bool http_conn::stream_attach(unsigned request_id, const shared_ptr<stream_owner> &owner) {
+    m_stream_lock.lock();
+    bool ok = request_id == m_request_id && m_streaming && !m_stream_done;
+    if (ok) m_stream_owner = owner;
+    m_stream_lock.unlock();
+    return ok;
+}
+
+// 在锁内核对请求编号再操作 socket，保证不会写到已被复用的连接上
+ssize_t http_conn::stream_splice(unsigned request_id, int pipe_fd, size_t len) {
+    m_stream_lock.lock();
+    if (request_id != m_request_id || !m_streaming || m_stream_done || m_sockfd < 0) {
+        m_stream_lock.unlock();
+        errno = EPIPE;
+        return -1;
     }
+    if (m_body_stream || m_stream_sent < m_stream_buf.size()) {  // 请求体还没读完，或缓冲区里还有数据必须先发完
+        m_stream_lock.unlock();
+        errno = EAGAIN;
+        return -1;
+    }
+    ssize_t n;
+    if (!m_ssl || tls_ktls_send(m_ssl)) {
+        n = splice(pipe_fd, NULL, m_sockfd, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) m_timing.bytes += n;
+        m_stream_lock.unlock();
+        return n;
+    }
+    // 用户态加密时无法 splice：从管道读出放进流式缓冲区，由 write_stream() 加密发送。
+    // 缓冲区发空前一直返回 EAGAIN，每次最多读出 64KB，内存占用与 splice 时管道的容量相当
+    char buf[65536];
+    n = read(pipe_fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+    if (n > 0) m_stream_buf.append(buf, n);
+    int sockfd = m_sockfd;
+    m_stream_lock.unlock();
+    if (n > 0) modfd(m_epollfd, sockfd, EPOLLOUT, m_TRIGMode);
+    return n;
+}
+
+bool http_conn::stream_wake(unsigned request_id) {
+    m_stream_lock.lock();
+    bool ok = request_id == m_request_id && m_streaming && !m_stream_done && m_sockfd >= 0;
+    int sockfd = m_sockfd;
+    bool hold = ok && hold_response();
+    m_stream_lock.unlock();
+    if (ok && !hold) modfd(m_epollfd, sockfd, EPOLLOUT, m_TRIGMode);
+    return ok;
+}
+
+bool http_conn::stream_abort(unsigned request_id) {
+    m_stream_lock.lock();
+    if (request_id != m_request_id || !m_streaming || m_stream_done || m_sockfd < 0) {
+        m_stream_lock.unlock();
+        return false;
+    }
+    m_linger = false;  // 发完已缓冲的数据后关闭连接
+    m_stream_done = true;
+    int sockfd = m_sockfd;
+    bool hold = hold_response();
+    m_stream_lock.unlock();
+    if (!hold) modfd(m_epollfd, sockfd, EPOLLOUT, m_TRIGMode);
+    return true;
+}
+
+size_t http_conn::stream_backlog(unsigned) {  // 一个连接同时只有一个流式响应
+    m_stream_lock.lock();
+    size_t backlog = m_stream_buf.size() - m_stream_sent;
+    m_stream_lock.unlock();
+    return backlog;
+}
+
+// 发送流式缓冲区。缓冲区发空但生产者尚未结束时直接返回，不注册任何事件，
+// 生产者下一次 stream_push() 会重新注册写事件
+bool http_conn::write_stream() {
+    m_stream_lock.lock();
+    while (m_stream_sent < m_stream_buf.size()) {
+        ssize_t n;
+        if (m_ssl) {
+            struct iovec iov = {(char *)m_stream_buf.data() + m_stream_sent, m_stream_buf.size() - m_stream_sent};
+            n = tls_writev(m_ssl, &iov, 1);
+        } else {
+            n = send(m_sockfd, m_stream_buf.data() + m_stream_sent, m_stream_buf.size() - m_stream_sent, 0);
+        }
+        if (n < 0) {
+            m_stream_lock.unlock();
+            if (errno == EAGAIN) {  // 发送缓冲区满，等待下一次写事件
+                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+                return true;
+            }
+            return false;  // 发送失败
+        }
+        m_stream_sent += n;
+        m_timing.bytes += n;
+    }
+    m_stream_buf.clear();
+    m_stream_sent = 0;
+    bool done = m_stream_done;
+    shared_ptr<stream_owner> owner;
+    if (done)
+        m_stream_owner.reset();  // 响应已发完，不再需要接管者
+    else
+        owner = m_stream_owner;
+    m_stream_lock.unlock();
+
+    if (!done) {
+        if (owner) owner->on_drain();  // 缓冲区已发空，由接管者继续写
+        return true;                   // 等待生产者继续写入
+    }
+
+    modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);  // 响应结束，重新监听读事件
+    log_access(m_timing.bytes);
+    if (m_linger) {
+        init();  // 保持连接，为下一个请求初始化
+        return true;
+    }
+    return false;  // 不保持连接，关闭
+}
+
+// 添加响应内容。响应头全部由常量片段拼成，这里只做复制
+bool http_conn::add_response(const char *data, size_t len) {
+    if (len >= (size_t)(WRITE_BUFFER_SIZE - 1 - m_write_idx))
+        return false;  // 写缓冲区剩余空间不足，返回 false
+    memcpy(m_write_buf + m_write_idx, data, len);
     m_write_idx += len;  // 更新写索引
-    va_end(arg_list);    // 结束可变参数列表
+    return true;         // 返回 true
+}
+// 添加十进制整数
+bool http_conn::add_uint(uint64_t value) {
+    char num[UINT_DIGITS_MAX];
+    return add_response(num, format_uint(num, value));
+}
 
-    LOG_INFO("request:%s", m_write_buf);  // 记录请求内容
+void http_conn::mark_queued() {
+    if (!access_log::enabled()) return;
+    long long now = access_log::now_us();
+    if (m_timing.start == 0) m_timing.start = now;
+    m_timing.queued = now;
+}
 
-    return true;  // 返回 true
+// 各阶段耗时在 process()、stream_push() 中记下，这里补上发送时间，交给访问日志的写线程
+void http_conn::log_access(uint64_t bytes) {
+    if (!access_log::enabled() || m_timing.start == 0) return;
+    long long now = access_log::now_us();
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    access_entry e;
+    memset(&e, 0, sizeof(e));
+    e.total_us = now - m_timing.start;
+    e.start_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec - (long long)e.total_us * 1000;
+    e.bytes = bytes;
+    e.addr = m_address.sin_addr.s_addr;
+    e.reuse = m_reuse++;
+    e.status = m_timing.status;
+    e.method = m_url ? (uint8_t)m_method : access_entry::NO_METHOD;
+    e.flags = (m_linger ? access_entry::KEEP_ALIVE : 0) | (m_ssl ? access_entry::TLS : 0) |
+              (m_version && strcasecmp(m_version, "HTTP/1.0") == 0 ? access_entry::HTTP10 : 0);
+    e.queue_us = m_timing.queue_us;
+    e.parse_us = m_timing.parse_us;
+    e.handler_us = m_timing.handler_us;
+    e.send_us = m_timing.ready ? now - m_timing.ready : 0;
+    const char *path = m_url ? m_url : "";
+    access_log::get_instance()->write(e, path, strlen(path));
+    m_timing.start = 0;  // 迟到的写事件不会再记一次
 }
 
-// 添加状态行
+// 添加状态行，之后紧跟 Date 和 Server
 bool http_conn::add_status_line(int status, const char *title) {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    m_timing.status = status;
+    size_t len;
+    const char *line = status_line(status, len);
+    bool ok = line ? add_response(line, len)
+                   : add_response("HTTP/1.1 ", 9) && add_uint(status) && add_response(" ", 1) &&
+                         add_response(title) && add_response("\r\n", 2);
+    return ok && add_response(http_date::line(), http_date::LINE_LEN) && add_response(HEAD_SERVER, HEAD_SERVER_LEN);
 }
 // 添加头部信息
 bool http_conn::add_headers(int content_len) {
-    return add_content_length(content_len) && add_linger() && add_blank_line();
+    return add_content_length(content_len) && add_content_type() && add_content_encoding() && add_vary() && add_linger() && add_blank_line();
 }
 // 添加内容长度
 bool http_conn::add_content_length(int content_len) {
-    return add_response("Content-Length:%d\r\n", content_len);
+    return add_response("Content-Length:", 15) && add_uint(content_len) && add_response("\r\n", 2);
 }
 // 添加内容类型
 bool http_conn::add_content_type() {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    return add_response("Content-Type:", 13) && add_response(m_content_type) && add_response("\r\n", 2);
+}
+// 添加内容编码，发送原文时不输出
+bool http_conn::add_content_encoding() {
+    if (m_content_encoding == ENC_IDENTITY) return true;
+    return add_response("Content-Encoding:", 17) && add_response(encoding_name(m_content_encoding)) &&
+           add_response("\r\n", 2);
+}
+// 添加 Vary 头，只对可能返回不同编码的资源输出
+bool http_conn::add_vary() {
+    if (!m_vary) return true;
+    static const char vary[] = "Vary:Accept-Encoding\r\n";
+    return add_response(vary, sizeof(vary) - 1);
 }
 // 添加连接状态
 bool http_conn::add_linger() {
-    return add_response("Connection:%s\r\n",
-                        (m_linger == true) ? "keep-alive" : "close");
+    return m_linger ? add_response(HEAD_KEEP_ALIVE, HEAD_KEEP_ALIVE_LEN) : add_response(HEAD_CLOSE, HEAD_CLOSE_LEN);
+}
+// 添加 Allow 头
+bool http_conn::add_allow() {
+    std::string value = allow_value(m_allow);
+    return add_response("Allow:", 6) && add_response(value.data(), value.size()) && add_response("\r\n", 2);
+}
+
+std::string http_conn::allow_value(int allow) {
+    std::string out;
+    for (size_t i = 0; i < sizeof(method_names) / sizeof(method_names[0]); ++i) {
+        if (!(allow & (1 << i))) continue;
+        if (!out.empty()) out += ", ";
+        out += method_names[i];
+    }
+    return out;
 }
 // 添加空行
-bool http_conn::add_blank_line() { return add_response("%s", "\r\n"); }
+bool http_conn::add_blank_line() { return add_response("\r\n", 2); }
 // 添加内容
 bool http_conn::add_content(const char *content) {
-    return add_response("%s", content);
+    if (m_method == HEAD) return true;  // HEAD 响应没有响应体，头部与 GET 相同
+    return add_response(content);
 }
 
 // 处理写入的 HTTP 响应，根据解析结果生成响应内容
@@ -624,41 +1469,93 @@ bool http_conn::process_write(HTTP_CODE ret) {
     switch (ret) {
         case INTERNAL_ERROR: {                      // 如果是内部错误
             add_status_line(500, error_500_title);  // 添加状态行，状态码为 500
+            m_content_type = error_content_type;  // 错误页面是纯文本
+            m_content_encoding = ENC_IDENTITY;    // 错误页面不压缩
+            m_vary = false;
             add_headers(strlen(error_500_form));  // 添加头部信息
             if (!add_content(error_500_form)) return false;  // 添加错误信息内容
             break;
         }
         case BAD_REQUEST: {                         // 如果是错误请求
+            add_status_line(400, error_400_title);  // 添加状态行，状态码为 400
+            m_content_type = error_content_type;  // 错误页面是纯文本
+            m_content_encoding = ENC_IDENTITY;    // 错误页面不压缩
+            m_vary = false;
+            add_headers(strlen(error_400_form));  // 添加头部信息
+            if (!add_content(error_400_form)) return false;  // 添加错误信息内容
+            break;
+        }
+        case NO_RESOURCE: {                         // 如果资源不存在
             add_status_line(404, error_404_title);  // 添加状态行，状态码为 404
+            m_content_type = error_content_type;  // 错误页面是纯文本
+            m_content_encoding = ENC_IDENTITY;    // 错误页面不压缩
+            m_vary = false;
             add_headers(strlen(error_404_form));  // 添加头部信息
             if (!add_content(error_404_form)) return false;  // 添加错误信息内容
             break;
         }
+        case TOO_LARGE_REQUEST: {  // 请求体超出上限，没读完的请求体无法跳过，回复后关闭连接
+            m_linger = false;
+            add_status_line(413, error_413_title);
+            m_content_type = error_content_type;  // 错误页面是纯文本
+            m_content_encoding = ENC_IDENTITY;    // 错误页面不压缩
+            m_vary = false;
+            add_headers(strlen(error_413_form));
+            if (!add_content(error_413_form)) return false;
+            break;
+        }
+        case METHOD_NOT_ALLOWED: {  // 路由不接受这个方法，Allow 头列出它接受的方法
+            add_status_line(405, error_405_title);
+            m_content_type = error_content_type;  // 错误页面是纯文本
+            m_content_encoding = ENC_IDENTITY;    // 错误页面不压缩
+            m_vary = false;
+            if (!add_allow()) return false;
+            add_headers(strlen(error_405_form));
+            if (!add_content(error_405_form)) return false;
+            break;
+        }
         case FORBIDDEN_REQUEST: {                   // 如果是禁止访问
             add_status_line(403, error_403_title);  // 添加状态行，状态码为 403
+            m_content_type = error_content_type;  // 错误页面是纯文本
+            m_content_encoding = ENC_IDENTITY;    // 错误页面不压缩
+            m_vary = false;
             add_headers(strlen(error_403_form));  // 添加头部信息
             if (!add_content(error_403_form)) return false;  // 添加错误信息内容
             break;
         }
         case FILE_REQUEST: {                     // 如果是文件请求
             add_status_line(200, ok_200_title);  // 添加状态行，状态码为 200
-            if (m_file_stat.st_size != 0) {        // 如果文件大小不为 0
-                add_headers(m_file_stat.st_size);  // 添加头部信息
+            if (m_file_size != 0) {              // 如果响应体大小不为 0
+                add_headers(m_file_size);        // 添加头部信息
+                if (m_method == HEAD) break;     // 头部信息都来自缓存项，不发送文件内容
                 m_iv[0].iov_base = m_write_buf;  // 设置第一个缓冲区的基地址
                 m_iv[0].iov_len = m_write_idx;  // 设置第一个缓冲区的长度
                 m_iv[1].iov_base = m_file_address;  // 设置第二个缓冲区的基地址
-                m_iv[1].iov_len =
-                    m_file_stat.st_size;  // 设置第二个缓冲区的长度
+                m_iv[1].iov_len = m_file_size;      // 设置第二个缓冲区的长度
                 m_iv_count = 2;           // 设置缓冲区数量为 2
+                // 内核 TLS 下未压缩的文件用 SSL_sendfile 发送，打开失败时退回从映射加密发送
+                if (m_ssl && !m_encoded && tls_ktls_send(m_ssl)) m_file_fd = open(m_real_file, O_RDONLY);
                 bytes_to_send =
-                    m_write_idx + m_file_stat.st_size;  // 设置待发送字节数
+                    m_write_idx + m_file_size;  // 设置待发送字节数
                 return true;                            // 返回处理成功
             } else {
                 const char *ok_string =
                     "<html><body></body></html>";  // 定义空页面内容
+                m_content_type = empty_page_content_type;  // 空页面是 html
+                m_content_encoding = ENC_IDENTITY;         // 空页面不压缩
                 add_headers(strlen(ok_string));    // 添加头部信息
                 if (!add_content(ok_string)) return false;  // 添加空页面内容
             }
+            break;
+        }
+        case STREAM_REQUEST:  // 响应由处理函数经 stream_push() 陆续写入
+            return true;
+        case UPGRADE_REQUEST:  // 101 响应已由 upgrade() 或 upgrade_h2c() 写入写缓冲区
+            break;
+        case OPTIONS_REQUEST: {  // 204 响应没有响应体，也不带 Content-Length
+            if (!add_status_line(204, "No Content") || !add_allow() || !add_linger() || !add_blank_line())
+                return false;
+            break;
         }
         default:
             return false;  // 返回处理失败
@@ -672,13 +1569,41 @@ bool http_conn::process_write(HTTP_CODE ret) {
 
 // 处理 HTTP 请求
 void http_conn::process() {
+    long long t0 = 0;
+    if (access_log::enabled() && m_timing.start) {
+        t0 = access_log::now_us();
+        if (m_timing.queued) m_timing.queue_us += t0 - m_timing.queued;
+        m_timing.queued = 0;
+    }
     HTTP_CODE read_ret = process_read();  // 处理读取的 HTTP 请求
+    // 上传和流式请求体每轮都会读满读缓冲区。TLS 连接上已解密而没读走的数据留在 OpenSSL 中，
+    // 不会再触发读事件，在这里接着读完（流式请求体因此可能比接收者要求的多读一些再暂停）
+    while (read_ret == NO_REQUEST && (m_upload || m_body_stream) && m_ssl && tls_pending(m_ssl) && read_once())
+        read_ret = process_read();
     if (read_ret == NO_REQUEST) {         // 如果没有请求
+        if (t0) m_timing.parse_us += access_log::now_us() - t0;
+        if (m_body_stream) {
+            wait_body();  // 流式请求体可能需要暂停读
+            return;
+        }
         modfd(m_epollfd, m_sockfd, EPOLLIN,
               m_TRIGMode);  // 修改 epoll 事件为读事件
         return;             // 返回
     }
     bool write_ret = process_write(read_ret);  // 处理写入的 HTTP 响应
+    if (t0) {
+        // 解析到 do_request() 为止，之后到响应生成完毕算作处理时间；处理函数的响应在 stream_push() 中计时，
+        // 推迟完成的响应这时还没有输出。流式请求体的处理函数在前几轮就已执行，这一轮全部算作解析
+        long long now = access_log::now_us();
+        long long handler = m_timing.handler >= t0 ? m_timing.handler : now;
+        m_timing.parse_us += handler - t0;
+        m_stream_lock.lock();
+        if (m_timing.ready == 0 && !m_streaming) {
+            m_timing.handler_us = now - handler;
+            m_timing.ready = now;
+        }
+        m_stream_lock.unlock();
+    }
     if (!write_ret) {                          // 如果写入失败
         close_conn();                          // 关闭连接
     }
@@ -23,15 +23,40 @@
 #include <unistd.h>          // 包含 POSIX 标准函数，如 close()，用于处理unistd，如read()、write()
 
 #include <map>   // 包含 C++ STL 中的 map 容器。
+#include <memory>  // 包含智能指针，用于持有 WebSocket 握手信息。
+#include <string>  // 包含 C++ STL 中的 string，用作流式响应的发送缓冲区。
 
 #include "../CGImysql/sql_connection_pool.h"    //包含数据库连接池类
+#include "../cache/file_cache.h"                 //包含静态文件缓存类
+#include "../http2/http2.h"                      //包含 HTTP/2 服务端，h2c 握手后交给它
 #include "../lock/locker.h"                      //包含锁类，用于线程同步
+#include "../log/access_log.h"                   //包含访问日志，记录每个请求的各阶段耗时
 #include "../log/log.h"                          //包含日志类
 #include "../timer/lst_timer.h"                  //包含定时器类，用于处理非活跃连接
+#include "../tls/tls.h"                          //包含 TLS 连接的读写函数
+#include "../upload/form.h"                      //包含表单请求体的流式解析
+#include "../websocket/websocket.h"              //包含 WebSocket 的接口和握手信息
+#include "chunked.h"                             //包含分块传输编码的编解码
+#include "handler.h"                             //包含动态接口的处理函数 API
+#include "response_head.h"                       //包含响应头的常量片段和缓存的 Date 头
+#include "router.h"                              //包含按路径分派请求的路由表
 
-class http_conn {
+// 流式响应的接管者。响应体不经过发送缓冲区、由接管者直接写入 socket（如 splice）时，
+// 需要知道缓冲区何时发空：每次发送缓冲区发空而响应尚未结束时回调 on_drain()。
+// 回调在发送线程中执行，不能阻塞。
+struct vhost;
+class vhost_table;
+
+class stream_owner {
+   public:
+    virtual ~stream_owner() {}
+    virtual void on_drain() = 0;
+};
+
+class http_conn : public response_sink {
    public:
     static const int FILENAME_LEN = 200;        // 文件名最大长度
+    static const int STATIC_CACHE_VALID = 1;    // find_static() 只查缓存时，缓存项确认过多少秒内有效
     static const int READ_BUFFER_SIZE = 2048;   // 读缓冲区大小
     static const int WRITE_BUFFER_SIZE = 1024;  // 写缓冲区大小
 
@@ -45,7 +70,7 @@ class http_conn {
         TRACE,    // TRACE请求
         OPTIONS,  // OPTIONS请求
         CONNECT,  // CONNECT请求
-        PATH      // PATH请求
+        PATH      // PATCH请求
     };
 
     // HTTP请求解析状态枚举，这个没有协议标准，是自定义的。
@@ -65,12 +90,51 @@ class http_conn {
         FORBIDDEN_REQUEST,  // 禁止访问
         FILE_REQUEST,       // 文件请求
         INTERNAL_ERROR,     // 内部错误
-        CLOSED_CONNECTION   // 连接关闭
+        CLOSED_CONNECTION,  // 连接关闭
+        STREAM_REQUEST,     // 流式响应，头部已生成，响应体由生产者陆续写入
+        UPGRADE_REQUEST,    // 协议升级：WebSocket 或 h2c 的 101 响应已生成（HTTP/2 连接前言没有响应），发完后交出连接
+        OPTIONS_REQUEST,    // OPTIONS 请求，回复 204 和 Allow 头
+        TOO_LARGE_REQUEST,  // 请求体超出上限，回复 413 并关闭连接
+        METHOD_NOT_ALLOWED  // 命中路由但方法不被接受，回复 405 和 Allow 头
     };
 
     // 行解析状态枚举，用于解析HTTP请求中的每一行。
     enum LINE_STATUS { LINE_OK = 0, LINE_BAD, LINE_OPEN };
 
+    // 路由的处理方式
+    enum ROUTE_KIND {
+        ROUTE_FILE = 0,  // 固定映射到文档根目录下的一个文件
+        ROUTE_STATIC,    // 前缀路由，余下路径映射到文档根目录下的一个子目录
+        ROUTE_HANDLER,   // 交给注册的处理函数
+        ROUTE_WEBSOCKET  // WebSocket 握手，之后交给 ws_server
+    };
+
+    // 路由表中的一项
+    // 各成员都有默认值，注册函数只设置用到的成员，新增成员不会留下未初始化的值
+    struct route {
+        ROUTE_KIND kind = ROUTE_FILE;  // 处理方式
+        int methods = 0;        // 允许的请求方法位掩码（1 << METHOD），方法不符时回复 405
+        string target;          // ROUTE_FILE 为文件路径，ROUTE_STATIC 为目录，均相对文档根目录、以 '/' 开头
+        handler_fn handler;     // ROUTE_HANDLER 的处理函数
+        HANDLER_MODE mode = HANDLER_INLINE;  // ROUTE_HANDLER 的执行方式
+        shared_ptr<ws_endpoint> ws;  // ROUTE_WEBSOCKET 的接口
+        shared_ptr<upload_limits> upload;  // 非空时 ROUTE_HANDLER 的表单请求体流式解析，见 add_upload()
+        bool stream_body = false;   // ROUTE_HANDLER 在请求头读完时执行，请求体边读边交给处理函数，见 add_body_stream()
+    };
+
+    typedef radix_router<route> router;
+
+    // 静态文件的查找结果，HTTP/1.1 和 HTTP/2 共用
+    struct static_file {
+        shared_ptr<file_entry> file;       // 持有的缓存项，保证发送期间映射有效
+        shared_ptr<encoded_body> encoded;  // 选中的压缩变体，发送原文时为空
+        const char *data;                  // 响应体
+        long size;                         // 响应体长度
+        CONTENT_ENCODING encoding;         // 响应体的编码
+        bool vary;                         // 是否需要输出 Vary: Accept-Encoding
+        const char *content_type;          // Content-Type
+    };
+
    public:
     http_conn() {}   // 构造函数，本项目http_conn只有默认构造函数
     ~http_conn() {}  // 析构函数，本项目http_conn只有默认析构函数
@@ -78,11 +142,13 @@ class http_conn {
 /*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
 //代码块功能：与http_conn对象交互相关的函数，如初始化、关闭连接、读取数据、写入数据等。
    public:
-    // 初始化函数，设置socket、地址、用户信息等
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int,
-              string user, string passwd, string sqlname);
+    // 初始化函数，设置socket、地址、用户信息等；ssl 为已完成握手的 TLS 连接，明文连接为 NULL
+    void init(int sockfd, const sockaddr_in &addr, int, int,
+              string user, string passwd, string sqlname, SSL *ssl = NULL);
     // 关闭连接
     void close_conn(bool real_close = true);
+    // 连接即将被关闭（socket 仍然有效）：发送 close_notify 并释放 TLS 状态
+    void close_tls();
     // 有这read_once()、process()、write()三个接口函数，意味着可以使用线程池threadpool。
     // 处理HTTP请求
     void process();
@@ -92,8 +158,65 @@ class http_conn {
     bool write();
     // 获取地址，获取的是客户端的地址信息
     sockaddr_in *get_address() { return &m_address; }
+    // 读事件投递到线程池之前调用，访问日志据此计算排队时间；请求的第一个读事件同时作为请求的开始
+    void mark_queued();
     // 初始化MySQL结果
     void initmysql_result(connection_pool *connPool);
+
+    // 流式响应：处理函数的输出经由 http_response 编码后追加到流式发送缓冲区，并通知事件循环发送，
+    // done 为 true 表示响应结束。可以在任意线程调用，request_id 与当前请求不符（连接已关闭或
+    // 已开始处理下一个请求）时丢弃并返回 false。
+    bool stream_push(unsigned request_id, const struct iovec *iov, int count, bool done) override;
+    // 尚未发送出去的流式数据字节数，生产者据此做背压
+    size_t stream_backlog(unsigned request_id) override;
+    // 设置流式响应的接管者，请求结束时自动释放
+    bool stream_attach(unsigned request_id, const shared_ptr<stream_owner> &owner) override;
+    // 发送缓冲区为空时，把管道中最多 len 字节 splice 到客户端 socket，返回值与 splice() 相同
+    ssize_t stream_splice(unsigned request_id, int pipe_fd, size_t len) override;
+    // 注册写事件，客户端可写且发送缓冲区为空时回调接管者
+    bool stream_wake(unsigned request_id) override;
+    // 异常结束流式响应：发完已缓冲的数据后关闭连接，客户端据此知道响应不完整
+    bool stream_abort(unsigned request_id) override;
+    // 设置流式请求体的接收者，只在处理函数执行期间调用
+    bool stream_read_body(unsigned request_id, const shared_ptr<body_reader> &reader) override;
+    // 接收者积压已发下去：暂停中的连接重新注册读事件
+    bool stream_resume_body(unsigned request_id) override;
+
+    // 注册内置路由：表单页面跳转
+    static bool default_routes(router &r);
+    // 注册处理函数，methods 为允许的请求方法位掩码（1 << METHOD）
+    static bool add_handler(router &r, const char *pattern, int methods, HANDLER_MODE mode, const handler_fn &fn);
+    // 注册上传接口：请求体按 multipart/form-data 或 urlencoded 边读边解析，文件写入 limits.dir 下的临时文件，
+    // 处理函数从 http_request::form 取得结果。请求体不受读缓冲区大小限制，只受 limits 约束
+    static bool add_upload(router &r, const char *pattern, int methods, HANDLER_MODE mode,
+                           const upload_limits &limits, const handler_fn &fn);
+    // 注册流式请求体的接口：处理函数在请求头读完时（INLINE）执行，请求体不进读缓冲区，
+    // 由处理函数经 http_response::read_body() 边读边取，不受读缓冲区大小限制，如反向代理和 FastCGI
+    static bool add_body_stream(router &r, const char *pattern, int methods, const handler_fn &fn);
+    // 注册 WebSocket 接口，只接受 GET 握手
+    static bool add_websocket(router &r, const char *pattern, const ws_endpoint &endpoint);
+
+    // 请求路径能否安全地拼到文档根目录后面：含 ".." 路径段的路径会访问根目录之外的文件，
+    // 静态文件、send_file() 和 FastCGI 的 SCRIPT_FILENAME 都先经过这里
+    static bool safe_path(const char *path, size_t len);
+    // 把虚拟主机的文档根目录 + dir + path 拼成 real_file（至少 FILENAME_LEN 字节）并从它的文件缓存取出，
+    // 成功时返回 FILE_REQUEST。cached_only 时不访问磁盘，只用最近 STATIC_CACHE_VALID 秒内确认过的缓存项，
+    // 没有时返回 NO_REQUEST，由调用者到可以阻塞的线程中再查一次（HTTP/2 的主循环）
+    static HTTP_CODE find_static(vhost &host, const char *dir, size_t dir_len, const char *path, size_t path_len,
+                                 int accept_encoding, char *real_file, static_file &out, bool cached_only = false);
+    // 解析 Accept-Encoding 头，返回可接受编码的位掩码（1 << CONTENT_ENCODING）
+    static int parse_accept_encoding(const char *text);
+    // 错误码对应的状态码、原因短语和页面内容，不是错误码时返回 false
+    static bool error_page(HTTP_CODE code, int &status, const char *&title, const char *&form);
+    // 路由接受的方法位掩码，接受 GET 时加上 HEAD
+    static int route_allow(const route &r);
+    // 把方法位掩码写成 Allow 头的值，如 "GET, HEAD"
+    static std::string allow_value(int allow);
+
+    // 101 响应已发完，等待主循环调用 handoff()
+    bool detached() const { return m_detached; }
+    // 主循环线程调用：把 socket 交给 ws_server 或 h2_server，本对象不再管理它
+    void handoff();
     
     int timer_flag;  // 定时器标志，其值为1表示需要关闭连接（或定时器处理）
     int improv;      // 改进标志，其值为1表示需要改进（或已处理）
@@ -119,31 +242,71 @@ class http_conn {
     HTTP_CODE parse_headers(char *text);
     // 解析请求体，解析HTTP请求的请求体。
     HTTP_CODE parse_content(char *text);
+    // 解析分块传输编码的请求体，原地解码到 m_body_start 处。
+    HTTP_CODE parse_chunked_content();
+    // 请求头结束时调用：上传路由创建 m_upload，其他请求体必须能放进读缓冲区，需要时回复 100 Continue。
+    HTTP_CODE begin_body();
+    // 把读缓冲区中的请求体交给 m_upload，随即腾出读缓冲区。
+    HTTP_CODE parse_upload_content();
+    // 把读缓冲区中的请求体交给 m_body_reader，随即腾出读缓冲区；请求体读完时返回 STREAM_REQUEST。
+    HTTP_CODE parse_stream_content();
+    // 流式请求体还没读完时代替重新注册读事件：接收者积压过多时暂停，响应已结束时放弃剩下的请求体。
+    void wait_body();
+    // 通知接收者请求体没有读完并释放它（连接关闭或开始下一个请求时）。
+    void drop_body();
+    // 持有 m_stream_lock 时调用：请求体读完之前响应暂不发送，返回 true。
+    bool hold_response();
+    // 客户端带 Expect: 100-continue 时，在读取请求体之前直接写出 100 Continue。
+    void send_continue();
     // 处理请求，根据请求方法执行相应的操作。
     HTTP_CODE do_request();
+    // 把文档根目录 + dir + path 拼成 m_real_file 并打开文件，dir 可以为空。
+    HTTP_CODE serve_file(const char *dir, size_t dir_len, const char *path, size_t path_len);
+    // 构造请求对象，执行或投递处理函数，响应经流式发送缓冲区发出。
+    HTTP_CODE dispatch(const route &r, const route_params &params, size_t path_len);
+    // 校验 WebSocket 握手请求并生成 101 响应。
+    HTTP_CODE upgrade(const route &r, const route_params &params, size_t path_len);
+    // 把带 Upgrade: h2c 的请求转换成 HTTP/2 流 1 的请求并生成 101 响应，不满足条件时返回 NO_REQUEST。
+    HTTP_CODE upgrade_h2c();
 
 
     // 解除内存映射，释放文件映射的内存。被映射的文件是静态文件，如html、css、js等。
     void unmap();
 
+    // 把 m_iv 发给客户端，TLS 连接经 tls_writev()/tls_sendfile()，返回值与 writev() 相同。
+    ssize_t send_iov();
+    // 发送流式响应缓冲区中的数据。
+    bool write_stream();
+
     // 处理写入的HTTP响应，，根据解析结果生成响应内容。
     bool process_write(HTTP_CODE ret);
-    // 添加响应内容，，用于生成HTTP响应。
-    bool add_response(const char *format, ...);
+    // 添加响应内容，，用于生成HTTP响应。原样复制 len 字节，不做格式化。
+    bool add_response(const char *data, size_t len);
+    bool add_response(const char *str) { return add_response(str, strlen(str)); }
+    // 添加十进制整数
+    bool add_uint(uint64_t value);
     // 添加内容，用于生成HTTP响应的内容部分。
     bool add_content(const char *content);
-    // 添加状态行，用于生成HTTP响应的状态行。
+    // 添加状态行和 Date、Server 头。常用状态码使用预先生成的状态行，title 只用于不在表中的状态码。
     bool add_status_line(int status, const char *title);
     // 添加头部信息，用于生成HTTP响应的头部。
     bool add_headers(int content_length);
-    // 添加内容类型，用于生成HTTP响应的内容类型。
+    // 添加内容类型，用于生成HTTP响应的内容类型，取自 m_content_type。
     bool add_content_type();
+    // 添加内容编码，响应体经过压缩时生成 Content-Encoding 头。
+    bool add_content_encoding();
+    // 添加 Vary 头，告诉中间缓存响应随 Accept-Encoding 变化。
+    bool add_vary();
     // 添加内容长度，用于生成HTTP响应的内容长度。
     bool add_content_length(int content_length);
     // 添加连接状态，用于生成HTTP响应的连接状态。
     bool add_linger();
+    // 添加 Allow 头，列出 m_allow 中的方法
+    bool add_allow();
     // 添加空行，用于生成HTTP响应的空行。
     bool add_blank_line();
+    // 响应发完时写一条访问日志，bytes 为发送的字节数；未启用访问日志时什么都不做
+    void log_access(uint64_t bytes);
 
 /*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
 
@@ -152,6 +315,7 @@ class http_conn {
    public:
     static int m_epollfd;     // epoll文件描述符，被所有连接(其实每个连接都是一个http_conn对象)共享，值来自webserver类
     static int m_user_count;  // 用户数量，其实是http_conn对象的数量
+    static vhost_table *m_vhosts;  // 虚拟主机表（文档根目录、路由表、文件缓存），被所有连接共享，值来自webserver类
     MYSQL *mysql;             // MySQL连接，不为每个连接单独创建一个 MySQL 连接，它的值来自连接池
     int m_state;              // 状态，0表示读，1表示写
 
@@ -172,15 +336,52 @@ class http_conn {
     char *m_host;                         // 主机名，存储请求的主机名。
     long m_content_length;                // 内容长度，表示请求体的长度。
     bool m_linger;                        // 是否保持连接，表示客户端是否希望保持连接。
-    char *m_file_address;                 // 文件地址，存储文件的内存映射地址。
-    struct stat m_file_stat;              // 文件状态，存储文件的状态信息。
+    char *m_file_address;                 // 文件地址，指向缓存中待发送的响应体（原文或压缩变体）。
+    long m_file_size;                     // 待发送响应体的长度，压缩时小于文件大小。
+    shared_ptr<file_entry> m_file;        // 持有的缓存项，保证发送期间映射有效。
+    shared_ptr<encoded_body> m_encoded;   // 持有的压缩变体，发送原文时为空。
+    int m_accept_encoding;                // 客户端可接受的编码位掩码，来自 Accept-Encoding。
+    CONTENT_ENCODING m_content_encoding;  // 本次响应使用的编码。
+    bool m_vary;                          // 是否需要输出 Vary: Accept-Encoding。
+    int m_allow;                          // OPTIONS 和 405 响应中 Allow 头的方法位掩码（1 << METHOD）。
+    const char *m_content_type;           // 本次响应的 Content-Type，文件取自缓存项的 MIME 类型。
+    bool m_chunked;                       // 请求体是否使用分块传输编码（Transfer-Encoding: chunked）。
+    chunked_decoder m_chunk_decoder;      // 请求体的增量分块解码器。
+    long m_body_start;                    // 请求体在读缓冲区中的起始位置。
+    unique_ptr<upload_session> m_upload;  // 上传接口的请求体解析状态，其他请求为空。
+    long m_upload_received = 0;           // 已交给 m_upload 或 m_body_reader 的请求体字节数（Content-Length 请求体）。
+    bool m_body_stream = false;           // 请求体正边读边交给处理函数，读完或被放弃后为 false，由 m_stream_lock 保护。
+    shared_ptr<body_reader> m_body_reader;  // 流式请求体的接收者，处理函数没有设置时请求体读出后丢弃。
+    bool m_body_full = false;             // 这一轮接收者报告积压过多，只在读请求的线程中访问。
+    bool m_body_paused = false;           // 已暂停读请求体，等待 stream_resume_body()，由 m_stream_lock 保护。
+    bool m_body_resume = false;           // 暂停之前就收到了 stream_resume_body()，由 m_stream_lock 保护。
+    bool m_expect_continue = false;       // 请求是否带 Expect: 100-continue。
+    http_header m_headers[http_request::MAX_HEADERS];  // 请求头部，指向读缓冲区，供处理函数使用。
+    int m_header_count;                   // 已记录的请求头部数量。
+    unsigned m_request_id;                // 请求编号，每个请求开始时加一，用来识别过期的异步响应。
+    bool m_streaming;                     // 当前响应是否为流式响应。
+    bool m_stream_done;                   // 流式响应的生产者是否已写完。
+    string m_stream_buf;                  // 流式响应待发送的数据（头部和已编码的 chunk）。
+    size_t m_stream_sent;                 // m_stream_buf 中已发送的字节数。
+    locker m_stream_lock;                 // 保护流式响应状态，生产者和发送方可能在不同线程。
+    shared_ptr<stream_owner> m_stream_owner;  // 流式响应的接管者，没有时为空。
+    char m_remote_ip[INET_ADDRSTRLEN];    // 客户端 IP 的文本形式，供处理函数使用。
+    SSL *m_ssl = NULL;                    // TLS 连接的状态，明文连接为 NULL。
+    int m_file_fd = -1;                   // 内核 TLS 下用 SSL_sendfile 发送的静态文件，没有时为 -1。
+    bool m_upgrade_websocket;             // 请求是否带 Upgrade: websocket。
+    unique_ptr<ws_upgrade> m_upgrade;     // 握手成功后保留的请求信息，交给 ws_server。
+    bool m_upgrade_h2c;                   // 请求是否带 Upgrade: h2c。
+    unique_ptr<h2_upgrade> m_h2_upgrade;  // 切换到 HTTP/2 时保留的请求信息，交给 h2_server。
+    bool m_detached;                      // 101 响应已发完，连接等待交出。
     struct iovec m_iv[2];                 // 分散/聚集IO向量，用于高效地发送数据。
     int m_iv_count;                       // IO向量数量，表示 m_iv 数组中的有效元素数量。
     int cgi;                              // 是否启用POST，表示是否启用 CGI 处理。
     char *m_string;                       // 存储请求头数据，用于解析请求头。
     int bytes_to_send;                    // 待发送字节数，表示还需要发送的字节数。
     int bytes_have_send;                  // 已发送字节数，表示已经发送的字节数。
-    char *doc_root;                       // 文档根目录，存储服务器的根目录路径。
+    vhost *m_vhost = NULL;                // 当前请求所属的虚拟主机，请求头读完时按 Host 选出
+    access_timing m_timing;               // 访问日志的计时，流式响应的部分由 m_stream_lock 保护。
+    uint32_t m_reuse = 0;                 // 连接上已完成的请求数，写进访问日志。
 
     map<string, string> m_users;  // 用户信息，存储用户的数据。
     int m_TRIGMode;               // 触发模式，表示 epoll 的触发模式（ET或LT）。
@@ -0,0 +1,136 @@
+// mime.h 文件实现了扩展名到 MIME 类型的查找表。表在编译期构造成完美哈希：
+// 编译器替我们搜索一个让所有扩展名落在不同槽位的种子，运行期查找只需一次哈希和一次字符串比较。
+// 查找结果随文件缓存项保存，每个文件只解析一次。
+
+#ifndef MIME_H
+#define MIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct mime_type {
+    const char *ext;           // 小写扩展名，不含点
+    const char *content_type;  // Content-Type 头的值，文本类型带 charset
+    bool compressible;         // 是否值得即时压缩
+};
+
+// 扩展名 -> MIME 类型。新增类型直接加在表里，编译期会重新搜索种子，冲突无法消除时编译失败
+inline constexpr mime_type MIME_TYPES[] = {
+    {"html", "text/html; charset=utf-8", true},
+    {"htm", "text/html; charset=utf-8", true},
+    {"css", "text/css; charset=utf-8", true},
+    {"js", "text/javascript; charset=utf-8", true},
+    {"mjs", "text/javascript; charset=utf-8", true},
+    {"json", "application/json; charset=utf-8", true},
+    {"map", "application/json; charset=utf-8", true},
+    {"xml", "application/xml; charset=utf-8", true},
+    {"txt", "text/plain; charset=utf-8", true},
+    {"csv", "text/csv; charset=utf-8", true},
+    {"md", "text/markdown; charset=utf-8", true},
+    {"svg", "image/svg+xml", true},
+    {"ico", "image/x-icon", true},
+    {"wasm", "application/wasm", true},
+    {"png", "image/png", false},
+    {"jpg", "image/jpeg", false},
+    {"jpeg", "image/jpeg", false},
+    {"gif", "image/gif", false},
+    {"webp", "image/webp", false},
+    {"avif", "image/avif", false},
+    {"bmp", "image/bmp", false},
+    {"mp4", "video/mp4", false},
+    {"webm", "video/webm", false},
+    {"ogv", "video/ogg", false},
+    {"mp3", "audio/mpeg", false},
+    {"ogg", "audio/ogg", false},
+    {"wav", "audio/wav", false},
+    {"woff", "font/woff", false},
+    {"woff2", "font/woff2", false},
+    {"ttf", "font/ttf", true},
+    {"otf", "font/otf", true},
+    {"pdf", "application/pdf", false},
+    {"zip", "application/zip", false},
+    {"gz", "application/gzip", false},
+    {"tar", "application/x-tar", true},
+};
+
+// 未知扩展名一律按二进制流处理
+inline constexpr mime_type MIME_DEFAULT = {"", "application/octet-stream", false};
+
+constexpr size_t MIME_COUNT = sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0]);
+constexpr size_t MIME_SLOTS = 128;   // 槽位数，2 的幂
+constexpr size_t MIME_EXT_MAX = 8;   // 扩展名最大长度
+
+constexpr char mime_lower(char c) { return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c; }
+
+// 带种子的 FNV-1a，大小写不敏感
+constexpr uint32_t mime_hash(const char *s, size_t n, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (unsigned char)mime_lower(s[i]);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+constexpr size_t mime_strlen(const char *s) {
+    size_t n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+// 种子是否让所有扩展名落在不同槽位
+constexpr bool mime_seed_ok(uint32_t seed) {
+    bool used[MIME_SLOTS] = {};
+    for (size_t i = 0; i < MIME_COUNT; ++i) {
+        size_t slot = mime_hash(MIME_TYPES[i].ext, mime_strlen(MIME_TYPES[i].ext), seed) & (MIME_SLOTS - 1);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t mime_find_seed() {
+    for (uint32_t seed = 0; seed < 1000000; ++seed)
+        if (mime_seed_ok(seed)) return seed;
+    return UINT32_MAX;
+}
+
+constexpr uint32_t MIME_SEED = mime_find_seed();
+static_assert(MIME_SEED != UINT32_MAX, "no perfect hash seed for MIME_TYPES, enlarge MIME_SLOTS");
+
+// 槽位表，存 MIME_TYPES 下标 + 1，0 表示空槽
+struct mime_slot_table {
+    unsigned char slot[MIME_SLOTS];
+};
+
+constexpr mime_slot_table mime_build_slots() {
+    mime_slot_table t = {};
+    for (size_t i = 0; i < MIME_COUNT; ++i)
+        t.slot[mime_hash(MIME_TYPES[i].ext, mime_strlen(MIME_TYPES[i].ext), MIME_SEED) & (MIME_SLOTS - 1)] = i + 1;
+    return t;
+}
+
+inline constexpr mime_slot_table MIME_SLOT_TABLE = mime_build_slots();
+
+// 按扩展名（不含点，大小写不敏感）查找
+constexpr const mime_type *mime_lookup_ext(const char *ext, size_t n) {
+    if (n == 0 || n > MIME_EXT_MAX) return &MIME_DEFAULT;
+    unsigned char idx = MIME_SLOT_TABLE.slot[mime_hash(ext, n, MIME_SEED) & (MIME_SLOTS - 1)];
+    if (idx == 0) return &MIME_DEFAULT;
+    const mime_type *m = &MIME_TYPES[idx - 1];
+    for (size_t i = 0; i < n; ++i)
+        if (mime_lower(ext[i]) != m->ext[i]) return &MIME_DEFAULT;
+    return m->ext[n] == '\0' ? m : &MIME_DEFAULT;
+}
+
+static_assert(mime_lookup_ext("HTML", 4) == &MIME_TYPES[0], "mime lookup must be case-insensitive");
+
+// 按文件路径查找，取最后一个 '/' 之后的最后一个 '.' 作为扩展名
+inline const mime_type *mime_lookup(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) return &MIME_DEFAULT;
+    return mime_lookup_ext(dot + 1, strlen(dot + 1));
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "response_head.h"
+
+#include <string.h>
+
+#include <atomic>
+
+// 两位数查表，每次除以 100 写出两位
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+size_t format_uint(char *out, uint64_t v) {
+    char tmp[UINT_DIGITS_MAX];
+    char *p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        const char *d = digit_pairs + (v % 100) * 2;
+        v /= 100;
+        *--p = d[1];
+        *--p = d[0];
+    }
+    if (v >= 10) {
+        const char *d = digit_pairs + v * 2;
+        *--p = d[1];
+        *--p = d[0];
+    } else {
+        *--p = (char)('0' + v);
+    }
+    size_t len = tmp + sizeof(tmp) - p;
+    memcpy(out, p, len);
+    return len;
+}
+
+// 认识的状态码和原因短语，状态行和 status_reason() 都由这张表生成
+#define STATUS_CODES(X)               \
+    X(101, "Switching Protocols")     \
+    X(200, "OK")                      \
+    X(201, "Created")                 \
+    X(202, "Accepted")                \
+    X(204, "No Content")              \
+    X(301, "Moved Permanently")       \
+    X(302, "Found")                   \
+    X(303, "See Other")               \
+    X(304, "Not Modified")            \
+    X(307, "Temporary Redirect")      \
+    X(400, "Bad Request")             \
+    X(401, "Unauthorized")            \
+    X(403, "Forbidden")               \
+    X(404, "Not Found")               \
+    X(405, "Method Not Allowed")      \
+    X(409, "Conflict")                \
+    X(413, "Payload Too Large")       \
+    X(429, "Too Many Requests")       \
+    X(500, "Internal Error")          \
+    X(502, "Bad Gateway")             \
+    X(503, "Service Unavailable")     \
+    X(504, "Gateway Timeout")
+
+#define REASON_CASE(code, reason) \
+    case code:                    \
+        return reason;
+
+const char *status_reason(int status) {
+    switch (status) {
+        STATUS_CODES(REASON_CASE)
+        default:
+            return "Unknown";
+    }
+}
+
+#define STATUS_LINE_CASE(code, reason)                                   \
+    case code: {                                                         \
+        static const char line[] = "HTTP/1.1 " #code " " reason "\r\n"; \
+        len = sizeof(line) - 1;                                          \
+        return line;                                                     \
+    }
+
+const char *status_line(int status, size_t &len) {
+    switch (status) {
+        STATUS_CODES(STATUS_LINE_CASE)
+        default:
+            return NULL;
+    }
+}
+
+#undef STATUS_LINE_CASE
+#undef REASON_CASE
+#undef STATUS_CODES
+
+static const int DATE_SLOTS = 64;
+static char date_slots[DATE_SLOTS][http_date::LINE_LEN];
+static int date_slot = 0;
+static time_t date_sec = -1;
+static std::atomic<const char *> date_current(
+    "Date:Thu, 01 Jan 1970 00:00:00 GMT\r\n");  // update() 之前的占位，服务器启动时即被替换
+
+static void two_digits(char *out, int v) {
+    out[0] = digit_pairs[v * 2];
+    out[1] = digit_pairs[v * 2 + 1];
+}
+
+void http_date::update(time_t now) {
+    if (now == date_sec) return;
+    date_sec = now;
+    static const char week[] = "SunMonTueWedThuFriSat";
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    struct tm tm;
+    gmtime_r(&now, &tm);
+
+    date_slot = (date_slot + 1) % DATE_SLOTS;
+    char *p = date_slots[date_slot];
+    memcpy(p, "Date:", 5);
+    memcpy(p + 5, week + tm.tm_wday * 3, 3);
+    memcpy(p + 8, ", ", 2);
+    two_digits(p + 10, tm.tm_mday);
+    p[12] = ' ';
+    memcpy(p + 13, months + tm.tm_mon * 3, 3);
+    p[16] = ' ';
+    int year = tm.tm_year + 1900;
+    two_digits(p + 17, year / 100 % 100);
+    two_digits(p + 19, year % 100);
+    p[21] = ' ';
+    two_digits(p + 22, tm.tm_hour);
+    p[24] = ':';
+    two_digits(p + 25, tm.tm_min);
+    p[27] = ':';
+    two_digits(p + 28, tm.tm_sec);
+    memcpy(p + 30, " GMT\r\n", 6);
+    date_current.store(p, std::memory_order_release);
+}
+
+const char *http_date::line() { return date_current.load(std::memory_order_acquire); }
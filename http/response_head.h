@@ -0,0 +1,49 @@
+// response_head.h 文件提供拼装响应头用的常量片段、整数格式化和缓存的 Date 头。
+// 响应头全部由预先生成的片段拼成：常用状态码的整条状态行、Connection、Server 都是常量，
+// Content-Length 用 format_uint() 格式化，Date 每秒只格式化一次，响应路径上没有 printf 类调用。
+
+#ifndef RESPONSE_HEAD_H
+#define RESPONSE_HEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// 常量片段
+static const char HEAD_KEEP_ALIVE[] = "Connection:keep-alive\r\n";
+static const size_t HEAD_KEEP_ALIVE_LEN = sizeof(HEAD_KEEP_ALIVE) - 1;
+static const char HEAD_CLOSE[] = "Connection:close\r\n";
+static const size_t HEAD_CLOSE_LEN = sizeof(HEAD_CLOSE) - 1;
+static const char HEAD_SERVER[] = "Server:TinyWebServer\r\n";
+static const size_t HEAD_SERVER_LEN = sizeof(HEAD_SERVER) - 1;
+
+// 十进制整数的最大长度
+static const size_t UINT_DIGITS_MAX = 20;
+
+// 把 v 写成十进制，不加结尾的 '\0'，返回写入的字节数，out 至少 UINT_DIGITS_MAX 字节
+size_t format_uint(char *out, uint64_t v);
+
+// 常用状态码的原因短语，不认识的返回 "Unknown"
+const char *status_reason(int status);
+
+// 预先生成的状态行，如 "HTTP/1.1 200 OK\r\n"；status 不在表中时返回 NULL
+const char *status_line(int status, size_t &len);
+
+/**
+ * @brief 缓存的 Date 头（RFC 7231 7.1.1.1 的 IMF-fixdate）
+ *
+ * 只有主循环线程调用 update()，每次 epoll_wait 返回后调用一次，秒数没变时直接返回；
+ * 任何线程都可以调用 line()。新的一行写入 64 个槽位中的下一个再发布指针，
+ * 读者拿到的指针在之后 63 秒内不会被覆盖。
+ */
+class http_date {
+   public:
+    // "Date:Sun, 06 Nov 1994 08:49:37 GMT\r\n" 的长度
+    static const size_t LINE_LEN = 36;
+
+    static void update(time_t now);
+    // 当前的 Date 行，长度为 LINE_LEN，不以 '\0' 结尾
+    static const char *line();
+};
+
+#endif
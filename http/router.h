@@ -0,0 +1,210 @@
+// router.h 文件实现了一个压缩前缀树（radix tree）路由表，按请求路径查找处理方式。
+// 支持三种路由：
+//   精确路由    /2CGISQL.cgi
+//   参数路由    /users/:id/posts/:post    （":name" 匹配一个路径段）
+//   前缀路由    /static/*path             （"*name" 匹配余下全部，用于静态目录）
+// 匹配优先级为 静态 > 参数 > 前缀，同一路径可回溯尝试。查找过程不分配内存，参数以指针+长度的形式
+// 指向请求路径本身，只在本次请求内有效。与线程池一样写成模板，路由值的类型由使用者决定。
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// 一条路由最多携带的参数个数（含前缀路由的余下部分）
+static const int ROUTE_MAX_PARAMS = 8;
+
+struct route_param {
+    const char *name;   // 参数名，指向路由表中保存的字符串
+    const char *value;  // 参数值，指向请求路径
+    size_t len;         // 参数值长度
+};
+
+struct route_params {
+    route_params() : count(0) {}
+
+    // 按名字取参数，找不到返回 NULL
+    const route_param *get(const char *name) const {
+        for (int i = 0; i < count; ++i)
+            if (strcmp(items[i].name, name) == 0) return &items[i];
+        return NULL;
+    }
+
+    route_param items[ROUTE_MAX_PARAMS];
+    int count;
+};
+
+template <typename T>
+class radix_router {
+   public:
+    radix_router() : m_root(new node) {}
+    ~radix_router() { destroy(m_root); }
+
+    /**
+     * @brief 注册路由
+     * @param pattern 以 '/' 开头的路径模式，':' 和 '*' 只能出现在路径段开头，'*' 段必须是最后一段
+     * @param value 路由值，会被复制保存
+     * @return 模式非法、参数过多或与已有路由冲突时返回 false
+     */
+    bool add(const char *pattern, const T &value) {
+        if (!pattern || pattern[0] != '/') return false;
+        return insert(m_root, pattern, value, 0);
+    }
+
+    /**
+     * @brief 查找路由，不分配内存
+     * @param path 请求路径（不含查询串）
+     * @param len 路径长度
+     * @param params 输出匹配到的参数
+     * @return 路由值；没有匹配时返回 NULL
+     */
+    const T *find(const char *path, size_t len, route_params &params) const {
+        params.count = 0;
+        return match(m_root, path, path + len, params);
+    }
+
+   private:
+    struct node {
+        node() : param_child(NULL), wildcard(NULL), value(NULL) {}
+
+        std::string label;              // 压缩边上的静态字符串
+        std::string first;              // 各静态子节点 label 的首字节，与 children 一一对应
+        std::vector<node *> children;   // 静态子节点
+        node *param_child;              // ":name" 子节点
+        std::string param_name;         // 参数名
+        node *wildcard;                 // "*name" 子节点，终止节点
+        std::string wildcard_name;      // 余下部分的参数名
+        T *value;                       // 在此终止的路由
+    };
+
+    static void destroy(node *n) {
+        if (!n) return;
+        for (size_t i = 0; i < n->children.size(); ++i) destroy(n->children[i]);
+        destroy(n->param_child);
+        destroy(n->wildcard);
+        delete n->value;
+        delete n;
+    }
+
+    static bool insert(node *n, const char *p, const T &value, int nparams) {
+        if (*p == '\0') {
+            if (n->value) return false;  // 重复注册
+            n->value = new T(value);
+            return true;
+        }
+
+        if (*p == ':' || *p == '*') {
+            if (p[-1] != '/') return false;  // 只能出现在段首
+            if (++nparams > ROUTE_MAX_PARAMS) return false;
+            size_t name_len = strcspn(p + 1, "/");
+            if (name_len == 0) return false;
+            std::string name(p + 1, name_len);
+            if (*p == '*') {
+                if (p[1 + name_len] != '\0') return false;  // 必须是最后一段
+                if (n->wildcard) return false;
+                n->wildcard = new node;
+                n->wildcard_name = name;
+                n->wildcard->value = new T(value);
+                return true;
+            }
+            if (!n->param_child) {
+                n->param_child = new node;
+                n->param_name = name;
+            } else if (n->param_name != name) {
+                return false;  // 同一位置的参数名必须一致
+            }
+            return insert(n->param_child, p + 1 + name_len, value, nparams);
+        }
+
+        // 静态部分一直延伸到下一个参数段
+        size_t run = 0;
+        while (p[run] && !((p[run] == ':' || p[run] == '*') && run > 0 && p[run - 1] == '/')) ++run;
+
+        size_t idx = n->first.find(p[0]);
+        if (idx == std::string::npos) {
+            node *child = new node;
+            child->label.assign(p, run);
+            n->first.push_back(p[0]);
+            n->children.push_back(child);
+            return insert(child, p + run, value, nparams);
+        }
+
+        node *child = n->children[idx];
+        size_t k = 0;
+        while (k < run && k < child->label.size() && child->label[k] == p[k]) ++k;
+        if (k < child->label.size()) {
+            // 公共前缀比已有边短，拆分：mid 接管公共前缀，原节点保留剩余部分
+            node *mid = new node;
+            mid->label = child->label.substr(0, k);
+            child->label.erase(0, k);
+            mid->first.push_back(child->label[0]);
+            mid->children.push_back(child);
+            n->children[idx] = mid;
+            child = mid;
+        }
+        return insert(child, p + k, value, nparams);
+    }
+
+    static const T *match(const node *n, const char *p, const char *end, route_params &params) {
+        if (p == end) {
+            if (n->value) return n->value;
+            // "/static/" 这样余下部分为空也算匹配前缀路由
+            if (n->wildcard && params.count < ROUTE_MAX_PARAMS) {
+                route_param &rp = params.items[params.count++];
+                rp.name = n->wildcard_name.c_str();
+                rp.value = p;
+                rp.len = 0;
+                return n->wildcard->value;
+            }
+            return NULL;
+        }
+
+        // 1. 静态子节点
+        if (!n->first.empty()) {
+            const char *hit = (const char *)memchr(n->first.data(), *p, n->first.size());
+            if (hit) {
+                const node *child = n->children[hit - n->first.data()];
+                size_t len = child->label.size();
+                if ((size_t)(end - p) >= len && memcmp(p, child->label.data(), len) == 0) {
+                    const T *r = match(child, p + len, end, params);
+                    if (r) return r;
+                }
+            }
+        }
+
+        // 2. 参数子节点，匹配到下一个 '/' 为止的非空段
+        if (n->param_child && *p != '/' && params.count < ROUTE_MAX_PARAMS) {
+            const char *seg_end = (const char *)memchr(p, '/', end - p);
+            if (!seg_end) seg_end = end;
+            int saved = params.count;
+            route_param &rp = params.items[params.count++];
+            rp.name = n->param_name.c_str();
+            rp.value = p;
+            rp.len = seg_end - p;
+            const T *r = match(n->param_child, seg_end, end, params);
+            if (r) return r;
+            params.count = saved;  // 回溯
+        }
+
+        // 3. 前缀子节点，吞掉余下全部
+        if (n->wildcard && params.count < ROUTE_MAX_PARAMS) {
+            route_param &rp = params.items[params.count++];
+            rp.name = n->wildcard_name.c_str();
+            rp.value = p;
+            rp.len = end - p;
+            return n->wildcard->value;
+        }
+        return NULL;
+    }
+
+   private:
+    node *m_root;  // 根节点，label 为空
+
+    radix_router(const radix_router &);
+    radix_router &operator=(const radix_router &);
+};
+
+#endif
@@ -0,0 +1,153 @@
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include "vhost.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+static const size_t MB = 1 << 20;
+
+// FNV-1a，名字已转为小写
+static uint32_t name_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 主机名只允许字母、数字、'-' 和 '.'，转为小写
+static bool normalize_name(std::string &name) {
+    while (!name.empty() && name[name.size() - 1] == '.') name.erase(name.size() - 1);
+    if (name.empty() || name.size() > vhost_table::MAX_NAME) return false;
+    for (size_t i = 0; i < name.size(); ++i) {
+        char c = name[i];
+        if (!isalnum((unsigned char)c) && c != '-' && c != '.') return false;
+        name[i] = tolower((unsigned char)c);
+    }
+    return true;
+}
+
+vhost_table::~vhost_table() {
+    for (size_t i = 0; i < m_hosts.size(); ++i) delete m_hosts[i];
+}
+
+vhost *vhost_table::add_default(const std::string &doc_root, size_t max_entries, size_t cache_budget,
+                                int close_log) {
+    m_default = new vhost("", doc_root, max_entries, cache_budget, close_log);
+    m_hosts.insert(m_hosts.begin(), m_default);
+    return m_default;
+}
+
+void vhost_table::grow() {
+    std::vector<slot> old;
+    old.swap(m_slots);
+    m_slots.resize(old.empty() ? 16 : old.size() * 2);
+    for (size_t i = 0; i < m_slots.size(); ++i) m_slots[i].host = NULL;
+    m_mask = m_slots.size() - 1;
+    for (size_t i = 0; i < old.size(); ++i) {
+        if (old[i].name.empty()) continue;
+        size_t pos = old[i].hash & m_mask;
+        while (!m_slots[pos].name.empty()) pos = (pos + 1) & m_mask;
+        m_slots[pos].hash = old[i].hash;
+        m_slots[pos].name.swap(old[i].name);
+        m_slots[pos].host = old[i].host;
+    }
+}
+
+bool vhost_table::add_name(const std::string &name, vhost *host) {
+    if (lookup(name.data(), name.size())) return false;
+    if ((m_count + 1) * 2 > m_slots.size()) grow();  // 装载率不超过 1/2
+    uint32_t hash = name_hash(name.data(), name.size());
+    size_t pos = hash & m_mask;
+    while (!m_slots[pos].name.empty()) pos = (pos + 1) & m_mask;
+    m_slots[pos].hash = hash;
+    m_slots[pos].name = name;
+    m_slots[pos].host = host;
+    ++m_count;
+    return true;
+}
+
+vhost *vhost_table::lookup(const char *name, size_t len) const {
+    if (m_slots.empty()) return NULL;
+    uint32_t hash = name_hash(name, len);
+    for (size_t pos = hash & m_mask;; pos = (pos + 1) & m_mask) {
+        const slot &s = m_slots[pos];
+        if (s.name.empty()) return NULL;
+        if (s.hash == hash && s.name.size() == len && memcmp(s.name.data(), name, len) == 0) return s.host;
+    }
+}
+
+vhost *vhost_table::find(const char *host, size_t len) const {
+    if (!host || m_count == 0) return m_default;
+    while (len > 0 && (host[len - 1] == ' ' || host[len - 1] == '\t')) --len;
+    // 去掉端口：IPv6 字面量带方括号，其余情况第一个 ':' 之后都是端口
+    size_t end = 0;
+    if (len > 0 && host[0] == '[') {
+        while (end < len && host[end] != ']') ++end;
+        if (end < len) ++end;
+    } else {
+        while (end < len && host[end] != ':') ++end;
+    }
+    while (end > 0 && host[end - 1] == '.') --end;
+    if (end == 0 || end > MAX_NAME) return m_default;
+
+    char name[MAX_NAME];
+    for (size_t i = 0; i < end; ++i) name[i] = tolower((unsigned char)host[i]);
+    vhost *h = lookup(name, end);
+    return h ? h : m_default;
+}
+
+bool vhost_table::configure(const std::vector<std::string> &specs, int close_log) {
+    m_close_log = close_log;
+    for (size_t i = 0; i < specs.size(); ++i) {
+        const std::string &spec = specs[i];
+        size_t eq = spec.find('=');
+        if (eq == std::string::npos || eq == 0) return false;
+        std::string names = spec.substr(0, eq);
+        std::string root = spec.substr(eq + 1);
+
+        // 可选的缓存配置：@缓存MB[:缓存文件数]
+        size_t budget = 32 * MB, entries = 1024;
+        size_t at = root.rfind('@');
+        if (at != std::string::npos) {
+            char *end;
+            std::string opt = root.substr(at + 1);
+            root.erase(at);
+            long mb = strtol(opt.c_str(), &end, 10);
+            if (end == opt.c_str() || mb < 0) return false;
+            budget = (size_t)mb * MB;
+            if (*end == ':') {
+                const char *p = end + 1;
+                long n = strtol(p, &end, 10);
+                if (end == p || n <= 0) return false;
+                entries = (size_t)n;
+            }
+            if (*end != '\0') return false;
+        }
+
+        while (root.size() > 1 && root[root.size() - 1] == '/') root.erase(root.size() - 1);
+        struct stat st;
+        if (root.empty() || stat(root.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) return false;
+
+        std::vector<std::string> list;
+        for (size_t start = 0; start <= names.size();) {
+            size_t comma = names.find(',', start);
+            if (comma == std::string::npos) comma = names.size();
+            std::string name = names.substr(start, comma - start);
+            if (!normalize_name(name)) return false;
+            list.push_back(name);
+            start = comma + 1;
+        }
+
+        vhost *host = new vhost(list[0], root, entries, budget, close_log);
+        m_hosts.push_back(host);
+        for (size_t j = 0; j < list.size(); ++j) {
+            if (!add_name(list[j], host)) return false;
+        }
+        LOG_INFO("vhost %s -> %s (cache %zu entries, %zuMB)", names.c_str(), root.c_str(), entries, budget / MB);
+    }
+    return true;
+}
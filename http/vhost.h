@@ -0,0 +1,84 @@
+/**
+ * @file vhost.h
+ * @brief 基于名字的虚拟主机
+ *
+ * 一个进程承载多个小站点，共用事件循环和线程池。
+ * 主要特点：
+ * 1. 每个虚拟主机有自己的文档根目录、路由表和静态文件缓存（缓存项个数和即时压缩的内存预算分别配置）
+ * 2. 按 Host 头（HTTP/2 为 :authority）选择主机：转小写、去掉端口和末尾的 '.' 后查哈希表，
+ *    开放寻址，查找过程不分配内存
+ * 3. Host 缺失或不匹配任何名字的请求交给默认主机，即原来的 ./root 站点
+ * 4. 启动后只读，各线程查找不加锁
+ */
+
+#ifndef VHOST_H
+#define VHOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "http_conn.h"
+
+// 一个虚拟主机
+struct vhost {
+    vhost(const std::string &name, const std::string &doc_root, size_t max_entries, size_t cache_budget,
+          int close_log)
+        : name(name), doc_root(doc_root), cache(max_entries, cache_budget, close_log) {}
+
+    std::string name;          // 第一个名字，用于日志；默认主机为空
+    std::string doc_root;      // 文档根目录，不以 '/' 结尾
+    http_conn::router router;  // 路由表，启动后只读
+    file_cache cache;          // 静态文件缓存
+};
+
+class vhost_table {
+   public:
+    static const size_t MAX_NAME = 255;  // 主机名的最大长度（RFC 1035）
+
+    vhost_table() : m_mask(0), m_count(0), m_default(NULL), m_close_log(0) {}
+    ~vhost_table();
+
+    // 创建默认主机，只调用一次
+    vhost *add_default(const std::string &doc_root, size_t max_entries, size_t cache_budget, int close_log);
+
+    /**
+     * @brief 解析 -v 配置并创建虚拟主机
+     * @param specs 每项形如 名字[,别名...]=文档根目录[@缓存MB[:缓存文件数]]
+     * @return 格式错误、目录不存在或名字重复时返回 false
+     */
+    bool configure(const std::vector<std::string> &specs, int close_log);
+
+    // 按 Host 头的值查找，找不到时返回默认主机；host 为 NULL 表示请求没有 Host 头
+    vhost *find(const char *host, size_t len) const;
+    vhost *find(const char *host) const { return find(host, host ? strlen(host) : 0); }
+    // 按名字精确查找（名字已规范化），找不到时返回 NULL
+    vhost *lookup(const char *name, size_t len) const;
+
+    vhost *default_host() const { return m_default; }
+    // 所有主机，默认主机在最前面
+    const std::vector<vhost *> &hosts() const { return m_hosts; }
+
+   private:
+    struct slot {
+        uint32_t hash;
+        std::string name;  // 空表示空槽
+        vhost *host;
+    };
+
+    bool add_name(const std::string &name, vhost *host);
+    void grow();
+
+   private:
+    std::vector<slot> m_slots;  // 开放寻址的哈希表，大小为 2 的幂
+    size_t m_mask;              // m_slots.size() - 1
+    size_t m_count;             // 已用槽数
+    std::vector<vhost *> m_hosts;
+    vhost *m_default;
+    int m_close_log;  // 日志开关
+};
+
+#endif
@@ -0,0 +1,344 @@
+/**
+ * @file hpack.cpp
+ * @brief HTTP/2 头部压缩的实现
+ */
+
+#include "hpack.h"
+
+// 静态表（RFC 7541 附录 A），下标 0 对应索引 1
+static const hpack_header static_table[hpack_table::STATIC_SIZE] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// 霍夫曼码长（RFC 7541 附录 B），下标为符号，256 为 EOS
+static const unsigned char huffman_bits[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+static const int HUFFMAN_MAX_BITS = 30;
+static const int HUFFMAN_EOS = 256;
+
+// 由码长生成的规范霍夫曼码表：同一码长的码字按符号顺序连续分配，码长增加时左移一位
+struct huffman_code {
+    uint32_t code[257];                    // 各符号的码字
+    uint32_t first[HUFFMAN_MAX_BITS + 1];  // 每种码长的第一个码字
+    int count[HUFFMAN_MAX_BITS + 1];       // 每种码长的符号个数
+    int offset[HUFFMAN_MAX_BITS + 1];      // 每种码长的第一个符号在 symbols 中的位置
+    int symbols[257];                      // 按 (码长, 符号) 排序的符号
+
+    huffman_code() {
+        uint32_t next = 0;
+        int n = 0;
+        for (int bits = 1; bits <= HUFFMAN_MAX_BITS; ++bits) {
+            first[bits] = next;
+            offset[bits] = n;
+            count[bits] = 0;
+            for (int s = 0; s < 257; ++s) {
+                if (huffman_bits[s] != bits) continue;
+                code[s] = next++;
+                symbols[n++] = s;
+                ++count[bits];
+            }
+            next <<= 1;
+        }
+    }
+};
+
+static const huffman_code &huffman() {
+    static const huffman_code table;
+    return table;
+}
+
+size_t huffman_length(std::string_view s) {
+    size_t bits = 0;
+    for (size_t i = 0; i < s.size(); ++i) bits += huffman_bits[(unsigned char)s[i]];
+    return (bits + 7) / 8;
+}
+
+void huffman_encode(std::string &out, std::string_view s) {
+    const huffman_code &h = huffman();
+    uint64_t acc = 0;
+    int n = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = s[i];
+        acc = (acc << huffman_bits[c]) | h.code[c];
+        n += huffman_bits[c];
+        while (n >= 8) {
+            n -= 8;
+            out.push_back((char)(acc >> n));
+        }
+        acc &= (1u << n) - 1;
+    }
+    // 不足一个字节的部分用 EOS 的前缀（全 1）填充
+    if (n > 0) out.push_back((char)((acc << (8 - n)) | ((1u << (8 - n)) - 1)));
+}
+
+bool huffman_decode(const unsigned char *data, size_t len, std::string &out) {
+    const huffman_code &h = huffman();
+    uint32_t code = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; ++i) {
+        for (int b = 7; b >= 0; --b) {
+            code = (code << 1) | ((data[i] >> b) & 1);
+            ++bits;
+            if (code - h.first[bits] < (uint32_t)h.count[bits]) {
+                int sym = h.symbols[h.offset[bits] + code - h.first[bits]];
+                if (sym == HUFFMAN_EOS) return false;
+                out.push_back((char)sym);
+                code = 0;
+                bits = 0;
+            } else if (bits == HUFFMAN_MAX_BITS) {
+                return false;
+            }
+        }
+    }
+    // 结尾的填充最多 7 位且必须全为 1
+    return bits <= 7 && code == (1u << bits) - 1;
+}
+
+// 整数编码（RFC 7541 5.1），flags 为首字节前缀之外的高位
+static void encode_int(std::string &out, unsigned char flags, int prefix, uint64_t value) {
+    uint64_t max = (1u << prefix) - 1;
+    if (value < max) {
+        out.push_back((char)(flags | value));
+        return;
+    }
+    out.push_back((char)(flags | max));
+    value -= max;
+    while (value >= 128) {
+        out.push_back((char)(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+static bool decode_int(const unsigned char *&p, const unsigned char *end, int prefix, uint64_t &value) {
+    if (p >= end) return false;
+    uint64_t max = (1u << prefix) - 1;
+    value = *p++ & max;
+    if (value < max) return true;
+    for (int shift = 0; p < end && shift <= 28; shift += 7) {
+        unsigned char b = *p++;
+        value += (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;  // 数据不完整或超过 32 位
+}
+
+// 字符串编码：霍夫曼编码更短时使用霍夫曼编码
+static void encode_string(std::string &out, std::string_view s) {
+    size_t hlen = huffman_length(s);
+    if (hlen < s.size()) {
+        encode_int(out, 0x80, 7, hlen);
+        huffman_encode(out, s);
+    } else {
+        encode_int(out, 0, 7, s.size());
+        out.append(s.data(), s.size());
+    }
+}
+
+static bool decode_string(const unsigned char *&p, const unsigned char *end, std::string &out) {
+    if (p >= end) return false;
+    bool huff = *p & 0x80;
+    uint64_t len;
+    if (!decode_int(p, end, 7, len) || len > (uint64_t)(end - p)) return false;
+    out.clear();
+    if (huff) {
+        if (!huffman_decode(p, len, out)) return false;
+    } else {
+        out.assign((const char *)p, len);
+    }
+    p += len;
+    return true;
+}
+
+const hpack_header *hpack_table::get(size_t index) const {
+    if (index == 0) return NULL;
+    if (index <= STATIC_SIZE) return &static_table[index - 1];
+    index -= STATIC_SIZE + 1;
+    return index < m_entries.size() ? &m_entries[index] : NULL;
+}
+
+void hpack_table::add(std::string_view name, std::string_view value) {
+    size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+    if (size > m_max_size) {
+        evict(0);
+        return;
+    }
+    evict(m_max_size - size);
+    hpack_header h;
+    h.name.assign(name.data(), name.size());
+    h.value.assign(value.data(), value.size());
+    m_entries.push_front(std::move(h));
+    m_size += size;
+}
+
+void hpack_table::resize(size_t max_size) {
+    m_max_size = max_size;
+    evict(max_size);
+}
+
+void hpack_table::evict(size_t limit) {
+    while (m_size > limit && !m_entries.empty()) {
+        const hpack_header &last = m_entries.back();
+        m_size -= last.name.size() + last.value.size() + ENTRY_OVERHEAD;
+        m_entries.pop_back();
+    }
+}
+
+size_t hpack_table::find(std::string_view name, std::string_view value, size_t &name_index) const {
+    name_index = 0;
+    for (size_t i = 0; i < STATIC_SIZE; ++i) {
+        if (static_table[i].name != name) continue;
+        if (static_table[i].value == value) return i + 1;
+        if (!name_index) name_index = i + 1;
+    }
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (m_entries[i].name != name) continue;
+        if (m_entries[i].value == value) return STATIC_SIZE + 1 + i;
+        if (!name_index) name_index = STATIC_SIZE + 1 + i;
+    }
+    return 0;
+}
+
+bool hpack_decoder::decode(const unsigned char *data, size_t len, std::vector<hpack_header> &out,
+                           size_t max_list_size) {
+    const unsigned char *p = data, *end = data + len;
+    size_t list_size = 0;
+    bool seen_header = false;
+    while (p < end) {
+        unsigned char b = *p;
+        uint64_t index;
+        if (b & 0x80) {  // 索引
+            if (!decode_int(p, end, 7, index)) return false;
+            const hpack_header *h = m_table.get(index);
+            if (!h) return false;
+            out.push_back(*h);
+        } else if ((b & 0xE0) == 0x20) {  // 动态表大小更新，只能出现在头部块开头
+            if (seen_header || !decode_int(p, end, 5, index) || index > m_limit) return false;
+            m_table.resize(index);
+            continue;
+        } else {
+            // 01 增量索引，0000 不索引，0001 永不索引
+            bool incremental = b & 0x40;
+            if (!decode_int(p, end, incremental ? 6 : 4, index)) return false;
+            hpack_header h;
+            if (index) {
+                const hpack_header *named = m_table.get(index);
+                if (!named) return false;
+                h.name = named->name;
+            } else if (!decode_string(p, end, h.name)) {
+                return false;
+            }
+            if (!decode_string(p, end, h.value)) return false;
+            if (incremental) m_table.add(h.name, h.value);
+            out.push_back(std::move(h));
+        }
+        seen_header = true;
+        list_size += out.back().name.size() + out.back().value.size() + hpack_table::ENTRY_OVERHEAD;
+        if (list_size > max_list_size) return false;
+    }
+    return true;
+}
+
+void hpack_encoder::set_max_size(size_t size) {
+    if (size > 4096) size = 4096;  // 编码器不需要比默认更大的表
+    if (size == m_table.max_size()) return;
+    m_table.resize(size);
+    m_resized = true;
+}
+
+void hpack_encoder::begin(std::string &out) {
+    if (!m_resized) return;
+    encode_int(out, 0x20, 5, m_table.max_size());
+    m_resized = false;
+}
+
+void hpack_encoder::encode(std::string &out, std::string_view name, std::string_view value, bool index) {
+    size_t name_index;
+    size_t full = m_table.find(name, value, name_index);
+    if (full) {
+        encode_int(out, 0x80, 7, full);
+        return;
+    }
+    encode_int(out, index ? 0x40 : 0x00, index ? 6 : 4, name_index);
+    if (!name_index) encode_string(out, name);
+    encode_string(out, value);
+    if (index) m_table.add(name, value);
+}
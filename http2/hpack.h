@@ -0,0 +1,100 @@
+/**
+ * @file hpack.h
+ * @brief HTTP/2 头部压缩（RFC 7541）
+ *
+ * 主要特点：
+ * 1. 静态表 61 项与动态表统一按 1 起始编号，动态表按 RFC 规定的每项 32 字节开销计算大小，
+ *    超出上限时从最旧的一项开始淘汰
+ * 2. HPACK 的霍夫曼码是规范霍夫曼码，源码只保存 257 个符号的码长，第一次使用时生成码表；
+ *    解码逐位比较各码长的首码，不需要展开解码树
+ * 3. 编码器对重复出现的头部（content-type、vary 等）使用增量索引，同一连接上后续响应只需一个字节；
+ *    content-length 之类每次都变的值不入表，免得挤掉有用的项
+ * 4. 编码器和解码器都只属于一条连接，不加锁
+ */
+
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct hpack_header {
+    std::string name;   // 小写的头部名，伪头部以 ':' 开头
+    std::string value;  // 头部值
+};
+
+// 静态表加动态表
+class hpack_table {
+   public:
+    static const size_t STATIC_SIZE = 61;  // 静态表项数
+    static const size_t ENTRY_OVERHEAD = 32;  // 每项在大小计算中的额外开销
+
+    explicit hpack_table(size_t max_size) : m_size(0), m_max_size(max_size) {}
+
+    // 按索引取出一项，索引从 1 开始，越界返回 NULL
+    const hpack_header *get(size_t index) const;
+    // 插入动态表，单项超过上限时清空动态表
+    void add(std::string_view name, std::string_view value);
+    // 修改动态表上限，淘汰超出的项
+    void resize(size_t max_size);
+    size_t max_size() const { return m_max_size; }
+
+    // 查找完全匹配的项，返回其索引；没有时返回 0，name_index 为只有名字匹配的索引（也可能为 0）
+    size_t find(std::string_view name, std::string_view value, size_t &name_index) const;
+
+   private:
+    void evict(size_t limit);
+
+   private:
+    std::deque<hpack_header> m_entries;  // 动态表，最新的在前
+    size_t m_size;                       // 动态表当前大小
+    size_t m_max_size;                   // 动态表上限
+};
+
+class hpack_decoder {
+   public:
+    // max_size 为本端通过 SETTINGS_HEADER_TABLE_SIZE 允许的动态表上限
+    explicit hpack_decoder(size_t max_size = 4096) : m_table(max_size), m_limit(max_size) {}
+
+    /**
+     * @brief 解码一个完整的头部块
+     * @param out 解出的头部，追加在末尾
+     * @param max_list_size 头部列表的大小上限（按 RFC 7540 的计算方式），超过时失败
+     * @return 格式错误、索引越界或超过上限时返回 false，调用者应以 COMPRESSION_ERROR 关闭连接
+     */
+    bool decode(const unsigned char *data, size_t len, std::vector<hpack_header> &out, size_t max_list_size);
+
+   private:
+    hpack_table m_table;  // 解码用的表
+    size_t m_limit;       // 对端能设置的动态表上限
+};
+
+class hpack_encoder {
+   public:
+    hpack_encoder() : m_table(4096), m_resized(false) {}
+
+    // 对端 SETTINGS_HEADER_TABLE_SIZE 变化，下一个头部块开头会输出表大小更新
+    void set_max_size(size_t size);
+    // 开始一个头部块
+    void begin(std::string &out);
+    // 编码一个头部，name 必须是小写；index 为 false 时不加入动态表
+    void encode(std::string &out, std::string_view name, std::string_view value, bool index = true);
+
+   private:
+    hpack_table m_table;  // 编码用的表
+    bool m_resized;       // 是否有尚未告知对端的表大小变化
+};
+
+// 霍夫曼编码后的字节数
+size_t huffman_length(std::string_view s);
+// 霍夫曼编码，追加到 out
+void huffman_encode(std::string &out, std::string_view s);
+// 霍夫曼解码，追加到 out；出现 EOS、填充超过 7 位或填充不全为 1 时返回 false
+bool huffman_decode(const unsigned char *data, size_t len, std::string &out);
+
+#endif
@@ -0,0 +1,1434 @@
+/**
+ * @file http2.cpp
+ * @brief 明文 HTTP/2 服务端的实现
+ */
+
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include "http2.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "../http/http_conn.h"
+#include "../http/response_head.h"
+#include "../http/vhost.h"
+#include "../log/log.h"
+
+static const uint8_t FLAG_END_STREAM = 0x1;   // DATA、HEADERS
+static const uint8_t FLAG_ACK = 0x1;          // SETTINGS、PING
+static const uint8_t FLAG_END_HEADERS = 0x4;  // HEADERS、CONTINUATION
+static const uint8_t FLAG_PADDED = 0x8;       // DATA、HEADERS
+static const uint8_t FLAG_PRIORITY = 0x20;    // HEADERS
+
+static const uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+static const uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+static const uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+static const uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+static const uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+static const uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+static const int64_t MAX_WINDOW = 0x7fffffff;     // 流控窗口的上限
+static const uint32_t DEFAULT_WINDOW = 65535;     // 协议规定的初始窗口
+static const uint32_t MAX_SEND_FRAME = 65536;     // 本端发出的 DATA 帧上限，对端允许更大时也不超过它
+static const size_t OUT_HIGH = 64 * 1024;         // 发送缓冲区超过这个值就不再分帧
+static const int MAX_READS = 16;                  // 一次事件最多读多少次，避免一条连接独占主循环
+static const int MAX_WRITES = 16;                 // 一次最多发送多少轮，其余等写事件
+
+// 请求方法名，下标与 http_conn::METHOD 一致
+static const char *method_names[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"};
+
+static inline uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void put32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static inline void put_setting(unsigned char *p, uint16_t id, uint32_t v) {
+    p[0] = id >> 8;
+    p[1] = id;
+    put32(p + 2, v);
+}
+
+bool h2_settings_decode(std::string_view in, std::string &out) {
+    out.clear();
+    uint32_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < in.size(); ++i) {
+        char c = in[i];
+        int v;
+        if (c >= 'A' && c <= 'Z')
+            v = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            v = c - '0' + 52;
+        else if (c == '-' || c == '+')
+            v = 62;
+        else if (c == '_' || c == '/')
+            v = 63;
+        else if (c == '=')
+            break;  // 宽容地接受带填充的写法
+        else
+            return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    return out.size() % 6 == 0;
+}
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// 连接的建立与接收
+
+void h2_session::start(int fd, std::unique_ptr<h2_upgrade> info, int close_log) {
+    m_fd = fd;
+    m_active = true;
+    m_close_log = close_log;
+    m_remote_addr = info->remote_addr;
+    if (inet_pton(AF_INET, m_remote_addr.c_str(), &m_addr) != 1) m_addr = 0;
+    m_reuse = 0;
+    m_event_us = 0;
+    access_log::stamp(m_event_us);  // Upgrade 请求作为流 1，从这里开始计时
+    m_in = std::move(info->pending);
+    m_out.clear();
+    m_out_off = 0;
+    m_armed = EPOLLIN | EPOLLRDHUP;
+    m_dead = false;
+    m_closing = false;
+    m_goaway_received = false;
+    m_preface = false;
+    m_settings_received = false;
+    m_last_active = time(NULL);
+    m_decoder = hpack_decoder();
+    m_encoder = hpack_encoder();
+    m_header_block.clear();
+    m_header_stream = 0;
+    m_header_flags = 0;
+    m_last_stream = 0;
+    m_send_window = DEFAULT_WINDOW;
+    m_peer_initial_window = DEFAULT_WINDOW;
+    m_peer_max_frame = H2_MAX_FRAME;
+    m_recv_window = H2_CONN_WINDOW;
+    m_recv_consumed = 0;
+
+    // 服务器的第一个帧必须是 SETTINGS；连接级接收窗口只能通过 WINDOW_UPDATE 扩大
+    unsigned char settings[18];
+    put_setting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, H2_MAX_STREAMS);
+    put_setting(settings + 6, SETTINGS_INITIAL_WINDOW_SIZE, H2_MAX_BODY);
+    put_setting(settings + 12, SETTINGS_MAX_HEADER_LIST_SIZE, H2_MAX_HEADER_LIST);
+    write_frame(H2_SETTINGS, 0, 0, settings, sizeof(settings));
+    unsigned char inc[4];
+    put32(inc, H2_CONN_WINDOW - DEFAULT_WINDOW);
+    write_frame(H2_WINDOW_UPDATE, 0, 0, inc, sizeof(inc));
+
+    if (info->prior_knowledge) return;
+
+    // Upgrade: h2c：HTTP2-Settings 相当于客户端的第一个 SETTINGS（不需要确认），原请求成为半关闭的流 1
+    if (!apply_settings((const unsigned char *)info->settings.data(), info->settings.size())) return;
+    h2_stream *s = open_stream(1);
+    m_last_stream = 1;
+    s->headers.swap(info->headers);
+    s->remote_closed = true;
+    if (validate(*s))
+        dispatch(*s);
+    else
+        reset_stream(*s, H2_PROTOCOL_ERROR);
+}
+
+void h2_session::on_io(int, uint32_t events) {
+    m_armed = 0;  // EPOLLONESHOT：事件触发后需要重新注册
+    if (m_dead) return;
+    access_log::stamp(m_event_us);
+    if (events & EPOLLERR) {
+        kill();
+        return;
+    }
+    ++m_busy;  // 处理请求期间只生成帧，结束后统一分帧发送
+    bool ok = true;
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) ok = read();
+    --m_busy;
+    if (ok) pump();
+}
+
+bool h2_session::read() {
+    char *buf = h2_server::get_instance()->buffer();
+    for (int round = 0; round < MAX_READS; ++round) {
+        ssize_t n = recv(m_fd, buf, h2_server::BUFFER_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            kill();
+            return false;
+        }
+        if (n == 0) {
+            kill();
+            return false;
+        }
+        m_last_active = time(NULL);
+        if (m_closing) continue;  // 已发送 GOAWAY，丢弃之后的数据
+        m_in.append(buf, n);
+        if (!process_input()) return false;
+        if ((size_t)n < h2_server::BUFFER_SIZE) break;
+    }
+    return true;
+}
+
+// 处理 m_in 中所有完整的帧，不完整的帧尾留到下次
+bool h2_session::process_input() {
+    size_t pos = 0;
+    if (!m_preface) {
+        size_t n = std::min(m_in.size(), H2_PREFACE_LEN);
+        if (memcmp(m_in.data(), H2_PREFACE, n) != 0) {
+            LOG_INFO("http2: bad connection preface from %s", m_remote_addr.c_str());
+            kill();
+            return false;
+        }
+        if (n < H2_PREFACE_LEN) return true;
+        m_preface = true;
+        pos = H2_PREFACE_LEN;
+    }
+
+    const unsigned char *base = (const unsigned char *)m_in.data();
+    while (!m_closing && !m_dead && m_in.size() - pos >= H2_FRAME_HEADER) {
+        const unsigned char *h = base + pos;
+        uint32_t len = ((uint32_t)h[0] << 16) | ((uint32_t)h[1] << 8) | h[2];
+        if (len > H2_MAX_FRAME) {
+            connection_error(H2_FRAME_SIZE_ERROR, "frame too large");
+            break;
+        }
+        if (m_in.size() - pos - H2_FRAME_HEADER < len) break;
+        pos += H2_FRAME_HEADER + len;
+        if (!handle_frame(h[3], h[4], get32(h + 5) & 0x7fffffff, h + H2_FRAME_HEADER, len)) break;
+    }
+    if (m_closing)
+        m_in.clear();
+    else
+        m_in.erase(0, pos);
+    return !m_dead;
+}
+
+bool h2_session::handle_frame(uint8_t type, uint8_t flags, uint32_t sid, const unsigned char *p, size_t len) {
+    if (m_header_stream && type != H2_CONTINUATION)
+        return connection_error(H2_PROTOCOL_ERROR, "expected CONTINUATION");
+    if (!m_settings_received && type != H2_SETTINGS)
+        return connection_error(H2_PROTOCOL_ERROR, "first frame is not SETTINGS");
+
+    switch (type) {
+        case H2_DATA:
+            return on_data(flags, sid, p, len);
+        case H2_HEADERS:
+            return on_headers(flags, sid, p, len);
+        case H2_PRIORITY:  // 不做优先级调度，所有流轮转
+            if (sid == 0) return connection_error(H2_PROTOCOL_ERROR, "PRIORITY on stream 0");
+            if (len != 5) send_rst(sid, H2_FRAME_SIZE_ERROR);
+            return true;
+        case H2_RST_STREAM: {
+            if (sid == 0) return connection_error(H2_PROTOCOL_ERROR, "RST_STREAM on stream 0");
+            if (len != 4) return connection_error(H2_FRAME_SIZE_ERROR, "bad RST_STREAM");
+            if (sid > m_last_stream) return connection_error(H2_PROTOCOL_ERROR, "RST_STREAM on idle stream");
+            auto it = m_streams.find(sid);
+            if (it != m_streams.end()) reset_stream(it->second, get32(p), false);
+            return true;
+        }
+        case H2_SETTINGS:
+            return on_settings(flags, sid, p, len);
+        case H2_PUSH_PROMISE:
+            return connection_error(H2_PROTOCOL_ERROR, "PUSH_PROMISE from client");
+        case H2_PING:
+            if (sid != 0) return connection_error(H2_PROTOCOL_ERROR, "PING on a stream");
+            if (len != 8) return connection_error(H2_FRAME_SIZE_ERROR, "bad PING");
+            if (!(flags & FLAG_ACK)) write_frame(H2_PING, FLAG_ACK, 0, p, 8);
+            return true;
+        case H2_GOAWAY:
+            if (sid != 0) return connection_error(H2_PROTOCOL_ERROR, "GOAWAY on a stream");
+            if (len < 8) return connection_error(H2_FRAME_SIZE_ERROR, "bad GOAWAY");
+            m_goaway_received = true;  // 进行中的流照常完成，之后关闭
+            return true;
+        case H2_WINDOW_UPDATE:
+            return on_window_update(sid, p, len);
+        case H2_CONTINUATION:
+            return on_continuation(flags, sid, p, len);
+        default:
+            return true;  // 未知类型的帧必须忽略
+    }
+}
+
+bool h2_session::on_headers(uint8_t flags, uint32_t sid, const unsigned char *p, size_t len) {
+    if (sid == 0 || (sid & 1) == 0) return connection_error(H2_PROTOCOL_ERROR, "bad stream id");
+    size_t off = 0, pad = 0;
+    if (flags & FLAG_PADDED) {
+        if (len < 1) return connection_error(H2_FRAME_SIZE_ERROR, "bad HEADERS");
+        pad = p[0];
+        off = 1;
+    }
+    if (flags & FLAG_PRIORITY) off += 5;  // 依赖关系和权重，不使用
+    if (off + pad > len) return connection_error(H2_PROTOCOL_ERROR, "bad padding");
+    m_header_block.assign((const char *)p + off, len - off - pad);
+    m_header_stream = sid;
+    m_header_flags = flags;
+    if (flags & FLAG_END_HEADERS) return end_headers();
+    return true;
+}
+
+bool h2_session::on_continuation(uint8_t flags, uint32_t sid, const unsigned char *p, size_t len) {
+    if (m_header_stream == 0 || sid != m_header_stream)
+        return connection_error(H2_PROTOCOL_ERROR, "unexpected CONTINUATION");
+    if (m_header_block.size() + len > 2 * H2_MAX_HEADER_LIST)  // 压缩后仍超过上限，不必再解码
+        return connection_error(H2_ENHANCE_YOUR_CALM, "header block too large");
+    m_header_block.append((const char *)p, len);
+    if (flags & FLAG_END_HEADERS) return end_headers();
+    return true;
+}
+
+// 头部块已完整：解码（即使流被拒绝也必须解码，以保持动态表一致），然后打开流或处理 trailer
+bool h2_session::end_headers() {
+    uint32_t sid = m_header_stream;
+    bool end_stream = m_header_flags & FLAG_END_STREAM;
+    m_header_stream = 0;
+    std::vector<hpack_header> headers;
+    if (!m_decoder.decode((const unsigned char *)m_header_block.data(), m_header_block.size(), headers,
+                          H2_MAX_HEADER_LIST))
+        return connection_error(H2_COMPRESSION_ERROR, "bad header block");
+    m_header_block.clear();
+
+    auto it = m_streams.find(sid);
+    if (it != m_streams.end()) {  // 请求体之后的 trailer，内容不使用
+        h2_stream &s = it->second;
+        if (s.remote_closed) {
+            reset_stream(s, H2_STREAM_CLOSED);
+        } else if (!end_stream) {
+            reset_stream(s, H2_PROTOCOL_ERROR);
+        } else {
+            s.remote_closed = true;
+            if (!s.dispatched) dispatch(s);
+        }
+        return true;
+    }
+    if (sid <= m_last_stream) return connection_error(H2_STREAM_CLOSED, "HEADERS on closed stream");
+    m_last_stream = sid;
+    if (m_goaway_received || m_closing) return true;
+    if (m_streams.size() >= H2_MAX_STREAMS) {
+        send_rst(sid, H2_REFUSED_STREAM);
+        return true;
+    }
+
+    h2_stream *s = open_stream(sid);
+    s->headers.swap(headers);
+    s->remote_closed = end_stream;
+    if (!validate(*s)) {
+        reset_stream(*s, H2_PROTOCOL_ERROR);
+        return true;
+    }
+    if (s->expected > (long)H2_MAX_BODY) {  // 请求体声明的长度已超过上限，不必等它发完
+        s->dispatched = true;
+        respond_simple(*s, 413, "text/plain; charset=utf-8", "Request body too large.\n");
+        return true;
+    }
+    if (end_stream) dispatch(*s);
+    return true;
+}
+
+bool h2_session::on_data(uint8_t flags, uint32_t sid, const unsigned char *p, size_t len) {
+    if (sid == 0) return connection_error(H2_PROTOCOL_ERROR, "DATA on stream 0");
+    if ((int64_t)len > m_recv_window) return connection_error(H2_FLOW_CONTROL_ERROR, "connection window exceeded");
+    m_recv_window -= len;  // 整个负载（含填充）都计入流控
+    m_recv_consumed += len;
+
+    size_t off = 0, pad = 0;
+    if (flags & FLAG_PADDED) {
+        if (len < 1) return connection_error(H2_FRAME_SIZE_ERROR, "bad DATA");
+        pad = p[0];
+        off = 1;
+        if (off + pad > len) return connection_error(H2_PROTOCOL_ERROR, "bad padding");
+    }
+    auto it = m_streams.find(sid);
+    if (it == m_streams.end() || it->second.remote_closed) {
+        if (sid > m_last_stream) return connection_error(H2_PROTOCOL_ERROR, "DATA on idle stream");
+        send_rst(sid, H2_STREAM_CLOSED);
+        return true;
+    }
+    h2_stream &s = it->second;
+    if (!s.dispatched) {
+        size_t n = len - off - pad;
+        if (s.body.size() + n > H2_MAX_BODY) {
+            s.dispatched = true;
+            respond_simple(s, 413, "text/plain; charset=utf-8", "Request body too large.\n");
+        } else {
+            s.body.append((const char *)p + off, n);
+        }
+    }
+    if (flags & FLAG_END_STREAM) {
+        s.remote_closed = true;
+        if (!s.dispatched) {
+            if (s.expected >= 0 && (size_t)s.expected != s.body.size())
+                reset_stream(s, H2_PROTOCOL_ERROR);  // 请求体长度与 content-length 不符
+            else
+                dispatch(s);
+        }
+    }
+    return true;
+}
+
+bool h2_session::on_settings(uint8_t flags, uint32_t sid, const unsigned char *p, size_t len) {
+    if (sid != 0) return connection_error(H2_PROTOCOL_ERROR, "SETTINGS on a stream");
+    if (flags & FLAG_ACK) {
+        if (len != 0) return connection_error(H2_FRAME_SIZE_ERROR, "bad SETTINGS ack");
+        return true;
+    }
+    if (len % 6 != 0) return connection_error(H2_FRAME_SIZE_ERROR, "bad SETTINGS");
+    if (!apply_settings(p, len)) return false;
+    m_settings_received = true;
+    write_frame(H2_SETTINGS, FLAG_ACK, 0, NULL, 0);
+    return true;
+}
+
+bool h2_session::apply_settings(const unsigned char *p, size_t len) {
+    if (len % 6 != 0) return connection_error(H2_PROTOCOL_ERROR, "bad HTTP2-Settings");
+    for (size_t i = 0; i < len; i += 6) {
+        uint16_t id = (p[i] << 8) | p[i + 1];
+        uint32_t v = get32(p + i + 2);
+        switch (id) {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                m_encoder.set_max_size(v);
+                break;
+            case SETTINGS_ENABLE_PUSH:  // 本端从不推送
+                if (v > 1) return connection_error(H2_PROTOCOL_ERROR, "bad ENABLE_PUSH");
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (v > MAX_WINDOW) return connection_error(H2_FLOW_CONTROL_ERROR, "bad INITIAL_WINDOW_SIZE");
+                int64_t delta = (int64_t)v - m_peer_initial_window;  // 已有流的窗口按差值调整，可能变成负数
+                m_peer_initial_window = v;
+                for (auto &kv : m_streams) {
+                    kv.second.window += delta;
+                    if (kv.second.window > MAX_WINDOW)
+                        return connection_error(H2_FLOW_CONTROL_ERROR, "stream window overflow");
+                    schedule(kv.second);
+                }
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (v < H2_MAX_FRAME || v > 0xffffff) return connection_error(H2_PROTOCOL_ERROR, "bad MAX_FRAME_SIZE");
+                m_peer_max_frame = std::min(v, MAX_SEND_FRAME);
+                break;
+            default:  // MAX_CONCURRENT_STREAMS 只约束推送，MAX_HEADER_LIST_SIZE 是建议值，未知设置必须忽略
+                break;
+        }
+    }
+    return true;
+}
+
+bool h2_session::on_window_update(uint32_t sid, const unsigned char *p, size_t len) {
+    if (len != 4) return connection_error(H2_FRAME_SIZE_ERROR, "bad WINDOW_UPDATE");
+    uint32_t inc = get32(p) & 0x7fffffff;
+    if (sid == 0) {
+        if (inc == 0) return connection_error(H2_PROTOCOL_ERROR, "zero window increment");
+        m_send_window += inc;
+        if (m_send_window > MAX_WINDOW) return connection_error(H2_FLOW_CONTROL_ERROR, "connection window overflow");
+        for (auto &kv : m_streams) schedule(kv.second);  // 因连接窗口为 0 而等待的流
+        return true;
+    }
+    auto it = m_streams.find(sid);
+    if (it == m_streams.end()) {
+        if (sid > m_last_stream) return connection_error(H2_PROTOCOL_ERROR, "WINDOW_UPDATE on idle stream");
+        return true;  // 已关闭的流，迟到的更新直接忽略
+    }
+    h2_stream &s = it->second;
+    if (inc == 0) {
+        reset_stream(s, H2_PROTOCOL_ERROR);
+        return true;
+    }
+    s.window += inc;
+    if (s.window > MAX_WINDOW) {
+        reset_stream(s, H2_FLOW_CONTROL_ERROR);
+        return true;
+    }
+    schedule(s);
+    return true;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// 请求处理：与 http_conn::do_request() 相同的路由和静态文件逻辑
+
+// 上传接口的任务：表单中的文件要写入临时文件，解析和处理函数一起在阻塞线程池中执行
+struct h2_upload_job : handler_job {
+    h2_upload_job(const handler_fn *fn, const http_request &req, response_sink *conn, unsigned request_id, vhost *host,
+                  const std::shared_ptr<upload_limits> &limits, std::string_view type)
+        : handler_job(fn, req, conn, request_id, true, host), limits(limits), type(type) {}
+
+    void run() override {
+        upload_session up(*limits);
+        UPLOAD_STATUS st = up.start(type) ? up.feed(req.body.data(), req.body.size()) : UPLOAD_BAD;
+        if (st == UPLOAD_MORE) st = up.finish();
+        if (st != UPLOAD_DONE) {
+            int status;
+            const char *title, *form;
+            http_conn::error_page(st == UPLOAD_TOO_LARGE ? http_conn::TOO_LARGE_REQUEST
+                                  : st == UPLOAD_BAD     ? http_conn::BAD_REQUEST
+                                                         : http_conn::INTERNAL_ERROR,
+                                  status, title, form);
+            res.set_status(status);
+            res.set_content_type("text/plain; charset=utf-8");
+            res.send(form);
+            return;
+        }
+        req.form = up.form();
+        req.body = std::string_view();
+        req.body_length = 0;
+        handler_job::run();
+    }
+
+    std::shared_ptr<upload_limits> limits;  // 路由的上传限制
+    std::string type;                       // 请求的 Content-Type
+};
+
+// 静态文件的一次查找：缓存中没有最近确认过的项时在阻塞线程池中进行，结果带回主循环
+struct h2_static_lookup {
+    h2_session *session;
+    unsigned request_id;
+    vhost *host;
+    std::string dir;
+    std::string path;
+    int accept;                    // 客户端可接受的编码
+    http_conn::HTTP_CODE ret;      // find_static() 的结果
+    http_conn::static_file file;   // 找到的文件
+};
+
+struct h2_static_job : pool_job {
+    explicit h2_static_job(const std::shared_ptr<h2_static_lookup> &l) : l(l) {}
+
+    void run() override {
+        char real_file[http_conn::FILENAME_LEN];
+        l->ret = http_conn::find_static(*l->host, l->dir.data(), l->dir.size(), l->path.data(), l->path.size(),
+                                        l->accept, real_file, l->file);
+        std::shared_ptr<h2_static_lookup> done = l;
+        event_hub::get_instance()->post([done]() { done->session->static_done(*done); });
+    }
+
+    std::shared_ptr<h2_static_lookup> l;
+};
+
+h2_stream *h2_session::open_stream(uint32_t sid) {
+    h2_stream &s = m_streams[sid];
+    s.id = sid;
+    s.window = m_peer_initial_window;
+    if (access_log::enabled()) s.timing.start = m_event_us;
+    m_lock.lock();
+    if (++m_next_request == 0) ++m_next_request;  // 0 不用作请求编号
+    s.request_id = m_next_request;
+    request_state &r = m_requests[s.request_id];
+    r.stream = sid;
+    r.posted = 0;
+    r.buffered = 0;
+    m_lock.unlock();
+    return &s;
+}
+
+// 伪头部必须在普通头部之前，头部名必须是小写，不能出现 HTTP/1.1 的逐跳头部
+bool h2_session::validate(h2_stream &s) {
+    bool regular = false, method = false, path = false;
+    for (size_t i = 0; i < s.headers.size(); ++i) {
+        const hpack_header &h = s.headers[i];
+        if (h.name.empty()) return false;
+        if (h.name[0] == ':') {
+            if (regular) return false;
+            if (h.name == ":method")
+                method = !h.value.empty();
+            else if (h.name == ":path")
+                path = !h.value.empty();
+            else if (h.name != ":scheme" && h.name != ":authority")
+                return false;
+            continue;
+        }
+        regular = true;
+        for (size_t j = 0; j < h.name.size(); ++j)
+            if (h.name[j] >= 'A' && h.name[j] <= 'Z') return false;
+        if (h.name == "connection" || h.name == "keep-alive" || h.name == "proxy-connection" ||
+            h.name == "transfer-encoding" || h.name == "upgrade")
+            return false;
+        if (h.name == "te" && h.value != "trailers") return false;
+        if (h.name == "content-length") s.expected = atol(h.value.c_str());
+    }
+    return method && path;
+}
+
+void h2_session::dispatch(h2_stream &s) {
+    s.dispatched = true;
+    if (s.timing.start) {
+        // 排队：同一批读到的帧中排在前面的先处理；解析：从 HEADERS 到收齐请求体的读事件
+        long long now = access_log::now_us();
+        s.timing.queue_us = now - m_event_us;
+        s.timing.parse_us = m_event_us - s.timing.start;
+        s.timing.handler = now;
+    }
+    std::string_view method, path, authority;
+    for (size_t i = 0; i < s.headers.size(); ++i) {
+        const hpack_header &h = s.headers[i];
+        if (h.name == ":method")
+            method = h.value;
+        else if (h.name == ":path")
+            path = h.value;
+        else if (h.name == ":authority")
+            authority = h.value;
+    }
+    s.head_only = method == "HEAD";
+    if (authority.empty()) {  // 没有 :authority 时可以带 host 头（RFC 7540 8.1.2.3）
+        for (size_t i = 0; i < s.headers.size(); ++i)
+            if (s.headers[i].name == "host") authority = s.headers[i].value;
+    }
+    s.host = http_conn::m_vhosts->find(authority.data(), authority.size());
+
+    int m = -1;
+    for (size_t i = 0; i < sizeof(method_names) / sizeof(method_names[0]); ++i)
+        if (method == method_names[i]) m = i;
+    if (m >= 0) s.method = m;
+    if (m < 0 || path[0] != '/') {
+        int status;
+        const char *title, *form;
+        http_conn::error_page(http_conn::BAD_REQUEST, status, title, form);
+        respond_simple(s, status, "text/plain; charset=utf-8", form);
+        return;
+    }
+
+    std::string url(path);
+    if (url == "/") url += "judge.html";  // 与 HTTP/1.1 一致，根路径显示判断界面
+    size_t path_len = std::min(url.find('?'), url.size());
+
+    route_params params;
+    const http_conn::route *r = s.host->router.find(url.data(), path_len, params);
+    if (!r) {
+        respond_static(s, "", 0, url.data(), path_len);
+        return;
+    }
+    int allow = http_conn::route_allow(*r);
+    if (!(allow & (1 << m))) {  // 与 HTTP/1.1 一致，命中路由但方法不被接受时回复 405
+        int status;
+        const char *title, *form;
+        http_conn::error_page(http_conn::METHOD_NOT_ALLOWED, status, title, form);
+        respond_simple(s, status, "text/plain; charset=utf-8", form, http_conn::allow_value(allow));
+        return;
+    }
+    switch (r->kind) {
+        case http_conn::ROUTE_FILE:
+            respond_static(s, "", 0, r->target.data(), r->target.size());
+            return;
+        case http_conn::ROUTE_STATIC: {
+            const route_param &rest = params.items[params.count - 1];
+            respond_static(s, r->target.data(), r->target.size(), rest.value, rest.len);
+            return;
+        }
+        case http_conn::ROUTE_WEBSOCKET: {  // 不支持 RFC 8441 的扩展 CONNECT
+            int status;
+            const char *title, *form;
+            http_conn::error_page(http_conn::BAD_REQUEST, status, title, form);
+            respond_simple(s, status, "text/plain; charset=utf-8", form);
+            return;
+        }
+        case http_conn::ROUTE_HANDLER:
+            break;
+    }
+
+    http_request req;
+    req.method = method_names[m];
+    req.path = std::string_view(url.data(), path_len);
+    if (path_len < url.size()) req.query = std::string_view(url.data() + path_len + 1, url.size() - path_len - 1);
+    req.version = "HTTP/2.0";
+    req.remote_addr = m_remote_addr;
+    req.tls = false;  // HTTP/2 只走明文（h2c），TLS 连接的 ALPN 只协商 http/1.1
+    req.body = s.body;
+    req.body_length = s.body.size();  // 整个请求体已经收齐
+    req.header_count = 0;
+    if (!authority.empty()) {  // 处理函数按 HTTP/1.1 的习惯读 Host
+        req.headers[0].name = "host";
+        req.headers[0].value = authority;
+        req.header_count = 1;
+    }
+    for (size_t i = 0; i < s.headers.size() && req.header_count < http_request::MAX_HEADERS; ++i) {
+        if (s.headers[i].name[0] == ':') continue;
+        req.headers[req.header_count].name = s.headers[i].name;
+        req.headers[req.header_count].value = s.headers[i].value;
+        ++req.header_count;
+    }
+    req.param_count = params.count;
+    for (int i = 0; i < params.count; ++i) {
+        req.params[i].name = params.items[i].name;
+        req.params[i].value = std::string_view(params.items[i].value, params.items[i].len);
+    }
+    if (r->upload) {
+        // 请求体已经收齐在内存中（不超过 H2_MAX_BODY），同样解析成表单。文件要写入临时文件，
+        // 解析和处理函数一起投递到阻塞线程池，不管处理函数是哪种模式
+        std::string_view type;
+        for (size_t i = 0; i < s.headers.size(); ++i)
+            if (s.headers[i].name == "content-type") type = s.headers[i].value;
+        handler_job *job = new h2_upload_job(&r->handler, req, this, s.request_id, s.host, r->upload, type);
+        if (!handler_pool::get_instance()->enabled()) {  // 没有阻塞线程池时只能在主循环中完成
+            job->run();
+            delete job;
+        } else if (!handler_pool::get_instance()->submit(job)) {
+            job->res.set_status(503);
+            job->res.send("Server is busy, please retry later.\n");
+            delete job;
+        }
+        return;
+    }
+
+    if (r->mode == HANDLER_BLOCKING && handler_pool::get_instance()->enabled()) {
+        handler_job *job = new handler_job(&r->handler, req, this, s.request_id, true, s.host);
+        if (!handler_pool::get_instance()->submit(job)) {
+            job->res.set_status(503);  // 阻塞线程池积压已满
+            job->res.send("Server is busy, please retry later.\n");
+            delete job;
+        }
+        return;
+    }
+    // INLINE 处理函数在主循环线程中执行；期间 m_busy 不为 0，流不会被回收，req 中的指针保持有效
+    http_response res(this, s.request_id, true, s.host);
+    r->handler(req, res);
+}
+
+void h2_session::respond_static(h2_stream &s, const char *dir, size_t dir_len, const char *path, size_t path_len) {
+    int accept = 0;
+    for (size_t i = 0; i < s.headers.size(); ++i)
+        if (s.headers[i].name == "accept-encoding") accept = http_conn::parse_accept_encoding(s.headers[i].value.c_str());
+
+    // 先只查缓存；没有最近确认过的缓存项时 stat、open、mmap 可能阻塞，交给阻塞线程池
+    std::shared_ptr<h2_static_lookup> l = std::make_shared<h2_static_lookup>();
+    char real_file[http_conn::FILENAME_LEN];
+    l->ret = http_conn::find_static(*s.host, dir, dir_len, path, path_len, accept, real_file, l->file, true);
+    if (l->ret == http_conn::NO_REQUEST) {
+        handler_pool *pool = handler_pool::get_instance();
+        if (!pool->enabled()) {  // 没有阻塞线程池时只能在主循环中查找
+            l->ret = http_conn::find_static(*s.host, dir, dir_len, path, path_len, accept, real_file, l->file);
+        } else {
+            l->session = this;
+            l->request_id = s.request_id;
+            l->host = s.host;
+            l->dir.assign(dir, dir_len);
+            l->path.assign(path, path_len);
+            l->accept = accept;
+            h2_static_job *job = new h2_static_job(l);
+            if (!pool->submit(job)) {
+                delete job;
+                respond_simple(s, 503, "text/plain; charset=utf-8", "Server is busy, please retry later.\n");
+            }
+            return;
+        }
+    }
+    send_static(s, *l);
+}
+
+// 阻塞线程池查找完成，回到主循环：流仍然有效时发送
+void h2_session::static_done(h2_static_lookup &l) {
+    h2_stream *s = lookup(l.request_id);
+    if (s && !s->headers_sent) send_static(*s, l);
+    pump();
+}
+
+void h2_session::send_static(h2_stream &s, h2_static_lookup &l) {
+    if (l.ret != http_conn::FILE_REQUEST) {
+        int status;
+        const char *title, *form;
+        http_conn::error_page(l.ret, status, title, form);
+        respond_simple(s, status, "text/plain; charset=utf-8", form);
+        return;
+    }
+    const http_conn::static_file &f = l.file;
+    if (f.size == 0) {  // 与 HTTP/1.1 一致，空文件回复一个空页面
+        respond_simple(s, 200, "text/html; charset=utf-8", "<html><body></body></html>");
+        return;
+    }
+
+    std::string block;
+    char len[UINT_DIGITS_MAX];
+    m_encoder.begin(block);
+    m_encoder.encode(block, ":status", "200");
+    encode_common(block);
+    m_encoder.encode(block, "content-type", f.content_type);
+    m_encoder.encode(block, "content-length", std::string_view(len, format_uint(len, f.size)), false);
+    if (f.encoding != ENC_IDENTITY) m_encoder.encode(block, "content-encoding", encoding_name(f.encoding));
+    if (f.vary) m_encoder.encode(block, "vary", "accept-encoding");
+    mark_ready(s, 200, block.size());
+    write_headers(s.id, block, s.head_only);
+    s.headers_sent = true;
+    s.xlate = h2_stream::X_DONE;
+    if (s.head_only) {
+        finish(s);
+        return;
+    }
+    // 响应体直接从缓存的映射分帧，持有缓存项保证发送期间映射有效
+    s.file = f.file;
+    s.encoded = f.encoded;
+    s.file_data = f.data;
+    s.file_left = f.size;
+    s.done = true;
+    schedule(s);
+}
+
+// date 和 server，与 HTTP/1.1 的响应头一致。date 一秒内不变，入表后同一秒的响应只占一个字节
+void h2_session::encode_common(std::string &block) {
+    const char *date = http_date::line();
+    m_encoder.encode(block, "date", std::string_view(date + 5, http_date::LINE_LEN - 7));  // 去掉 "Date:" 和 CRLF
+    m_encoder.encode(block, "server", std::string_view(HEAD_SERVER + 7, HEAD_SERVER_LEN - 9));
+}
+
+void h2_session::respond_simple(h2_stream &s, int status, const char *content_type, std::string_view body,
+                                std::string_view allow) {
+    std::string block;
+    char num[UINT_DIGITS_MAX];
+    m_encoder.begin(block);
+    m_encoder.encode(block, ":status", std::string_view(num, format_uint(num, status)));
+    encode_common(block);
+    m_encoder.encode(block, "content-type", content_type);
+    m_encoder.encode(block, "content-length", std::string_view(num, format_uint(num, body.size())), false);
+    if (!allow.empty()) m_encoder.encode(block, "allow", allow);
+    mark_ready(s, status, block.size());
+    bool end = s.head_only || body.empty();
+    write_headers(s.id, block, end);
+    s.headers_sent = true;
+    s.xlate = h2_stream::X_DONE;
+    if (end) {
+        finish(s);
+        return;
+    }
+    append_body(s, body.data(), body.size());
+    s.done = true;
+    schedule(s);
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// response_sink：其他线程的调用投递到主循环，主循环中直接处理
+
+h2_stream *h2_session::lookup(unsigned request_id) {
+    // m_requests 只在主循环线程中修改，这里读不需要加锁
+    auto r = m_requests.find(request_id);
+    if (r == m_requests.end()) return NULL;
+    auto it = m_streams.find(r->second.stream);
+    return it == m_streams.end() ? NULL : &it->second;
+}
+
+bool h2_session::alive(unsigned request_id) {
+    m_lock.lock();
+    bool ok = m_requests.count(request_id) > 0;
+    m_lock.unlock();
+    return ok;
+}
+
+bool h2_session::stream_push(unsigned request_id, const struct iovec *iov, int count, bool done) {
+    event_hub *hub = event_hub::get_instance();
+    if (hub->in_loop()) return push(request_id, iov, count, done);
+
+    std::shared_ptr<std::string> data = std::make_shared<std::string>();
+    for (int i = 0; i < count; ++i) data->append((const char *)iov[i].iov_base, iov[i].iov_len);
+    m_lock.lock();
+    auto it = m_requests.find(request_id);
+    bool ok = it != m_requests.end();
+    if (ok) it->second.posted += data->size();
+    m_lock.unlock();
+    if (!ok) return false;
+    hub->post([this, request_id, data, done]() {
+        m_lock.lock();
+        auto it = m_requests.find(request_id);
+        if (it != m_requests.end()) it->second.posted -= data->size();
+        m_lock.unlock();
+        struct iovec v;
+        v.iov_base = (void *)data->data();
+        v.iov_len = data->size();
+        push(request_id, &v, 1, done);
+    });
+    return true;
+}
+
+bool h2_session::push(unsigned request_id, const struct iovec *iov, int count, bool done) {
+    h2_stream *s = lookup(request_id);
+    if (!s || s->done) return false;
+    for (int i = 0; i < count && !s->end_sent; ++i) {
+        if (!translate(*s, (const char *)iov[i].iov_base, iov[i].iov_len)) {
+            LOG_WARN("http2: malformed handler output on stream %u", s->id);
+            reset_stream(*s, H2_INTERNAL_ERROR);
+            pump();
+            return false;
+        }
+    }
+    if (!s->end_sent) {
+        if (done) {
+            s->done = true;
+            if (!s->headers_sent)
+                reset_stream(*s, H2_INTERNAL_ERROR);  // 响应头不完整
+            else if (s->xlate == h2_stream::X_LENGTH || s->xlate == h2_stream::X_CHUNKED)
+                s->aborted = true;  // 响应体不完整，已有数据发完后重置流
+        } else {
+            s->notify = true;
+            if (s->out_off == s->out.size()) drained(*s);
+        }
+        schedule(*s);
+    }
+    pump();
+    return true;
+}
+
+// 把处理函数输出的 HTTP/1.1 字节流转换成帧：头部变成 HEADERS，响应体去掉分块编码后进入发送缓冲区
+bool h2_session::translate(h2_stream &s, const char *data, size_t len) {
+    while (len > 0 && !s.end_sent) {
+        switch (s.xlate) {
+            case h2_stream::X_HEAD: {
+                size_t old = s.head.size();
+                s.head.append(data, len);
+                size_t end = s.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+                if (end == std::string::npos) return s.head.size() <= H2_MAX_HEADER_LIST;
+                size_t used = end + 4 - old;
+                data += used;
+                len -= used;
+                if (!translate_head(s, end + 4)) return false;
+                std::string().swap(s.head);
+                break;
+            }
+            case h2_stream::X_LENGTH: {
+                size_t take = std::min(len, (size_t)s.remaining);
+                append_body(s, data, take);
+                s.remaining -= take;
+                if (s.remaining == 0) s.xlate = h2_stream::X_DONE;
+                return true;
+            }
+            case h2_stream::X_CHUNKED: {
+                std::string buf(data, len);  // 原地解码需要可写的缓冲区
+                long pos = 0, out = 0;
+                chunked_decoder::STATUS st = s.chunks.decode(&buf[0], pos, len, out, LONG_MAX);
+                append_body(s, buf.data(), out);
+                if (st == chunked_decoder::CHUNK_ERROR) return false;
+                if (st == chunked_decoder::CHUNK_DONE) s.xlate = h2_stream::X_DONE;
+                return true;
+            }
+            case h2_stream::X_UNTIL_END:
+                append_body(s, data, len);
+                return true;
+            case h2_stream::X_DONE:
+                return true;  // 响应体之后多余的数据
+        }
+    }
+    return true;
+}
+
+bool h2_session::translate_head(h2_stream &s, size_t head_len) {
+    const std::string &head = s.head;
+    size_t eol = head.find("\r\n");
+    size_t sp = head.find(' ');
+    if (sp == std::string::npos || sp > eol) return false;
+    int status = atoi(head.c_str() + sp + 1);
+    if (status < 200 || status > 999) return false;  // 处理函数不产生 1xx
+
+    std::string block;
+    char num[UINT_DIGITS_MAX];
+    m_encoder.begin(block);
+    m_encoder.encode(block, ":status", std::string_view(num, format_uint(num, status)));
+
+    bool chunked = false;
+    long length = -1;
+    std::string name;
+    for (size_t pos = eol + 2; pos + 2 < head_len;) {
+        size_t next = head.find("\r\n", pos);
+        size_t colon = head.find(':', pos);
+        if (colon < next) {
+            name.assign(head, pos, colon - pos);
+            for (size_t i = 0; i < name.size(); ++i)
+                if (name[i] >= 'A' && name[i] <= 'Z') name[i] += 'a' - 'A';
+            size_t v = colon + 1;
+            while (v < next && (head[v] == ' ' || head[v] == '\t')) ++v;
+            std::string_view value(head.data() + v, next - v);
+            if (name == "transfer-encoding") {
+                chunked = value.find("chunked") != std::string_view::npos;
+            } else if (name == "content-length") {
+                length = atol(head.c_str() + v);
+                m_encoder.encode(block, name, value, false);  // 每次都不同，不入动态表
+            } else if (name != "connection" && name != "keep-alive" && name != "proxy-connection" &&
+                       name != "upgrade") {
+                m_encoder.encode(block, name, value);
+            }
+        }
+        pos = next + 2;
+    }
+
+    if (s.head_only || status == 204 || status == 304)
+        s.xlate = h2_stream::X_DONE;
+    else if (chunked)
+        s.xlate = h2_stream::X_CHUNKED;
+    else if (length > 0)
+        s.xlate = h2_stream::X_LENGTH;
+    else if (length == 0)
+        s.xlate = h2_stream::X_DONE;
+    else
+        s.xlate = h2_stream::X_UNTIL_END;
+    s.remaining = length;
+
+    bool end = s.xlate == h2_stream::X_DONE;
+    mark_ready(s, status, block.size());
+    write_headers(s.id, block, end);
+    s.headers_sent = true;
+    if (end) finish(s);
+    return true;
+}
+
+void h2_session::append_body(h2_stream &s, const char *data, size_t len) {
+    if (s.head_only || len == 0) return;
+    s.out.append(data, len);
+    account(s);
+}
+
+// 处理耗时算到响应头生成为止，状态码和响应头大小计入访问记录
+void h2_session::mark_ready(h2_stream &s, int status, size_t head_len) {
+    s.timing.status = status;
+    s.timing.bytes += head_len;
+    if (!s.timing.start) return;
+    long long now = access_log::now_us();
+    if (s.timing.handler) s.timing.handler_us = now - s.timing.handler;
+    s.timing.ready = now;
+}
+
+// 与 http_conn::log_access() 的字段一致；发送时间算到最后一帧分帧进连接的发送缓冲区
+void h2_session::log_access(h2_stream &s) {
+    if (!access_log::enabled() || s.timing.start == 0) return;
+    long long now = access_log::now_us();
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    access_entry e;
+    memset(&e, 0, sizeof(e));
+    e.total_us = now - s.timing.start;
+    e.start_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec - (long long)e.total_us * 1000;
+    e.bytes = s.timing.bytes;
+    e.addr = m_addr;
+    e.reuse = m_reuse++;
+    e.status = s.timing.status;
+    e.method = s.method;
+    e.flags = access_entry::KEEP_ALIVE | access_entry::HTTP2;
+    e.queue_us = s.timing.queue_us;
+    e.parse_us = s.timing.parse_us;
+    e.handler_us = s.timing.handler_us;
+    e.send_us = s.timing.ready ? now - s.timing.ready : 0;
+    std::string_view path("");
+    for (size_t i = 0; i < s.headers.size(); ++i)
+        if (s.headers[i].name == ":path") path = s.headers[i].value;
+    access_log::get_instance()->write(e, path.data(), path.size());
+    s.timing.start = 0;  // 只记一次
+}
+
+// 更新请求编号表中的积压字节数，供其他线程的 stream_backlog() 读取
+void h2_session::account(h2_stream &s) {
+    m_lock.lock();
+    auto it = m_requests.find(s.request_id);
+    if (it != m_requests.end()) it->second.buffered = s.out.size() - s.out_off;
+    m_lock.unlock();
+}
+
+// 流的发送缓冲区已空而响应尚未结束：通知接管者。投递执行，避免在生产者的调用栈中重入
+void h2_session::drained(h2_stream &s) {
+    if (s.done || !s.owner || !s.notify) return;
+    s.notify = false;
+    std::shared_ptr<stream_owner> owner = s.owner;
+    event_hub::get_instance()->post([owner]() { owner->on_drain(); });
+}
+
+size_t h2_session::stream_backlog(unsigned request_id) {
+    m_lock.lock();
+    auto it = m_requests.find(request_id);
+    size_t n = it == m_requests.end() ? 0 : it->second.posted + it->second.buffered;
+    m_lock.unlock();
+    return n;
+}
+
+bool h2_session::stream_attach(unsigned request_id, const std::shared_ptr<stream_owner> &owner) {
+    event_hub *hub = event_hub::get_instance();
+    if (!hub->in_loop()) {
+        if (!alive(request_id)) return false;
+        hub->post([this, request_id, owner]() { stream_attach(request_id, owner); });
+        return true;
+    }
+    h2_stream *s = lookup(request_id);
+    if (!s || s->done) return false;
+    s->owner = owner;
+    return true;
+}
+
+ssize_t h2_session::stream_splice(unsigned request_id, int pipe_fd, size_t len) {
+    if (!event_hub::get_instance()->in_loop()) {  // 稍后由 stream_wake() 在主循环中回调接管者
+        errno = EAGAIN;
+        return -1;
+    }
+    h2_stream *s = lookup(request_id);
+    if (!s || s->done || !s->headers_sent) {
+        errno = EPIPE;
+        return -1;
+    }
+    if (s->out_off < s->out.size()) {  // 缓冲区里还有数据，必须先分帧
+        errno = EAGAIN;
+        return -1;
+    }
+    // 帧需要加帧头，没法从管道直接 splice 到 socket，读出来进入发送缓冲区
+    size_t want = std::min(len, h2_server::BUFFER_SIZE);
+    s->out.resize(want);
+    ssize_t n = ::read(pipe_fd, &s->out[0], want);
+    s->out.resize(n > 0 ? n : 0);
+    if (n <= 0) return n;
+    if (s->head_only) s->out.clear();
+    if (s->xlate == h2_stream::X_LENGTH) {
+        s->remaining -= std::min((long)n, s->remaining);
+        if (s->remaining == 0) s->xlate = h2_stream::X_DONE;
+    }
+    account(*s);
+    schedule(*s);
+    pump();
+    return n;
+}
+
+bool h2_session::stream_wake(unsigned request_id) {
+    event_hub *hub = event_hub::get_instance();
+    if (!hub->in_loop()) {
+        if (!alive(request_id)) return false;
+        hub->post([this, request_id]() { stream_wake(request_id); });
+        return true;
+    }
+    h2_stream *s = lookup(request_id);
+    if (!s || s->done) return false;
+    s->notify = true;
+    if (s->out_off == s->out.size()) drained(*s);
+    return true;
+}
+
+bool h2_session::stream_abort(unsigned request_id) {
+    event_hub *hub = event_hub::get_instance();
+    if (!hub->in_loop()) {
+        if (!alive(request_id)) return false;
+        hub->post([this, request_id]() { stream_abort(request_id); });
+        return true;
+    }
+    h2_stream *s = lookup(request_id);
+    if (!s || s->done) return false;
+    if (!s->headers_sent) {
+        reset_stream(*s, H2_INTERNAL_ERROR);
+    } else {
+        s->done = true;
+        s->aborted = true;
+        schedule(*s);
+    }
+    pump();
+    return true;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// 发送：控制帧和 HEADERS 直接进入发送缓冲区，DATA 按流轮转分帧
+
+void h2_session::write_frame(uint8_t type, uint8_t flags, uint32_t sid, const void *payload, size_t len) {
+    unsigned char h[H2_FRAME_HEADER];
+    h[0] = len >> 16;
+    h[1] = len >> 8;
+    h[2] = len;
+    h[3] = type;
+    h[4] = flags;
+    put32(h + 5, sid);
+    m_out.append((const char *)h, sizeof(h));
+    if (len) m_out.append((const char *)payload, len);
+}
+
+// 头部块超过对端的帧上限时拆成 HEADERS + CONTINUATION，中间不能插入其他帧
+void h2_session::write_headers(uint32_t sid, const std::string &block, bool end_stream) {
+    size_t n = std::min(block.size(), (size_t)m_peer_max_frame);
+    uint8_t flags = (end_stream ? FLAG_END_STREAM : 0) | (n == block.size() ? FLAG_END_HEADERS : 0);
+    write_frame(H2_HEADERS, flags, sid, block.data(), n);
+    for (size_t off = n; off < block.size(); off += n) {
+        n = std::min(block.size() - off, (size_t)m_peer_max_frame);
+        write_frame(H2_CONTINUATION, off + n == block.size() ? FLAG_END_HEADERS : 0, sid, block.data() + off, n);
+    }
+}
+
+void h2_session::send_rst(uint32_t sid, uint32_t code) {
+    unsigned char p[4];
+    put32(p, code);
+    write_frame(H2_RST_STREAM, 0, sid, p, sizeof(p));
+}
+
+void h2_session::queue(h2_stream &s) {
+    if (s.queued) return;
+    s.queued = true;
+    m_ready.push_back(s.id);
+}
+
+void h2_session::schedule(h2_stream &s) {
+    if (!s.queued && sendable(s)) queue(s);
+}
+
+// 已结束的流需要回收；其余的流在响应头已发出、且有数据和窗口或只差结束标志时可以分帧
+bool h2_session::sendable(const h2_stream &s) const {
+    if (s.end_sent) return true;
+    if (!s.headers_sent) return false;
+    size_t avail = s.file_data ? s.file_left : s.out.size() - s.out_off;
+    if (avail == 0) return s.done;
+    return s.window > 0 && m_send_window > 0;
+}
+
+// 为一个流生成一个 DATA 帧
+void h2_session::emit(h2_stream &s) {
+    size_t avail = s.file_data ? s.file_left : s.out.size() - s.out_off;
+    if (avail == 0) {
+        if (!s.done) return;
+        if (s.aborted) {
+            reset_stream(s, H2_INTERNAL_ERROR);
+            return;
+        }
+        write_frame(H2_DATA, FLAG_END_STREAM, s.id, NULL, 0);
+        finish(s);
+        return;
+    }
+    int64_t limit = std::min(s.window, m_send_window);
+    if (limit <= 0) return;
+    size_t n = std::min(avail, (size_t)std::min(limit, (int64_t)m_peer_max_frame));
+    bool last = s.done && !s.aborted && n == avail;
+    const char *src = s.file_data ? s.file_data : s.out.data() + s.out_off;
+    write_frame(H2_DATA, last ? FLAG_END_STREAM : 0, s.id, src, n);
+    s.timing.bytes += n;
+    s.window -= n;
+    m_send_window -= n;
+    if (s.file_data) {
+        s.file_data += n;
+        s.file_left -= n;
+    } else {
+        s.out_off += n;
+        if (s.out_off == s.out.size()) {
+            s.out.clear();
+            s.out_off = 0;
+        }
+        account(s);
+    }
+    if (last) {
+        finish(s);
+        return;
+    }
+    if (!s.file_data && s.out.empty()) drained(s);
+}
+
+// 轮转分帧，直到发送缓冲区超过 OUT_HIGH 或没有可发的流；结束的流在这里回收
+void h2_session::fill() {
+    if (m_out_off > 0) {
+        m_out.erase(0, m_out_off);
+        m_out_off = 0;
+    }
+    while (!m_ready.empty() && m_out.size() < OUT_HIGH) {
+        uint32_t sid = m_ready.front();
+        m_ready.pop_front();
+        auto it = m_streams.find(sid);
+        if (it == m_streams.end()) continue;
+        h2_stream &s = it->second;
+        s.queued = false;
+        if (!s.end_sent) emit(s);
+        if (s.end_sent) {
+            m_streams.erase(it);
+            continue;
+        }
+        schedule(s);
+    }
+}
+
+void h2_session::pump() {
+    if (m_dead || m_busy || !m_active) return;
+    // 接收窗口用掉一半时一次补满，避免每个 DATA 帧都回一个 WINDOW_UPDATE
+    if (m_recv_consumed >= H2_CONN_WINDOW / 2) {
+        unsigned char inc[4];
+        put32(inc, m_recv_consumed);
+        write_frame(H2_WINDOW_UPDATE, 0, 0, inc, sizeof(inc));
+        m_recv_window += m_recv_consumed;
+        m_recv_consumed = 0;
+    }
+    for (int round = 0; round < MAX_WRITES; ++round) {
+        fill();
+        if (m_out_off == m_out.size()) break;
+        ssize_t n = send(m_fd, m_out.data() + m_out_off, m_out.size() - m_out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            kill();
+            return;
+        }
+        m_out_off += n;
+        m_last_active = time(NULL);
+        if (m_out_off == m_out.size()) {
+            m_out.clear();
+            m_out_off = 0;
+        }
+    }
+    bool flushed = m_out_off == m_out.size() && m_ready.empty();
+    if (flushed && (m_closing || (m_goaway_received && m_streams.empty()))) {
+        kill();
+        return;
+    }
+    arm();
+}
+
+void h2_session::arm() {
+    if (m_dead) return;
+    uint32_t want = EPOLLIN | EPOLLRDHUP | (m_out_off < m_out.size() || !m_ready.empty() ? (uint32_t)EPOLLOUT : 0u);
+    if (want == m_armed) return;
+    if (event_hub::get_instance()->mod(m_fd, want)) m_armed = want;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// 关闭
+
+// 响应的 END_STREAM 已发出。请求还没发完时用 RST_STREAM(NO_ERROR) 告诉对端不必再发
+void h2_session::finish(h2_stream &s) {
+    log_access(s);
+    s.end_sent = true;
+    if (!s.remote_closed) send_rst(s.id, H2_NO_ERROR);
+    release(s);
+    queue(s);  // 由 fill() 回收
+}
+
+// 对端重置的流与 HTTP/1.1 发送途中断开的请求一样不记访问日志
+void h2_session::reset_stream(h2_stream &s, uint32_t code, bool notify_peer) {
+    if (!s.end_sent && notify_peer) {
+        log_access(s);
+        send_rst(s.id, code);
+    }
+    s.end_sent = true;
+    release(s);
+    queue(s);
+}
+
+// 注销请求编号，之后生产者的输出都会失败；请求头部和请求体留到回收时释放，INLINE 处理函数可能还在使用
+void h2_session::release(h2_stream &s) {
+    m_lock.lock();
+    m_requests.erase(s.request_id);
+    m_lock.unlock();
+    s.done = true;
+    s.owner.reset();
+    std::string().swap(s.out);
+    s.out_off = 0;
+    s.file.reset();
+    s.encoded.reset();
+    s.file_data = NULL;
+    s.file_left = 0;
+}
+
+bool h2_session::connection_error(uint32_t code, const char *why) {
+    LOG_WARN("http2: %s from %s, closing connection", why, m_remote_addr.c_str());
+    go_away(code);
+    return false;
+}
+
+void h2_session::go_away(uint32_t code) {
+    if (m_closing) return;
+    unsigned char p[8];
+    put32(p, m_last_stream);
+    put32(p + 4, code);
+    write_frame(H2_GOAWAY, 0, 0, p, sizeof(p));
+    m_closing = true;
+}
+
+void h2_session::kill() {
+    if (m_dead) return;
+    m_dead = true;
+    h2_server::get_instance()->bury(this);
+}
+
+// 关闭 socket 并清空状态，对象留在 h2_server 中供同一 fd 的下一条连接复用
+void h2_session::destroy() {
+    event_hub::get_instance()->del(m_fd);
+    ::close(m_fd);
+    --http_conn::m_user_count;
+    m_lock.lock();
+    m_requests.clear();
+    m_lock.unlock();
+    m_streams.clear();
+    m_ready.clear();
+    std::string().swap(m_in);
+    std::string().swap(m_out);
+    std::string().swap(m_header_block);
+    m_fd = -1;
+    m_active = false;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+
+void h2_server::init(int close_log) {
+    m_close_log = close_log;
+    if (!m_started) {
+        event_hub::get_instance()->add_tick([this]() { tick(); });
+        m_started = true;
+    }
+}
+
+void h2_server::adopt(int fd, std::unique_ptr<h2_upgrade> info) {
+    // 大量小响应，关掉 Nagle 以降低延迟
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if ((size_t)fd >= m_sessions.size()) m_sessions.resize(fd + 1, NULL);
+    h2_session *&session = m_sessions[fd];
+    if (!session) session = new h2_session;
+    if (!event_hub::get_instance()->adopt(fd, EPOLLIN | EPOLLRDHUP, session)) {
+        LOG_ERROR("http2: adopt fd %d failed", fd);
+        ::close(fd);
+        --http_conn::m_user_count;
+        return;
+    }
+    m_live.push_back(session);
+
+    ++session->m_busy;
+    session->start(fd, std::move(info), m_close_log);
+    // 握手时已经读入的帧不会再触发读事件，这里先处理掉
+    if (!session->m_dead && !session->m_in.empty()) session->process_input();
+    --session->m_busy;
+    session->pump();
+}
+
+// 没有活动流的连接空闲太久时发送 GOAWAY；有数据要发却长时间发不出去的连接直接关闭
+void h2_server::tick() {
+    time_t now = time(NULL);
+    for (size_t i = 0; i < m_live.size(); ++i) {
+        h2_session *s = m_live[i];
+        if (s->m_dead || now - s->m_last_active <= H2_IDLE_TIMEOUT) continue;
+        if (s->m_out_off < s->m_out.size()) {
+            s->kill();
+        } else if (s->m_streams.empty()) {
+            s->go_away(H2_NO_ERROR);
+            s->pump();
+        }
+    }
+}
+
+void h2_server::bury(h2_session *session) {
+    m_graveyard.push_back(session);
+    if (m_graveyard.size() == 1) event_hub::get_instance()->post([this]() { sweep(); });
+}
+
+void h2_server::sweep() {
+    std::vector<h2_session *> dead;
+    dead.swap(m_graveyard);
+    for (size_t i = 0; i < dead.size(); ++i) {
+        dead[i]->destroy();
+        m_live.erase(std::find(m_live.begin(), m_live.end(), dead[i]));
+    }
+}
@@ -0,0 +1,307 @@
+/**
+ * @file http2.h
+ * @brief 明文 HTTP/2（h2c）服务端
+ *
+ * 内部服务之间的调用走 h2c，几条长连接上并发大量小请求，省掉 HTTP/1.1 的队头阻塞和每个请求重复的头部。
+ * 主要特点：
+ * 1. 两种进入方式：客户端直接发送连接前言（prior knowledge），或在没有请求体的 HTTP/1.1 请求中带
+ *    Upgrade: h2c。http_conn 识别后像 WebSocket 一样把 socket 交给 h2_server，之后的读写、分帧都在主循环线程中进行
+ * 2. 路由表和静态文件缓存与 HTTP/1.1 共用：静态文件直接从缓存的映射中分帧发送；处理函数照常通过
+ *    http_response 输出，h2_session 实现 response_sink，把 HTTP/1.1 格式的输出转换成 HEADERS 和 DATA 帧，
+ *    反向代理、FastCGI 等已有的处理函数不需要修改
+ * 3. 流控：连接和每个流分别维护发送窗口，响应按流轮转分帧，一个大响应不会饿死同一连接上的其他流；
+ *    接收窗口按已处理的数据及时补充
+ * 4. 每条连接最多 H2_MAX_STREAMS 个并发流，超出的流以 REFUSED_STREAM 拒绝；请求头列表不超过
+ *    H2_MAX_HEADER_LIST 字节，请求体不超过 H2_MAX_BODY 字节
+ * 5. 会话对象按 fd 常驻、复用，请求编号在同一对象上单调递增，其他线程迟到的输出不会写到新连接上
+ * 6. 启用访问日志时每个流结束时写一条记录，字段与 HTTP/1.1 相同
+ */
+
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../cache/file_cache.h"
+#include "../http/chunked.h"
+#include "../http/handler.h"
+#include "../lock/locker.h"
+#include "../log/access_log.h"
+#include "../upstream/event_hub.h"
+#include "hpack.h"
+
+// 帧类型
+enum H2_FRAME {
+    H2_DATA = 0x0,
+    H2_HEADERS = 0x1,
+    H2_PRIORITY = 0x2,
+    H2_RST_STREAM = 0x3,
+    H2_SETTINGS = 0x4,
+    H2_PUSH_PROMISE = 0x5,
+    H2_PING = 0x6,
+    H2_GOAWAY = 0x7,
+    H2_WINDOW_UPDATE = 0x8,
+    H2_CONTINUATION = 0x9
+};
+
+// 错误码
+enum H2_ERROR {
+    H2_NO_ERROR = 0x0,
+    H2_PROTOCOL_ERROR = 0x1,
+    H2_INTERNAL_ERROR = 0x2,
+    H2_FLOW_CONTROL_ERROR = 0x3,
+    H2_STREAM_CLOSED = 0x5,
+    H2_FRAME_SIZE_ERROR = 0x6,
+    H2_REFUSED_STREAM = 0x7,
+    H2_CANCEL = 0x8,
+    H2_COMPRESSION_ERROR = 0x9,
+    H2_ENHANCE_YOUR_CALM = 0xb
+};
+
+static const char H2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";  // 客户端连接前言
+static const size_t H2_PREFACE_LEN = sizeof(H2_PREFACE) - 1;
+static const size_t H2_FRAME_HEADER = 9;              // 帧头长度
+static const uint32_t H2_MAX_FRAME = 16384;           // 本端接受的最大帧负载（协议默认值）
+static const uint32_t H2_MAX_STREAMS = 128;           // 每条连接的并发流上限
+static const uint32_t H2_MAX_HEADER_LIST = 16384;     // 请求头列表上限
+static const uint32_t H2_MAX_BODY = 1 << 20;          // 请求体上限，也是本端给每个流的初始接收窗口
+static const uint32_t H2_CONN_WINDOW = 1 << 24;       // 连接级接收窗口
+static const int H2_IDLE_TIMEOUT = 60;                // 没有活动流的连接空闲多少秒后关闭
+
+// 握手时从 HTTP/1.1 请求中保留下来的信息
+struct h2_upgrade {
+    bool prior_knowledge = false;       // 客户端直接发送了连接前言，否则为 Upgrade: h2c
+    std::string settings;               // HTTP2-Settings 解码后的 SETTINGS 负载
+    std::vector<hpack_header> headers;  // Upgrade 请求转换成的伪头部和头部，作为流 1 的请求
+    std::string remote_addr;            // 客户端 IP
+    std::string pending;                // 已读入但尚未处理的数据
+};
+
+// 解码 HTTP2-Settings 头（base64url，不带填充）
+bool h2_settings_decode(std::string_view in, std::string &out);
+
+// 一个流：请求的接收状态和响应的发送状态
+struct h2_stream {
+    // 处理函数输出的 HTTP/1.1 格式响应的转换进度
+    enum TRANSLATE {
+        X_HEAD = 0,  // 读取状态行和头部
+        X_LENGTH,    // 按 Content-Length 复制响应体
+        X_CHUNKED,   // 解码分块响应体
+        X_UNTIL_END, // 没有声明长度，直到生产者结束
+        X_DONE       // 响应体已完整
+    };
+
+    uint32_t id = 0;                          // 流编号
+    unsigned request_id = 0;                  // 请求编号
+    std::vector<hpack_header> headers;        // 请求头部
+    std::string body;                         // 请求体
+    long expected = -1;                       // 请求的 content-length，-1 表示未声明
+    bool remote_closed = false;               // 对端已发送 END_STREAM
+    bool dispatched = false;                  // 请求已交给处理者
+    bool head_only = false;                   // HEAD 请求，响应只发头部
+    vhost *host = NULL;                       // 按 :authority 选出的虚拟主机
+    uint8_t method = access_entry::NO_METHOD;  // http_conn::METHOD，访问日志用
+    access_timing timing;                     // 访问日志的计时，start 为 HEADERS 所在的读事件
+
+    int64_t window = 0;                       // 发送窗口
+    bool headers_sent = false;                // 响应头已发出
+    bool end_sent = false;                    // 已发出 END_STREAM 或 RST_STREAM，等待回收
+    bool done = false;                        // 响应的全部数据已到达
+    bool aborted = false;                     // 异常结束：已有数据发完后发送 RST_STREAM
+    bool queued = false;                      // 在待发送队列中
+    bool notify = false;                      // 缓冲区发空时需要回调接管者
+    std::string out;                          // 待分帧的响应体
+    size_t out_off = 0;                       // out 中已分帧的字节数
+    std::shared_ptr<file_entry> file;         // 静态文件响应持有的缓存项
+    std::shared_ptr<encoded_body> encoded;    // 静态文件响应选中的压缩变体
+    const char *file_data = NULL;             // 静态文件尚未分帧的部分
+    size_t file_left = 0;
+    std::shared_ptr<stream_owner> owner;      // 流式响应的接管者
+
+    TRANSLATE xlate = X_HEAD;                 // 转换进度
+    std::string head;                         // 尚不完整的 HTTP/1.1 头部
+    chunked_decoder chunks;                   // 分块响应体的解码器
+    long remaining = 0;                       // X_LENGTH 时还剩多少字节
+};
+
+struct h2_static_lookup;
+
+/**
+ * @brief 一条 HTTP/2 连接
+ *
+ * 协议状态只在主循环线程中访问。response_sink 的各函数可以在任意线程调用：
+ * 请求编号表由 m_lock 保护，其他线程的输出投递到主循环处理。
+ */
+class h2_session : public io_handler, public response_sink {
+   public:
+    void on_io(int fd, uint32_t events);
+
+    bool stream_push(unsigned request_id, const struct iovec *iov, int count, bool done) override;
+    size_t stream_backlog(unsigned request_id) override;
+    bool stream_attach(unsigned request_id, const std::shared_ptr<stream_owner> &owner) override;
+    // 用读管道 + 复制模拟：数据进入流的发送缓冲区，只在主循环线程中有效
+    ssize_t stream_splice(unsigned request_id, int pipe_fd, size_t len) override;
+    bool stream_wake(unsigned request_id) override;
+    // 已输出的数据发完后以 RST_STREAM(INTERNAL_ERROR) 结束流
+    bool stream_abort(unsigned request_id) override;
+
+   private:
+    friend class h2_server;
+    friend struct h2_static_job;
+
+    // 请求编号表的一项，其他线程据此判断请求是否仍然有效
+    struct request_state {
+        uint32_t stream;  // 流编号
+        size_t posted;    // 其他线程投递、尚未处理的字节数
+        size_t buffered;  // 流的发送缓冲区中尚未分帧的字节数
+    };
+
+    h2_session() : m_fd(-1), m_active(false), m_dead(false), m_busy(0), m_next_request(0) {}
+    ~h2_session() {}
+
+    void start(int fd, std::unique_ptr<h2_upgrade> info, int close_log);
+
+    // 接收
+    bool read();
+    bool process_input();
+    bool handle_frame(uint8_t type, uint8_t flags, uint32_t sid, const unsigned char *p, size_t len);
+    bool on_headers(uint8_t flags, uint32_t sid, const unsigned char *p, size_t len);
+    bool on_continuation(uint8_t flags, uint32_t sid, const unsigned char *p, size_t len);
+    bool end_headers();
+    bool on_data(uint8_t flags, uint32_t sid, const unsigned char *p, size_t len);
+    bool on_settings(uint8_t flags, uint32_t sid, const unsigned char *p, size_t len);
+    bool apply_settings(const unsigned char *p, size_t len);
+    bool on_window_update(uint32_t sid, const unsigned char *p, size_t len);
+
+    // 请求处理
+    h2_stream *open_stream(uint32_t sid);
+    bool validate(h2_stream &s);
+    void dispatch(h2_stream &s);
+    void respond_static(h2_stream &s, const char *dir, size_t dir_len, const char *path, size_t path_len);
+    void static_done(h2_static_lookup &l);                // 阻塞线程池查找完成，在主循环中回调
+    void send_static(h2_stream &s, h2_static_lookup &l);  // 按查找结果回复文件或错误页
+    void respond_simple(h2_stream &s, int status, const char *content_type, std::string_view body,
+                        std::string_view allow = std::string_view());
+    void encode_common(std::string &block);  // 每个响应都带的 date 和 server
+
+    // 处理函数输出的转换
+    h2_stream *lookup(unsigned request_id);
+    bool alive(unsigned request_id);
+    bool push(unsigned request_id, const struct iovec *iov, int count, bool done);
+    bool translate(h2_stream &s, const char *data, size_t len);
+    bool translate_head(h2_stream &s, size_t head_len);
+    void append_body(h2_stream &s, const char *data, size_t len);
+    void account(h2_stream &s);
+    void drained(h2_stream &s);
+    void mark_ready(h2_stream &s, int status, size_t head_len);  // 响应头已生成
+    void log_access(h2_stream &s);                               // 流结束时写一条访问记录
+
+    // 发送
+    void write_frame(uint8_t type, uint8_t flags, uint32_t sid, const void *payload, size_t len);
+    void write_headers(uint32_t sid, const std::string &block, bool end_stream);
+    void send_rst(uint32_t sid, uint32_t code);
+    void queue(h2_stream &s);
+    void schedule(h2_stream &s);
+    bool sendable(const h2_stream &s) const;
+    void emit(h2_stream &s);
+    void fill();
+    void pump();
+    void arm();
+
+    // 关闭
+    void finish(h2_stream &s);  // END_STREAM 已发出
+    void reset_stream(h2_stream &s, uint32_t code, bool notify_peer = true);
+    void release(h2_stream &s);
+    bool connection_error(uint32_t code, const char *why);
+    void go_away(uint32_t code);
+    void kill();
+    void destroy();
+
+   private:
+    int m_fd;                          // socket
+    bool m_active;                     // 是否正在服务一条连接
+    int m_close_log;                   // 日志开关
+    std::string m_remote_addr;         // 客户端 IP
+    std::string m_in;                  // 尚未组成完整帧的数据
+    std::string m_out;                 // 待发送的帧
+    size_t m_out_off;                  // m_out 中已发送的字节数
+    uint32_t m_armed;                  // 当前注册的事件，事件触发后为 0
+    bool m_dead;                       // 已决定关闭，等待统一释放
+    bool m_closing;                    // 已发送 GOAWAY，发完后关闭
+    bool m_goaway_received;            // 对端已发送 GOAWAY，不再接受新流
+    bool m_preface;                    // 已收到连接前言
+    bool m_settings_received;          // 已收到对端的第一个 SETTINGS
+    int m_busy;                        // 正在处理事件，结束后统一发送
+    time_t m_last_active;              // 最近一次收发数据的时间
+    uint32_t m_addr;                   // 客户端 IPv4 地址，网络字节序，访问日志用
+    uint32_t m_reuse;                  // 连接上已记录访问日志的流数
+    long long m_event_us;              // 当前读事件开始处理的时间，访问日志未启用时为 0
+
+    hpack_decoder m_decoder;           // 请求头解码
+    hpack_encoder m_encoder;           // 响应头编码
+    std::string m_header_block;        // HEADERS + CONTINUATION 拼出的头部块
+    uint32_t m_header_stream;          // 正在接收头部块的流，0 表示没有
+    uint8_t m_header_flags;            // 头部块第一帧（HEADERS）的标志
+
+    uint32_t m_last_stream;            // 已处理的最大客户端流编号
+    int64_t m_send_window;             // 连接级发送窗口
+    uint32_t m_peer_initial_window;    // 对端给每个流的初始发送窗口
+    uint32_t m_peer_max_frame;         // 对端接受的最大帧负载
+    int64_t m_recv_window;             // 连接级接收窗口
+    uint32_t m_recv_consumed;          // 已处理、尚未通过 WINDOW_UPDATE 补充的字节数
+
+    std::unordered_map<uint32_t, h2_stream> m_streams;  // 流编号 -> 流
+    std::deque<uint32_t> m_ready;                       // 有数据可发的流，轮转分帧
+    locker m_lock;                                      // 保护 m_requests 和 m_next_request
+    std::unordered_map<unsigned, request_state> m_requests;  // 请求编号 -> 状态
+    unsigned m_next_request;                            // 上一个请求编号，对象复用时不清零
+};
+
+/**
+ * @brief HTTP/2 连接管理（单例）
+ */
+class h2_server {
+   public:
+    static h2_server *get_instance() {
+        static h2_server instance;
+        return &instance;
+    }
+
+    // 注册空闲检查，启动阶段调用；文档根目录和路由表按请求的 :authority 从 http_conn::m_vhosts 中选择
+    void init(int close_log);
+    // 接管已完成握手的 socket，主循环线程调用
+    void adopt(int fd, std::unique_ptr<h2_upgrade> info);
+
+    size_t connections() const { return m_live.size(); }
+    char *buffer() { return m_buf; }
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+   private:
+    friend class h2_session;
+
+    h2_server() : m_close_log(0), m_started(false) {}
+    ~h2_server() {}
+
+    void tick();
+    void bury(h2_session *session);  // 推迟释放：事件处理过程中不能清空会话
+    void sweep();
+
+   private:
+    int m_close_log;                                 // 日志开关
+    bool m_started;                                  // 是否已注册周期回调
+    std::vector<h2_session *> m_sessions;            // fd -> 会话，常驻复用
+    std::vector<h2_session *> m_live;                // 正在服务的会话
+    std::vector<h2_session *> m_graveyard;           // 等待释放的会话
+    char m_buf[BUFFER_SIZE];                         // 读连接的缓冲区
+};
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * @file access_log.cpp
+ * @brief 访问日志的实现
+ */
+
+#include "access_log.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+
+static const int IDLE_WAIT_US = 10000;  // 写线程没有新记录时的等待时间
+
+// 请求方法名，下标与 http_conn::METHOD 一致
+static const char *method_names[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"};
+
+const char access_log::MAGIC[8] = {'T', 'W', 'S', 'A', 'L', 'O', 'G', '1'};
+
+// 线程退出时交还环形缓冲区，由写线程读完剩余记录后释放
+struct access_ring_holder {
+    log_ring *ring = NULL;
+    ~access_ring_holder() {
+        if (ring) ring->retire();
+    }
+};
+static thread_local access_ring_holder t_access_ring;
+
+access_log::access_log()
+    : m_format(ACCESS_OFF), m_ring_size(0), m_fp(NULL), m_today(0), m_dropped(0), m_stop(false), m_started(false) {}
+
+access_log::~access_log() {
+    m_enabled.store(false, std::memory_order_relaxed);
+    if (m_started) {
+        m_stop.store(true, std::memory_order_release);
+        pthread_join(m_thread, NULL);  // 写线程读完剩余记录后退出
+    }
+    if (m_fp) fclose(m_fp);
+    for (size_t i = 0; i < m_rings.size(); ++i) delete m_rings[i];
+}
+
+bool access_log::parse_format(const char *name, access_format &format) {
+    static const char *names[] = {"off", "clf", "json", "binary"};
+    for (int i = 0; i < 4; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            format = (access_format)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool access_log::init(const char *file_name, access_format format, uint32_t ring_size) {
+    if (format == ACCESS_OFF || m_started) return true;
+    m_format = format;
+    m_ring_size = ring_size;
+    m_base = file_name;
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+    rotate(my_tm);
+    if (!m_fp) return false;
+    if (pthread_create(&m_thread, NULL, worker, this) != 0) return false;
+    m_started = true;
+    m_enabled.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void access_log::rotate(const struct tm &my_tm) {
+    const char *slash = strrchr(m_base.c_str(), '/');
+    size_t dir_len = slash ? slash - m_base.c_str() + 1 : 0;
+    char path[512];
+    snprintf(path, sizeof(path), "%.*s%d_%02d_%02d_%s%s", (int)dir_len, m_base.c_str(), my_tm.tm_year + 1900,
+             my_tm.tm_mon + 1, my_tm.tm_mday, m_base.c_str() + dir_len, m_format == ACCESS_BINARY ? ".bin" : "");
+    FILE *fp = fopen(path, "a");
+    if (!fp) return;  // 打开失败时继续写原来的文件
+    if (m_fp) fclose(m_fp);
+    m_fp = fp;
+    m_today = my_tm.tm_mday;
+    if (m_format == ACCESS_BINARY) fwrite(MAGIC, 1, sizeof(MAGIC), m_fp);
+}
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：请求线程一侧
+
+log_ring *access_log::thread_ring() {
+    if (t_access_ring.ring) return t_access_ring.ring;
+    log_ring *ring = new log_ring(m_ring_size);
+    m_ring_lock.lock();
+    m_rings.push_back(ring);
+    m_ring_lock.unlock();
+    t_access_ring.ring = ring;
+    return ring;
+}
+
+void access_log::write(const access_entry &entry, const char *path, size_t path_len) {
+    log_ring *ring = thread_ring();
+    if (!ring->reserve(1)) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    access_entry e = entry;
+    e.path_len = path_len < ACCESS_MAX_PATH ? path_len : ACCESS_MAX_PATH;
+    log_record &r = ring->slot(0);
+    memcpy(r.text, &e, sizeof(e));  // text 只按 4 字节对齐，整体复制
+    memcpy(r.text + sizeof(e), path, e.path_len);
+    r.len = sizeof(e) + e.path_len;
+    r.more = 0;
+    r.level = 0;
+    ring->publish(1);
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：格式化
+
+// 路径中的引号、反斜杠和控制字符转义为 \xHH，保证一条记录只占一行、字段边界清楚
+static void append_escaped(std::string &out, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = s[i];
+        if (c < 0x20 || c == 0x7f || c == '"' || c == '\\') {
+            char esc[4] = {'\\', 'x', hex[c >> 4], hex[c & 15]};
+            out.append(esc, 4);
+        } else {
+            out += (char)c;
+        }
+    }
+}
+
+static const char *method_name(const access_entry &e) {
+    return e.method < sizeof(method_names) / sizeof(method_names[0]) ? method_names[e.method] : "-";
+}
+
+// 按秒缓存格式化好的时间，同一秒内的记录只调用一次 localtime_r
+static const char *format_date(int64_t ns, bool json) {
+    static thread_local time_t cached[2] = {-1, -1};
+    static thread_local char text[2][64];
+    time_t t = ns / 1000000000LL;
+    if (cached[json] != t) {
+        struct tm my_tm;
+        localtime_r(&t, &my_tm);
+        strftime(text[json], sizeof(text[json]), json ? "%Y-%m-%dT%H:%M:%S" : "%d/%b/%Y:%H:%M:%S %z", &my_tm);
+        cached[json] = t;
+    }
+    return text[json];
+}
+
+static void format_addr(char *buf, size_t size, uint32_t addr) {
+    struct in_addr in;
+    in.s_addr = addr;
+    if (!inet_ntop(AF_INET, &in, buf, size)) snprintf(buf, size, "-");
+}
+
+void access_log::format_clf(std::string &out, const access_entry &e, const char *path) {
+    char addr[INET_ADDRSTRLEN], buf[256];
+    format_addr(addr, sizeof(addr), e.addr);
+    out += addr;
+    out += " - - [";
+    out += format_date(e.start_ns, false);
+    out += "] \"";
+    if (e.method == access_entry::NO_METHOD) {
+        out += "-\"";
+    } else {
+        out += method_name(e);
+        out += ' ';
+        append_escaped(out, path, e.path_len);
+        out += e.flags & access_entry::HTTP2 ? " HTTP/2.0\"" : e.flags & access_entry::HTTP10 ? " HTTP/1.0\"" : " HTTP/1.1\"";
+    }
+    int n = snprintf(buf, sizeof(buf), " %u %llu reuse=%u queue=%u parse=%u handler=%u send=%u total=%u%s\n",
+                     e.status, (unsigned long long)e.bytes, e.reuse, e.queue_us, e.parse_us, e.handler_us, e.send_us,
+                     e.total_us, e.flags & access_entry::TLS ? " tls" : "");
+    out.append(buf, n);
+}
+
+void access_log::format_json(std::string &out, const access_entry &e, const char *path) {
+    char addr[INET_ADDRSTRLEN], buf[320];
+    format_addr(addr, sizeof(addr), e.addr);
+    int n = snprintf(buf, sizeof(buf), "{\"time\":\"%s.%06lld\",\"addr\":\"%s\",\"method\":\"%s\",\"path\":\"",
+                     format_date(e.start_ns, true), (long long)(e.start_ns % 1000000000LL / 1000), addr, method_name(e));
+    out.append(buf, n);
+    // JSON 字符串中 \x 不合法，控制字符、引号和反斜杠用 \u00HH
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < e.path_len; ++i) {
+        unsigned char c = path[i];
+        if (c < 0x20 || c == '"' || c == '\\') {
+            char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            out.append(esc, 6);
+        } else {
+            out += (char)c;
+        }
+    }
+    n = snprintf(buf, sizeof(buf),
+                 "\",\"status\":%u,\"bytes\":%llu,\"keep_alive\":%s,\"tls\":%s,\"reuse\":%u,"
+                 "\"queue_us\":%u,\"parse_us\":%u,\"handler_us\":%u,\"send_us\":%u,\"total_us\":%u}\n",
+                 e.status, (unsigned long long)e.bytes, e.flags & access_entry::KEEP_ALIVE ? "true" : "false",
+                 e.flags & access_entry::TLS ? "true" : "false", e.reuse, e.queue_us, e.parse_us, e.handler_us,
+                 e.send_us, e.total_us);
+    out.append(buf, n);
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：写线程
+
+void *access_log::worker(void *arg) {
+    ((access_log *)arg)->run();
+    return NULL;
+}
+
+void access_log::run() {
+    while (true) {
+        bool stop = m_stop.load(std::memory_order_acquire);  // 先读退出标志，之后提交的记录也能读到
+        size_t n = drain_rings();
+        if (n > 0) fflush(m_fp);
+        if (stop) break;
+        if (n == 0) usleep(IDLE_WAIT_US);
+    }
+}
+
+size_t access_log::drain_rings() {
+    m_ring_lock.lock();
+    for (size_t i = 0; i < m_rings.size();) {
+        log_ring *ring = m_rings[i];
+        if (ring->retired() && ring->readable() == 0) {
+            delete ring;
+            m_rings[i] = m_rings.back();
+            m_rings.pop_back();
+        } else {
+            ++i;
+        }
+    }
+    std::vector<log_ring *> rings(m_rings);
+    m_ring_lock.unlock();
+
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+    if (m_today != my_tm.tm_mday) rotate(my_tm);
+
+    size_t total = 0;
+    for (size_t i = 0; i < rings.size(); ++i) {
+        log_ring *ring = rings[i];
+        uint32_t n = ring->readable();
+        uint32_t tail = ring->tail();
+        for (uint32_t j = 0; j < n; ++j) {
+            const log_record &r = ring->at(tail + j);
+            if (m_format == ACCESS_BINARY) {
+                fwrite(r.text, 1, r.len, m_fp);
+                continue;
+            }
+            access_entry e;
+            memcpy(&e, r.text, sizeof(e));
+            m_line.clear();
+            if (m_format == ACCESS_JSON)
+                format_json(m_line, e, r.text + sizeof(access_entry));
+            else
+                format_clf(m_line, e, r.text + sizeof(access_entry));
+            fwrite(m_line.data(), 1, m_line.size(), m_fp);
+        }
+        ring->release(n);
+        total += n;
+    }
+    return total;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
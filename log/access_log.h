@@ -0,0 +1,143 @@
+/**
+ * @file access_log.h
+ * @brief 访问日志：每个完成的请求一条记录
+ *
+ * 与运行日志（Log）分开的文件和写线程，记录客户端地址、方法、路径、状态码、发送字节数、
+ * 连接上的第几个请求，以及排队、解析、处理和发送各阶段的耗时。
+ * 主要特点：
+ * 1. 请求线程只把定长的 access_entry 和路径复制进本线程的环形缓冲区（log_ring.h），不格式化、不加锁，
+ *    环满时丢弃并计数
+ * 2. 写线程按 -A 选择的格式输出：CLF（Common Log Format 后加耗时字段）、每行一个 JSON 对象，
+ *    或原样写出二进制记录（文件头 "TWSALOG1"，logdecode 解码为 CLF）
+ * 3. 按天切换文件，文件名形如 2026_10_19_AccessLog
+ * 4. 未启用时 enabled() 为 false，连接上的计时全部跳过，每个请求只多一次读取
+ *
+ * 二进制文件由文件头和若干条记录组成，多字节字段均为本机字节序：
+ *   "TWSALOG1"                                 文件头，追加写入时会再次出现
+ *   access_entry(56) path(path_len)             一条记录
+ */
+
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "../lock/locker.h"
+#include "log_ring.h"
+
+enum access_format { ACCESS_OFF = 0, ACCESS_CLF, ACCESS_JSON, ACCESS_BINARY };
+
+// 一条访问记录的定长部分，路径紧跟在后面。耗时均为微秒
+struct access_entry {
+    enum { KEEP_ALIVE = 1, TLS = 2, HTTP10 = 4, HTTP2 = 8 };
+    static const uint8_t NO_METHOD = 0xff;
+
+    int64_t start_ns;     // 收到请求的墙上时间（纳秒）
+    uint64_t bytes;       // 发送的字节数，含响应头
+    uint32_t addr;        // 客户端 IPv4 地址，网络字节序
+    uint32_t reuse;       // 连接上此前已完成的请求数，第一个请求为 0
+    uint16_t status;      // 状态码
+    uint16_t path_len;
+    uint8_t method;       // http_conn::METHOD，请求行未解析时为 NO_METHOD
+    uint8_t flags;        // KEEP_ALIVE、TLS、HTTP10、HTTP2
+    uint16_t reserved;
+    uint32_t queue_us;    // 读事件到达到工作线程开始处理，请求体分几次读入时累加
+    uint32_t parse_us;    // 解析请求行、头部和请求体
+    uint32_t handler_us;  // 生成响应，异步处理函数算到它写出第一段响应为止
+    uint32_t send_us;     // 开始发送到发完
+    uint32_t total_us;    // 第一个读事件到发完
+};
+static_assert(sizeof(access_entry) == 56, "access_entry is written to binary access logs as is");
+static const size_t ACCESS_MAX_PATH = log_record::TEXT - sizeof(access_entry);  // 更长的路径截断
+
+// 连接上正在处理的请求的计时，时间取自 access_log::now_us()
+struct access_timing {
+    long long start = 0;    // 第一个读事件，0 表示尚未开始
+    long long queued = 0;   // 最近一次投递到线程池
+    long long handler = 0;  // 开始执行 do_request()
+    long long ready = 0;    // 响应开始发送，0 表示尚未生成
+    uint32_t queue_us = 0;
+    uint32_t parse_us = 0;
+    uint32_t handler_us = 0;
+    uint64_t bytes = 0;     // 流式响应已发送的字节数
+    int status = 0;
+};
+
+class access_log {
+   public:
+    static access_log *get_instance() {
+        static access_log instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 打开访问日志并启动写线程
+     * @param file_name 路径，文件名前加日期，如 ./AccessLog -> ./2026_10_19_AccessLog，二进制格式再加 .bin
+     * @param ring_size 每个线程的环形缓冲区记录数
+     */
+    bool init(const char *file_name, access_format format, uint32_t ring_size = 4096);
+    // 解析 -A 的取值：off/clf/json/binary，不认识时返回 false
+    static bool parse_format(const char *name, access_format &format);
+
+    static bool enabled() { return m_enabled.load(std::memory_order_relaxed); }
+    // 单调时钟微秒
+    static long long now_us() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+    // 启用时把 t 设为当前时间
+    static void stamp(long long &t) {
+        if (enabled()) t = now_us();
+    }
+
+    // 提交一条记录，path 超过 ACCESS_MAX_PATH 时截断；环满时丢弃
+    void write(const access_entry &entry, const char *path, size_t path_len);
+    // 环满而丢弃的记录数
+    unsigned long dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // 把一条记录格式化为一行 CLF 或 JSON（含换行），logdecode 也使用
+    static void format_clf(std::string &out, const access_entry &e, const char *path);
+    static void format_json(std::string &out, const access_entry &e, const char *path);
+
+    static const char MAGIC[8];
+
+   private:
+    access_log();
+    ~access_log();
+    access_log(const access_log &) = delete;
+    access_log &operator=(const access_log &) = delete;
+
+    log_ring *thread_ring();
+    static void *worker(void *arg);
+    void run();
+    // 读完所有环，返回读到的记录数
+    size_t drain_rings();
+    // 日期变化时切换文件，只由写线程调用
+    void rotate(const struct tm &my_tm);
+
+   private:
+    static inline std::atomic<bool> m_enabled{false};
+    access_format m_format;
+    uint32_t m_ring_size;
+    std::string m_base;     // init() 的 file_name
+    FILE *m_fp;
+    int m_today;
+    std::string m_line;     // 写线程的格式化缓冲区
+
+    locker m_ring_lock;     // 保护 m_rings
+    std::vector<log_ring *> m_rings;
+    std::atomic<unsigned long> m_dropped;
+    std::atomic<bool> m_stop;
+    bool m_started;
+    pthread_t m_thread;
+};
+
+#endif
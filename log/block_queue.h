@@ -15,6 +15,7 @@
 #include <sys/time.h>
 
 #include <iostream>
+#include <utility>
 
 #include "../lock/locker.h"  // 自定义的锁和条件变量封装
 using namespace std;
@@ -138,7 +139,7 @@ class block_queue {
 
         // 取出队首元素
         m_front = (m_front + 1) % m_max_size;  // 队首指针后移
-        item = m_array[m_front];    //item就是取出的队首元素
+        item = std::move(m_array[m_front]);    //item就是取出的队首元素，移出以免槽位继续持有资源
         m_size--;
         m_mutex.unlock();
         return true;
@@ -167,7 +168,7 @@ class block_queue {
         }
 
         m_front = (m_front + 1) % m_max_size;
-        item = m_array[m_front];
+        item = std::move(m_array[m_front]);
         m_size--;
         m_mutex.unlock();
         return true;
@@ -2,30 +2,140 @@
  * 日志系统实现文件
  * 功能：提供日志记录功能，支持同步和异步日志写入。
  * 同步模式：日志直接写入文件。
- * 异步模式：日志通过阻塞队列缓冲，由后台线程异步写入文件，避免阻塞主线程。
+ * 异步模式：每个线程把日志行格式化进自己的单生产者单消费者环形缓冲区（log_ring.h），
+ *          后台线程轮流读取各个环，攒成大块后一次写入文件。写日志的线程之间不共享任何锁。
+ * 二进制模式：异步模式的变体，环形缓冲区中放的是格式编号、时间戳计数和原始参数（log_binary.h），
+ *          由 logdecode 离线格式化。
+ * 环满时按级别丢弃最新的行、请求日志线程丢弃最旧的行、等待空位或写入溢出文件（set_backpressure()）。
  * 支持按日期和行数分割日志文件，便于管理和查看。
  */
 
+#include <ctype.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <string.h>
 #include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <mutex>
 
 #include "log.h"
 using namespace std;
 
+static const size_t STAGE_SIZE = 64 * 1024;  // 日志线程每次写入文件的最大字节数
+static const int IDLE_WAIT_MS = 50;          // 日志线程没有新日志时的最长等待时间
+static const int BATCH_WAIT_US = 1000;       // 读到日志后隔这么久再读下一轮，让各线程攒够一批
+static const size_t BINARY_MAX = 8192;       // 一条二进制记录的最大字节数，超过的丢弃
+static const int CLOCK_INTERVAL_MS = 1000;   // 二进制模式写时钟校准条目的间隔
+static const size_t DATE_SIZE = 48;          // "年_月_日_" 前缀，三个 int 都取最长时也放得下
+static const size_t PATH_SIZE = 128 + DATE_SIZE + 128 + 16;  // 路径 + 日期 + 文件名 + ".序号"
+
+// 线程退出时交还环形缓冲区，由日志线程读完剩余记录后释放
+struct ring_holder {
+    log_ring *ring = NULL;
+    char *scratch = NULL;  // 一条记录放不下的长行先格式化到这里，大小为 scratch_size()
+    ~ring_holder() {
+        if (ring) ring->retire();
+        delete[] scratch;
+    }
+};
+static thread_local ring_holder t_ring;
+
+static size_t scratch_size(int log_buf_size) { return std::max((size_t)log_buf_size, BINARY_MAX); }
+
+static long long now_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+static long long monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static long long realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 用单调时钟测量 10ms 内的时间戳计数，得到每纳秒的计数；非 x86 平台计数本身就是纳秒
+static double calibrate_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec a, b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    uint64_t t0 = log_bin::ticks();
+    usleep(10000);
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    uint64_t t1 = log_bin::ticks();
+    double ns = (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+    return ns > 0 && t1 > t0 ? (t1 - t0) / ns : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
 // 构造函数，初始化日志计数器并设置异步标志为false
-Log::Log() {
+Log::Log()
+    : m_flush_requested(false),
+      m_dropped(0),
+      m_evicted(0),
+      m_spilled(0),
+      m_waited(0),
+      m_max_depth(0),
+      m_spill_fd(-1),
+      m_sleeping(false),
+      m_stop(false) {
     m_count = 0;         // 日志行数计数器
     m_is_async = false;  // 默认同步模式
+    m_fp = NULL;
+    m_segments = NULL;
+    m_file_index = 0;
+    m_buf = NULL;
+    m_stage = NULL;
+    m_stage_len = 0;
+    m_ring_size = 0;
+    m_dropped_reported = 0;
+    m_file_buf = NULL;
+    m_unflushed = 0;
+    m_last_flush_ms = 0;
+    m_is_binary = false;
+    m_coarse_clock = false;
+    m_ticks_per_ns = 1.0;
+    m_last_clock_ms = 0;
+    for (int i = 0; i < 4; ++i) m_text_sites[i].store(0);
+    // 环满时默认丢弃 DEBUG/INFO 的新行，WARN 挤掉本线程最旧的行，ERROR 写入溢出文件
+    m_full_action[LOG_LEVEL_DEBUG] = LOG_FULL_DROP_NEWEST;
+    m_full_action[LOG_LEVEL_INFO] = LOG_FULL_DROP_NEWEST;
+    m_full_action[LOG_LEVEL_WARN] = LOG_FULL_DROP_OLDEST;
+    m_full_action[LOG_LEVEL_ERROR] = LOG_FULL_SPILL;
+    m_full_wait_ms = 10;
+    for (int i = 0; i < 4; ++i) m_dropped_level[i].store(0);
 }
 
-// 析构函数，关闭日志文件
+// 析构函数，等日志线程写完剩余日志后关闭日志文件
 Log::~Log() {
+    if (m_is_async) {
+        m_stop.store(true, std::memory_order_release);
+        m_wake_lock.lock();
+        m_wake.signal();
+        m_wake_lock.unlock();
+        pthread_join(m_writer, NULL);
+    }
     if (m_fp != NULL) {
         fclose(m_fp);  // 关闭文件指针
     }
+    delete m_segments;  // 截断当前段，等后台线程做完改名和压缩
+    if (m_spill_fd >= 0) close(m_spill_fd);
+    delete[] m_buf;
+    delete[] m_stage;
+    delete[] m_file_buf;
 }
 
 /*
@@ -35,20 +145,20 @@ Log::~Log() {
  *   - close_log: 是否关闭日志（未使用）
  *   - log_buf_size: 日志缓冲区大小
  *   - split_lines: 日志文件最大行数，超过则分割
- *   - max_queue_size: 异步队列大小，>=1时启用异步模式
+ *   - max_queue_size: 每个线程的环形缓冲区记录数（向上取整为 2 的幂），>=1时启用异步模式
+ *   - binary: 写二进制日志，文件名加 .bin 后缀，需要同时启用异步模式
  * 返回值：成功返回true，失败返回false
 */
 bool Log::init(const char *file_name, int close_log, int log_buf_size,
-               int split_lines, int max_queue_size) {
-    // 如果设置了max_queue_size，则启用异步模式
-    if (max_queue_size >= 1) {
-        m_is_async = true;  // 设置为异步模式
-        m_log_queue = new block_queue<string>(max_queue_size);  // 创建阻塞队列
-        pthread_t tid;  //创建线程标识符，唯一标识该线程，类似进程的pid
-        // 创建线程异步写日志，flush_log_thread为回调函数
-        pthread_create(&tid, NULL, flush_log_thread, NULL);
+               int split_lines, int max_queue_size, bool binary) {
+    if (binary && max_queue_size < 1) return false;
+    string name = file_name;
+    if (binary) {
+        name += ".bin";  // 与同名的文本日志分开
+        file_name = name.c_str();
+        m_is_binary = true;
+        m_ticks_per_ns = calibrate_ticks();
     }
-
     m_close_log = close_log;              // 是否关闭日志（未使用）
     m_log_buf_size = log_buf_size;        // 设置日志缓冲区大小
     m_buf = new char[m_log_buf_size];     // 分配缓冲区内存
@@ -67,32 +177,238 @@ bool Log::init(const char *file_name, int close_log, int log_buf_size,
     }
     // 解析日志文件名和路径
     const char *p = strrchr(file_name, '/');
-    char log_full_name[256] = {0};
+    char log_full_name[PATH_SIZE] = {0};
 
     if (p == NULL)  // 如果文件名中不包含路径
     {
-        snprintf(log_full_name, 255, "%d_%02d_%02d_%s", my_tm.tm_year + 1900,
+        snprintf(log_full_name, sizeof(log_full_name), "%d_%02d_%02d_%s", my_tm.tm_year + 1900,
                  my_tm.tm_mon + 1, my_tm.tm_mday, file_name);
     } else  // 如果文件名中包含路径
     {
         strcpy(log_name, p + 1);                          // 提取文件名
         strncpy(dir_name, file_name, p - file_name + 1);  // 提取路径
-        snprintf(log_full_name, 255, "%s%d_%02d_%02d_%s", dir_name,
+        snprintf(log_full_name, sizeof(log_full_name), "%s%d_%02d_%02d_%s", dir_name,
                  my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
                  log_name);
     }
 
     m_today = my_tm.tm_mday;  // 记录当前日期
+    m_spill_path = string(log_full_name) + ".overflow";
 
     // 打开日志文件
-    m_fp = fopen(log_full_name, "a");
-    if (m_fp == NULL) {
+    m_file_buf = new char[m_policy.bytes];
+    m_last_flush_ms = now_ms();
+    if (m_segment_policy.size > 0) m_segments = new log_segments(m_segment_policy.size, m_segment_policy.compress);
+    if (!open_locked(log_full_name)) {
+        delete m_segments;
+        m_segments = NULL;
         return false;  // 文件打开失败
     }
 
+    // 如果设置了max_queue_size，则启用异步模式；日志文件打开后再启动日志线程
+    if (max_queue_size >= 1) {
+        m_is_async = true;  // 设置为异步模式
+        m_ring_size = max_queue_size;
+        m_stage = new char[STAGE_SIZE];
+        // 创建线程异步写日志，flush_log_thread为回调函数
+        pthread_create(&m_writer, NULL, flush_log_thread, NULL);
+    }
+
+    // 日志已可写，打开所有模块；需要更高级别时之后再调用 set_levels()
+    for (int i = 0; i < LOG_MOD_COUNT; ++i) set_level(i, LOG_LEVEL_DEBUG);
     return true;  // 初始化成功
 }
 
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：运行时级别
+
+static const char *LEVEL_NAMES[] = {"debug", "info", "warn", "error", "off"};
+static const char *MODULE_NAMES[] = {"main", "http", "timer", "pool", "sql"};
+
+static int find_name(const char *const *names, int count, const string &name) {
+    for (int i = 0; i < count; ++i) {
+        if (name == names[i]) return i;
+    }
+    return -1;
+}
+
+bool Log::set_levels(const char *spec) {
+    // 先全部解析，有错误时不改动任何模块
+    int levels[LOG_MOD_COUNT];
+    for (int i = 0; i < LOG_MOD_COUNT; ++i) levels[i] = m_levels[i].load(std::memory_order_relaxed);
+    string s(spec);
+    for (size_t start = 0; start <= s.size();) {
+        size_t comma = s.find(',', start);
+        if (comma == string::npos) comma = s.size();
+        string item = s.substr(start, comma - start);
+        start = comma + 1;
+        while (!item.empty() && isspace((unsigned char)item[item.size() - 1])) item.erase(item.size() - 1);
+        while (!item.empty() && isspace((unsigned char)item[0])) item.erase(0, 1);
+        if (item.empty()) continue;
+
+        size_t eq = item.find('=');
+        int level = find_name(LEVEL_NAMES, LOG_LEVEL_OFF + 1, eq == string::npos ? item : item.substr(eq + 1));
+        if (level < 0) return false;
+        if (eq == string::npos) {
+            for (int i = 0; i < LOG_MOD_COUNT; ++i) levels[i] = level;
+        } else {
+            int module = find_name(MODULE_NAMES, LOG_MOD_COUNT, item.substr(0, eq));
+            if (module < 0) return false;
+            levels[module] = level;
+        }
+    }
+    for (int i = 0; i < LOG_MOD_COUNT; ++i) set_level(i, levels[i]);
+    return true;
+}
+
+void Log::shift_levels(int delta) {
+    for (int i = 0; i < LOG_MOD_COUNT; ++i) {
+        int level = m_levels[i].load(std::memory_order_relaxed);
+        if (level == LOG_LEVEL_OFF) continue;
+        set_level(i, std::min(std::max(level + delta, (int)LOG_LEVEL_DEBUG), (int)LOG_LEVEL_ERROR));
+    }
+}
+
+string Log::levels() {
+    string s;
+    for (int i = 0; i < LOG_MOD_COUNT; ++i) {
+        if (i) s += ',';
+        s += MODULE_NAMES[i];
+        s += '=';
+        s += LEVEL_NAMES[m_levels[i].load(std::memory_order_relaxed)];
+    }
+    return s;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：环满时的处理方式和计数
+
+static const char *FULL_NAMES[] = {"drop-newest", "drop-oldest", "block", "spill"};
+
+bool Log::set_backpressure(const char *spec) {
+    uint8_t actions[4];
+    memcpy(actions, m_full_action, sizeof(actions));
+    int wait_ms = m_full_wait_ms;
+    string s(spec);
+    for (size_t start = 0; start <= s.size();) {
+        size_t comma = s.find(',', start);
+        if (comma == string::npos) comma = s.size();
+        string item = s.substr(start, comma - start);
+        start = comma + 1;
+        while (!item.empty() && isspace((unsigned char)item[item.size() - 1])) item.erase(item.size() - 1);
+        while (!item.empty() && isspace((unsigned char)item[0])) item.erase(0, 1);
+        if (item.empty()) continue;
+
+        size_t eq = item.find('=');
+        string key = eq == string::npos ? string() : item.substr(0, eq);
+        string value = eq == string::npos ? item : item.substr(eq + 1);
+        if (key == "wait") {
+            char *end;
+            long ms = strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || ms < 0 || ms > 10000) return false;
+            wait_ms = ms;
+            continue;
+        }
+        int action = find_name(FULL_NAMES, 4, value);
+        if (action < 0) return false;
+        if (key.empty()) {
+            for (int i = 0; i < 4; ++i) actions[i] = action;
+        } else {
+            int level = find_name(LEVEL_NAMES, LOG_LEVEL_OFF, key);
+            if (level < 0) return false;
+            actions[level] = action;
+        }
+    }
+    memcpy(m_full_action, actions, sizeof(actions));
+    m_full_wait_ms = wait_ms;
+    return true;
+}
+
+string Log::backpressure() const {
+    string s;
+    for (int i = 0; i < 4; ++i) {
+        s += LEVEL_NAMES[i];
+        s += '=';
+        s += FULL_NAMES[m_full_action[i]];
+        s += ',';
+    }
+    return s + "wait=" + std::to_string(m_full_wait_ms);
+}
+
+log_stats Log::stats() {
+    log_stats st;
+    for (int i = 0; i < 4; ++i) st.dropped[i] = m_dropped_level[i].load(std::memory_order_relaxed);
+    st.evicted = m_evicted.load(std::memory_order_relaxed);
+    st.spilled = m_spilled.load(std::memory_order_relaxed);
+    st.waited = m_waited.load(std::memory_order_relaxed);
+    st.max_depth = m_max_depth.load(std::memory_order_relaxed);
+    m_ring_lock.lock();
+    st.rings = m_rings.size();
+    for (size_t i = 0; i < m_rings.size(); ++i) st.depth += m_rings[i]->readable();
+    m_ring_lock.unlock();
+    if (m_ring_size > 0) {
+        st.capacity = 1;
+        while (st.capacity < m_ring_size) st.capacity <<= 1;  // 与 log_ring 的取整相同
+    }
+    return st;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：日志行的时间前缀。每个线程缓存当前这一分钟的 "YYYY-MM-DD HH:MM:"，
+//换分钟时才调用 localtime_r() 重新格式化，秒和微秒用整数直接写入，不再调用不可重入的 localtime() 和 snprintf()。
+//时区偏移都是整分钟，所以本地时间与 UTC 在同一时刻换分钟。
+
+struct time_cache {
+    long long minute = -1;  // 缓存对应的 UTC 分钟数
+    struct tm tm;           // 这一分钟开始时的本地时间，供按日期分割文件使用
+    char text[20];          // "YYYY-MM-DD HH:MM:"
+    int len = 0;
+};
+static thread_local time_cache t_time;
+
+struct level_tag {
+    const char *text;
+    int len;
+};
+static const level_tag LEVEL_TAGS[] = {{"[debug]: ", 9}, {"[info]: ", 8}, {"[warn]: ", 8}, {"[erro]: ", 8}};
+
+static inline void put_digits(char *p, long v, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        p[i] = '0' + v % 10;
+        v /= 10;
+    }
+}
+
+int Log::format_prefix(char *prefix, int level, const struct tm *&my_tm) {
+    struct timespec now;
+    clock_gettime(m_coarse_clock ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME, &now);  // 两者都走 vDSO，不进内核
+
+    long long minute = now.tv_sec / 60;
+    if (minute != t_time.minute) {
+        time_t t = now.tv_sec;
+        localtime_r(&t, &t_time.tm);
+        t_time.len = snprintf(t_time.text, sizeof(t_time.text), "%d-%02d-%02d %02d:%02d:", t_time.tm.tm_year + 1900,
+                              t_time.tm.tm_mon + 1, t_time.tm.tm_mday, t_time.tm.tm_hour, t_time.tm.tm_min);
+        t_time.minute = minute;
+    }
+    my_tm = &t_time.tm;
+
+    const level_tag &tag = LEVEL_TAGS[level >= 0 && level <= 3 ? level : 1];
+    char *p = prefix;
+    memcpy(p, t_time.text, t_time.len);
+    p += t_time.len;
+    put_digits(p, now.tv_sec % 60, 2);
+    p[2] = '.';
+    put_digits(p + 3, now.tv_nsec / 1000, 6);
+    p[9] = ' ';
+    p += 10;
+    memcpy(p, tag.text, tag.len);
+    return p + tag.len - prefix;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
 /*
  * 写入日志
  * 参数：
@@ -101,135 +417,562 @@ bool Log::init(const char *file_name, int close_log, int log_buf_size,
  *   - ...: 可变参数
 */
 void Log::write_log(int level, const char *format, ...) {
-
-    // 获取当前时间（精确到微秒）
-    struct timeval now = {0, 0};       // 定义timeval结构体，用于存储秒和微秒
-    gettimeofday(&now, NULL);          // 获取当前系统时间（比time()更高精度）
-    
-    time_t t = now.tv_sec;             // 提取秒级时间
-    struct tm *sys_tm = localtime(&t); // 转换为本地时间的tm结构体
-    struct tm my_tm = *sys_tm;         // 拷贝时间结构体（避免localtime的线程安全问题）
-    
-    char s[16] = {0};                  // 准备存储日志级别前缀的缓冲区
-
-    // 根据日志级别设置前缀
-    switch (level) {
-        case 0:
-            strcpy(s, "[debug]:");
-            break;
-        case 1:
-            strcpy(s, "[info]:");
-            break;
-        case 2:
-            strcpy(s, "[warn]:");
-            break;
-        case 3:
-            strcpy(s, "[erro]:");
-            break;
-        default:
-            strcpy(s, "[info]:");
-            break;
-    }
-
-    // 经过以上操作，产生的日志头部如下：
-    // 2023-10-05 14:30:45.123456 [debug]: 这是一条调试日志
-    
-    
-/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
-//代码块功能：
-    // 加锁，使用locker机制来确保线程安全的日志文件分割/
-    m_mutex.lock();
-    m_count++;  // 日志行数计数器递增。同时表明，每次调用write_log，只写入1行日志
-    // 每次调用write_log，都会检查是否需要分割
-    // 检查是否需要分割日志文件（按日期或行数，初始化日期不等于当前日期表明跨天，行数超过限制）
-    if (m_today != my_tm.tm_mday || m_count % m_split_lines == 0) {
-        char new_log[256] = {0};
-        fflush(m_fp);  // 刷新缓冲区
-        fclose(m_fp);  // 关闭当前文件
-        char tail[16] = {0};
-
-        // 生成新的日志文件名
-        snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900,
-                 my_tm.tm_mon + 1, my_tm.tm_mday);
-
-        if (m_today != my_tm.tm_mday)  // 如果是新的一天
-        {
-            snprintf(new_log, 255, "%s%s%s", dir_name, tail, log_name);
-            m_today = my_tm.tm_mday;  // 更新日期
-            m_count = 0;              // 重置计数器
-        } else                        // 如果是行数超过限制
-        {
-            snprintf(new_log, 255, "%s%s%s.%lld", dir_name, tail, log_name,
-                     m_count / m_split_lines);
-        }
-        m_fp = fopen(new_log, "a");  // 打开新文件
+    // 二进制模式下没有调用点编号，格式化后按 "%s" 记录
+    if (m_is_binary) {
+        char buf[log_bin::MAX_STRING + 1];
+        va_list valst;
+        va_start(valst, format);
+        vsnprintf(buf, sizeof(buf), format, valst);
+        va_end(valst);
+        int i = std::min(std::max(level, 0), 3);
+        write_binary(m_text_sites[i], i, "%s", (const char *)buf);
+        return;
     }
 
-    m_mutex.unlock();
-/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+    // 产生的日志头部如下，时间部分取自本线程缓存的前缀：
+    // 2023-10-05 14:30:45.123456 [debug]: 这是一条调试日志
+    char prefix[48];
+    const struct tm *my_tm;
+    int n = format_prefix(prefix, level, my_tm);
 
     // 处理可变参数。即调用write_log时，可以像printf一样，传入格式化字符串和可变参数
     // 如：log->write_log(1, "User %s login from %s", username, ip);
     va_list valst;          // 定义可变参数列表指针
     va_start(valst, format); // 初始化valst，指向format后的第一个可变参数
 
-
+    // 异步模式：格式化进本线程的环形缓冲区，不加锁
+    if (m_is_async) {
+        append_async(level, prefix, n, format, valst);
+        va_end(valst);
+        return;
+    }
 
 /*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
 //代码块功能：
-    string log_str; //存储最终格式化后的完整日志内容，即要写入日志文件的日志行
+    // 同步模式：加锁，检查是否需要分割日志文件，格式化后直接写入文件
     // 格式示例：2023-10-05 14:30:45.123456 [info]: User login from 192.168.1.1
     m_mutex.lock();
+    m_count++;  // 日志行数计数器递增。同时表明，每次调用write_log，只写入1行日志
+    // 检查是否需要分割日志文件（按日期或行数，初始化日期不等于当前日期表明跨天，行数超过限制）
+    if (m_today != my_tm->tm_mday || m_count % m_split_lines == 0) rotate_locked(*my_tm);
 
     // 格式化时间戳和日志内容，char*指针m_buf是日志缓冲区，暂存日志内容
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
-    // 拼接为完整日志行
+    memcpy(m_buf, prefix, n);
     int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
+    m = std::min(std::max(m, 0), m_log_buf_size - n - 2);  // 过长的行被截断
     m_buf[n + m] = '\n';
     m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
+    reserve_locked(n + m + 1);
+    write_locked(m_buf, n + m + 1);
+    m_unflushed += n + m + 1;
+    maybe_flush_locked(level >= m_policy.level);
 
     m_mutex.unlock();
 /*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
 
-    // // 根据模式选择写入方式
-    // if (m_is_async && !m_log_queue->full())  // 异步模式且队列未满
-    // {
-    //     m_log_queue->push(log_str);  // 将日志推入队列
-    // } else                           // 同步模式或队列已满
-    // {   //操作共享资源m_fp，故需加锁
-    //     m_mutex.lock();
-    //     fputs(log_str.c_str(), m_fp);  // 直接写入文件
-    //     m_mutex.unlock();
-    // }
-
-    if (m_is_async && !m_log_queue->full()) {   // 异步模式且队列未满
-        m_log_queue->push(log_str); /* 将日志字符串 log_str 推入日志队列 */
+    va_end(valst);  // 结束可变参数处理
+}
+
+// 切换到新的日志文件：跨天时按新日期命名，行数超限（或日志段写满）时加序号
+void Log::rotate_locked(const struct tm &my_tm) {
+    char new_log[PATH_SIZE] = {0};
+    if (!m_segments) {
+        fflush(m_fp);  // 刷新缓冲区
+        fclose(m_fp);  // 关闭当前文件
+    }
+    m_unflushed = 0;
+    char tail[DATE_SIZE] = {0};
+
+    // 生成新的日志文件名
+    snprintf(tail, sizeof(tail), "%d_%02d_%02d_", my_tm.tm_year + 1900,
+             my_tm.tm_mon + 1, my_tm.tm_mday);
+
+    if (m_today != my_tm.tm_mday)  // 如果是新的一天
+    {
+        snprintf(new_log, sizeof(new_log), "%s%s%s", dir_name, tail, log_name);
+        m_today = my_tm.tm_mday;  // 更新日期
+        m_count = 0;              // 重置计数器
+        m_file_index = 0;
+    } else                        // 如果是行数超过限制
+    {
+        snprintf(new_log, sizeof(new_log), "%s%s%s.%d", dir_name, tail, log_name,
+                 ++m_file_index);
+    }
+    open_locked(new_log);  // 打开新文件
+}
+
+bool Log::open_locked(const char *path) {
+    if (m_segments) {
+        // 日志段：切换到后台准备好的段，失败时继续写原来的段
+        if (!m_segments->open(path)) return false;
+    } else {
+        m_fp = fopen(path, "a");
+        if (m_fp == NULL) return false;
+        // 日志攒在 m_policy.bytes 大小的缓冲区中，满了或按策略刷新时才进入内核
+        setvbuf(m_fp, m_file_buf, _IOFBF, m_policy.bytes);
+    }
+    if (m_is_binary) write_header_locked();
+    return true;
+}
+
+void Log::write_locked(const void *data, size_t len) {
+    if (m_segments)
+        m_segments->write((const char *)data, len);
+    else
+        fwrite(data, 1, len, m_fp);
+}
+
+void Log::reserve_locked(size_t len) {
+    if (!m_segments || m_stage_len + len <= m_segments->remaining()) return;
+    // 当前段放不下，写出暂存区后切换到下一段
+    write_stage_locked();
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+    rotate_locked(my_tm);
+}
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：二进制模式的文件头、格式定义和时钟校准条目
+
+void Log::write_header_locked() {
+    char buf[log_bin::HEADER_SIZE];
+    uint64_t tsc = log_bin::ticks();
+    long long ns = realtime_ns();
+    memcpy(buf, log_bin::MAGIC, 8);
+    memcpy(buf + 8, &tsc, 8);
+    memcpy(buf + 16, &ns, 8);
+    memcpy(buf + 24, &m_ticks_per_ns, 8);
+    write_locked(buf, log_bin::HEADER_SIZE);
+    m_unflushed += log_bin::HEADER_SIZE;
+    m_defined.clear();  // 新文件重新写格式定义
+    m_last_clock_ms = now_ms();
+}
+
+string Log::format_entry(uint32_t id) {
+    m_format_lock.lock();
+    log_format f = m_formats[id - 1];
+    m_format_lock.unlock();
+    uint16_t sig_len = f.sig.size();
+    uint16_t fmt_len = std::min(f.fmt.size(), (size_t)UINT16_MAX);
+    char head[6] = {log_bin::FORMAT};
+    memcpy(head + 1, &id, 4);
+    head[5] = f.level;
+    string entry(head, 6);
+    entry.append((const char *)&sig_len, 2);
+    entry.append(f.sig.data(), sig_len);
+    entry.append((const char *)&fmt_len, 2);
+    entry.append(f.fmt.data(), fmt_len);
+    return entry;
+}
+
+void Log::write_clock_locked() {
+    char buf[17] = {log_bin::CLOCK};
+    uint64_t tsc = log_bin::ticks();
+    long long ns = realtime_ns();
+    memcpy(buf + 1, &tsc, 8);
+    memcpy(buf + 9, &ns, 8);
+    stage_locked(buf, sizeof(buf));
+    m_last_clock_ms = now_ms();
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+void Log::flush_locked() {
+    if (m_fp) fflush(m_fp);  // 日志段写入即进入页缓存，不需要刷新
+    m_unflushed = 0;
+    m_last_flush_ms = now_ms();
+}
+
+void Log::maybe_flush_locked(bool urgent) {
+    if (m_unflushed == 0) return;
+    if (urgent || m_unflushed >= m_policy.bytes || now_ms() - m_last_flush_ms >= m_policy.interval_ms)
+        flush_locked();
+}
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：异步模式的生产者一侧
+
+log_ring *Log::thread_ring() {
+    if (t_ring.ring) return t_ring.ring;
+    log_ring *ring = new log_ring(m_ring_size);
+    m_ring_lock.lock();
+    m_rings.push_back(ring);
+    m_ring_lock.unlock();
+    t_ring.ring = ring;
+    return ring;
+}
+
+void Log::append_async(int level, const char *prefix, int prefix_len, const char *format, va_list valst) {
+    log_ring *ring = thread_ring();
+    int state = reserve_ring(ring, level, 1);
+    if (state == RING_SPILL) spill_line(level, prefix, prefix_len, format, valst);
+    if (state != RING_RESERVED) return;
+
+    // 常见情况：一条记录放得下，直接格式化进槽位
+    log_record &r = ring->slot(0);
+    memcpy(r.text, prefix, prefix_len);
+    va_list copy;
+    va_copy(copy, valst);
+    int m = vsnprintf(r.text + prefix_len, log_record::TEXT - prefix_len, format, copy);
+    va_end(copy);
+    size_t len = prefix_len + std::max(m, 0) + 1;  // 加上换行
+    if (len <= log_record::TEXT) {
+        r.text[len - 1] = '\n';
+        r.len = len;
+        r.more = 0;
+        r.level = level;
+        ring->publish(1);
     } else {
-        /* 如果队列已满，选择丢弃当前日志，并增加 dropped_logs 计数器。 */
-        static int dropped_logs = 0;
-        if (m_is_async && m_log_queue->full()) {
-            dropped_logs++;
-            if (dropped_logs % 100 == 0) {
-                // 每丢弃 100条日志时，通过标准错误流（std::cerr）输出警告，提醒队列已满
-                std::cerr << "Log queue full. Dropped logs count: "<< dropped_logs << std::endl;
+        // 长行先格式化到本线程的暂存区，再拆进相邻的几条记录
+        if (!t_ring.scratch) t_ring.scratch = new char[scratch_size(m_log_buf_size)];
+        char *buf = t_ring.scratch;
+        memcpy(buf, prefix, prefix_len);
+        len = std::min(len, (size_t)m_log_buf_size - 1);  // 过长的行被截断
+        vsnprintf(buf + prefix_len, len - prefix_len, format, valst);
+        buf[len - 1] = '\n';
+        append_split(ring, level, buf, len);
+    }
+    wake_writer();
+}
+
+void Log::append_split(log_ring *ring, int level, const char *buf, size_t len) {
+    uint32_t count = (len + log_record::TEXT - 1) / log_record::TEXT;
+    int state = reserve_ring(ring, level, count);
+    if (state == RING_SPILL) spill(level, buf, len);  // 二进制记录在 binary_begin() 中已经预留，不会走到这里
+    if (state != RING_RESERVED) return;
+    for (uint32_t i = 0; i < count; ++i) {
+        log_record &part = ring->slot(i);
+        size_t off = i * log_record::TEXT;
+        part.len = std::min(log_record::TEXT, len - off);
+        part.more = i + 1 < count;
+        part.level = level;
+        memcpy(part.text, buf + off, part.len);
+    }
+    ring->publish(count);
+}
+
+void Log::wake_writer() {
+    // 日志线程在等待时唤醒它，同一次等待只需一个生产者发信号
+    if (m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false)) {
+        m_wake_lock.lock();
+        m_wake.signal();
+        m_wake_lock.unlock();
+    }
+}
+
+int Log::ring_full(log_ring *ring, int level, uint32_t count) {
+    int i = std::min(std::max(level, 0), 3);
+    int action = m_full_action[i];
+    if (action == LOG_FULL_SPILL) return RING_SPILL;
+    if (action != LOG_FULL_DROP_NEWEST && count <= ring->capacity()) {
+        // 先让出处理器，日志线程通常一轮就能读出空位；之后每 50us 检查一次，同时防止错过唤醒
+        long long deadline = monotonic_us() + m_full_wait_ms * 1000LL;
+        for (int spins = 0;; ++spins) {
+            // DROP_OLDEST：自己丢弃环首的低级别行，日志线程卡在写文件时也不用等；环首是同级别及以上的行时照常等待
+            if (action == LOG_FULL_DROP_OLDEST) {
+                uint32_t lines = ring->evict(count, i);
+                if (lines) {
+                    m_evicted.fetch_add(lines, std::memory_order_relaxed);
+                    m_dropped.fetch_add(lines, std::memory_order_relaxed);
+                    if (ring->reserve(count)) return RING_RESERVED;
+                }
+            }
+            wake_writer();
+            if (spins < 16)
+                sched_yield();
+            else
+                usleep(50);
+            if (ring->reserve(count)) {
+                m_waited.fetch_add(1, std::memory_order_relaxed);
+                return RING_RESERVED;
             }
-        } else {/* 同步写入日志文件 */
-            std::lock_guard<locker> lock(m_mutex);
-            fputs(log_str.c_str(), m_fp);
+            if (monotonic_us() >= deadline) break;
         }
     }
+    m_dropped_level[i].fetch_add(1, std::memory_order_relaxed);
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    return RING_DROPPED;
+}
 
-    va_end(valst);  // 结束可变参数处理
+void Log::spill(int level, const char *line, size_t len) {
+    int fd = m_spill_fd.load(std::memory_order_acquire);
+    if (fd == -1) {
+        m_spill_lock.lock();
+        fd = m_spill_fd.load(std::memory_order_relaxed);
+        if (fd == -1) {
+            fd = open(m_spill_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            m_spill_fd.store(fd < 0 ? -2 : fd, std::memory_order_release);  // 打开失败后不再重试
+        }
+        m_spill_lock.unlock();
+    }
+    // O_APPEND 下每行一次 write，多个线程同时溢出时行不会交错
+    if (fd >= 0 && write(fd, line, len) == (ssize_t)len) {
+        m_spilled.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_dropped_level[std::min(std::max(level, 0), 3)].fetch_add(1, std::memory_order_relaxed);
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Log::spill_line(int level, const char *prefix, int prefix_len, const char *format, va_list valst) {
+    if (!t_ring.scratch) t_ring.scratch = new char[scratch_size(m_log_buf_size)];
+    char *buf = t_ring.scratch;
+    memcpy(buf, prefix, prefix_len);
+    int m = vsnprintf(buf + prefix_len, m_log_buf_size - prefix_len - 1, format, valst);
+    m = std::min(std::max(m, 0), m_log_buf_size - prefix_len - 2);  // 过长的行被截断
+    buf[prefix_len + m] = '\n';
+    spill(level, buf, prefix_len + m + 1);
+}
+
+void Log::spill_text(int level, const char *format, ...) {
+    char prefix[48];
+    const struct tm *my_tm;
+    int n = format_prefix(prefix, level, my_tm);
+    va_list valst;
+    va_start(valst, format);
+    spill_line(level, prefix, n, format, valst);
+    va_end(valst);
+}
+
+uint32_t Log::register_format(int level, const char *format, const char *sig) {
+    m_format_lock.lock();
+    m_formats.push_back(log_format{format, sig, level});
+    uint32_t id = m_formats.size();
+    m_format_lock.unlock();
+    return id;
+}
+
+char *Log::binary_begin(int level, size_t size, bool &spill) {
+    log_ring *ring = thread_ring();
+    if (size > BINARY_MAX) {
+        m_dropped_level[std::min(std::max(level, 0), 3)].fetch_add(1, std::memory_order_relaxed);
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    // 整条记录一次预留，binary_commit() 时不会再遇到环满
+    uint32_t count = (size + log_record::TEXT - 1) / log_record::TEXT;
+    int state = reserve_ring(ring, level, count);
+    if (state != RING_RESERVED) {
+        spill = state == RING_SPILL;
+        return NULL;
+    }
+    // 常见情况：一条记录放得下，直接写进槽位
+    if (count == 1) return ring->slot(0).text;
+    if (!t_ring.scratch) t_ring.scratch = new char[scratch_size(m_log_buf_size)];
+    return t_ring.scratch;
 }
 
+void Log::binary_commit(int level, size_t size) {
+    log_ring *ring = t_ring.ring;
+    if (size <= log_record::TEXT) {
+        log_record &r = ring->slot(0);
+        r.len = size;
+        r.more = 0;
+        r.level = level;
+        ring->publish(1);
+    } else {
+        append_split(ring, level, t_ring.scratch, size);
+    }
+    wake_writer();
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+//代码块功能：异步模式的消费者一侧，只在日志线程中执行
+
+void *Log::async_write_log() {
+    while (true) {
+        bool stop = m_stop.load(std::memory_order_acquire);
+        bool busy = false;
+        if (drain_rings(busy) > 0) {
+            // 持续有日志时按固定间隔轮询，不进入等待，生产者也就不必发信号；有环超过四分之一满时立即读下一轮
+            if (!stop && !busy) usleep(BATCH_WAIT_US);
+            continue;
+        }
+        if (stop) break;  // 收到退出通知之后又读空了一轮
+
+        m_wake_lock.lock();
+        m_sleeping.store(true);
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_nsec += IDLE_WAIT_MS * 1000000L;
+        if (t.tv_nsec >= 1000000000L) {
+            t.tv_sec += 1;
+            t.tv_nsec -= 1000000000L;
+        }
+        // 生产者只在看到 m_sleeping 时发信号，错过的信号最多推迟 IDLE_WAIT_MS 毫秒
+        if (!m_stop.load(std::memory_order_acquire)) m_wake.timewait(m_wake_lock.get(), t);
+        m_sleeping.store(false);
+        m_wake_lock.unlock();
+    }
+    return NULL;
+}
+
+void Log::write_stage_locked() {
+    if (m_stage_len == 0) return;
+    write_locked(m_stage, m_stage_len);
+    m_stage_len = 0;
+}
+
+void Log::stage_locked(const void *data, size_t len) {
+    reserve_locked(len);
+    if (m_stage_len + len > STAGE_SIZE) write_stage_locked();
+    if (len > STAGE_SIZE) {
+        write_locked(data, len);
+    } else {
+        memcpy(m_stage + m_stage_len, data, len);
+        m_stage_len += len;
+    }
+    m_unflushed += len;
+}
+
+size_t Log::drain_rings(bool &busy) {
+    // 取出环的列表，顺便释放已退出线程的空环
+    m_ring_lock.lock();
+    for (size_t i = 0; i < m_rings.size();) {
+        log_ring *ring = m_rings[i];
+        if (ring->retired() && ring->readable() == 0) {
+            delete ring;
+            m_rings[i] = m_rings.back();
+            m_rings.pop_back();
+        } else {
+            ++i;
+        }
+    }
+    std::vector<log_ring *> rings(m_rings);
+    m_ring_lock.unlock();
+
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+
+    size_t total = 0;
+    bool urgent = false;
+    // 一行最多占 scratch_size() 字节，按整条记录取整
+    size_t line_max = (scratch_size(m_log_buf_size) + log_record::TEXT - 1) / log_record::TEXT * log_record::TEXT;
+    if (m_line.size() < line_max) m_line.resize(line_max);
+    m_mutex.lock();
+    if (m_today != my_tm.tm_mday) rotate_locked(my_tm);
+    if (m_is_binary && now_ms() - m_last_clock_ms >= CLOCK_INTERVAL_MS) write_clock_locked();
+    for (size_t i = 0; i < rings.size(); ++i) {
+        log_ring *ring = rings[i];
+        uint32_t end = ring->head();
+        uint32_t n = (int32_t)(end - ring->tail()) > 0 ? end - ring->tail() : 0;
+        if (n * 4 >= ring->capacity()) busy = true;
+        if (n > m_max_depth.load(std::memory_order_relaxed)) m_max_depth.store(n, std::memory_order_relaxed);
+        // 生产者整行一次发布，环首总是行首。每行先复制出来再认领，认领后槽位立即还给生产者；
+        // 认领失败说明生产者为 DROP_OLDEST 丢弃了这一行，复制的内容可能已被改写，作废后从新的环首继续
+        for (uint32_t pos = ring->tail(); (int32_t)(end - pos) > 0; pos = ring->tail()) {
+            uint32_t k = 0;
+            size_t len = 0;
+            int level = ring->at(pos).level;
+            for (bool more = true; more && (int32_t)(end - pos - k) > 0; ++k) {
+                const log_record &r = ring->at(pos + k);
+                size_t part = std::min((size_t)r.len, std::min(log_record::TEXT, m_line.size() - len));
+                memcpy(&m_line[len], r.text, part);
+                len += part;
+                more = r.more;
+            }
+            if (!ring->consume(pos, k)) continue;
+            total += k;
+
+            // 二进制记录的格式在当前文件中还没有定义时先写定义
+            uint32_t id = 0;
+            string def;
+            if (m_is_binary) {
+                memcpy(&id, m_line.data() + 1, 4);
+                if (id >= m_defined.size() || !m_defined[id]) def = format_entry(id);
+            }
+            // 写日志段时整行连同格式定义一起预留，切换段不会把它们拆到两个文件里
+            if (m_segments) {
+                reserve_locked(def.size() + len);
+                // 切换到了新段，定义要重新写
+                if (m_is_binary && def.empty() && (id >= m_defined.size() || !m_defined[id])) def = format_entry(id);
+            }
+            if (!def.empty()) {
+                stage_locked(def.data(), def.size());
+                if (m_defined.size() <= id) m_defined.resize(id + 1);
+                m_defined[id] = true;
+            }
+            stage_locked(m_line.data(), len);
+            if (level >= m_policy.level) urgent = true;
+            if (++m_count % m_split_lines == 0) {  // 一行结束，检查是否需要按行数分割
+                write_stage_locked();
+                rotate_locked(my_tm);
+            }
+        }
+    }
+
+    // 丢弃的行数写进日志，代替原来每丢弃 100 行向标准错误输出一次
+    unsigned long dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_dropped_reported) {
+        if (m_is_binary) {
+            char buf[9] = {log_bin::DROPPED};
+            uint64_t count = dropped - m_dropped_reported;
+            memcpy(buf + 1, &count, 8);
+            stage_locked(buf, sizeof(buf));
+        } else {
+            reserve_locked(128);
+            if (m_stage_len + 128 > STAGE_SIZE) write_stage_locked();
+            m_stage_len += snprintf(m_stage + m_stage_len, 128,
+                                    "%d-%02d-%02d %02d:%02d:%02d.000000 [warn]: log ring full, dropped %lu lines\n",
+                                    my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, my_tm.tm_hour,
+                                    my_tm.tm_min, my_tm.tm_sec, dropped - m_dropped_reported);
+        }
+        m_dropped_reported = dropped;
+    }
+    write_stage_locked();
+    // 按策略成组刷新；ERROR 及以上的日志、flush() 的请求立即刷新。空闲的轮次也会检查，按时间刷新不依赖新日志
+    if (m_flush_requested.exchange(false)) urgent = true;
+    maybe_flush_locked(urgent);
+    m_mutex.unlock();
+    return total;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
 /*
- * flush() 函数用于强制刷新日志文件的缓冲区，确保所有缓存的日志数据立即写入磁盘文件。
+ * flush() 函数用于刷新日志文件的缓冲区，把已写入的日志交给内核。
+ * 异步模式下只通知日志线程在下一轮刷新，调用者不必与日志线程争锁。
  */
 void Log::flush(void) {
+    if (m_fp == NULL && m_segments == NULL) return;
+    if (m_is_async) {
+        m_flush_requested.store(true);
+        wake_writer();
+        return;
+    }
     m_mutex.lock();   //操作共享资源m_fp，故需加锁
-    fflush(m_fp);  // 刷新文件缓冲区// 调用C标准库函数，刷新文件流缓冲区
+    flush_locked();  // 刷新文件缓冲区// 调用C标准库函数，刷新文件流缓冲区
+    m_mutex.unlock();
+}
+
+void Log::sync(void) {
+    if (m_fp == NULL && m_segments == NULL) return;
+    drain();
+    m_mutex.lock();
+    if (m_segments)
+        m_segments->sync();
+    else
+        fsync(fileno(m_fp));
+    m_mutex.unlock();
+}
+
+void Log::drain(void) {
+    if (m_fp == NULL && m_segments == NULL) return;
+    if (!m_is_async) {
+        flush();
+        return;
+    }
+    while (true) {
+        bool empty = true;
+        m_ring_lock.lock();
+        for (size_t i = 0; i < m_rings.size() && empty; ++i) empty = m_rings[i]->readable() == 0;
+        m_ring_lock.unlock();
+        if (empty) break;
+        usleep(100);
+    }
+    // 记录在日志线程持有 m_mutex 时出环，拿到锁说明读空这些环的那一轮已经写完
+    m_mutex.lock();
+    flush_locked();
     m_mutex.unlock();
 }
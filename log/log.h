@@ -6,10 +6,64 @@
 #include <string>
 #include <stdarg.h>
 #include <pthread.h>
+#include <atomic>
+#include <vector>
 #include "block_queue.h"
+#include "log_ring.h"
+#include "log_binary.h"
+#include "log_segment.h"
 
 using namespace std;
 
+// 日志级别，低于模块当前级别的调用点不执行
+enum log_level { LOG_LEVEL_DEBUG = 0, LOG_LEVEL_INFO, LOG_LEVEL_WARN, LOG_LEVEL_ERROR, LOG_LEVEL_OFF };
+
+// 模块，每个模块单独设置级别。源文件在包含任何头文件之前 #define LOG_MODULE 选择默认模块，
+// 个别调用点用 LOG_AT() 指定
+enum log_module { LOG_MOD_MAIN = 0, LOG_MOD_HTTP, LOG_MOD_TIMER, LOG_MOD_POOL, LOG_MOD_SQL, LOG_MOD_COUNT };
+
+#ifndef LOG_MODULE
+#define LOG_MODULE LOG_MOD_MAIN
+#endif
+
+// 编译期最低级别，低于它的调用点连同参数一起被编译器删掉，如 make LOG_MIN_LEVEL=1 去掉所有 DEBUG
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// 日志文件的刷新策略：日志先攒在文件流缓冲区中，满足任一条件才刷新到内核
+struct log_flush_policy {
+    size_t bytes = 64 * 1024;  // 未刷新的日志达到这么多字节时刷新，也是文件流缓冲区的大小
+    int interval_ms = 1000;    // 距上次刷新超过这么久时刷新（同步模式下在下一行日志或 flush() 时检查）
+    int level = 3;             // 该级别及以上的日志写入后立即刷新，默认 ERROR
+};
+
+// 日志段：size > 0 时不经过 stdio，写入预分配并映射的文件段（log_segment.h），段写满或达到行数时切换
+struct log_segment_policy {
+    size_t size = 0;       // 每段预分配的字节数，0 表示用 stdio 写文件
+    bool compress = true;  // 切换后用 gzip 压缩旧段
+};
+
+// 异步模式下写日志的线程发现自己的环已满时的处理方式，每个级别单独设置
+enum log_full_action {
+    LOG_FULL_DROP_NEWEST = 0,  // 丢弃这一行
+    LOG_FULL_DROP_OLDEST,      // 丢弃本线程环首最旧的低级别行后写入，环首是同级别及以上的行时等待
+    LOG_FULL_BLOCK,            // 等日志线程读出空位后写入
+    LOG_FULL_SPILL             // 不进环，直接追加到溢出文件
+};
+
+// 异步日志的计数，见 Log::stats()
+struct log_stats {
+    unsigned long dropped[4] = {};  // 各级别因环满丢弃的行数（丢弃最新的行或等待超时）
+    unsigned long evicted = 0;      // 生产者为 DROP_OLDEST 从环首丢弃的旧行
+    unsigned long spilled = 0;      // 写入溢出文件的行数
+    unsigned long waited = 0;       // 环满后等到空位的次数
+    unsigned long depth = 0;        // 当前所有环中待写的记录数
+    unsigned long max_depth = 0;    // 日志线程一轮从单个环读出的最多记录数
+    unsigned long capacity = 0;     // 每个环的记录数
+    unsigned long rings = 0;        // 环的个数，即写过日志的线程数
+};
+
 class Log
 {
 public:
@@ -32,27 +86,122 @@ public:
         return nullptr;
     }
     
-    //可选择的参数有日志文件、日志缓冲区大小、最大行数以及最长日志条队列
-    bool init(const char *file_name, int close_log, int log_buf_size = 8192, int split_lines = 5000000, int max_queue_size = 0);
+    //可选择的参数有日志文件、日志缓冲区大小、最大行数以及每个线程的环形缓冲区记录数（0 表示同步写入）
+    //binary 为 true 时写二进制日志（文件名加 .bin，用 logdecode 解码），要求异步模式
+    bool init(const char *file_name, int close_log, int log_buf_size = 8192, int split_lines = 5000000, int max_queue_size = 0,
+              bool binary = false);
 
     void write_log(int level, const char *format, ...);
 
+    // 二进制模式下 LOG_* 宏走这里：site 是调用点的格式编号，0 表示尚未登记
+    template <typename... Args>
+    void write_binary(std::atomic<uint32_t> &site, int level, const char *format, Args... args);
+
+    bool is_binary() const { return m_is_binary; }
+
+    // ---------- 运行时级别，任意线程可调用 ----------
+    // 调用点是否启用：一次原子读加一次比较
+    static bool enabled(int module, int level) { return level >= m_levels[module].load(std::memory_order_relaxed); }
+    static void set_level(int module, int level) { m_levels[module].store(level, std::memory_order_relaxed); }
+    /**
+     * @brief 按配置串设置级别
+     * @param spec 逗号分隔，每项为 级别（所有模块）或 模块=级别，按顺序生效，如 "warn,http=debug"；
+     *        级别为 debug/info/warn/error/off，模块为 main/http/timer/pool/sql
+     * @return 格式错误时返回 false，级别不变
+     */
+    static bool set_levels(const char *spec);
+    // 所有模块的级别同时调高（delta > 0，更安静）或调低，限制在 DEBUG 到 ERROR 之间，已关闭的模块不变
+    static void shift_levels(int delta);
+    // 当前级别，格式同 set_levels()，如 "main=info,http=debug,timer=info,pool=info,sql=info"
+    static std::string levels();
+
+    // 设置刷新策略，在 init() 之前调用
+    void set_flush_policy(const log_flush_policy &policy) { m_policy = policy; }
+
+    // 设置日志段，在 init() 之前调用；使用日志段时刷新策略不起作用，写入即进入页缓存
+    void set_segment_policy(const log_segment_policy &policy) { m_segment_policy = policy; }
+
+    // 时间戳改用 CLOCK_REALTIME_COARSE：更便宜，但精度只有一个时钟节拍（通常 1~4ms），微秒部分随之变粗
+    void set_coarse_clock(bool coarse) { m_coarse_clock = coarse; }
+
+    // 把已写入的日志刷新到内核：同步模式下立即刷新，异步模式下由日志线程在下一轮刷新，不等待
     void flush(void);
 
+    // 异步模式下等待日志线程写完目前已提交的日志并刷新，同步模式下立即刷新
+    void drain(void);
+
+    // drain() 之后再 fsync，保证日志落盘；只在需要时调用（如退出前），不在热路径上
+    void sync(void);
+
+    /**
+     * @brief 设置环满时各级别的处理方式，在 init() 之前调用
+     * @param spec 逗号分隔，每项为 方式（所有级别）、级别=方式 或 wait=毫秒，按顺序生效，如 "drop-newest,error=spill"；
+     *        方式为 drop-newest/drop-oldest/block/spill，wait 是 block 和 drop-oldest 最多等待的时间，超时则丢弃
+     * @return 格式错误时返回 false，设置不变
+     */
+    bool set_backpressure(const char *spec);
+    // 当前的处理方式，格式同 set_backpressure()
+    std::string backpressure() const;
+
+    // 环形缓冲区满而丢弃的行数（含 DROP_OLDEST 丢弃的旧行）
+    unsigned long dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    // 丢弃、溢出和环的深度，任意线程可调用
+    log_stats stats();
+
 private:
     Log(); // 构造函数私有化，禁止外部创建实例
     virtual ~Log();
-    void *async_write_log()
-    {
-        string single_log;
-        //从阻塞队列中取出一个日志string，写入文件
-        while (m_log_queue->pop(single_log))    //single_log就是取出的队首元素
-        {
-            m_mutex.lock();
-            fputs(single_log.c_str(), m_fp);    //把single_log写入文件
-            m_mutex.unlock();
-        }
+    // 日志线程：轮流读取各线程的环形缓冲区，攒成大块后一次写入文件
+    void *async_write_log();
+    // 写出 "YYYY-MM-DD HH:MM:SS.uuuuuu [level]: " 前缀，返回长度；my_tm 指向本线程缓存的本地时间
+    int format_prefix(char *prefix, int level, const struct tm *&my_tm);
+    // 当前线程的环形缓冲区，第一次写日志时创建并登记
+    log_ring *thread_ring();
+    // 把一行日志写入当前线程的环形缓冲区，满时丢弃
+    void append_async(int level, const char *prefix, int prefix_len, const char *format, va_list valst);
+    // 把 buf 中的一行拆进相邻的几条记录，环满时按处理方式等待、丢弃或写入溢出文件
+    void append_split(log_ring *ring, int level, const char *buf, size_t len);
+    // 预留 count 个槽位；环满时按 level 的处理方式等待，返回 RING_RESERVED、RING_DROPPED（已计数）或 RING_SPILL
+    enum { RING_RESERVED, RING_DROPPED, RING_SPILL };
+    int reserve_ring(log_ring *ring, int level, uint32_t count) {
+        return ring->reserve(count) ? RING_RESERVED : ring_full(ring, level, count);
     }
+    int ring_full(log_ring *ring, int level, uint32_t count);
+    // 把一行追加到溢出文件，第一次使用时打开；写入失败时计为丢弃
+    void spill(int level, const char *line, size_t len);
+    // 格式化后写入溢出文件；spill_text() 供二进制模式使用
+    void spill_line(int level, const char *prefix, int prefix_len, const char *format, va_list valst);
+    void spill_text(int level, const char *format, ...);
+    // 日志线程在等待时唤醒它
+    void wake_writer();
+    // 登记一个二进制格式，返回从 1 开始的编号
+    uint32_t register_format(int level, const char *format, const char *sig);
+    // 预留 size 字节的二进制记录，返回写入位置；写好后调用 binary_commit()。
+    // 环满时返回 NULL，spill 表示应改为调用 spill_text()
+    char *binary_begin(int level, size_t size, bool &spill);
+    void binary_commit(int level, size_t size);
+    // 二进制模式：写文件头、格式定义和时钟校准条目，调用者持有 m_mutex
+    void write_header_locked();
+    // 编号为 id 的格式定义条目
+    string format_entry(uint32_t id);
+    void write_clock_locked();
+    // 追加到暂存区，放不下时先写出暂存区。调用者持有 m_mutex
+    void stage_locked(const void *data, size_t len);
+    // 读完所有环形缓冲区中的记录，写入文件；返回读到的记录数，busy 表示有环超过四分之一满
+    size_t drain_rings(bool &busy);
+    // 写出暂存区，调用者持有 m_mutex
+    void write_stage_locked();
+    // 按日期或行数切换日志文件，调用者持有 m_mutex
+    void rotate_locked(const struct tm &my_tm);
+    // 打开日志文件并设置文件流缓冲区（或切换日志段），调用者持有 m_mutex
+    bool open_locked(const char *path);
+    // 写入文件流或当前日志段，调用者持有 m_mutex
+    void write_locked(const void *data, size_t len);
+    // 当前日志段放不下暂存区和接下来的 len 字节时切换到下一段，保证一行不跨文件。调用者持有 m_mutex
+    void reserve_locked(size_t len);
+    // 按刷新策略判断是否刷新；urgent 表示刚写入了需要立即刷新的日志。调用者持有 m_mutex
+    void maybe_flush_locked(bool urgent);
+    void flush_locked();
 
 private:
     char dir_name[128]; //路径名
@@ -62,16 +211,109 @@ private:
     long long m_count;  //日志行数记录
     int m_today;        //因为按天分类,记录当前时间是那一天
     FILE *m_fp;         //打开log的文件指针
-    char *m_buf;
-    block_queue<string> *m_log_queue; //阻塞队列
+    log_segment_policy m_segment_policy;
+    log_segments *m_segments; //使用日志段时代替 m_fp
+    int m_file_index;   //当天按行数（或段写满）切换的序号
+    char *m_buf;        //同步模式的格式化缓冲区
     bool m_is_async;                  //是否同步标志位
-    locker m_mutex;
+    locker m_mutex;     //保护日志文件和切换状态
     int m_close_log; //关闭日志
+    bool m_coarse_clock; //时间戳使用 CLOCK_REALTIME_COARSE
+
+    // 刷新策略，由 m_mutex 保护
+    log_flush_policy m_policy;
+    char *m_file_buf;                   //文件流缓冲区，大小为 m_policy.bytes，切换文件时沿用
+    size_t m_unflushed;                 //上次刷新以来写入的字节数
+    long long m_last_flush_ms;          //上次刷新的时间
+    std::atomic<bool> m_flush_requested; //flush() 请求日志线程刷新
+
+    // 异步模式
+    uint32_t m_ring_size;               //每个线程的环形缓冲区记录数
+    locker m_ring_lock;                 //保护 m_rings，只在登记新线程和日志线程每轮开始时使用
+    std::vector<log_ring *> m_rings;    //所有线程的环形缓冲区
+    std::atomic<unsigned long> m_dropped; //环形缓冲区满而丢弃的行数
+    uint8_t m_full_action[4];           //各级别环满时的处理方式，init() 之后只读
+    int m_full_wait_ms;                 //BLOCK 和 DROP_OLDEST 最多等待的时间
+    std::atomic<unsigned long> m_dropped_level[4]; //各级别丢弃的行数
+    std::atomic<unsigned long> m_evicted; //生产者为 DROP_OLDEST 丢弃的旧行
+    std::atomic<unsigned long> m_spilled; //写入溢出文件的行数
+    std::atomic<unsigned long> m_waited;  //环满后等到空位的次数
+    std::atomic<unsigned long> m_max_depth; //日志线程一轮从单个环读出的最多记录数
+    string m_line;                      //日志线程从环中复制出的一行
+    string m_spill_path;                //溢出文件，与当天的日志文件同名加 .overflow
+    locker m_spill_lock;                //保护溢出文件的打开
+    std::atomic<int> m_spill_fd;
+    unsigned long m_dropped_reported;   //已经写进日志的丢弃行数，只由日志线程访问
+    char *m_stage;                      //日志线程的暂存区，攒满后一次写入文件
+    size_t m_stage_len;
+    std::atomic<bool> m_sleeping;       //日志线程正在等待新日志
+    locker m_wake_lock;                 //与 m_wake 配合唤醒日志线程
+    cond m_wake;
+    std::atomic<bool> m_stop;           //通知日志线程退出
+    pthread_t m_writer;                 //日志线程
+
+    // 各模块的当前级别；init() 之前为 OFF，日志尚未打开时所有调用点都不执行
+    static inline std::atomic<uint8_t> m_levels[LOG_MOD_COUNT] = {LOG_LEVEL_OFF, LOG_LEVEL_OFF, LOG_LEVEL_OFF,
+                                                                  LOG_LEVEL_OFF, LOG_LEVEL_OFF};
+
+    // 二进制模式
+    struct log_format {
+        std::string fmt;
+        std::string sig;  //参数类型码，见 log_binary.h
+        int level;
+    };
+    bool m_is_binary;
+    locker m_format_lock;               //保护 m_formats，只在登记新调用点和日志线程写格式定义时使用
+    std::vector<log_format> m_formats;  //编号 i 的格式在 m_formats[i - 1]
+    std::vector<bool> m_defined;        //当前文件已写出定义的编号，只由持有 m_mutex 的线程访问
+    std::atomic<uint32_t> m_text_sites[4]; //二进制模式下直接调用 write_log() 的行按 "%s" 记录，每个级别一个编号
+    double m_ticks_per_ns;              //时间戳计数与纳秒之比，init() 时校准
+    long long m_last_clock_ms;          //上次写时钟校准条目的时间
 };
 
-#define LOG_DEBUG(format, ...) if(0 == m_close_log) {Log::get_instance()->write_log(0, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_INFO(format, ...) if(0 == m_close_log) {Log::get_instance()->write_log(1, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_WARN(format, ...) if(0 == m_close_log) {Log::get_instance()->write_log(2, format, ##__VA_ARGS__); Log::get_instance()->flush();}
-#define LOG_ERROR(format, ...) if(0 == m_close_log) {Log::get_instance()->write_log(3, format, ##__VA_ARGS__); Log::get_instance()->flush();}
+template <typename... Args>
+void Log::write_binary(std::atomic<uint32_t> &site, int level, const char *format, Args... args) {
+    uint32_t id = site.load(std::memory_order_relaxed);
+    if (id == 0) {
+        // 两个线程同时第一次执行同一调用点时各登记一次，两个编号都有效
+        static const char sig[] = {log_bin::type_code<Args>()..., '\0'};
+        id = register_format(level, format, sig);
+        site.store(id, std::memory_order_relaxed);
+    }
+    size_t size = log_bin::RECORD_HEAD + (size_t(0) + ... + log_bin::arg_size(args));
+    bool spill = false;
+    char *p = binary_begin(level, size, spill);
+    if (!p) {
+        if (spill) spill_text(level, format, args...);
+        return;
+    }
+    uint64_t tsc = log_bin::ticks();
+    *p = log_bin::RECORD;
+    memcpy(p + 1, &id, 4);
+    memcpy(p + 5, &tsc, 8);
+    p += log_bin::RECORD_HEAD;
+    ((p = log_bin::put(p, args)), ...);
+    binary_commit(level, size);
+}
+
+// 何时刷新由 log_flush_policy 决定，宏本身不再逐行刷新
+// 二进制模式下每个调用点有自己的格式编号，format 必须是字符串字面量
+// 未启用的调用点只有一次级别比较，参数不求值；LOG_MIN_LEVEL 以下的调用点在编译期即被删除
+// 二进制记录不解析格式串，'*' 宽度和精度在编译期拒绝，不定长的内容先复制成以 '\0' 结尾的字符串
+#define LOG_AT(module, level, format, ...) \
+    if ((level) >= LOG_MIN_LEVEL && Log::enabled(module, level) && 0 == m_close_log) { \
+        static_assert(!log_bin::has_star(format), "'*' width/precision is not supported by the binary log"); \
+        if (Log::get_instance()->is_binary()) { \
+            static std::atomic<uint32_t> log_site(0); \
+            Log::get_instance()->write_binary(log_site, level, format, ##__VA_ARGS__); \
+        } else { \
+            Log::get_instance()->write_log(level, format, ##__VA_ARGS__); \
+        } \
+    }
+
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_MODULE, LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_AT(LOG_MODULE, LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_AT(LOG_MODULE, LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_AT(LOG_MODULE, LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
 
 #endif
@@ -0,0 +1,129 @@
+/**
+ * @file log_binary.h
+ * @brief 二进制日志的文件格式和参数编码
+ *
+ * 二进制模式（-l 2）下写日志的线程不调用 vsnprintf 和 localtime，只把格式编号、时间戳计数和原始参数
+ * 写进自己的环形缓冲区，由 logdecode 离线还原成与文本日志相同的行。
+ * 主要特点：
+ * 1. 每个 LOG_* 调用点第一次执行时登记格式串和参数类型，得到编号，之后每行只写 4 字节编号
+ * 2. 时间戳取 TSC（非 x86 平台为 CLOCK_MONOTONIC 纳秒），文件头和每秒一次的校准条目记下它与墙上时间的对应关系
+ * 3. 整数一律写 8 字节，浮点写 double，字符串写 2 字节长度加内容（最长 MAX_STRING 字节）
+ * 4. 日志线程在某个编号第一次出现在当前文件之前写出它的格式定义，每个文件都能单独解码
+ * 5. 参数按类型编码，不解析格式串，因此不支持 '*' 宽度和精度（%.*s 的字符串没有结尾的 '\0'），编译期拒绝
+ *
+ * 文件由若干条目组成，每个条目以 1 字节类型开头，多字节字段均为本机字节序：
+ *   'T' "WSBLOG1"  tsc(8) realtime_ns(8) ticks_per_ns(double 8)   文件头，追加写入时会再次出现
+ *   'F' id(4) level(1) sig_len(2) sig fmt_len(2) fmt             格式定义，sig 每个字符对应一个参数
+ *   'R' id(4) tsc(8) 参数...                                     一行日志
+ *   'C' tsc(8) realtime_ns(8)                                     时钟校准
+ *   'D' count(8)                                                   环满丢弃的行数
+ */
+
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace log_bin {
+
+enum entry : char { HEADER = 'T', FORMAT = 'F', RECORD = 'R', CLOCK = 'C', DROPPED = 'D' };
+
+static const char MAGIC[8] = {'T', 'W', 'S', 'B', 'L', 'O', 'G', '1'};  // 文件头，以 HEADER 开头
+static const size_t HEADER_SIZE = 8 + 8 + 8 + 8;
+static const size_t RECORD_HEAD = 1 + 4 + 8;  // 'R' id tsc
+static const size_t MAX_STRING = 1024;
+
+// 时间戳计数：x86 上是一条 rdtsc，要求 TSC 恒定速率（constant_tsc），其余平台退回单调时钟
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// 参数类型码：'i' 有符号整数，'u' 无符号整数，'d' 浮点，'s' 字符串，'p' 其它指针
+template <typename T>
+constexpr char type_code() {
+    typedef typename std::decay<T>::type U;
+    static_assert(std::is_arithmetic<U>::value || std::is_enum<U>::value || std::is_pointer<U>::value,
+                  "binary log arguments must be numbers, enums or pointers");
+    if constexpr (std::is_same<U, char *>::value || std::is_same<U, const char *>::value)
+        return 's';
+    else if constexpr (std::is_floating_point<U>::value)
+        return 'd';
+    else if constexpr (std::is_pointer<U>::value)
+        return 'p';
+    else if constexpr (std::is_enum<U>::value || std::is_signed<U>::value)
+        return 'i';
+    else
+        return 'u';
+}
+
+// 格式串中是否有 '*' 宽度或精度，LOG_AT 用它在编译期拒绝这样的调用点
+constexpr bool has_star(const char *fmt) {
+    for (; *fmt; ++fmt) {
+        if (*fmt != '%') continue;
+        if (*++fmt == '%') continue;
+        for (; *fmt && !((*fmt >= 'a' && *fmt <= 'z') || (*fmt >= 'A' && *fmt <= 'Z')); ++fmt)
+            if (*fmt == '*') return true;
+        if (!*fmt) break;
+    }
+    return false;
+}
+
+inline size_t string_len(const char *s) {
+    if (!s) return 6;  // "(null)"
+    size_t n = strlen(s);
+    return n < MAX_STRING ? n : MAX_STRING;
+}
+
+// 参数编码后的字节数
+template <typename T>
+inline size_t arg_size(T v) {
+    if constexpr (type_code<T>() == 's')
+        return 2 + string_len(v);
+    else
+        return 8;
+}
+
+// 写入一个参数，返回下一个参数的位置
+template <typename T>
+inline char *put(char *p, T v) {
+    constexpr char code = type_code<T>();
+    if constexpr (code == 's') {
+        const char *s = v ? v : "(null)";
+        uint16_t n = string_len(s);
+        memcpy(p, &n, 2);
+        memcpy(p + 2, s, n);
+        return p + 2 + n;
+    } else if constexpr (code == 'd') {
+        double d = v;
+        memcpy(p, &d, 8);
+    } else if constexpr (code == 'p') {
+        uint64_t u = (uintptr_t)v;
+        memcpy(p, &u, 8);
+    } else if constexpr (code == 'i') {
+        int64_t i = (int64_t)v;
+        memcpy(p, &i, 8);
+    } else {
+        uint64_t u = (uint64_t)v;
+        memcpy(p, &u, 8);
+    }
+    return p + 8;
+}
+
+}  // namespace log_bin
+
+#endif
@@ -0,0 +1,118 @@
+/**
+ * @file log_ring.h
+ * @brief 异步日志的单生产者单消费者环形缓冲区
+ *
+ * 每个写日志的线程独占一个环，日志线程是唯一的消费者。
+ * 主要特点：
+ * 1. 槽位是定长记录，生产者直接把日志行格式化进槽位，不经过中间的 string 和队列
+ * 2. 一行放不下时占用相邻的几个槽位，除最后一个外都带 more 标记
+ * 3. 生产者只写 m_head，消费者下标 m_tail 在不同缓存行，入队出队都不加锁、不进内核
+ * 4. 生产者缓存消费者下标，只有看起来满了才重新读取，减少缓存行来回传递
+ * 5. 环满时生产者可以自己用 CAS 移动 m_tail，整行丢弃最旧的低级别行（evict），不用等消费者；
+ *    消费者先把一行复制出来再用 CAS 认领（consume），认领失败说明这一行已被丢弃，复制的内容作废
+ */
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// 一条定长记录
+struct log_record {
+    static constexpr size_t SIZE = 256;
+    static constexpr size_t TEXT = SIZE - 4;
+
+    uint16_t len;      // text 中的字节数
+    uint8_t more;      // 1 表示下一条记录是同一行的后续部分
+    uint8_t level;     // 日志级别，日志线程据此决定是否立即刷新
+    char text[TEXT];
+};
+
+class log_ring {
+   public:
+    static constexpr size_t CACHE_LINE = 64;
+
+    // capacity 向上取整为 2 的幂
+    explicit log_ring(uint32_t capacity) : m_tail_cache(0), m_retired(false), m_head(0), m_tail(0) {
+        uint32_t n = 1;
+        while (n < capacity) n <<= 1;
+        m_mask = n - 1;
+        m_slots = new log_record[n];
+    }
+    ~log_ring() { delete[] m_slots; }
+
+    // ---------- 生产者 ----------
+    // 预留 n 个连续槽位，空间不足时返回 false；成功后用 slot(0..n-1) 填写，再 publish(n)
+    bool reserve(uint32_t n) {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail_cache + n <= m_mask + 1) return true;
+        m_tail_cache = m_tail.load(std::memory_order_acquire);
+        return head - m_tail_cache + n <= m_mask + 1;
+    }
+    log_record &slot(uint32_t i) { return m_slots[(m_head.load(std::memory_order_relaxed) + i) & m_mask]; }
+    void publish(uint32_t n) { m_head.store(m_head.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+    // 所属线程退出，消费者读完后释放
+    void retire() { m_retired.store(true, std::memory_order_release); }
+    // 从环首整行丢弃级别低于 level 的行，直到放得下 n 个槽位或遇到其他级别的行，返回丢弃的行数。
+    // [m_tail, m_head) 中的记录都是本线程写的，读它们不与消费者冲突
+    uint32_t evict(uint32_t n, int level) {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        uint32_t tail = m_tail.load(std::memory_order_acquire);
+        for (;;) {
+            uint32_t pos = tail, lines = 0;
+            while (head - pos + n > m_mask + 1 && pos != head && m_slots[pos & m_mask].level < level) {
+                while (m_slots[pos & m_mask].more) ++pos;
+                ++pos;
+                ++lines;
+            }
+            if (lines == 0) return 0;
+            // 失败时消费者刚读走了若干行，tail 已更新为新值，重新计算
+            if (m_tail.compare_exchange_weak(tail, pos, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                m_tail_cache = pos;
+                return lines;
+            }
+        }
+    }
+
+    // ---------- 消费者 ----------
+    uint32_t readable() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+    uint32_t head() const { return m_head.load(std::memory_order_acquire); }
+    uint32_t tail() const { return m_tail.load(std::memory_order_acquire); }
+    // 位置 pos 的记录；生产者可能已经丢弃并改写它，内容只有 consume() 成功后才可信
+    const log_record &at(uint32_t pos) const { return m_slots[pos & m_mask]; }
+    // 认领从 tail 开始的 n 条记录并释放槽位；生产者已经丢弃了它们时返回 false
+    bool consume(uint32_t tail, uint32_t n) {
+        return m_tail.compare_exchange_strong(tail, tail + n, std::memory_order_acq_rel, std::memory_order_relaxed);
+    }
+    // 读完后批量释放 n 条记录，只能用于生产者从不调用 evict() 的环（如访问日志）
+    void release(uint32_t n) { m_tail.store(m_tail.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+    bool retired() const { return m_retired.load(std::memory_order_acquire); }
+
+    uint32_t capacity() const { return m_mask + 1; }
+
+   private:
+    log_ring(const log_ring &) = delete;
+    log_ring &operator=(const log_ring &) = delete;
+
+    // 只读成员
+    log_record *m_slots;
+    uint32_t m_mask;
+
+    // 生产者独占
+    alignas(CACHE_LINE) uint32_t m_tail_cache;  // 上次读到的消费者下标
+    std::atomic<bool> m_retired;
+
+    // 生产者写、消费者读
+    alignas(CACHE_LINE) std::atomic<uint32_t> m_head;
+
+    // 消费者写、生产者读；生产者只在环满丢弃最旧的行时写
+    alignas(CACHE_LINE) std::atomic<uint32_t> m_tail;
+    char m_pad[CACHE_LINE - sizeof(std::atomic<uint32_t>)];
+};
+
+#endif
@@ -0,0 +1,52 @@
+/**
+ * @file log_routes.cpp
+ * @brief 日志级别管理接口的实现
+ */
+
+#include "log_routes.h"
+
+static bool is_loopback(std::string_view addr) { return addr.substr(0, 4) == "127." || addr == "::1"; }
+
+static void log_levels(http_request &req, http_response &res) {
+    if (!is_loopback(req.remote_addr)) {
+        res.set_status(403);
+        res.send("forbidden\n");
+        return;
+    }
+    if (req.method == "POST" && !Log::set_levels(std::string(req.body).c_str())) {
+        res.set_status(400);
+        res.send("invalid log level spec\n");
+        return;
+    }
+    res.send(Log::levels() + "\n");
+}
+
+static void log_counters(http_request &req, http_response &res) {
+    if (!is_loopback(req.remote_addr)) {
+        res.set_status(403);
+        res.send("forbidden\n");
+        return;
+    }
+    static const char *names[] = {"debug", "info", "warn", "error"};
+    log_stats st = Log::get_instance()->stats();
+    std::string out;
+    char line[256];
+    for (int i = 0; i < 4; ++i) {
+        snprintf(line, sizeof(line), "log_dropped_total{level=\"%s\"} %lu\n", names[i], st.dropped[i]);
+        out += line;
+    }
+    snprintf(line, sizeof(line),
+             "log_evicted_total %lu\nlog_spilled_total %lu\nlog_waited_total %lu\n"
+             "log_queue_depth %lu\nlog_queue_depth_max %lu\nlog_queue_capacity %lu\nlog_queue_rings %lu\n",
+             st.evicted, st.spilled, st.waited, st.depth, st.max_depth, st.capacity, st.rings);
+    out += line;
+    snprintf(line, sizeof(line), "access_log_dropped_total %lu\n", access_log::get_instance()->dropped());
+    out += line;
+    res.send(out);
+}
+
+bool log_routes(http_conn::router &r) {
+    return http_conn::add_handler(r, "/admin/log", 1 << http_conn::GET | 1 << http_conn::POST, HANDLER_INLINE,
+                                  log_levels) &&
+           http_conn::add_handler(r, "/admin/log/stats", 1 << http_conn::GET, HANDLER_INLINE, log_counters);
+}
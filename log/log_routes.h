@@ -0,0 +1,19 @@
+/**
+ * @file log_routes.h
+ * @brief 日志级别的管理接口
+ *
+ * GET /admin/log 返回各模块的当前级别，POST /admin/log 以请求体为配置串修改级别（格式见 Log::set_levels()），
+ * 如 curl -d 'warn,http=debug' http://127.0.0.1:9006/admin/log。
+ * GET /admin/log/stats 以每行"名称 值"的文本格式返回异步日志各级别的丢弃数、溢出数和环的深度（见 log_stats），
+ * 可直接由 Prometheus 抓取，最后一行是访问日志因环满丢弃的记录数。只接受来自本机回环地址的请求。
+ */
+
+#ifndef LOG_ROUTES_H
+#define LOG_ROUTES_H
+
+#include "../http/http_conn.h"
+
+// 向路由表注册日志级别接口，路由冲突时返回 false
+bool log_routes(http_conn::router &r);
+
+#endif
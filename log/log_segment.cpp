@@ -0,0 +1,206 @@
+/**
+ * @file log_segment.cpp
+ * @brief 预分配日志段的实现
+ */
+
+#include "log_segment.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static const size_t COPY_CHUNK = 64 * 1024;  // 压缩时每次读取的字节数
+
+log_segments::log_segments(size_t size, bool compress)
+    : m_size(size < MIN_SIZE ? MIN_SIZE : size),
+      m_compress(compress),
+      m_cur(NULL),
+      m_spare(NULL),
+      m_spare_failed(false),
+      m_stop(false),
+      m_started(false) {}
+
+log_segments::~log_segments() {
+    if (m_started) {
+        m_lock.lock();
+        m_stop = true;
+        m_cond.broadcast();
+        m_lock.unlock();
+        pthread_join(m_thread, NULL);  // 后台线程做完已排队的改名和压缩后退出
+    }
+    // 当前段是最新的日志，只截断不压缩
+    if (m_cur) close_segment(m_cur, false);
+    if (m_spare) {
+        close_segment(m_spare, false);
+        unlink(m_spare_path.c_str());
+    }
+}
+
+log_segments::segment *log_segments::create(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        return NULL;
+    }
+    // 已有内容之后再预分配一段；文件系统不支持 fallocate 时 posix_fallocate 会退回逐块写零
+    size_t used = st.st_size;
+    size_t size = used + m_size;
+    if (posix_fallocate(fd, 0, size) != 0 && ftruncate(fd, size) < 0) {
+        ::close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (base == MAP_FAILED) {
+        ::close(fd);
+        return NULL;
+    }
+    segment *seg = new segment;
+    seg->fd = fd;
+    seg->base = (char *)base;
+    seg->size = size;
+    seg->used = used;
+    seg->path = path;
+    return seg;
+}
+
+void log_segments::close_segment(segment *seg, bool compress) {
+    munmap(seg->base, seg->size);
+    if (ftruncate(seg->fd, seg->used) < 0) {
+        // 截断失败时文件末尾留有预分配的 0，内容不受影响
+    }
+    ::close(seg->fd);
+    if (compress && seg->used > 0 && gzip_file(seg->path)) unlink(seg->path.c_str());
+    delete seg;
+}
+
+bool log_segments::gzip_file(const std::string &path) {
+    int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    std::string gz_path = path + ".gz";
+    gzFile out = gzopen(gz_path.c_str(), "wb6");
+    if (!out) {
+        ::close(in);
+        return false;
+    }
+    char buf[COPY_CHUNK];
+    bool ok = true;
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (gzwrite(out, buf, n) != n) {
+            ok = false;
+            break;
+        }
+    }
+    if (n < 0) ok = false;
+    if (gzclose(out) != Z_OK) ok = false;
+    ::close(in);
+    if (!ok) unlink(gz_path.c_str());
+    return ok;
+}
+
+bool log_segments::open(const char *path) {
+    if (!m_cur) {
+        // 第一个段同步创建，备用段放在同一目录下，改名不跨文件系统
+        m_cur = create(path);
+        if (!m_cur) return false;
+        const char *slash = strrchr(path, '/');
+        std::string dir = slash ? std::string(path, slash - path + 1) : std::string();
+        m_spare_path = dir + "." + (slash ? slash + 1 : path) + ".next";
+        if (pthread_create(&m_thread, NULL, worker, this) != 0) return true;  // 没有后台线程时每次切换都同步创建
+        m_started = true;
+        push(task{PREPARE, NULL, std::string()});
+        return true;
+    }
+
+    segment *next = NULL;
+    bool spare = false;
+    if (m_started && access(path, F_OK) != 0) {
+        // 通常情况：取后台准备好的备用段
+        m_lock.lock();
+        while (!m_spare && !m_spare_failed) m_cond.wait(m_lock.get());
+        next = m_spare;
+        m_spare = NULL;
+        m_spare_failed = false;
+        m_lock.unlock();
+        spare = next != NULL;
+    }
+    if (!next) next = create(path);
+    if (!next) {
+        if (m_started) push(task{PREPARE, NULL, std::string()});
+        return false;
+    }
+
+    segment *old = m_cur;
+    m_cur = next;
+    if (spare) push(task{RENAME, next, path});
+    if (m_started) {
+        if (spare) push(task{PREPARE, NULL, std::string()});
+        push(task{CLOSE, old, std::string()});
+    } else {
+        close_segment(old, m_compress);
+    }
+    return true;
+}
+
+void log_segments::write(const char *data, size_t len) {
+    if (!m_cur) return;
+    if (len > remaining()) len = remaining();
+    memcpy(m_cur->base + m_cur->used, data, len);
+    m_cur->used += len;
+}
+
+void log_segments::sync() {
+    if (!m_cur || m_cur->used == 0) return;
+    msync(m_cur->base, m_cur->used, MS_SYNC);
+}
+
+void log_segments::push(const task &t) {
+    m_lock.lock();
+    m_tasks.push_back(t);
+    m_cond.broadcast();
+    m_lock.unlock();
+}
+
+void *log_segments::worker(void *arg) {
+    ((log_segments *)arg)->run();
+    return NULL;
+}
+
+void log_segments::run() {
+    m_lock.lock();
+    while (true) {
+        while (m_tasks.empty() && !m_stop) m_cond.wait(m_lock.get());
+        if (m_tasks.empty()) break;  // 收到退出通知且任务已做完
+        task t = m_tasks.front();
+        m_tasks.pop_front();
+        m_lock.unlock();
+
+        switch (t.type) {
+            case PREPARE: {
+                if (m_stop) break;
+                unlink(m_spare_path.c_str());  // 上次异常退出留下的备用段
+                segment *seg = create(m_spare_path);
+                m_lock.lock();
+                m_spare = seg;
+                m_spare_failed = seg == NULL;
+                m_cond.broadcast();
+                m_lock.unlock();
+                break;
+            }
+            case RENAME:
+                // 改名之前写入的内容也在这个文件里，改名不影响映射
+                if (rename(t.seg->path.c_str(), t.path.c_str()) == 0) t.seg->path = t.path;
+                break;
+            case CLOSE:
+                close_segment(t.seg, m_compress);
+                break;
+        }
+        m_lock.lock();
+    }
+    m_lock.unlock();
+}
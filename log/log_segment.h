@@ -0,0 +1,93 @@
+/**
+ * @file log_segment.h
+ * @brief 内存映射的预分配日志段
+ *
+ * 日志不经过 stdio 缓冲，直接 memcpy 进用 fallocate 预先分配、mmap 映射的文件段。
+ * 主要特点：
+ * 1. 后台线程提前创建并映射好下一个段（MAP_POPULATE，页面已就绪），切换文件只是交换指针，
+ *    改名、截断、关闭和压缩旧段都在后台线程中完成，不占用写日志线程持有的锁
+ * 2. 写入的内容立即进入页缓存，不需要 fflush，进程崩溃也不会丢失；sync() 用 msync 落盘
+ * 3. 关闭的段截断到实际长度，可选用 gzip 压缩后删除原文件
+ * 4. 当前段的文件长度是预分配的长度，未写到的部分为 0，关闭时才截断
+ * 5. 调用者负责串行化（Log 的 m_mutex），本类只保护与后台线程共享的任务队列
+ */
+
+#ifndef LOG_SEGMENT_H
+#define LOG_SEGMENT_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include <deque>
+#include <string>
+
+#include "../lock/locker.h"
+
+class log_segments {
+   public:
+    static const size_t MIN_SIZE = 1 << 20;  // 段的最小长度，保证任何一次写入都放得进新段
+
+    // size 为每段预分配的字节数，compress 表示关闭的段用 gzip 压缩
+    log_segments(size_t size, bool compress);
+    ~log_segments();
+
+    /**
+     * @brief 切换到 path
+     *
+     * 第一次调用时同步创建；之后取后台准备好的备用段，由后台线程改名为 path，旧段交给后台线程关闭。
+     * path 已存在（如同一天重启）时同步打开，在原有内容之后继续写。
+     * @return 创建失败时返回 false，继续写原来的段
+     */
+    bool open(const char *path);
+
+    // 当前段剩余的字节数
+    size_t remaining() const { return m_cur ? m_cur->size - m_cur->used : 0; }
+    // 写入当前段，超出剩余空间的部分被丢弃，调用者先用 remaining() 检查
+    void write(const char *data, size_t len);
+    // 当前段已写入的部分落盘
+    void sync();
+
+   private:
+    struct segment {
+        int fd;
+        char *base;
+        size_t size;  // 映射长度
+        size_t used;  // 已写入的字节数
+        std::string path;
+    };
+
+    enum task_type { PREPARE, RENAME, CLOSE };
+    struct task {
+        task_type type;
+        segment *seg;
+        std::string path;  // RENAME 的目标
+    };
+
+    // 打开或创建 path，在已有内容之后预分配 m_size 字节并映射
+    segment *create(const std::string &path);
+    // 截断到实际长度并关闭，compress 时压缩后删除原文件
+    void close_segment(segment *seg, bool compress);
+    static bool gzip_file(const std::string &path);
+
+    void push(const task &t);
+    static void *worker(void *arg);
+    void run();
+
+   private:
+    size_t m_size;
+    bool m_compress;
+    std::string m_spare_path;  // 备用段的临时文件名，与日志在同一目录
+    segment *m_cur;            // 当前段，只由调用者访问
+
+    // 与后台线程共享，由 m_lock 保护
+    locker m_lock;
+    cond m_cond;
+    segment *m_spare;  // 准备好的备用段
+    bool m_spare_failed;
+    std::deque<task> m_tasks;
+    bool m_stop;
+    bool m_started;
+    pthread_t m_thread;
+};
+
+#endif
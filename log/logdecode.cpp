@@ -0,0 +1,317 @@
+/*
+ * 二进制日志解码器：把 -l 2 写出的 .bin 日志还原成与文本日志相同格式的行
+ *
+ * 用法：./logdecode [日志文件...]，不给文件时读标准输入，结果写到标准输出
+ *
+ * 格式定义和时钟校准都在日志文件里（见 log_binary.h），解码不需要服务器的源码或可执行文件。
+ * 格式串按 printf 的规则逐个解析转换说明，长度修饰符一律换成与编码相符的 ll 或 double；
+ * 参数类型与转换说明不符时输出 '?'，不会读错后面的字节。
+ * 条目之间的 0 字节是日志段（-S）预分配而未写到的空间，直接跳过。
+ * 文件头为 "TWSALOG1" 的是二进制访问日志（-A binary），每条记录输出为一行 CLF，与 -A clf 的输出相同。
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "access_log.h"
+#include "log_binary.h"
+
+struct format {
+    bool defined = false;
+    int level = 1;
+    std::string sig;
+    std::string fmt;
+};
+
+struct arg {
+    char type = 0;
+    int64_t i = 0;  // 整数参数按有符号和无符号各存一份
+    uint64_t u = 0;
+    double d = 0;
+    std::string s;
+};
+
+class decoder {
+   public:
+    decoder(FILE *in, const char *name) : m_in(in), m_name(name) {}
+
+    // 解码到文件末尾，文件损坏或被截断时返回 false
+    bool run();
+
+   private:
+    bool read(void *p, size_t n) { return fread(p, 1, n, m_in) == n; }
+    bool read_header();
+    // 访问日志：文件头之后全部是 access_entry 加路径
+    bool run_access();
+    bool read_format();
+    bool read_record();
+    bool read_arg(char type, arg &a);
+    long long to_ns(uint64_t tsc) const {
+        return m_sync_ns + (long long)((int64_t)(tsc - m_sync_tsc) / m_ticks_per_ns);
+    }
+    void print_prefix(long long ns, int level);
+    bool error(const char *what) {
+        fprintf(stderr, "%s: %s at offset %ld\n", m_name, what, ftell(m_in));
+        return false;
+    }
+
+   private:
+    FILE *m_in;
+    const char *m_name;
+    std::vector<format> m_formats;
+    bool m_have_header = false;
+    bool m_access = false;
+    uint64_t m_sync_tsc = 0;
+    long long m_sync_ns = 0;
+    double m_ticks_per_ns = 1.0;
+    long long m_last_ns = 0;  // 最近一行的时间，丢弃条目沿用
+};
+
+// 把一条转换说明连同参数格式化后追加到 out
+template <typename T>
+static void append(std::string &out, const std::string &spec, T value) {
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf), spec.c_str(), value);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(buf)) {
+        out.append(buf, n);
+    } else {
+        std::string big(n + 1, '\0');
+        snprintf(&big[0], big.size(), spec.c_str(), value);
+        out.append(big.data(), n);
+    }
+}
+
+static std::string render(const std::string &fmt, const std::vector<arg> &args) {
+    std::string out;
+    size_t next = 0;
+    for (size_t i = 0; i < fmt.size(); ++i) {
+        if (fmt[i] != '%') {
+            out += fmt[i];
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
+            out += '%';
+            ++i;
+            continue;
+        }
+        // %[标志][宽度][.精度][长度]转换
+        size_t start = i, j = i + 1;
+        std::string spec = "%";
+        while (j < fmt.size() && strchr("-+ #0", fmt[j])) spec += fmt[j++];
+        while (j < fmt.size() && (isdigit((unsigned char)fmt[j]) || fmt[j] == '.')) spec += fmt[j++];
+        while (j < fmt.size() && strchr("hlLqjzt", fmt[j])) ++j;
+        if (j >= fmt.size()) {
+            out.append(fmt, i, std::string::npos);
+            break;
+        }
+        char conv = fmt[j];
+        i = j;
+        if (next >= args.size()) {
+            out += "<missing>";
+            continue;
+        }
+        const arg &a = args[next++];
+        bool num = a.type == 'i' || a.type == 'u';
+        switch (conv) {
+            case 'd':
+            case 'i':
+                if (num) append(out, spec + "lld", (long long)a.i);
+                else out += '?';
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (num) append(out, spec + "ll" + conv, (unsigned long long)a.u);
+                else out += '?';
+                break;
+            case 'c':
+                if (num) append(out, spec + "c", (int)a.i);
+                else out += '?';
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (a.type == 'd') append(out, spec + conv, a.d);
+                else out += '?';
+                break;
+            case 's':
+                if (a.type == 's') append(out, spec + "s", a.s.c_str());
+                else out += '?';
+                break;
+            case 'p':
+                if (a.type == 'p') append(out, spec + "p", (void *)(uintptr_t)a.u);
+                else out += '?';
+                break;
+            default:
+                out.append(fmt, start, i - start + 1);  // 不认识的转换原样输出
+                break;
+        }
+    }
+    return out;
+}
+
+void decoder::print_prefix(long long ns, int level) {
+    static const char *names[] = {"[debug]:", "[info]:", "[warn]:", "[erro]:"};
+    time_t t = ns / 1000000000LL;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    printf("%d-%02d-%02d %02d:%02d:%02d.%06lld %s ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+           tm.tm_min, tm.tm_sec, ns % 1000000000LL / 1000, names[level >= 0 && level <= 3 ? level : 1]);
+}
+
+bool decoder::read_header() {
+    char magic[7];
+    uint64_t ns;
+    if (!read(magic, 7)) return error("bad header");
+    if (memcmp(magic, access_log::MAGIC + 1, 7) == 0) {
+        m_access = true;
+        return true;
+    }
+    if (memcmp(magic, log_bin::MAGIC + 1, 7) != 0) return error("bad header");
+    if (!read(&m_sync_tsc, 8) || !read(&ns, 8) || !read(&m_ticks_per_ns, 8)) return error("truncated header");
+    if (!(m_ticks_per_ns > 0)) return error("bad clock rate");
+    m_sync_ns = ns;
+    m_formats.clear();  // 追加写入的新一段重新定义格式
+    m_have_header = true;
+    return true;
+}
+
+bool decoder::read_format() {
+    uint32_t id;
+    uint8_t level;
+    uint16_t sig_len, fmt_len;
+    format f;
+    if (!read(&id, 4) || !read(&level, 1) || !read(&sig_len, 2)) return error("truncated format");
+    f.sig.resize(sig_len);
+    if ((sig_len && !read(&f.sig[0], sig_len)) || !read(&fmt_len, 2)) return error("truncated format");
+    f.fmt.resize(fmt_len);
+    if (fmt_len && !read(&f.fmt[0], fmt_len)) return error("truncated format");
+    f.defined = true;
+    f.level = level;
+    if (m_formats.size() <= id) m_formats.resize(id + 1);
+    m_formats[id] = f;
+    return true;
+}
+
+bool decoder::read_arg(char type, arg &a) {
+    a.type = type;
+    if (type == 's') {
+        uint16_t n;
+        if (!read(&n, 2)) return false;
+        a.s.resize(n);
+        return n == 0 || read(&a.s[0], n);
+    }
+    char raw[8];
+    if (!read(raw, 8)) return false;
+    if (type == 'd') {
+        memcpy(&a.d, raw, 8);
+    } else {
+        memcpy(&a.i, raw, 8);
+        memcpy(&a.u, raw, 8);
+    }
+    return true;
+}
+
+bool decoder::read_record() {
+    uint32_t id;
+    uint64_t tsc;
+    if (!read(&id, 4) || !read(&tsc, 8)) return error("truncated record");
+    // 参数长度由格式定义决定，未定义的编号之后的内容都无法解析
+    if (id >= m_formats.size() || !m_formats[id].defined) return error("record with undefined format id");
+    const format &f = m_formats[id];
+    std::vector<arg> args(f.sig.size());
+    for (size_t i = 0; i < f.sig.size(); ++i) {
+        if (!read_arg(f.sig[i], args[i])) return error("truncated record");
+    }
+    m_last_ns = to_ns(tsc);
+    print_prefix(m_last_ns, f.level);
+    std::string line = render(f.fmt, args);
+    line += '\n';
+    fwrite(line.data(), 1, line.size(), stdout);
+    return true;
+}
+
+bool decoder::run_access() {
+    char buf[sizeof(access_entry) + ACCESS_MAX_PATH];
+    std::string line;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(access_log::MAGIC), m_in)) > 0) {
+        if (n < sizeof(access_log::MAGIC)) return error("truncated record");
+        // 同一天重启时追加写入的文件头。start_ns 恰好等于这 8 个字节要到 2081 年
+        if (memcmp(buf, access_log::MAGIC, sizeof(access_log::MAGIC)) == 0) continue;
+        if (!read(buf + n, sizeof(access_entry) - n)) return error("truncated record");
+        access_entry e;
+        memcpy(&e, buf, sizeof(e));
+        if (e.path_len > ACCESS_MAX_PATH) return error("bad path length");
+        if (e.path_len && !read(buf + sizeof(e), e.path_len)) return error("truncated record");
+        line.clear();
+        access_log::format_clf(line, e, buf + sizeof(e));
+        fwrite(line.data(), 1, line.size(), stdout);
+    }
+    return true;
+}
+
+bool decoder::run() {
+    int c;
+    while ((c = fgetc(m_in)) != EOF) {
+        if (c == 0) continue;  // 日志段预分配的空间，进程异常退出时没有截断
+        if (c != log_bin::HEADER && !m_have_header) return error("missing header");
+        switch (c) {
+            case log_bin::HEADER:
+                if (!read_header()) return false;
+                if (m_access) return run_access();
+                break;
+            case log_bin::FORMAT:
+                if (!read_format()) return false;
+                break;
+            case log_bin::RECORD:
+                if (!read_record()) return false;
+                break;
+            case log_bin::CLOCK: {
+                uint64_t ns;
+                if (!read(&m_sync_tsc, 8) || !read(&ns, 8)) return error("truncated clock");
+                m_sync_ns = ns;
+                break;
+            }
+            case log_bin::DROPPED: {
+                uint64_t count;
+                if (!read(&count, 8)) return error("truncated drop count");
+                print_prefix(m_last_ns, 2);
+                printf("log ring full, dropped %llu lines\n", (unsigned long long)count);
+                break;
+            }
+            default:
+                return error("unknown entry");
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    int status = 0;
+    if (argc < 2) return decoder(stdin, "<stdin>").run() ? 0 : 1;
+    for (int i = 1; i < argc; ++i) {
+        FILE *in = fopen(argv[i], "rb");
+        if (!in) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        if (!decoder(in, argv[i]).run()) status = 1;
+        fclose(in);
+    }
+    return status;
+}
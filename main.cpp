@@ -17,7 +17,11 @@ int main(int argc, char *argv[]) {
     // 初始化。将上面的config对象中的配置参数，传入到WebServer对象的init方法中，让WebServer对象也能使用
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite,
                 config.OPT_LINGER, config.TRIGMode, config.sql_num,
-                config.thread_num, config.close_log, config.actor_model);
+                config.thread_num, config.close_log, config.actor_model,
+                config.compress_threads, config.handler_threads, config.proxy_specs,
+                config.fastcgi_specs, config.vhost_specs, config.tls_port, config.tls_cert, config.tls_key,
+                config.log_levels, config.log_segment_mb, config.log_backpressure, config.access_format,
+                config.ws_topics);
 
     //  配置并初始化日志系统，用于记录服务器运行时的事件、错误、请求信息等 
     server.log_write();
@@ -25,6 +29,10 @@ int main(int argc, char *argv[]) {
     server.sql_pool();
     // 初始化线程池，创建一定数量的工作线程，用于并发处理客户端请求，提升服务器的并发能力。
     server.thread_pool();
+    // 初始化虚拟主机、各自的静态文件缓存和后台压缩线程，按 Accept-Encoding 发送预压缩或即时压缩的内容。
+    server.static_cache();
+    // 初始化路由表、阻塞处理函数线程池和反向代理，按请求路径分派到页面跳转、登录注册、上游服务器、FastCGI 应用等处理方式。
+    server.route_table();
     //  设置触发模式，配置事件监听的触发方式（ LT 模式和 ET 模式），用于控制 I/O 多路复用的触发行为。
     server.trig_mode();
     //  监听端口，准备接受客户端的连接请求。
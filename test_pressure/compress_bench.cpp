@@ -0,0 +1,116 @@
+/*
+ * 压缩开销基准：对比各编码/级别下的线上字节数与压缩 CPU 时间
+ *
+ * 用法：./compress_bench [目录，默认 ./root] [每个组合的重复次数，默认 200]
+ *
+ * 对目录下每个文件分别压缩，输出：
+ *   - wire   压缩后的字节数（即发送到网络上的响应体大小）
+ *   - ratio  wire / 原始字节数
+ *   - cpu    单次压缩的线程 CPU 时间
+ *   - MB/s   压缩吞吐
+ * 最后汇总每个组合在整个目录上的总字节数与总 CPU 时间，用来决定即时压缩的编码和级别。
+ * 预压缩兄弟文件（.gz/.br/.zst）不参与统计。
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "../cache/compressor.h"
+
+using namespace std;
+
+struct bench_case {
+    CONTENT_ENCODING enc;
+    int level;
+};
+
+static double thread_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool is_sibling(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot && (strcmp(dot, ".gz") == 0 || strcmp(dot, ".br") == 0 || strcmp(dot, ".zst") == 0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = argc > 1 ? argv[1] : "./root";
+    int iterations = argc > 2 ? atoi(argv[2]) : 200;
+    if (iterations <= 0) iterations = 1;
+
+    // 读入目录下的所有普通文件
+    vector<pair<string, string> > files;
+    DIR *dp = opendir(dir);
+    if (!dp) {
+        perror(dir);
+        return 1;
+    }
+    while (struct dirent *de = readdir(dp)) {
+        string path = string(dir) + "/" + de->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 || is_sibling(de->d_name)) continue;
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (!fp) continue;
+        string data(st.st_size, '\0');
+        size_t n = fread(&data[0], 1, st.st_size, fp);
+        fclose(fp);
+        data.resize(n);
+        files.push_back(make_pair(string(de->d_name), data));
+    }
+    closedir(dp);
+
+    static const bench_case cases[] = {
+        {ENC_GZIP, 1}, {ENC_GZIP, 6}, {ENC_GZIP, 9},
+        {ENC_BROTLI, 4}, {ENC_BROTLI, 9}, {ENC_BROTLI, 11},
+        {ENC_ZSTD, 3}, {ENC_ZSTD, 9}, {ENC_ZSTD, 19},
+    };
+    const int ncases = sizeof(cases) / sizeof(cases[0]);
+    vector<size_t> total_wire(ncases, 0);
+    vector<double> total_cpu(ncases, 0);
+    size_t total_raw = 0;
+
+    printf("%-20s %10s %-6s %5s %10s %7s %10s %8s\n", "file", "raw", "enc", "level", "wire", "ratio", "cpu(us)", "MB/s");
+    for (size_t f = 0; f < files.size(); ++f) {
+        const string &name = files[f].first;
+        const string &data = files[f].second;
+        total_raw += data.size();
+        for (int c = 0; c < ncases; ++c) {
+            if (!encoding_supported(cases[c].enc)) continue;
+            size_t wire = data.size();  // 压缩不变小时服务器发送原文
+            double begin = thread_cpu_us();
+            for (int i = 0; i < iterations; ++i) {
+                std::shared_ptr<encoded_body> body = compress_buffer(cases[c].enc, data.data(), data.size(), cases[c].level);
+                if (body) wire = body->size;
+            }
+            double cpu = (thread_cpu_us() - begin) / iterations;
+            total_wire[c] += wire;
+            total_cpu[c] += cpu;
+            printf("%-20s %10zu %-6s %5d %10zu %7.3f %10.1f %8.1f\n", name.c_str(), data.size(),
+                encoding_name(cases[c].enc), cases[c].level, wire, (double)wire / data.size(), cpu,
+                cpu > 0 ? data.size() / cpu : 0.0);
+        }
+    }
+
+    printf("\n汇总（%zu 个文件，原始 %zu 字节）\n", files.size(), total_raw);
+    printf("%-6s %5s %12s %7s %12s %14s\n", "enc", "level", "wire", "ratio", "cpu(us)", "us/KB saved");
+    printf("%-6s %5s %12zu %7.3f %12.1f %14s\n", "none", "-", total_raw, 1.0, 0.0, "-");
+    for (int c = 0; c < ncases; ++c) {
+        if (!encoding_supported(cases[c].enc)) {
+            printf("%-6s %5d %12s\n", encoding_name(cases[c].enc), cases[c].level, "(未编译)");
+            continue;
+        }
+        double saved_kb = (total_raw - total_wire[c]) / 1024.0;
+        printf("%-6s %5d %12zu %7.3f %12.1f %14.2f\n", encoding_name(cases[c].enc), cases[c].level, total_wire[c],
+            total_raw ? (double)total_wire[c] / total_raw : 0.0, total_cpu[c], saved_kb > 0 ? total_cpu[c] / saved_kb : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+# fcgi_stub.py 是 FastCGI 客户端测试用的桩应用，监听 Unix socket，支持长连接（FCGI_KEEP_CONN）。
+# 加 --mpx 时对 FCGI_GET_VALUES 回答 FCGI_MPXS_CONNS=1，同一连接上的请求并发处理。
+#
+#   python3 fcgi_stub.py /tmp/fcgi.sock [--mpx]
+#   ./server -f /app=/tmp/fcgi.sock
+#
+# 按 SCRIPT_NAME 结尾区分接口：
+#   /echo              回显 REQUEST_METHOD、REQUEST_URI、REMOTE_ADDR、SERVER_PORT、HTTPS、CONTENT_LENGTH、HTTP_ 变量和请求体
+#   /big?n=字节数      分多个 FCGI_STDOUT 记录输出的大响应体
+#   /slow?ms=毫秒      延迟后回复，配合 --mpx 观察多路复用
+#   /status            Status: 404 和 stderr 输出
+#   /redirect          只有 Location 头的重定向
+
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+from urllib.parse import parse_qs
+
+BEGIN, ABORT, END, PARAMS, STDIN, STDOUT, STDERR, GET_VALUES, GET_VALUES_RESULT = 1, 2, 3, 4, 5, 6, 7, 9, 10
+
+
+def record(rtype, rid, data=b""):
+    out = b""
+    for pos in range(0, max(len(data), 1), 65535):
+        chunk = data[pos:pos + 65535]
+        pad = (8 - len(chunk) % 8) % 8
+        out += struct.pack("!BBHHBx", 1, rtype, rid, len(chunk), pad) + chunk + b"\0" * pad
+    return out
+
+
+def read_length(data, pos):
+    if data[pos] < 128:
+        return data[pos], pos + 1
+    return struct.unpack("!I", data[pos:pos + 4])[0] & 0x7fffffff, pos + 4
+
+
+def parse_pairs(data):
+    pairs, pos = {}, 0
+    while pos < len(data):
+        n, pos = read_length(data, pos)
+        v, pos = read_length(data, pos)
+        pairs[data[pos:pos + n].decode()] = data[pos + n:pos + n + v].decode("latin-1")
+        pos += n + v
+    return pairs
+
+
+def pair(name, value):
+    return bytes([len(name), len(value)]) + name + value
+
+
+class Conn:
+    def __init__(self, sock, mpx):
+        self.sock, self.mpx = sock, mpx
+        self.lock = threading.Lock()
+        self.requests = {}
+
+    def send(self, data):
+        with self.lock:
+            self.sock.sendall(data)
+
+    def recv_exact(self, n):
+        buf = b""
+        while len(buf) < n:
+            chunk = self.sock.recv(n - len(buf))
+            if not chunk:
+                raise EOFError
+            buf += chunk
+        return buf
+
+    def serve(self):
+        try:
+            while True:
+                _, rtype, rid, length, pad = struct.unpack("!BBHHBx", self.recv_exact(8))
+                content = self.recv_exact(length + pad)[:length]
+                if rtype == GET_VALUES:
+                    value = b"1" if self.mpx else b"0"
+                    self.send(record(GET_VALUES_RESULT, 0, pair(b"FCGI_MPXS_CONNS", value)))
+                elif rtype == BEGIN:
+                    self.requests[rid] = {"params": b"", "stdin": b""}
+                elif rtype == ABORT:
+                    self.requests.pop(rid, None)
+                    self.send(record(END, rid, struct.pack("!IB3x", 1, 0)))
+                elif rtype == PARAMS and rid in self.requests:
+                    self.requests[rid]["params"] += content
+                elif rtype == STDIN and rid in self.requests:
+                    if content:
+                        self.requests[rid]["stdin"] += content
+                        continue
+                    req = self.requests.pop(rid)
+                    if self.mpx:
+                        threading.Thread(target=self.respond, args=(rid, req), daemon=True).start()
+                    else:
+                        self.respond(rid, req)
+        except (EOFError, OSError):
+            pass
+        finally:
+            self.sock.close()
+
+    def respond(self, rid, req):
+        env = parse_pairs(req["params"])
+        q = {k: v[0] for k, v in parse_qs(env.get("QUERY_STRING", "")).items()}
+        script = env.get("SCRIPT_NAME", "")
+        out = []
+        if script.endswith("/echo"):
+            lines = ["%s %s" % (env.get("REQUEST_METHOD"), env.get("REQUEST_URI")),
+                     "remote=%s" % env.get("REMOTE_ADDR"),
+                     "script=%s" % env.get("SCRIPT_FILENAME"),
+                     "port=%s https=%s" % (env.get("SERVER_PORT"), env.get("HTTPS")),
+                     "length=%s" % env.get("CONTENT_LENGTH")]
+            lines += ["%s=%s" % (k, v) for k, v in sorted(env.items()) if k.startswith("HTTP_")]
+            lines.append("body=%s" % req["stdin"].decode("latin-1"))
+            out.append(b"Content-Type: text/plain\r\n\r\n" + ("\n".join(lines) + "\n").encode())
+        elif script.endswith("/big"):
+            n = int(q.get("n", 1 << 20))
+            out.append(b"Content-Type: application/octet-stream\r\n\r\n")
+            pattern = bytes(range(256)) * 256
+            while n > 0:
+                out.append(pattern[:min(n, len(pattern))])
+                n -= len(out[-1])
+        elif script.endswith("/slow"):
+            time.sleep(int(q.get("ms", 1000)) / 1000.0)
+            out.append(b"Content-Type: text/plain\n\nslow %d\n" % rid)
+        elif script.endswith("/status"):
+            self.send(record(STDERR, rid, b"stub warning"))
+            out.append(b"Status: 404 Not Found\r\nContent-Type: text/plain\r\n\r\nmissing\n")
+        elif script.endswith("/redirect"):
+            out.append(b"Location: /echo\r\n\r\n")
+        else:
+            out.append(b"Status: 500\r\n\r\nunknown script\n")
+        try:
+            for part in out:
+                self.send(record(STDOUT, rid, part))
+            self.send(record(STDOUT, rid) + record(END, rid, struct.pack("!IB3x", 0, 0)))
+        except OSError:
+            pass
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else "/tmp/fcgi.sock"
+    mpx = "--mpx" in sys.argv
+    if os.path.exists(path):
+        os.unlink(path)
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server.bind(path)
+    server.listen(128)
+    while True:
+        sock, _ = server.accept()
+        threading.Thread(target=Conn(sock, mpx).serve, daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,326 @@
+/*
+ * HTTP/2 多路复用基准：少量连接上并发大量小请求，与相同连接数的 HTTP/1.1 keep-alive 对比
+ *
+ * 用法：./h2_bench [主机，默认 127.0.0.1] [端口，默认 9006] [连接数，默认 8] [每连接并发流，默认 64]
+ *                  [每种协议的测试秒数，默认 10] [路径，默认 /judge.html]
+ *
+ * 先测 HTTP/1.1：每条连接一次只有一个请求在途；再测 HTTP/2：每条连接始终保持 S 个流在途，
+ * 一个流结束立即在同一连接上发起下一个。输出两种协议的每秒请求数和延迟分位数。
+ * 开始前先检查 h2c 升级：不带连接前言的 Upgrade: h2c 请求在 101 之后必须作为流 1 得到回答，否则退出。
+ * HTTP/2 客户端只做测试需要的部分：请求头用不入表的字面量编码，响应头块整块跳过，
+ * 开始时把连接和流的接收窗口都开到 1GB，之后按收到的字节补充连接窗口。
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+static const uint32_t WINDOW = 1u << 30;  // 客户端的接收窗口
+
+struct conn {
+    int fd;
+    string in;                              // 未处理的数据
+    string out;                             // 未发出的数据
+    uint32_t next_stream;                   // 下一个流编号
+    unordered_map<uint32_t, double> start;  // 在途的流 -> 发出时刻
+    double h1_start;                        // HTTP/1.1 在途请求的发出时刻
+    uint64_t consumed;                      // 已收到、尚未补充窗口的 DATA 字节数
+    bool idle;                              // 测试时间已到，在途的请求都已完成
+};
+
+static const char *g_host;
+static const char *g_path;
+static vector<double> g_latency;
+static long g_errors;
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int dial(const sockaddr_in &addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void frame(string &out, uint8_t type, uint8_t flags, uint32_t sid, const string &payload) {
+    size_t len = payload.size();
+    unsigned char h[9] = {(unsigned char)(len >> 16), (unsigned char)(len >> 8), (unsigned char)len, type, flags,
+                          (unsigned char)(sid >> 24), (unsigned char)(sid >> 16), (unsigned char)(sid >> 8),
+                          (unsigned char)sid};
+    out.append((const char *)h, 9);
+    out += payload;
+}
+
+static string u32(uint32_t v) {
+    char b[4] = {(char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v};
+    return string(b, 4);
+}
+
+// 发起一个 GET 流：:method GET 和 :scheme http 用静态表索引，:path 和 :authority 为不入表的字面量
+static void h2_request(conn &c) {
+    string block = "\x82\x86";
+    block += '\x04';
+    block += (char)strlen(g_path);
+    block += g_path;
+    block += '\x01';
+    block += (char)strlen(g_host);
+    block += g_host;
+    uint32_t sid = c.next_stream;
+    c.next_stream += 2;
+    frame(c.out, 0x1, 0x1 | 0x4, sid, block);  // END_STREAM | END_HEADERS
+    c.start[sid] = now_us();
+}
+
+static void h1_request(conn &c) {
+    c.out += "GET ";
+    c.out += g_path;
+    c.out += " HTTP/1.1\r\nHost: ";
+    c.out += g_host;
+    c.out += "\r\nConnection: keep-alive\r\n\r\n";
+    c.h1_start = now_us();
+}
+
+static bool flush(conn &c) {
+    while (!c.out.empty()) {
+        ssize_t n = write(c.fd, c.out.data(), c.out.size());
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        c.out.erase(0, n);
+    }
+    return true;
+}
+
+static bool drain(conn &c) {
+    char buf[65536];
+    while (true) {
+        ssize_t n = read(c.fd, buf, sizeof(buf));
+        if (n == 0) return false;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        c.in.append(buf, n);
+    }
+}
+
+// 处理收到的帧，结束的流立即换成新的流；返回 false 表示连接出错
+static bool h2_parse(conn &c, bool more) {
+    size_t pos = 0;
+    while (c.in.size() - pos >= 9) {
+        const unsigned char *h = (const unsigned char *)c.in.data() + pos;
+        uint32_t len = (h[0] << 16) | (h[1] << 8) | h[2];
+        if (c.in.size() - pos < 9 + len) break;
+        uint8_t type = h[3], flags = h[4];
+        uint32_t sid = ((h[5] & 0x7f) << 24) | (h[6] << 16) | (h[7] << 8) | h[8];
+        pos += 9 + len;
+        if (type == 0x0) c.consumed += len;
+        if (type == 0x4 && !(flags & 0x1)) frame(c.out, 0x4, 0x1, 0, "");  // SETTINGS ACK
+        if (type == 0x7) {
+            fprintf(stderr, "GOAWAY received\n");
+            return false;
+        }
+        bool ended = ((type == 0x0 || type == 0x1) && (flags & 0x1)) || type == 0x3;
+        if (!ended) continue;
+        auto it = c.start.find(sid);
+        if (it == c.start.end()) continue;
+        if (type == 0x3)
+            ++g_errors;
+        else
+            g_latency.push_back(now_us() - it->second);
+        c.start.erase(it);
+        if (more) h2_request(c);
+    }
+    c.in.erase(0, pos);
+    if (c.consumed >= WINDOW / 2) {
+        frame(c.out, 0x8, 0, 0, u32(c.consumed));
+        c.consumed = 0;
+    }
+    return true;
+}
+
+// 解析 HTTP/1.1 响应，只认 Content-Length
+static bool h1_parse(conn &c, bool more) {
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == string::npos) return true;
+    size_t cl = c.in.find("Content-Length:");
+    if (cl == string::npos || cl > end) cl = c.in.find("content-length:");
+    if (cl == string::npos || cl > end) return false;
+    size_t total = end + 4 + atol(c.in.c_str() + cl + 15);
+    if (c.in.size() < total) return true;
+    if (c.in.compare(9, 3, "200") == 0)
+        g_latency.push_back(now_us() - c.h1_start);
+    else
+        ++g_errors;
+    c.in.erase(0, total);
+    if (more)
+        h1_request(c);
+    else
+        c.h1_start = 0;
+    return true;
+}
+
+// h2c 升级：等到 101 后发送连接前言，升级的请求作为流 1 必须得到回答
+static void check_upgrade(const sockaddr_in &addr) {
+    g_latency.clear();
+    g_errors = 0;
+    conn c;
+    c.fd = dial(addr);
+    if (c.fd < 0) {
+        fprintf(stderr, "connect failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    c.next_stream = 3;  // 流 1 是升级的请求
+    c.consumed = 0;
+    c.idle = false;
+    c.out = string("GET ") + g_path + " HTTP/1.1\r\nHost: " + g_host +
+            "\r\nConnection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\n"
+            "HTTP2-Settings: AARAAAAA\r\n\r\n";  // SETTINGS_INITIAL_WINDOW_SIZE = WINDOW
+    double t0 = now_us();
+    c.start[1] = t0;
+    bool upgraded = false;
+    pollfd p = {c.fd, POLLIN, 0};
+    while (!c.start.empty()) {
+        if (!flush(c) || poll(&p, 1, 5000) <= 0 || !drain(c)) {
+            fprintf(stderr, "h2c upgrade: %s\n", upgraded ? "stream 1 was not answered" : "no response");
+            exit(1);
+        }
+        if (!upgraded) {
+            size_t end = c.in.find("\r\n\r\n");
+            if (end == string::npos) continue;
+            if (c.in.compare(0, 12, "HTTP/1.1 101") != 0) {
+                fprintf(stderr, "h2c upgrade: expected 101, got %.12s\n", c.in.c_str());
+                exit(1);
+            }
+            c.in.erase(0, end + 4);
+            upgraded = true;
+            c.out += "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+            frame(c.out, 0x4, 0, 0, "");
+            frame(c.out, 0x8, 0, 0, u32(WINDOW - 65535));
+        }
+        if (!h2_parse(c, false)) exit(1);
+    }
+    close(c.fd);
+    if (g_errors) {
+        fprintf(stderr, "h2c upgrade: stream 1 was reset\n");
+        exit(1);
+    }
+    printf("h2c upgrade: stream 1 answered in %.1f us\n", now_us() - t0);
+}
+
+static double percentile(vector<double> &v, double q) {
+    if (v.empty()) return 0;
+    size_t k = (size_t)(q * (v.size() - 1));
+    nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+static void run(const sockaddr_in &addr, bool h2, int connections, int streams, int seconds) {
+    g_latency.clear();
+    g_errors = 0;
+    int epfd = epoll_create1(0);
+    vector<conn> conns(connections);
+    for (int i = 0; i < connections; ++i) {
+        conn &c = conns[i];
+        c.fd = dial(addr);
+        if (c.fd < 0) {
+            fprintf(stderr, "connect failed: %s\n", strerror(errno));
+            exit(1);
+        }
+        c.next_stream = 1;
+        c.consumed = 0;
+        c.idle = false;
+        if (h2) {
+            c.out = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+            frame(c.out, 0x4, 0, 0, string("\x00\x04", 2) + u32(WINDOW));  // SETTINGS_INITIAL_WINDOW_SIZE
+            frame(c.out, 0x8, 0, 0, u32(WINDOW - 65535));
+            for (int s = 0; s < streams; ++s) h2_request(c);
+        } else {
+            h1_request(c);
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+        flush(c);
+    }
+
+    // 到时间后不再发起新请求，等在途的请求全部完成
+    double t0 = now_us(), deadline = t0 + seconds * 1e6;
+    int active = connections;
+    while (active > 0) {
+        bool more = now_us() < deadline;
+        epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, 5000);
+        if (n <= 0) {
+            fprintf(stderr, "timeout waiting for responses\n");
+            exit(1);
+        }
+        for (int i = 0; i < n; ++i) {
+            conn &c = conns[events[i].data.u32];
+            bool ok = drain(c) && (h2 ? h2_parse(c, more) : h1_parse(c, more)) && flush(c);
+            if (!ok) {
+                fprintf(stderr, "connection closed by server\n");
+                exit(1);
+            }
+            if (!c.idle && ((h2 && !more && c.start.empty()) || (!h2 && !more && c.in.empty() && c.h1_start == 0))) {
+                c.idle = true;
+                --active;
+            }
+        }
+    }
+    double elapsed = (now_us() - t0) / 1e6;
+    for (int i = 0; i < connections; ++i) close(conns[i].fd);
+    close(epfd);
+
+    printf("%-8s %6d conns x %-4d in flight: %10.0f req/s  p50 %8.1f us  p99 %8.1f us  errors %ld\n",
+           h2 ? "HTTP/2" : "HTTP/1.1", connections, h2 ? streams : 1, g_latency.size() / elapsed,
+           percentile(g_latency, 0.5), percentile(g_latency, 0.99), g_errors);
+}
+
+int main(int argc, char *argv[]) {
+    g_host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 9006;
+    int connections = argc > 3 ? atoi(argv[3]) : 8;
+    int streams = argc > 4 ? atoi(argv[4]) : 64;
+    int seconds = argc > 5 ? atoi(argv[5]) : 10;
+    g_path = argc > 6 ? argv[6] : "/judge.html";
+    if (connections <= 0 || streams <= 0 || seconds <= 0 || strlen(g_path) > 126 || strlen(g_host) > 126) {
+        fprintf(stderr, "usage: %s [host] [port] [connections] [streams] [seconds] [path]\n", argv[0]);
+        return 1;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, g_host, &addr.sin_addr);
+
+    check_upgrade(addr);
+    run(addr, false, connections, 1, seconds);
+    run(addr, true, connections, streams, seconds);
+    return 0;
+}
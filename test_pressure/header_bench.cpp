@@ -0,0 +1,135 @@
+/*
+ * 响应头基准：比较几种拼装响应头的方式每秒能生成多少个响应头
+ *
+ * 用法：./header_bench [每种方式的次数，默认 2000000]
+ *
+ * 三种方式生成同样的一组头（状态行、Content-Length、Content-Type、Connection，后两种还有 Date 和 Server）：
+ * 1. printf：原来 http_conn::add_response() 的做法，每个头一次 vsnprintf
+ * 2. printf + Date：同上，再在每个响应里用 strftime 格式化 Date，即不缓存 Date 时的开销
+ * 3. fragments：response_head.h 的做法，常量片段 memcpy、format_uint 格式化长度、Date 取缓存的行
+ * 状态码和长度在一组常见值中轮换，避免编译器把格式化结果当作常量。
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../http/response_head.h"
+
+static const int BUF_SIZE = 1024;
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const int STATUSES[] = {200, 200, 200, 304, 404, 200, 301, 500};
+static const int NSTATUS = sizeof(STATUSES) / sizeof(STATUSES[0]);
+
+// 与原来的 http_conn::add_response() 相同
+static bool add_response(char *buf, int &idx, const char *format, ...) {
+    if (idx >= BUF_SIZE) return false;
+    va_list arg_list;
+    va_start(arg_list, format);
+    int len = vsnprintf(buf + idx, BUF_SIZE - 1 - idx, format, arg_list);
+    va_end(arg_list);
+    if (len >= (BUF_SIZE - 1 - idx)) return false;
+    idx += len;
+    return true;
+}
+
+static int head_printf(char *buf, int status, long length, bool with_date) {
+    int idx = 0;
+    add_response(buf, idx, "%s %d %s\r\n", "HTTP/1.1", status, status_reason(status));
+    if (with_date) {
+        char date[40];
+        time_t now = time(NULL);
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        add_response(buf, idx, "Date:%s\r\n", date);
+        add_response(buf, idx, "Server:%s\r\n", "TinyWebServer");
+    }
+    add_response(buf, idx, "Content-Length:%ld\r\n", length);
+    add_response(buf, idx, "Content-Type:%s\r\n", "text/html");
+    add_response(buf, idx, "Connection:%s\r\n", "keep-alive");
+    add_response(buf, idx, "%s", "\r\n");
+    return idx;
+}
+
+static int head_fragments(char *buf, int status, long length) {
+    char *p = buf;
+    size_t len;
+    const char *line = status_line(status, len);
+    if (line) {
+        memcpy(p, line, len);
+        p += len;
+    } else {
+        memcpy(p, "HTTP/1.1 ", 9);
+        p += 9;
+        p += format_uint(p, status);
+        *p++ = ' ';
+        const char *reason = status_reason(status);
+        len = strlen(reason);
+        memcpy(p, reason, len);
+        p += len;
+        memcpy(p, "\r\n", 2);
+        p += 2;
+    }
+    memcpy(p, http_date::line(), http_date::LINE_LEN);
+    p += http_date::LINE_LEN;
+    memcpy(p, HEAD_SERVER, HEAD_SERVER_LEN);
+    p += HEAD_SERVER_LEN;
+    memcpy(p, "Content-Length:", 15);
+    p += 15;
+    p += format_uint(p, length);
+    static const char tail[] = "\r\nContent-Type:text/html\r\n";
+    memcpy(p, tail, sizeof(tail) - 1);
+    p += sizeof(tail) - 1;
+    memcpy(p, HEAD_KEEP_ALIVE, HEAD_KEEP_ALIVE_LEN);
+    p += HEAD_KEEP_ALIVE_LEN;
+    memcpy(p, "\r\n", 2);
+    p += 2;
+    return p - buf;
+}
+
+static void report(const char *name, long n, double elapsed, unsigned long bytes) {
+    printf("%-16s %12.0f heads/s  %7.1f ns/head  (%lu bytes)\n", name, n / elapsed, elapsed * 1e9 / n, bytes);
+}
+
+int main(int argc, char *argv[]) {
+    long n = argc > 1 ? atol(argv[1]) : 2000000;
+    if (n <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    char buf[BUF_SIZE];
+    unsigned long sink;
+    double t0;
+
+    sink = 0;
+    t0 = now_s();
+    for (long i = 0; i < n; ++i) sink += head_printf(buf, STATUSES[i % NSTATUS], 1000 + (i & 0xffff), false);
+    report("printf", n, now_s() - t0, sink);
+
+    sink = 0;
+    t0 = now_s();
+    for (long i = 0; i < n; ++i) sink += head_printf(buf, STATUSES[i % NSTATUS], 1000 + (i & 0xffff), true);
+    report("printf + Date", n, now_s() - t0, sink);
+
+    // 服务器中由主循环每次 epoll_wait 返回后调用，这里每 1024 个响应调用一次
+    sink = 0;
+    t0 = now_s();
+    for (long i = 0; i < n; ++i) {
+        if ((i & 1023) == 0) http_date::update(time(NULL));
+        sink += head_fragments(buf, STATUSES[i % NSTATUS], 1000 + (i & 0xffff));
+    }
+    report("fragments", n, now_s() - t0, sink);
+
+    printf("\n%.*s", head_fragments(buf, 200, 1234), buf);
+    return 0;
+}
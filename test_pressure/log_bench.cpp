@@ -0,0 +1,216 @@
+/*
+ * 日志基准：多个线程同时写日志时每秒能写多少行
+ *
+ * 用法：./log_bench [线程数，默认 16] [每个线程的行数，默认 100000] [日志目录，默认 /tmp] [每线程环的记录数，默认 800]
+ *
+ * 每种方式各在一个子进程中运行（Log 是单例，只能初始化一次）：
+ * 1. queue：原来的异步日志，加锁格式化到共享缓冲区、复制成 string、经 block_queue 交给写线程
+ * 2. sync+flush：同步日志，每行之后调用 flush()，即原来 LOG_* 宏的做法
+ * 3. sync：同步日志，按 log_flush_policy 成组刷新
+ * 4. coarse：同 sync，但时间戳取自 CLOCK_REALTIME_COARSE
+ * 5. ring：每个线程一个环形缓冲区（log_ring.h），日志线程攒成大块后写入
+ * 6. binary：同 ring，但调用线程只写格式编号、时间戳计数和原始参数（log_binary.h），不格式化
+ * 7. segment：同 sync，但写入预分配并映射的 1MB 日志段（log_segment.h），段写满即切换
+ * 8. segment+gz：同 segment，旧段由后台线程压缩（服务器 -S 的做法）
+ * 队列和环的容量默认与服务器相同（800 行 / 每线程 800 条记录，环向上取整为 1024）。满时两者都丢弃，
+ * 所以同时输出调用速率和实际写入文件的行数。环的记录数不小于每线程行数时不会丢弃，调用速率即调用线程的真实开销。
+ * 每个文件最多 SPLIT_LINES 行，同时输出单次调用的最大耗时：同步写入时切换文件（fclose/fopen）发生在调用线程持有的锁内。
+ * 日志文件测完即删除。
+ */
+
+#include <glob.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+
+#include "../log/log.h"
+
+static int g_threads = 16;
+static long g_lines = 100000;
+static const char *g_dir = "/tmp";
+static int g_ring = 800;
+static const int SPLIT_LINES = 20000;  // 每个日志文件的行数，约 1.5MB
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// 原来的异步日志：与改动前的 Log::write_log() 和 async_write_log() 相同的加锁、复制和队列操作
+static locker q_mutex;
+static char q_buf[2000];
+static block_queue<std::string> *q_queue;
+static FILE *q_fp;
+static std::atomic<long> q_written(0);
+static std::atomic<long> q_dropped(0);
+
+static void queue_write(int, const char *format, ...) {  // 级别只用于与 Log::write_log 的签名一致
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    time_t t = now.tv_sec;
+    struct tm my_tm = *localtime(&t);
+    q_mutex.lock();  // 原来在这里检查文件分割
+    q_mutex.unlock();
+
+    va_list valst;
+    va_start(valst, format);
+    std::string log_str;
+    q_mutex.lock();
+    int n = snprintf(q_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ", my_tm.tm_year + 1900, my_tm.tm_mon + 1,
+                     my_tm.tm_mday, my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, "[info]:");
+    int m = vsnprintf(q_buf + n, sizeof(q_buf) - n - 1, format, valst);
+    q_buf[n + m] = '\n';
+    q_buf[n + m + 1] = '\0';
+    log_str = q_buf;
+    q_mutex.unlock();
+    va_end(valst);
+
+    if (!q_queue->full())
+        q_queue->push(log_str);
+    else
+        q_dropped++;
+}
+
+static void *queue_consumer(void *) {
+    std::string line;
+    while (q_queue->pop(line)) {
+        q_mutex.lock();
+        fputs(line.c_str(), q_fp);
+        q_mutex.unlock();
+        q_written++;
+    }
+    return NULL;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+enum MODE { MODE_QUEUE, MODE_FLUSH, MODE_SYNC, MODE_COARSE, MODE_RING, MODE_BINARY, MODE_SEGMENT, MODE_SEGMENT_GZ };
+
+static MODE g_mode;
+static pthread_barrier_t g_start;
+static std::atomic<long> g_max_ns(0);  // 所有线程中单次调用的最大耗时
+
+static long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void *producer(void *arg) {
+    long id = (long)arg;
+    int m_close_log = 0;  // LOG_* 宏需要
+    char ip[32];
+    snprintf(ip, sizeof(ip), "10.0.%ld.%ld", id / 256, id % 256);
+    long max_ns = 0;
+    pthread_barrier_wait(&g_start);
+    for (long i = 0; i < g_lines; ++i) {
+        long t0 = now_ns();
+        if (g_mode == MODE_QUEUE) {
+            queue_write(1, "deal with the client(%s) fd %ld request %ld", ip, id, i);
+        } else {
+            LOG_INFO("deal with the client(%s) fd %ld request %ld", ip, id, i);
+            if (g_mode == MODE_FLUSH) Log::get_instance()->flush();
+        }
+        long dt = now_ns() - t0;
+        if (dt > max_ns) max_ns = dt;
+    }
+    long cur = g_max_ns.load();
+    while (max_ns > cur && !g_max_ns.compare_exchange_weak(cur, max_ns)) {
+    }
+    return NULL;
+}
+
+static void run(const char *name, MODE mode) {
+    g_mode = mode;
+    char base[256], path[300];
+    snprintf(base, sizeof(base), "%s/log_bench_%s", g_dir, name);
+    time_t t = time(NULL);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    snprintf(path, sizeof(path), "%s/%d_%02d_%02d_log_bench_%s%s", g_dir, tm.tm_year + 1900, tm.tm_mon + 1,
+             tm.tm_mday, name, mode == MODE_BINARY ? ".bin" : "");
+
+    pthread_t consumer;
+    Log::get_instance()->set_coarse_clock(mode == MODE_COARSE);
+    if (mode >= MODE_SEGMENT) {
+        log_segment_policy segments;
+        segments.size = 1 << 20;
+        segments.compress = mode == MODE_SEGMENT_GZ;
+        Log::get_instance()->set_segment_policy(segments);
+    }
+    if (mode == MODE_QUEUE) {
+        q_fp = fopen(path, "a");
+        q_queue = new block_queue<std::string>(800);
+        pthread_create(&consumer, NULL, queue_consumer, NULL);
+    } else if (!Log::get_instance()->init(base, 0, 2000, SPLIT_LINES,
+                                          mode == MODE_RING || mode == MODE_BINARY ? g_ring : 0,
+                                          mode == MODE_BINARY)) {
+        fprintf(stderr, "cannot open %s\n", path);
+        exit(1);
+    }
+
+    pthread_barrier_init(&g_start, NULL, g_threads + 1);
+    pthread_t tids[g_threads];
+    for (long i = 0; i < g_threads; ++i) pthread_create(&tids[i], NULL, producer, (void *)i);
+    pthread_barrier_wait(&g_start);
+    double t0 = now_s();
+    for (int i = 0; i < g_threads; ++i) pthread_join(tids[i], NULL);
+    double t_calls = now_s() - t0;
+
+    long dropped;
+    if (mode == MODE_QUEUE) {
+        while (!q_queue->empty()) usleep(100);
+        q_mutex.lock();  // 最后一行出队后仍在写
+        fflush(q_fp);
+        q_mutex.unlock();
+        dropped = q_dropped;
+    } else {
+        Log::get_instance()->drain();
+        dropped = Log::get_instance()->dropped();
+    }
+    double t_done = now_s() - t0;
+
+    long total = g_threads * g_lines;
+    printf("%-10s %12.0f calls/s  %12.0f lines/s written  dropped %ld (%.1f%%)  max call %.0f us\n", name,
+           total / t_calls, (total - dropped) / t_done, dropped, 100.0 * dropped / total, g_max_ns / 1e3);
+    fflush(stdout);
+    // 按行数切换出的文件带 .N 后缀，日志段还有压缩后的 .gz
+    glob_t files;
+    strcat(path, "*");
+    if (glob(path, 0, NULL, &files) == 0) {
+        for (size_t i = 0; i < files.gl_pathc; ++i) unlink(files.gl_pathv[i]);
+        globfree(&files);
+    }
+    _exit(0);  // 不等 Log 的析构，日志已经写完
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) g_threads = atoi(argv[1]);
+    if (argc > 2) g_lines = atol(argv[2]);
+    if (argc > 3) g_dir = argv[3];
+    if (argc > 4) g_ring = atoi(argv[4]);
+    if (g_threads <= 0 || g_lines <= 0 || g_ring <= 0) {
+        fprintf(stderr, "usage: %s [threads] [lines per thread] [dir] [ring records]\n", argv[0]);
+        return 1;
+    }
+    printf("%d threads x %ld lines\n", g_threads, g_lines);
+    fflush(stdout);
+
+    const char *names[] = {"queue", "sync+flush", "sync", "coarse", "ring", "binary", "segment", "segment+gz"};
+    for (int m = MODE_QUEUE; m <= MODE_SEGMENT_GZ; ++m) {
+        pid_t pid = fork();
+        if (pid == 0) run(names[m], (MODE)m);
+        waitpid(pid, NULL, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * 线程池扩展性基准：工作线程从 1 增加到 64 时每秒能处理多少个任务
+ *
+ * 用法：./pool_bench [任务数，默认 2000000] [连接数，默认 1024] [每个任务读写的连接缓冲区字节数，默认 1024]
+ *
+ * 依次以 1、2、4、8、16、32、64 个工作线程运行三种调度，每种各在一个子进程中运行：
+ * 1. shared：所有线程共用一个 mpmc_queue，在同一个 event_count 上休眠
+ * 2. steal：threadpool/work_stealing.h，每个线程一个队列，任务按连接号交给固定的线程，空闲线程窃取
+ * 3. batch：同 steal，但主线程每 BATCH 个任务 flush() 一次（相当于每轮 epoll_wait 一次 append_batch()），
+ *    工作线程用 take_batch() 一次取多个
+ * 一个线程相当于主线程，按随机顺序提交连接号；任务读写这个连接的缓冲区，模拟 process() 访问连接对象。
+ * 输出每秒处理的任务数、每个任务平均的主动上下文切换次数，以及连接换了处理线程的任务比例（moved，缓存中的连接数据失效的次数）。
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "../threadpool/mpmc_queue.h"
+#include "../threadpool/work_stealing.h"
+
+static long g_tasks = 2000000;
+static int g_conns = 1024;
+static int g_bytes = 1024;
+static const int MAX_REQUESTS = 10000;
+static const int BATCH = 64;       // batch 模式每批提交的任务数
+static const int TAKE_BATCH = 8;   // batch 模式工作线程一次最多取出的任务数，与 threadpool 相同
+static int g_spin = default_spin();
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 模拟的连接对象，owner 记录上一次处理它的线程
+struct conn {
+    int id;
+    int owner;
+    unsigned char *buf;
+};
+
+static conn *g_conn;
+
+enum MODE { MODE_SHARED, MODE_STEAL, MODE_BATCH };
+static MODE g_mode;
+static mpmc_queue<conn *> *s_queue;
+static event_count s_stat;
+static ws_scheduler<conn *> *w_sched;
+
+// 每个工作线程的计数各占一个缓存行，主线程汇总判断是否处理完
+struct alignas(QUEUE_CACHE_LINE) counter {
+    std::atomic<long> done{0};
+    std::atomic<long> moved{0};  // 与上一次处理这个连接的线程不同的任务数
+    long sum = 0;
+};
+static counter *g_count;
+static std::atomic<int> g_next_id(0);
+static pthread_barrier_t g_start;
+
+static void submit(conn *c) {
+    if (g_mode == MODE_SHARED) {
+        while (!s_queue->push(c)) sched_yield();
+        s_stat.notify();
+    } else if (g_mode == MODE_STEAL) {
+        while (!w_sched->submit(c, c->id)) sched_yield();
+    } else {
+        while (!w_sched->push(c, c->id)) {
+            w_sched->flush();  // 满时先唤醒已经入队的
+            sched_yield();
+        }
+    }
+}
+
+static void *worker(void *) {
+    int id = g_next_id++;
+    counter &n = g_count[id];
+    pthread_barrier_wait(&g_start);
+    conn *batch[TAKE_BATCH];
+    int got = 0, next = 0;
+    while (true) {
+        conn *c;
+        if (g_mode == MODE_SHARED) {
+            pop_wait(*s_queue, s_stat, c, g_spin);
+        } else if (g_mode == MODE_STEAL) {
+            w_sched->take(id, c);
+        } else {
+            if (next == got) {
+                got = w_sched->take_batch(id, batch, TAKE_BATCH);
+                next = 0;
+            }
+            c = batch[next++];
+        }
+        if (c->owner != id) n.moved.store(n.moved.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        c->owner = id;
+        for (int i = 0; i < g_bytes; i += 64) {
+            c->buf[i]++;
+            n.sum += c->buf[i];
+        }
+        n.done.store(n.done.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    return NULL;
+}
+
+static void run(const char *name, MODE mode, int threads) {
+    g_mode = mode;
+    if (mode == MODE_SHARED)
+        s_queue = new mpmc_queue<conn *>(MAX_REQUESTS);
+    else
+        w_sched = new ws_scheduler<conn *>(threads, MAX_REQUESTS, g_spin);
+    g_conn = new conn[g_conns];
+    for (int i = 0; i < g_conns; ++i) {
+        g_conn[i].id = i;
+        g_conn[i].owner = -1;
+        g_conn[i].buf = (unsigned char *)calloc(g_bytes, 1);
+    }
+    g_count = new counter[threads];
+
+    pthread_barrier_init(&g_start, NULL, threads + 1);
+    pthread_t tid[threads];
+    for (int i = 0; i < threads; ++i) pthread_create(&tid[i], NULL, worker, NULL);
+
+    struct rusage r0, r1;
+    getrusage(RUSAGE_SELF, &r0);
+    pthread_barrier_wait(&g_start);
+    double t0 = now_s();
+    uint32_t seed = 2463534242u;
+    for (long i = 0; i < g_tasks; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        submit(&g_conn[seed % g_conns]);
+        if (mode == MODE_BATCH && (i + 1) % BATCH == 0) w_sched->flush();
+    }
+    if (mode == MODE_BATCH) w_sched->flush();
+    // 工作线程不退出，处理完所有任务后直接结束子进程；一直等不到说明丢了任务或唤醒
+    long done = 0, moved = 0;
+    while (true) {
+        done = moved = 0;
+        for (int i = 0; i < threads; ++i) {
+            done += g_count[i].done.load(std::memory_order_acquire);
+            moved += g_count[i].moved.load(std::memory_order_relaxed);
+        }
+        if (done == g_tasks) break;
+        if (now_s() - t0 > 60) {
+            fprintf(stderr, "%s: stuck, %ld of %ld tasks done\n", name, done, g_tasks);
+            _exit(1);
+        }
+        usleep(100);
+    }
+    double t = now_s() - t0;
+    getrusage(RUSAGE_SELF, &r1);
+
+    printf("%-6s %2d threads  %12.0f tasks/s  %.3f voluntary switches/task  %5.1f%% moved\n", name, threads,
+           g_tasks / t, (double)(r1.ru_nvcsw - r0.ru_nvcsw) / g_tasks, 100.0 * moved / g_tasks);
+    fflush(stdout);
+    _exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) g_tasks = atol(argv[1]);
+    if (argc > 2) g_conns = atoi(argv[2]);
+    if (argc > 3) g_bytes = atoi(argv[3]);
+    if (g_tasks <= 0 || g_conns <= 0 || g_bytes <= 0) {
+        fprintf(stderr, "usage: %s [tasks] [connections] [bytes per connection]\n", argv[0]);
+        return 1;
+    }
+    printf("%ld tasks over %d connections, %d bytes each, %ld cpus\n", g_tasks, g_conns, g_bytes,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    fflush(stdout);
+
+    const char *names[] = {"shared", "steal", "batch"};
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        for (int m = MODE_SHARED; m <= MODE_BATCH; ++m) {
+            pid_t pid = fork();
+            if (pid == 0) run(names[m], (MODE)m, threads);
+            waitpid(pid, NULL, 0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * 任务队列基准：线程池请求队列每秒能传递多少个任务
+ *
+ * 用法：./queue_bench [生产者数，默认 1] [每个生产者的任务数，默认 1000000] [每个任务的工作量（空循环次数），默认 0]
+ *
+ * 依次以 4、8、32 个消费者运行两种队列，每种各在一个子进程中运行：
+ * 1. list+sem：原来 threadpool 的做法，std::list 每个任务分配一个节点，互斥锁保护，信号量计数
+ * 2. mpmc：threadpool/mpmc_queue.h 的有界无锁队列，空闲线程先自旋再在 event_count 上休眠
+ * 生产者相当于主线程，消费者相当于工作线程。队列容量都与服务器相同（10000，mpmc 向上取整为 16384），
+ * 满时生产者让出处理器后重试。输出每秒传递的任务数，以及每个任务平均的主动上下文切换次数
+ * （getrusage 的 ru_nvcsw，即线程因等待而睡下的次数）。
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <list>
+
+#include "../lock/locker.h"
+#include "../threadpool/mpmc_queue.h"
+
+static int g_producers = 1;
+static long g_tasks = 1000000;
+static int g_work = 0;
+static const int MAX_REQUESTS = 10000;
+static int g_spin = default_spin();
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// 原来的请求队列：与改动前的 threadpool::append() 和 run() 相同的加锁和信号量操作
+static std::list<long *> l_queue;
+static locker l_lock;
+static sem l_stat;
+
+static bool list_push(long *task) {
+    l_lock.lock();
+    if (l_queue.size() >= MAX_REQUESTS) {
+        l_lock.unlock();
+        return false;
+    }
+    l_queue.push_back(task);
+    l_lock.unlock();
+    l_stat.post();
+    return true;
+}
+
+static long *list_pop() {
+    while (true) {
+        l_stat.wait();
+        l_lock.lock();
+        if (l_queue.empty()) {
+            l_lock.unlock();
+            continue;
+        }
+        long *task = l_queue.front();
+        l_queue.pop_front();
+        l_lock.unlock();
+        return task;
+    }
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+static mpmc_queue<long *> *m_queue;
+static event_count m_stat;
+
+enum MODE { MODE_LIST, MODE_MPMC };
+static MODE g_mode;
+static long g_stop_task;  // 结束标记，每个消费者取到一个就退出
+static std::atomic<long> g_sum(0);
+static pthread_barrier_t g_start;
+
+static void *producer(void *) {
+    static long task = 1;
+    pthread_barrier_wait(&g_start);
+    for (long i = 0; i < g_tasks; ++i) {
+        if (g_mode == MODE_LIST) {
+            while (!list_push(&task)) sched_yield();
+        } else {
+            while (!m_queue->push(&task)) sched_yield();
+            m_stat.notify();
+        }
+    }
+    return NULL;
+}
+
+static void *consumer(void *) {
+    long sum = 0;
+    pthread_barrier_wait(&g_start);
+    while (true) {
+        long *task;
+        if (g_mode == MODE_LIST)
+            task = list_pop();
+        else
+            pop_wait(*m_queue, m_stat, task, g_spin);
+        if (task == &g_stop_task) break;
+        sum += *task;
+        for (volatile int i = 0; i < g_work; ++i) {
+        }
+    }
+    g_sum += sum;
+    return NULL;
+}
+
+static void run(const char *name, MODE mode, int consumers) {
+    g_mode = mode;
+    if (mode == MODE_MPMC) m_queue = new mpmc_queue<long *>(MAX_REQUESTS);
+    pthread_barrier_init(&g_start, NULL, g_producers + consumers + 1);
+    pthread_t prod[g_producers], cons[consumers];
+    for (int i = 0; i < consumers; ++i) pthread_create(&cons[i], NULL, consumer, NULL);
+    for (int i = 0; i < g_producers; ++i) pthread_create(&prod[i], NULL, producer, NULL);
+
+    struct rusage r0, r1;
+    getrusage(RUSAGE_SELF, &r0);
+    pthread_barrier_wait(&g_start);
+    double t0 = now_s();
+    for (int i = 0; i < g_producers; ++i) pthread_join(prod[i], NULL);
+    for (int i = 0; i < consumers; ++i) {
+        if (mode == MODE_LIST) {
+            while (!list_push(&g_stop_task)) sched_yield();
+        } else {
+            while (!m_queue->push(&g_stop_task)) sched_yield();
+            m_stat.notify_all();
+        }
+    }
+    for (int i = 0; i < consumers; ++i) pthread_join(cons[i], NULL);
+    double t = now_s() - t0;
+    getrusage(RUSAGE_SELF, &r1);
+
+    long total = g_producers * g_tasks;
+    if (g_sum != total) fprintf(stderr, "%s: lost tasks, %ld of %ld\n", name, g_sum.load(), total);
+    printf("%-9s %2d consumers  %12.0f tasks/s  %.3f voluntary switches/task\n", name, consumers, total / t,
+           (double)(r1.ru_nvcsw - r0.ru_nvcsw) / total);
+    fflush(stdout);
+    _exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) g_producers = atoi(argv[1]);
+    if (argc > 2) g_tasks = atol(argv[2]);
+    if (argc > 3) g_work = atoi(argv[3]);
+    if (g_producers <= 0 || g_tasks <= 0 || g_work < 0) {
+        fprintf(stderr, "usage: %s [producers] [tasks per producer] [work per task]\n", argv[0]);
+        return 1;
+    }
+    printf("%d producers x %ld tasks, work %d\n", g_producers, g_tasks, g_work);
+    fflush(stdout);
+
+    const int consumers[] = {4, 8, 32};
+    const char *names[] = {"list+sem", "mpmc"};
+    for (int c = 0; c < 3; ++c) {
+        for (int m = MODE_LIST; m <= MODE_MPMC; ++m) {
+            pid_t pid = fork();
+            if (pid == 0) run(names[m], (MODE)m, consumers[c]);
+            waitpid(pid, NULL, 0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+// 路由查找基准：在数千条路由的路由表中测量单次查找耗时，并确认查找过程不分配内存
+//
+// 用法：./router_bench [路由条数，默认 5000] [查找次数，默认 2000000]
+//
+// 路由表由三类路由混合组成：
+//   - 精确路由  /api/v<n>/svc<i>/res<j>/get         约 60%
+//   - 参数路由  /users<i>/:id/posts/:post           约 25%
+//   - 前缀路由  /static<i>/*path                    约 15%
+// 请求路径按相同比例生成，另有 10% 不命中任何路由。
+// 作为对照，同时测量 unordered_map<string> 只查精确路由的耗时（每次查找都要构造 string）。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../http/router.h"
+
+using namespace std;
+
+// 统计全局 operator new 的调用次数，用来验证查找路径上没有内存分配
+static size_t g_allocs = 0;
+
+void *operator new(size_t n) {
+    ++g_allocs;
+    void *p = malloc(n ? n : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+    int route_num = argc > 1 ? atoi(argv[1]) : 5000;
+    long lookups = argc > 2 ? atol(argv[2]) : 2000000;
+    if (route_num <= 0 || lookups <= 0) {
+        fprintf(stderr, "usage: %s [routes] [lookups]\n", argv[0]);
+        return 1;
+    }
+
+    radix_router<int> router;
+    unordered_map<string, int> exact;
+    char buf[128];
+    int added = 0;
+    for (int i = 0; i < route_num; ++i) {
+        int kind = i % 20;
+        if (kind < 12) {
+            snprintf(buf, sizeof(buf), "/api/v%d/svc%d/res%d/get", i % 4, i, i % 37);
+            exact[buf] = i;
+        } else if (kind < 17) {
+            snprintf(buf, sizeof(buf), "/users%d/:id/posts/:post", i);
+        } else {
+            snprintf(buf, sizeof(buf), "/static%d/*path", i);
+        }
+        if (router.add(buf, i)) ++added;
+    }
+
+    // 预先生成请求路径，避免计时包含字符串格式化
+    srand(12345);
+    const int path_num = 4096;
+    vector<string> paths;
+    for (int k = 0; k < path_num; ++k) {
+        int i = rand() % route_num;
+        int kind = i % 20;
+        if (rand() % 10 == 0) {
+            snprintf(buf, sizeof(buf), "/api/v%d/svc%d/missing", i % 4, i);
+        } else if (kind < 12) {
+            snprintf(buf, sizeof(buf), "/api/v%d/svc%d/res%d/get", i % 4, i, i % 37);
+        } else if (kind < 17) {
+            snprintf(buf, sizeof(buf), "/users%d/%d/posts/%d", i, rand(), rand());
+        } else {
+            snprintf(buf, sizeof(buf), "/static%d/img/%d.png", i, rand());
+        }
+        paths.push_back(buf);
+    }
+
+    // 预热
+    route_params params;
+    long hits = 0;
+    for (int k = 0; k < path_num; ++k)
+        if (router.find(paths[k].data(), paths[k].size(), params)) ++hits;
+
+    size_t allocs = g_allocs;
+    double start = now_ns();
+    hits = 0;
+    for (long n = 0; n < lookups; ++n) {
+        const string &p = paths[n & (path_num - 1)];
+        if (router.find(p.data(), p.size(), params)) ++hits;
+    }
+    double radix_ns = (now_ns() - start) / lookups;
+    size_t radix_allocs = g_allocs - allocs;
+
+    allocs = g_allocs;
+    start = now_ns();
+    long map_hits = 0;
+    for (long n = 0; n < lookups; ++n) {
+        const string &p = paths[n & (path_num - 1)];
+        // 模拟从请求缓冲区取路径：每次查找都要构造 string
+        if (exact.find(string(p.data(), p.size())) != exact.end()) ++map_hits;
+    }
+    double map_ns = (now_ns() - start) / lookups;
+    size_t map_allocs = g_allocs - allocs;
+
+    printf("routes: %d registered (%d requested), lookups: %ld\n", added, route_num, lookups);
+    printf("%-24s %10s %12s %14s\n", "router", "ns/lookup", "hit rate", "allocs/lookup");
+    printf("%-24s %10.1f %11.1f%% %14.3f\n", "radix (all kinds)", radix_ns, 100.0 * hits / lookups,
+           (double)radix_allocs / lookups);
+    printf("%-24s %10.1f %11.1f%% %14.3f\n", "unordered_map (exact)", map_ns, 100.0 * map_hits / lookups,
+           (double)map_allocs / lookups);
+    return radix_allocs == 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/*
+ * TLS 基准：握手开销与会话恢复的收益，以及 keep-alive 连接上的下载吞吐
+ *
+ * 用法：./tls_bench [主机，默认 127.0.0.1] [端口，默认 9443] [路径，默认 /judge.html] [每项测试秒数，默认 5]
+ *
+ * 依次测三项，都是单连接串行，结果反映服务器处理一条连接的开销：
+ * 1. 完整握手：每次新建连接、完整握手后发一个请求，读完响应后关闭
+ * 2. 会话恢复：同上，但带上前一条连接得到的会话（TLS 1.3 的票据在握手后随响应到达，所以每条连接都发一个请求）
+ * 3. 下载吞吐：一条 keep-alive 连接上反复请求同一路径，统计响应体的字节数
+ * 服务器用自签名证书即可，客户端不验证证书。
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+using namespace std;
+
+static sockaddr_in g_addr;
+static string g_request;
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int dial() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (const sockaddr *)&g_addr, sizeof(g_addr)) < 0) {
+        fprintf(stderr, "connect failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// 发一个请求并读完响应，返回响应体长度；只认带 Content-Length 的 200 响应
+static long fetch(SSL *ssl, string &in) {
+    if (SSL_write(ssl, g_request.data(), g_request.size()) <= 0) return -1;
+    char buf[65536];
+    while (true) {
+        size_t end = in.find("\r\n\r\n");
+        if (end != string::npos) {
+            size_t cl = in.find("Content-Length:");
+            if (cl == string::npos || cl > end) cl = in.find("content-length:");
+            if (cl == string::npos || cl > end || in.compare(9, 3, "200") != 0) return -1;
+            size_t body = atol(in.c_str() + cl + 15);
+            while (in.size() < end + 4 + body) {
+                int n = SSL_read(ssl, buf, sizeof(buf));
+                if (n <= 0) return -1;
+                in.append(buf, n);
+            }
+            in.erase(0, end + 4 + body);
+            return body;
+        }
+        int n = SSL_read(ssl, buf, sizeof(buf));
+        if (n <= 0) return -1;
+        in.append(buf, n);
+    }
+}
+
+// 新建连接完成握手并取回一个响应；resume 非空时尝试恢复该会话，返回本次连接的会话
+static SSL_SESSION *one_connection(SSL_CTX *ctx, SSL_SESSION *resume, bool *reused) {
+    int fd = dial();
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (resume) SSL_set_session(ssl, resume);
+    string in;
+    if (SSL_connect(ssl) != 1 || fetch(ssl, in) < 0) {
+        fprintf(stderr, "request failed\n");
+        ERR_print_errors_fp(stderr);
+        exit(1);
+    }
+    *reused = SSL_session_reused(ssl);
+    SSL_SESSION *sess = SSL_get1_session(ssl);
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+    return sess;
+}
+
+static void handshakes(SSL_CTX *ctx, bool resume, int seconds) {
+    bool reused;
+    SSL_SESSION *sess = one_connection(ctx, NULL, &reused);
+    long count = 0, resumed = 0;
+    double t0 = now_s(), deadline = t0 + seconds;
+    while (now_s() < deadline) {
+        SSL_SESSION *next = one_connection(ctx, resume ? sess : NULL, &reused);
+        SSL_SESSION_free(sess);
+        sess = next;
+        ++count;
+        resumed += reused;
+    }
+    double elapsed = now_s() - t0;
+    SSL_SESSION_free(sess);
+    printf("%-18s %10.0f conn/s  %8.1f us/conn  resumed %ld/%ld\n", resume ? "resumed handshake" : "full handshake",
+           count / elapsed, elapsed * 1e6 / count, resumed, count);
+}
+
+static void download(SSL_CTX *ctx, int seconds) {
+    int fd = dial();
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_connect(ssl) != 1) {
+        ERR_print_errors_fp(stderr);
+        exit(1);
+    }
+    string in;
+    long requests = 0;
+    double bytes = 0;
+    double t0 = now_s(), deadline = t0 + seconds;
+    while (now_s() < deadline) {
+        long n = fetch(ssl, in);
+        if (n < 0) {
+            fprintf(stderr, "connection closed by server\n");
+            exit(1);
+        }
+        bytes += n;
+        ++requests;
+    }
+    double elapsed = now_s() - t0;
+    printf("%-18s %10.0f req/s   %8.1f MB/s    cipher %s\n", "keep-alive", requests / elapsed,
+           bytes / elapsed / (1 << 20), SSL_get_cipher(ssl));
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 9443;
+    const char *path = argc > 3 ? argv[3] : "/judge.html";
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+    if (seconds <= 0) {
+        fprintf(stderr, "usage: %s [host] [port] [path] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons(port);
+    inet_pton(AF_INET, host, &g_addr.sin_addr);
+    g_request = string("GET ") + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: keep-alive\r\n\r\n";
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    handshakes(ctx, false, seconds);
+    handshakes(ctx, true, seconds);
+    download(ctx, seconds);
+    SSL_CTX_free(ctx);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+# upstream_stub.py 是反向代理测试用的桩上游：HTTP/1.1 长连接，每个响应带 X-Upstream 头标明端口，
+# 可以同时启动几个端口观察均衡效果，停掉其中一个观察健康检查。
+#
+#   python3 upstream_stub.py 8001 8002
+#
+# 接口：
+#   /echo              回显方法、路径、查询串、X-Forwarded-For、X-Forwarded-Proto 和请求体
+#   /big?n=字节数      带 Content-Length 的大响应体，用于验证 splice 转发
+#   /chunked?n=&parts= 分块响应
+#   /close?n=字节数    不带长度、以关闭连接结束的响应
+#   /slow?ms=毫秒      延迟后回复，用于观察最少连接均衡和超时
+
+import socketserver
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler
+from urllib.parse import parse_qs, urlsplit
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def do_GET(self):
+        self.route()
+
+    def do_POST(self):
+        self.route()
+
+    def do_HEAD(self):
+        self.route()
+
+    def body(self):
+        if "chunked" in self.headers.get("Transfer-Encoding", "").lower():
+            data = b""
+            while True:
+                n = int(self.rfile.readline().split(b";")[0], 16)
+                if n == 0:
+                    while self.rfile.readline() not in (b"\r\n", b""):
+                        pass
+                    return data
+                data += self.rfile.read(n)
+                self.rfile.readline()
+        n = int(self.headers.get("Content-Length", 0))
+        return self.rfile.read(n) if n else b""
+
+    def reply(self, data, status=200, content_type="text/plain"):
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(data)))
+        self.send_header("X-Upstream", str(self.server.server_address[1]))
+        self.end_headers()
+        if self.command != "HEAD":
+            self.wfile.write(data)
+
+    def route(self):
+        url = urlsplit(self.path)
+        q = {k: v[0] for k, v in parse_qs(url.query).items()}
+        body = self.body()
+        if url.path == "/echo" or url.path.endswith("/echo"):
+            text = "%s %s?%s\nxff=%s\nxfp=%s\nbody=%s\n" % (self.command, url.path, url.query,
+                                                             self.headers.get("X-Forwarded-For"),
+                                                             self.headers.get("X-Forwarded-Proto"),
+                                                             body.decode("latin-1"))
+            self.reply(text.encode())
+        elif url.path.endswith("/big"):
+            n = int(q.get("n", 1 << 20))
+            pattern = bytes(range(256))
+            data = (pattern * (n // 256 + 1))[:n]
+            self.reply(data, content_type="application/octet-stream")
+        elif url.path.endswith("/chunked"):
+            n, parts = int(q.get("n", 1000)), int(q.get("parts", 10))
+            self.send_response(200)
+            self.send_header("Content-Type", "text/plain")
+            self.send_header("Transfer-Encoding", "chunked")
+            self.send_header("X-Upstream", str(self.server.server_address[1]))
+            self.end_headers()
+            for i in range(parts):
+                chunk = (str(i % 10) * n).encode()
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(chunk), chunk))
+                self.wfile.flush()
+            self.wfile.write(b"0\r\n\r\n")
+        elif url.path.endswith("/close"):
+            n = int(q.get("n", 1000))
+            self.send_response(200)
+            self.send_header("Content-Type", "text/plain")
+            self.send_header("Connection", "close")
+            self.end_headers()
+            self.wfile.write(b"c" * n)
+            self.close_connection = True
+        elif url.path.endswith("/slow"):
+            time.sleep(int(q.get("ms", 1000)) / 1000.0)
+            self.reply(b"slow\n")
+        else:
+            self.reply(b"not found\n", status=404)
+
+
+class Server(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def main():
+    ports = [int(p) for p in sys.argv[1:]] or [8001]
+    servers = [Server(("127.0.0.1", p), Handler) for p in ports]
+    for s in servers[1:]:
+        threading.Thread(target=s.serve_forever, daemon=True).start()
+    servers[0].serve_forever()
+
+
+if __name__ == "__main__":
+    main()
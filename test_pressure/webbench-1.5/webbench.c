@@ -29,6 +29,7 @@ volatile int timerexpired=0;
 int speed=0;
 int failed=0;
 int bytes=0;
+int connections=0;
 /* globals */
 int http10=1; /* 0 - http/0.9, 1 - http/1.0, 2 - http/1.1 */
 /* Allow: GET, HEAD, OPTIONS, TRACE */
@@ -41,6 +42,7 @@ int method=METHOD_GET;
 int clients=1;
 int force=0;
 int force_reload=0;
+int keepalive=0;
 int proxyport=80;
 char *proxyhost=NULL;
 int benchtime=30;
@@ -54,6 +56,7 @@ static const struct option long_options[]=
 {
  {"force",no_argument,&force,1},
  {"reload",no_argument,&force_reload,1},
+ {"keep-alive",no_argument,NULL,'k'},
  {"time",required_argument,NULL,'t'},
  {"help",no_argument,NULL,'?'},
  {"http09",no_argument,NULL,'9'},
@@ -71,6 +74,7 @@ static const struct option long_options[]=
 
 /* prototypes */
 static void benchcore(const char* host,const int port, const char *request);
+static void benchcore_keepalive(const char* host,const int port, const char *request);
 static int bench(void);
 static void build_request(const char *url);
 
@@ -85,6 +89,7 @@ static void usage(void)
 	"webbench [option]... URL\n"
 	"  -f|--force               Don't wait for reply from server.\n"
 	"  -r|--reload              Send reload request - Pragma: no-cache.\n"
+	"  -k|--keep-alive          Reuse connections (responses need Content-Length).\n"
 	"  -t|--time <sec>          Run benchmark for <sec> seconds. Default 30.\n"
 	"  -p|--proxy <server:port> Use proxy server for request.\n"
 	"  -c|--clients <n>         Run <n> HTTP clients at once. Default one.\n"
@@ -111,13 +116,14 @@ int main(int argc, char *argv[])
           return 2;
  } 
 
- while((opt=getopt_long(argc,argv,"912Vfrt:p:c:?h",long_options,&options_index))!=EOF )
+ while((opt=getopt_long(argc,argv,"912Vfrkt:p:c:?h",long_options,&options_index))!=EOF )
  {
   switch(opt)
   {
    case  0 : break;
    case 'f': force=1;break;
    case 'r': force_reload=1;break; 
+   case 'k': keepalive=1;break;
    case '9': http10=0;break;
    case '1': http10=1;break;
    case '2': http10=2;break;
@@ -157,6 +163,7 @@ int main(int argc, char *argv[])
                     }
 
  if(clients==0) clients=1;
+ if(force) keepalive=0;
  if(benchtime==0) benchtime=60;
  /* Copyright */
  fprintf(stderr,"Webbench - Simple Web Benchmark "PROGRAM_VERSION"\n"
@@ -192,6 +199,7 @@ int main(int argc, char *argv[])
  if(force) printf(", early socket close");
  if(proxyhost!=NULL) printf(", via proxy server %s:%d",proxyhost,proxyport);
  if(force_reload) printf(", forcing reload");
+ if(keepalive) printf(", keep-alive");
  printf(".\n");
  return bench();
 }
@@ -206,6 +214,7 @@ void build_request(const char *url)
 
   if(force_reload && proxyhost!=NULL && http10<1) http10=1;
   if(method==METHOD_HEAD && http10<1) http10=1;
+  if(keepalive && http10<1) http10=1;
   if(method==METHOD_OPTIONS && http10<2) http10=2;
   if(method==METHOD_TRACE && http10<2) http10=2;
 
@@ -283,7 +292,9 @@ void build_request(const char *url)
   {
 	  strcat(request,"Pragma: no-cache\r\n");
   }
-  if(http10>1)
+  if(keepalive)
+	  strcat(request,"Connection: keep-alive\r\n");
+  else if(http10>1)
 	  strcat(request,"Connection: close\r\n");
   /* add empty line at end */
   if(http10>0) strcat(request,"\r\n"); 
@@ -293,7 +304,7 @@ void build_request(const char *url)
 /* vraci system rc error kod */
 static int bench(void)
 {
-  int i,j,k;	
+  int i,j,k,l;	
   pid_t pid=0;
   FILE *f;
 
@@ -341,7 +352,9 @@ static int bench(void)
   if(pid== (pid_t) 0)
   {
     /* I am a child */
-    if(proxyhost==NULL)
+    if(keepalive)
+      benchcore_keepalive(proxyhost==NULL?host:proxyhost,proxyport,request);
+    else if(proxyhost==NULL)
       benchcore(host,proxyport,request);
          else
       benchcore(proxyhost,proxyport,request);
@@ -354,7 +367,7 @@ static int bench(void)
 		 return 3;
 	 }
 	 /* fprintf(stderr,"Child - %d %d\n",speed,failed); */
-	 fprintf(f,"%d %d %d\n",speed,failed,bytes);
+	 fprintf(f,"%d %d %d %d\n",speed,failed,bytes,connections);
 	 fclose(f);
 	 return 0;
   } else
@@ -369,11 +382,12 @@ static int bench(void)
 	  speed=0;
           failed=0;
           bytes=0;
+          connections=0;
 
 	  while(1)
 	  {
-		  pid=fscanf(f,"%d %d %d",&i,&j,&k);
-		  if(pid<2)
+		  pid=fscanf(f,"%d %d %d %d",&i,&j,&k,&l);
+		  if(pid<4)
                   {
                        fprintf(stderr,"Some of our childrens died.\n");
                        break;
@@ -381,6 +395,7 @@ static int bench(void)
 		  speed+=i;
 		  failed+=j;
 		  bytes+=k;
+		  connections+=l;
 		  /* fprintf(stderr,"*Knock* %d %d read=%d\n",speed,failed,pid); */
 		  if(--clients==0) break;
 	  }
@@ -391,6 +406,9 @@ static int bench(void)
 		  (int)(bytes/(float)benchtime),
 		  speed,
 		  failed);
+  printf("Connections: %d (%.3f per request).\n",
+		  connections,
+		  speed+failed>0 ? connections/(float)(speed+failed) : 0.0f);
   }
   return i;
 }
@@ -423,6 +441,7 @@ void benchcore(const char *host,const int port,const char *req)
     }
     s=Socket(host,port);                          
     if(s<0) { failed++;continue;} 
+    connections++;
     if(rlen!=write(s,req,rlen)) {failed++;close(s);continue;}
     if(http10==0) 
 	    if(shutdown(s,1)) { failed++;close(s);continue;}
@@ -450,3 +469,85 @@ void benchcore(const char *host,const int port,const char *req)
     speed++;
  }
 }
+
+/* read one response on a keep-alive connection.
+ * returns 1 if the connection can be reused, 0 if the server closes it, -1 on error */
+static int read_response(int s)
+{
+ char head[8192];
+ char buf[1500];
+ char *end=NULL,*line,*p;
+ int hlen=0,i,reuse=1;
+ long body=0;
+
+ while(end==NULL)
+ {
+    if(timerexpired || hlen==sizeof(head)-1) return -1;
+    i=read(s,head+hlen,sizeof(head)-1-hlen);
+    if(i<=0) return -1;
+    bytes+=i;
+    hlen+=i;
+    head[hlen]='\0';
+    end=strstr(head,"\r\n\r\n");
+ }
+ body=hlen-(end+4-head); /* body bytes already read */
+ *end='\0';
+ for(line=strstr(head,"\r\n");line!=NULL;line=strstr(line,"\r\n"))
+ {
+    line+=2;
+    if(strncasecmp(line,"Content-Length:",15)==0)
+       body-=atol(line+15);
+    else if(strncasecmp(line,"Connection:",11)==0)
+    {
+       p=line+11;
+       while(*p==' ' || *p=='\t') p++;
+       if(strncasecmp(p,"close",5)==0) reuse=0;
+    }
+ }
+ if(method==METHOD_HEAD) return reuse;
+ /* body is now minus the bytes still to come */
+ while(body<0)
+ {
+    if(timerexpired) return -1;
+    i=read(s,buf,-body<(long)sizeof(buf)?-body:(long)sizeof(buf));
+    if(i<=0) return -1;
+    bytes+=i;
+    body+=i;
+ }
+ return reuse;
+}
+
+void benchcore_keepalive(const char *host,const int port,const char *req)
+{
+ int rlen;
+ int s=-1,i;
+ struct sigaction sa;
+
+ sa.sa_handler=alarm_handler;
+ sa.sa_flags=0;
+ if(sigaction(SIGALRM,&sa,NULL))
+    exit(3);
+ alarm(benchtime);
+
+ rlen=strlen(req);
+ while(1)
+ {
+    if(timerexpired)
+    {
+       if(failed>0) failed--;
+       if(s>=0) close(s);
+       return;
+    }
+    if(s<0)
+    {
+       s=Socket(host,port);
+       if(s<0) { failed++;continue;}
+       connections++;
+    }
+    if(rlen!=write(s,req,rlen)) {failed++;close(s);s=-1;continue;}
+    i=read_response(s);
+    if(i<0) {failed++;close(s);s=-1;continue;}
+    if(i==0) {close(s);s=-1;}
+    speed++;
+ }
+}
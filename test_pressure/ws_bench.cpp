@@ -0,0 +1,229 @@
+/*
+ * WebSocket 广播基准：N 个订阅者订阅同一主题，测量一条消息从发布到各订阅者收到的延迟
+ *
+ * 用法：./ws_bench [主机，默认 127.0.0.1] [端口，默认 9006] [订阅者数，默认 10000] [消息数，默认 100]
+ *
+ * 所有连接都走 /ws/bench（见 websocket/topic_routes.cpp，服务器需以 -W 1 启动），其中一条兼作发布者。
+ * 每条消息的负载是 8 字节序号 + 8 字节发送时刻，发布后等所有订阅者都收到再发下一条，
+ * 每条消息统计第一个、中位数、p99 和最后一个订阅者的延迟，最后输出各项在所有消息上的中位数。
+ * 订阅者数超过文件描述符上限时先提高 RLIMIT_NOFILE，服务器一侧同样需要足够的上限。
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const int MAX_CONNECTING = 4;  // 同时握手的连接数，服务器的监听队列很短
+static const char HANDSHAKE[] =
+    "GET /ws/bench HTTP/1.1\r\nHost: bench\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+
+struct client {
+    int fd;
+    bool open;        // 已收到 101
+    string in;        // 未处理的数据
+    uint64_t seen;    // 收到的最新序号
+};
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int dial(const sockaddr_in &addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) < 0 ||
+        write(fd, HANDSHAKE, sizeof(HANDSHAKE) - 1) != (ssize_t)(sizeof(HANDSHAKE) - 1)) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// 处理一个订阅者收到的数据，返回是否出错
+static bool consume(client &c) {
+    char buf[4096];
+    while (true) {
+        ssize_t n = read(c.fd, buf, sizeof(buf));
+        if (n == 0) return false;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        c.in.append(buf, n);
+    }
+}
+
+// 从订阅者的缓冲区中取出完整的帧，记录最新序号
+static void parse(client &c) {
+    size_t pos = 0;
+    if (!c.open) {
+        size_t end = c.in.find("\r\n\r\n");
+        if (end == string::npos) return;
+        if (c.in.compare(0, 12, "HTTP/1.1 101") != 0) {
+            fprintf(stderr, "handshake rejected: %.*s\n", (int)c.in.find("\r\n"), c.in.c_str());
+            exit(1);
+        }
+        c.open = true;
+        pos = end + 4;
+    }
+    while (c.in.size() - pos >= 2) {
+        const unsigned char *p = (const unsigned char *)c.in.data() + pos;
+        size_t len = p[1] & 0x7F, head = 2;
+        if (len == 126) {
+            if (c.in.size() - pos < 4) break;
+            len = (p[2] << 8) | p[3];
+            head = 4;
+        }
+        if (c.in.size() - pos < head + len) break;
+        if ((p[0] & 0x0F) == 0x2 && len == 16) memcpy(&c.seen, p + head, 8);
+        pos += head + len;
+    }
+    c.in.erase(0, pos);
+}
+
+static double percentile(vector<double> &v, double q) {
+    size_t k = (size_t)(q * (v.size() - 1));
+    nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 9006;
+    int subscribers = argc > 3 ? atoi(argv[3]) : 10000;
+    int messages = argc > 4 ? atoi(argv[4]) : 100;
+    if (subscribers <= 0 || messages <= 0) {
+        fprintf(stderr, "usage: %s [host] [port] [subscribers] [messages]\n", argv[0]);
+        return 1;
+    }
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < (rlim_t)subscribers + 64) {
+        rl.rlim_cur = min(rl.rlim_max, (rlim_t)subscribers + 64);
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host, &addr.sin_addr);
+
+    int epfd = epoll_create1(0);
+    vector<client> clients(subscribers);
+    double t0 = now_us();
+    // 建立连接：同时握手的连接数有限，收到 101 后再发起下一批
+    int dialed = 0, opened = 0, pending = 0;
+    while (opened < subscribers) {
+        while (pending < MAX_CONNECTING && dialed < subscribers) {
+            client &c = clients[dialed];
+            c.fd = dial(addr);
+            if (c.fd < 0) {
+                fprintf(stderr, "connect #%d failed: %s\n", dialed, strerror(errno));
+                return 1;
+            }
+            c.open = false;
+            c.seen = 0;
+            epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.u32 = dialed;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+            ++dialed;
+            ++pending;
+        }
+        epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, 5000);
+        if (n <= 0) {
+            fprintf(stderr, "handshake timeout after %d connections\n", opened);
+            return 1;
+        }
+        for (int i = 0; i < n; ++i) {
+            client &c = clients[events[i].data.u32];
+            if (!consume(c)) {
+                fprintf(stderr, "connection #%u closed during handshake\n", events[i].data.u32);
+                return 1;
+            }
+            if (c.open) continue;
+            parse(c);
+            if (c.open) {
+                --pending;
+                ++opened;
+            }
+        }
+    }
+    printf("%d subscribers connected in %.1f ms\n", subscribers, (now_us() - t0) / 1e3);
+
+    // 第一个连接兼作发布者，发出的帧按协议加掩码（全 0 掩码，负载不变）
+    int pub = clients[0].fd;
+    vector<double> first, median, p99, last;
+    vector<double> lat(subscribers);
+    for (int m = 1; m <= messages; ++m) {
+        unsigned char frame[2 + 4 + 16] = {0x82, 0x80 | 16, 0, 0, 0, 0};
+        uint64_t seq = m;
+        memcpy(frame + 6, &seq, 8);
+        double sent = now_us();
+        memcpy(frame + 14, &sent, 8);
+        if (write(pub, frame, sizeof(frame)) != (ssize_t)sizeof(frame)) {
+            fprintf(stderr, "publish failed\n");
+            return 1;
+        }
+        int got = 0;
+        while (got < subscribers) {
+            epoll_event events[256];
+            int n = epoll_wait(epfd, events, 256, 5000);
+            if (n <= 0) {
+                fprintf(stderr, "message %d: only %d of %d subscribers received it\n", m, got, subscribers);
+                return 1;
+            }
+            double now = now_us();
+            for (int i = 0; i < n; ++i) {
+                int idx = events[i].data.u32;
+                client &c = clients[idx];
+                uint64_t before = c.seen;
+                if (!consume(c)) {
+                    fprintf(stderr, "subscriber #%d closed\n", idx);
+                    return 1;
+                }
+                parse(c);
+                if (before < (uint64_t)m && c.seen >= (uint64_t)m) lat[got++] = now - sent;
+            }
+        }
+        sort(lat.begin(), lat.end());
+        first.push_back(lat[0]);
+        median.push_back(lat[subscribers / 2]);
+        p99.push_back(lat[(size_t)(0.99 * (subscribers - 1))]);
+        last.push_back(lat[subscribers - 1]);
+    }
+
+    printf("fan-out latency over %d messages (median across messages, us):\n", messages);
+    printf("  %-8s %10.1f\n", "first", percentile(first, 0.5));
+    printf("  %-8s %10.1f\n", "median", percentile(median, 0.5));
+    printf("  %-8s %10.1f\n", "p99", percentile(p99, 0.5));
+    printf("  %-8s %10.1f\n", "last", percentile(last, 0.5));
+    printf("  %-8s %10.1f  (worst message)\n", "last", *max_element(last.begin(), last.end()));
+
+    for (int i = 0; i < subscribers; ++i) close(clients[i].fd);
+    close(epfd);
+    return 0;
+}
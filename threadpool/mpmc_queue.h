@@ -0,0 +1,176 @@
+/**
+ * @file mpmc_queue.h
+ * @brief 线程池的有界无锁多生产者多消费者队列，以及工作线程的休眠/唤醒
+ *
+ * 主要特点：
+ * 1. mpmc_queue 是 Dmitry Vyukov 的有界队列：每个槽位带一个序号，入队和出队各自只对一个下标做一次 CAS，
+ *    不加锁、不分配内存，槽位数组在构造时一次分配
+ * 2. 入队下标、出队下标各占一个缓存行，生产者和消费者之间只通过槽位本身交换数据
+ * 3. event_count 让空闲的工作线程在 futex 上休眠：生产者只在确实有线程休眠时才进入内核唤醒，
+ *    忙碌时入队和出队都不产生系统调用
+ * 4. 工作线程先自旋若干次再休眠（pop_wait），短暂的空档不必睡下再被叫醒
+ */
+
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static const size_t QUEUE_CACHE_LINE = 64;
+
+// 自旋等待时让出流水线，超线程上的另一个线程可以继续执行
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+template <typename T>
+class mpmc_queue {
+   public:
+    // capacity 向上取整为 2 的幂
+    explicit mpmc_queue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        m_mask = n - 1;
+        m_cells = new cell[n];
+        for (size_t i = 0; i < n; ++i) m_cells[i].seq.store(i, std::memory_order_relaxed);
+        m_enqueue.store(0, std::memory_order_relaxed);
+        m_dequeue.store(0, std::memory_order_relaxed);
+    }
+    ~mpmc_queue() { delete[] m_cells; }
+
+    // 队列满时返回 false
+    bool push(const T &value) {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {  // 槽位空闲，抢占这个下标
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {  // 槽位还没被上一轮的消费者取走：队列满
+                return false;
+            } else {  // 被其他生产者抢先，重读下标
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+        c->value = value;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列空时返回 false
+    bool pop(T &value) {
+        size_t pos = m_dequeue.load(std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {  // 生产者还没写到这个槽位：队列空
+                return false;
+            } else {
+                pos = m_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+        value = c->value;
+        c->seq.store(pos + m_mask + 1, std::memory_order_release);  // 留给下一轮的生产者
+        return true;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+   private:
+    mpmc_queue(const mpmc_queue &) = delete;
+    mpmc_queue &operator=(const mpmc_queue &) = delete;
+
+    struct cell {
+        std::atomic<size_t> seq;  // 等于下标时可写入，等于下标 + 1 时可读出
+        T value;
+    };
+
+    // 只读成员
+    cell *m_cells;
+    size_t m_mask;
+
+    alignas(QUEUE_CACHE_LINE) std::atomic<size_t> m_enqueue;  // 生产者之间竞争
+    alignas(QUEUE_CACHE_LINE) std::atomic<size_t> m_dequeue;  // 消费者之间竞争
+    char m_pad[QUEUE_CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+// 事件计数：消费者 prepare_wait() 之后再检查一次条件，条件仍不满足才 wait()；
+// 生产者改变条件后 notify()，没有线程在等待时只是一次原子读
+class event_count {
+   public:
+    event_count() : m_epoch(0), m_waiters(0) {}
+
+    // 登记为等待者，返回当前纪元，交给 wait() 或 cancel_wait()
+    uint32_t prepare_wait() {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // 之后对队列的检查不能提前到登记之前
+        return m_epoch.load(std::memory_order_acquire);
+    }
+    void cancel_wait() { m_waiters.fetch_sub(1, std::memory_order_relaxed); }
+    // 纪元仍为 key 时休眠；prepare_wait() 之后的 notify() 都会让它返回
+    void wait(uint32_t key) {
+        while (m_epoch.load(std::memory_order_acquire) == key)
+            syscall(SYS_futex, &m_epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    // 唤醒最多 n 个等待者
+    void notify(int n = 1) {
+        // 与 prepare_wait() 成对：要么生产者看到等待者，要么等待者的再次检查看到新数据
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0) return;
+        m_epoch.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, &m_epoch, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+    }
+    void notify_all() { notify(INT32_MAX); }
+
+   private:
+    std::atomic<uint32_t> m_epoch;
+    std::atomic<int> m_waiters;
+};
+
+// 多核时自旋 128 次（约几微秒），单核时不自旋
+inline int default_spin() { return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 128 : 0; }
+
+/**
+ * @brief 取出一个元素，队列空时先自旋 spin 次，再在 ec 上休眠直到取到为止
+ *
+ * 生产者每次 push() 成功后调用 ec.notify()。单核上自旋只会占用生产者的时间，spin 应为 0（见 default_spin()）。
+ */
+template <typename T>
+void pop_wait(mpmc_queue<T> &queue, event_count &ec, T &value, int spin) {
+    for (int i = 0; i < spin; ++i) {
+        if (queue.pop(value)) return;
+        cpu_relax();
+    }
+    while (true) {
+        uint32_t key = ec.prepare_wait();
+        if (queue.pop(value)) {
+            ec.cancel_wait();
+            return;
+        }
+        ec.wait(key);
+        if (queue.pop(value)) return;
+    }
+}
+
+#endif
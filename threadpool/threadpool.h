@@ -3,12 +3,15 @@
 
 #include <pthread.h>  // 包含POSIX线程库，用于线程操作
 
+#include <stdint.h>
+
+#include <atomic>
 #include <cstdio>     // 包含C标准输入输出库，提供printf等函数
 #include <exception>  // 包含C++标准异常处理库
-#include <list>  // 包含C++标准库的list容器，用于实现请求队列
 
 #include "../CGImysql/sql_connection_pool.h"  // 包含数据库连接池的头文件
 #include "../lock/locker.h"  // 包含自定义的互斥锁和信号量封装
+#include "work_stealing.h"  // 包含每个工作线程的任务队列和任务窃取
 
 /**
  * @brief 线程池类，模板参数T是任务类型
@@ -23,7 +26,7 @@ class threadpool {
      * @param connPool 数据库连接池指针
      * @param thread_number 线程池中线程的数量，默认为8
      * @param max_requests
-     * 请求队列中最多允许的、等待处理的请求的数量，默认为10000
+     * 请求队列中最多允许的、等待处理的请求的数量，默认为10000，平均分给每个工作线程，每份向上取整为 2 的幂
      */
     threadpool(int actor_model, connection_pool *connPool,
                int thread_number = 8, int max_request = 10000);
@@ -35,6 +38,7 @@ class threadpool {
 
     /**
      * @brief 向请求队列中添加任务（Proactor模式下使用）
+     *        同一个连接的任务优先交给同一个工作线程；只能由主线程（事件循环）调用
      * @param request 指向任务对象的指针
      * @param state 任务的状态，例如读或写
      * @return true 添加成功
@@ -43,13 +47,22 @@ class threadpool {
     bool append(T *request, int state);
 
     /**
-     * @brief 向请求队列中添加任务（Reactor模式下使用）
+     * @brief 向请求队列中添加任务（Reactor模式下使用），同 append()
      * @param request 指向任务对象的指针
      * @return true 添加成功
      * @return false 添加失败（队列已满）
      */
     bool append_p(T *request);
 
+    /**
+     * @brief 一次添加一批任务（Proactor模式下使用），主线程每轮 epoll_wait 之后调用一次
+     *        逐个入队，最后按任务数和休眠的线程数唤醒一次，而不是每个任务唤醒一次
+     * @param requests 任务对象指针数组
+     * @param n 任务数
+     * @return int 添加成功的个数，小于 n 时 requests[返回值] 及之后的任务没有添加（队列已满）
+     */
+    int append_batch(T **requests, int n);
+
    private:
     /**
      * @brief 工作线程运行的函数，作为pthread_create的入口函数
@@ -62,17 +75,25 @@ class threadpool {
     /**
      * @brief 线程池中每个工作线程的实际运行逻辑
      *        从请求队列中取出任务并调用其process方法进行处理
+     * @param id 工作线程编号，0 ~ m_thread_number-1
      */
-    void run();
+    void run(int id);
+
+    // 处理一个任务
+    void handle(T *request);
+
+    static const int BATCH = 8;  // 工作线程一次最多从自己的队列取出的任务数
+
+    // 任务交给哪个工作线程：连接对象在 users 数组中的位置，即 sockfd 加一个常数
+    static size_t home(T *request) { return (uintptr_t)request / sizeof(T); }
 
    private:
     int m_thread_number;  // 线程池中的线程数
     int m_max_requests;   // 请求队列中允许的最大请求数
     pthread_t *
         m_threads;  // 描述线程池的数组，存储所有工作线程的线程ID，其大小为m_thread_number
-    std::list<T *> m_workqueue;  // 请求队列，存储待处理的任务对象指针
-    locker m_queuelocker;  // 保护请求队列的互斥锁，确保线程安全
-    sem m_queuestat;  // 信号量，用于判断是否有任务需要处理，当有任务时信号量值增加
+    ws_scheduler<T *> m_sched;  // 请求队列，每个工作线程一个，空闲线程从其他线程的队列窃取任务
+    std::atomic<int> m_next_id;  // 下一个启动的工作线程的编号
     connection_pool *m_connPool;  // 数据库连接池指针，用于数据库操作
     int m_actor_model;  // 模型切换标志，0表示Proactor模式，1表示Reactor模式
 };
@@ -84,6 +105,8 @@ threadpool<T>::threadpool(int actor_model, connection_pool *connPool,
       m_thread_number(thread_number),
       m_max_requests(max_requests),
       m_threads(NULL),
+      m_sched(thread_number > 0 ? thread_number : 1, max_requests > 0 ? max_requests : 1, default_spin()),
+      m_next_id(0),
       m_connPool(connPool) {
     // 检查线程数和最大请求数是否合法
     if (thread_number <= 0 || max_requests <= 0)
@@ -118,92 +141,78 @@ threadpool<T>::~threadpool() {
 
 template <typename T>
 bool threadpool<T>::append(T *request, int state) {
-    m_queuelocker.lock();  // 加锁保护请求队列
-    // 判断请求队列是否已满
-    if (m_workqueue.size() >= m_max_requests) {
-        m_queuelocker.unlock();  // 解锁
-        return false;            // 队列已满，添加失败
-    }
-    request->m_state = state;        // 设置任务的状态
-    m_workqueue.push_back(request);  // 将任务添加到队列尾部
-    m_queuelocker.unlock();          // 解锁
-    m_queuestat.post();  // 信号量加一，表示有新任务到来
-    return true;         // 添加成功
+    request->m_state = state;  // 入队之前设置，取出任务的线程一定能看到
+    return m_sched.submit(request, home(request));  // 所有队列都满时添加失败
 }
 
 template <typename T>
 bool threadpool<T>::append_p(T *request) {
-    m_queuelocker.lock();  // 加锁保护请求队列
-    // 判断请求队列是否已满
-    if (m_workqueue.size() >= m_max_requests) {
-        m_queuelocker.unlock();  // 解锁
-        return false;            // 队列已满，添加失败
-    }
-    m_workqueue.push_back(request);  // 将任务添加到队列尾部
-    m_queuelocker.unlock();          // 解锁
-    m_queuestat.post();  // 信号量加一，表示有新任务到来
-    return true;         // 添加成功
+    return m_sched.submit(request, home(request));  // 所有队列都满时添加失败
+}
+
+template <typename T>
+int threadpool<T>::append_batch(T **requests, int n) {
+    int i = 0;
+    while (i < n && m_sched.push(requests[i], home(requests[i]))) ++i;
+    m_sched.flush();  // 已入队的任务即使后面的添加失败也要唤醒
+    return i;
 }
 
 template <typename T>
 void *threadpool<T>::worker(void *arg) {
     threadpool *pool = (threadpool *)arg;  // 将参数转换为threadpool指针
-    pool->run();  // 调用run方法执行线程的实际工作
+    pool->run(pool->m_next_id++);  // 调用run方法执行线程的实际工作
     return pool;  // 返回线程池指针
 }
 
 template <typename T>
-void threadpool<T>::run() {
+void threadpool<T>::run(int id) {
+    T *batch[BATCH];
     while (true)  // 循环，工作线程持续运行
     {
-        m_queuestat.wait();  // 信号量减一，等待任务。如果队列为空，则线程阻塞
-        m_queuelocker.lock();  // 加锁保护请求队列
-        // 检查请求队列是否为空（在获取锁后再次检查，防止虚假唤醒）
-        if (m_workqueue.empty()) {
-            m_queuelocker.unlock();  // 解锁
-            continue;                // 继续等待下一个任务
-        }
-        T *request = m_workqueue.front();  // 从队列头部取出任务
-        m_workqueue.pop_front();           // 移除队列头部的任务
-        m_queuelocker.unlock();            // 解锁
+        // 取出任务：一次最多取走自己队列的一半，队列为空时窃取，都为空时先自旋再休眠
+        int n = m_sched.take_batch(id, batch, BATCH);
+        for (int i = 0; i < n; ++i) handle(batch[i]);
+    }
+}
 
-        if (!request)  // 如果取出的任务为空，则继续
-            continue;
+template <typename T>
+void threadpool<T>::handle(T *request) {
+    if (!request)  // 如果取出的任务为空，则直接返回
+        return;
 
-        // 根据模型切换标志执行不同的处理逻辑
-        if (1 == m_actor_model)  // Reactor模式
+    // 根据模型切换标志执行不同的处理逻辑
+    if (1 == m_actor_model)  // Reactor模式
+    {
+        if (0 == request->m_state)  // 读操作
         {
-            if (0 == request->m_state)  // 读操作
+            if (request->read_once())  // 读取数据
             {
-                if (request->read_once())  // 读取数据
-                {
-                    request->improv = 1;  // 标记为需要改进（或已处理）
-                    // 使用RAII机制管理数据库连接，确保连接的正确获取和释放
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
-                    request->process();  // 处理请求
-                } else                   // 读取失败
-                {
-                    request->improv = 1;  // 标记为需要改进
-                    request->timer_flag = 1;  // 标记为需要关闭连接（或定时器处理）
-                }
-            } else  // 写操作
+                request->improv = 1;  // 标记为需要改进（或已处理）
+                // 使用RAII机制管理数据库连接，确保连接的正确获取和释放
+                connectionRAII mysqlcon(&request->mysql, m_connPool);
+                request->process();  // 处理请求
+            } else                   // 读取失败
             {
-                if (request->write())  // 写入数据
-                {
-                    request->improv = 1;  // 标记为需要改进
-                } else                    // 写入失败
-                {
-                    request->improv = 1;      // 标记为需要改进
-                    request->timer_flag = 1;  // 标记为需要关闭连接
-                }
+                request->improv = 1;  // 标记为需要改进
+                request->timer_flag = 1;  // 标记为需要关闭连接（或定时器处理）
             }
-        } else  // Proactor模式
+        } else  // 写操作
         {
-            // 使用RAII机制管理数据库连接
-            connectionRAII mysqlcon(&request->mysql, m_connPool);
-            request->process();  // 直接处理请求
+            if (request->write())  // 写入数据
+            {
+                request->improv = 1;  // 标记为需要改进
+            } else                    // 写入失败
+            {
+                request->improv = 1;      // 标记为需要改进
+                request->timer_flag = 1;  // 标记为需要关闭连接
+            }
         }
+    } else  // Proactor模式
+    {
+        // 使用RAII机制管理数据库连接
+        connectionRAII mysqlcon(&request->mysql, m_connPool);
+        request->process();  // 直接处理请求
     }
 }
 #endif
-
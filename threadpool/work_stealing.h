@@ -0,0 +1,254 @@
+/**
+ * @file work_stealing.h
+ * @brief 每个工作线程一个 Chase-Lev 双端队列的任务调度
+ *
+ * 主要特点：
+ * 1. 每个工作线程有自己的双端队列（ws_deque），提交的任务按 home 放进对应线程的队列，
+ *    同一个连接总是先交给同一个线程，连接的缓冲区留在那个核的缓存里
+ * 2. ws_deque 是 Chase-Lev 的有界版本：所有者是提交任务的线程（事件循环），只在底部入队，不需要 CAS；
+ *    工作线程从顶部取任务，自己的队列和别人的队列一样用 steal()，先提交的先处理
+ * 3. 自己的队列空时从随机的一个线程开始依次窃取，全都空才休眠；每个线程在自己的 event_count 上休眠，
+ *    提交时只唤醒需要唤醒的线程：home 线程在休眠就唤醒它，否则有空闲线程时唤醒一个来窃取；
+ *    唤醒前先清掉对方的 sleeping 标志，连续提交时每次叫醒的是不同的线程
+ * 4. 同一个调度器只能有一个提交线程；多个事件循环时每个事件循环各用一个调度器
+ * 5. 批量提交：push() 只入队，一批之后 flush() 做一次 fence，按新任务数和休眠线程数唤醒；
+ *    批量取出：take_batch() 一次 CAS 取走自己队列的一半（至多 max 个），另一半留给窃取者
+ */
+
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "mpmc_queue.h"
+
+template <typename T>
+class ws_deque {
+   public:
+    // capacity 向上取整为 2 的幂
+    explicit ws_deque(size_t capacity) : m_top(0), m_bottom(0) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        m_mask = n - 1;
+        m_items = new std::atomic<T>[n];
+    }
+    ~ws_deque() { delete[] m_items; }
+
+    // 所有者在底部入队，满时返回 false
+    bool push(T value) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);  // 读到的旧值只会让队列显得更满
+        if (b - t > (int64_t)m_mask) return false;
+        m_items[b & m_mask].store(value, std::memory_order_relaxed);
+        m_bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 任意线程从顶部取出一个，队列空时返回 false；与其他线程争抢失败时重试
+    bool steal(T &value) {
+        while (true) {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if (t >= b) return false;
+            value = m_items[t & m_mask].load(std::memory_order_relaxed);
+            if (m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    // 任意线程从顶部一次取走一半（至多 max 个），队列空时返回 0。
+    // 所有者入队前检查 m_top，这些槽位在 CAS 成功之前不会被覆盖
+    int steal_half(T *out, int max) {
+        while (true) {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if (t >= b) return 0;
+            int64_t n = (b - t + 1) / 2;
+            if (n > max) n = max;
+            for (int64_t i = 0; i < n; ++i) out[i] = m_items[(t + i) & m_mask].load(std::memory_order_relaxed);
+            if (m_top.compare_exchange_strong(t, t + n, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return (int)n;
+        }
+    }
+
+    // 近似的元素个数
+    int64_t size() const {
+        return m_bottom.load(std::memory_order_relaxed) - m_top.load(std::memory_order_relaxed);
+    }
+
+   private:
+    ws_deque(const ws_deque &) = delete;
+    ws_deque &operator=(const ws_deque &) = delete;
+
+    std::atomic<T> *m_items;
+    size_t m_mask;
+    alignas(QUEUE_CACHE_LINE) std::atomic<int64_t> m_top;     // 窃取者之间竞争
+    alignas(QUEUE_CACHE_LINE) std::atomic<int64_t> m_bottom;  // 只有所有者写
+    char m_pad[QUEUE_CACHE_LINE - sizeof(std::atomic<int64_t>)];
+};
+
+template <typename T>
+class ws_scheduler {
+   public:
+    /**
+     * @param workers 工作线程数，线程由调用者创建，编号 0 ~ workers-1
+     * @param capacity 所有队列的总容量，平均分给每个线程
+     * @param spin 休眠之前自旋检查的次数，见 default_spin()
+     */
+    ws_scheduler(int workers, size_t capacity, int spin)
+        : m_count(workers), m_spin(spin), m_parked(0), m_pending(workers, 0), m_pending_tasks(0) {
+        size_t each = capacity / workers;
+        m_slots = new slot[workers];
+        for (int i = 0; i < workers; ++i) {
+            m_slots[i].deque = new ws_deque<T>(each > 0 ? each : 1);
+            m_slots[i].seed = 2463534242u + i * 2654435761u;
+        }
+    }
+    ~ws_scheduler() {
+        for (int i = 0; i < m_count; ++i) delete m_slots[i].deque;
+        delete[] m_slots;
+    }
+
+    int workers() const { return m_count; }
+
+    // 提交线程调用：放进 home % workers 号线程的队列，满时依次换下一个线程，全满时返回 false
+    bool submit(T value, size_t home) {
+        int w = home % m_count;
+        for (int i = 0; i < m_count; ++i, w = (w + 1 == m_count ? 0 : w + 1)) {
+            if (!m_slots[w].deque->push(value)) continue;
+            // 与 take_batch() 中 prepare_wait() 的 fence 成对：要么这里看到 sleeping，要么休眠者的 try_take() 看到新任务
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!wake(m_slots[w])) wake_thief(w);  // home 线程醒着，正在处理别的任务
+            return true;
+        }
+        return false;
+    }
+
+    // 提交线程调用：同 submit()，但不唤醒，一批 push() 之后调用一次 flush()
+    bool push(T value, size_t home) {
+        int w = home % m_count;
+        for (int i = 0; i < m_count; ++i, w = (w + 1 == m_count ? 0 : w + 1)) {
+            if (!m_slots[w].deque->push(value)) continue;
+            if (!m_pending[w]) {
+                m_pending[w] = 1;
+                m_touched.push_back(w);
+            }
+            ++m_pending_tasks;
+            return true;
+        }
+        return false;
+    }
+
+    // 提交线程调用：为上次 flush() 以来 push() 的任务唤醒线程，至多唤醒任务数个。
+    // 先唤醒收到任务且在休眠的线程，不够时再唤醒其他休眠的线程来窃取
+    void flush() {
+        if (m_pending_tasks == 0) return;
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // 一批只做一次，见 submit()
+        int want = m_pending_tasks, woken = 0;
+        for (size_t i = 0; i < m_touched.size(); ++i) {
+            int w = m_touched[i];
+            m_pending[w] = 0;
+            if (woken < want && wake(m_slots[w])) ++woken;
+        }
+        m_touched.clear();
+        m_pending_tasks = 0;
+        for (int v = 0; v < m_count && woken < want; ++v) {
+            if (m_parked.load(std::memory_order_relaxed) == 0) break;
+            if (wake(m_slots[v])) ++woken;
+        }
+    }
+
+    // id 号工作线程调用：取出一个任务，没有任务时休眠
+    void take(int id, T &value) { take_batch(id, &value, 1); }
+
+    // id 号工作线程调用：取出 1 ~ max 个任务放进 out，返回个数，没有任务时休眠
+    int take_batch(int id, T *out, int max) {
+        int n;
+        for (int i = 0; i < m_spin; ++i) {
+            if ((n = try_take(id, out, max)) > 0) return n;
+            cpu_relax();
+        }
+        slot &s = m_slots[id];
+        while (true) {
+            m_parked.fetch_add(1, std::memory_order_relaxed);
+            s.sleeping.store(true, std::memory_order_relaxed);
+            uint32_t key = s.ec.prepare_wait();
+            if ((n = try_take(id, out, max)) > 0) {
+                // 已被认领时 notify() 只是让纪元加一，本线程处理完这些任务还会回来取
+                s.sleeping.store(false, std::memory_order_relaxed);
+                s.ec.cancel_wait();
+                m_parked.fetch_sub(1, std::memory_order_relaxed);
+                return n;
+            }
+            s.ec.wait(key);
+            s.sleeping.store(false, std::memory_order_relaxed);  // 上一轮迟到的 notify() 唤醒时标志还在
+            m_parked.fetch_sub(1, std::memory_order_relaxed);
+            if ((n = try_take(id, out, max)) > 0) return n;
+        }
+    }
+
+   private:
+    ws_scheduler(const ws_scheduler &) = delete;
+    ws_scheduler &operator=(const ws_scheduler &) = delete;
+
+    struct alignas(QUEUE_CACHE_LINE) slot {
+        ws_deque<T> *deque;
+        event_count ec;  // 本线程在此休眠
+        std::atomic<bool> sleeping{false};  // 本线程准备休眠且还没有被认领唤醒
+        uint32_t seed;   // 选择窃取对象的随机数状态，只由本线程访问
+    };
+
+    // 先取自己的队列（至多一半、max 个），再从随机的一个线程开始依次窃取一个
+    int try_take(int id, T *out, int max) {
+        slot &s = m_slots[id];
+        int n = max == 1 ? s.deque->steal(*out) : s.deque->steal_half(out, max);
+        if (n > 0) return n;
+        if (m_count == 1) return 0;
+        s.seed ^= s.seed << 13;
+        s.seed ^= s.seed >> 17;
+        s.seed ^= s.seed << 5;
+        int v = s.seed % m_count;
+        for (int i = 0; i < m_count; ++i, v = (v + 1 == m_count ? 0 : v + 1)) {
+            // 先用不带 fence 的 size() 跳过空队列，线程多时空闲检查不必对每个队列做一次 fence；
+            // 休眠前的这次检查在 prepare_wait() 的 fence 之后，仍能看到 fence 之前提交的任务
+            ws_deque<T> *d = m_slots[v].deque;
+            if (v != id && d->size() > 0 && d->steal(*out)) return 1;
+        }
+        return 0;
+    }
+
+    // 认领并唤醒一个正在休眠的线程，别的提交已经认领过时返回 false
+    bool wake(slot &s) {
+        if (!s.sleeping.load(std::memory_order_relaxed) || !s.sleeping.exchange(false, std::memory_order_acq_rel))
+            return false;
+        s.ec.notify();
+        return true;
+    }
+
+    // home 线程正忙，有线程在休眠时唤醒一个来窃取
+    void wake_thief(int home) {
+        if (m_count == 1 || m_parked.load(std::memory_order_relaxed) == 0) return;
+        for (int i = 1; i < m_count; ++i) {
+            int v = (home + i) % m_count;
+            if (wake(m_slots[v])) return;
+        }
+    }
+
+   private:
+    slot *m_slots;
+    int m_count;
+    int m_spin;
+    std::atomic<int> m_parked;  // 正在休眠或准备休眠的线程数
+    // 以下只由提交线程访问：上次 flush() 以来收到任务的线程
+    std::vector<char> m_pending;
+    std::vector<int> m_touched;
+    int m_pending_tasks;
+};
+
+#endif
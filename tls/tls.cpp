@@ -0,0 +1,316 @@
+/**
+ * @file tls.cpp
+ * @brief TLS 终结的实现
+ */
+
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include "tls.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "../log/log.h"
+
+#ifdef USE_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+static const size_t TLS_RECORD = 16384;  // 一个 TLS 记录的最大明文长度
+static const long SESSION_CACHE_SIZE = 20480;  // 服务端会话缓存的条目上限
+static const long SESSION_TIMEOUT = 3600;      // 会话（含票据）的有效期，秒
+
+#ifdef USE_TLS
+
+// 把 SSL_get_error() 映射成 errno：WANT_READ/WANT_WRITE 为 EAGAIN，其余为 EPIPE
+static ssize_t tls_error(SSL *ssl, int ret) {
+    switch (SSL_get_error(ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        default:
+            errno = EPIPE;
+            return -1;
+    }
+}
+
+ssize_t tls_read(SSL *ssl, void *buf, size_t len) {
+    ERR_clear_error();
+    int n = SSL_read(ssl, buf, (int)std::min(len, (size_t)INT_MAX));
+    return n > 0 ? n : tls_error(ssl, n);
+}
+
+static ssize_t write_some(SSL *ssl, const char *data, size_t len) {
+    ERR_clear_error();
+    int n = SSL_write(ssl, data, (int)std::min(len, (size_t)INT_MAX));
+    if (n > 0) return n;
+    ssize_t r = tls_error(ssl, n);
+    if (r == 0) errno = EPIPE;  // 对端已发送 close_notify
+    return -1;
+}
+
+// SSL_write 没有 writev。响应头通常只有几百字节，单独成一个记录太浪费，
+// 与响应体开头合并成一个记录；之后按部分写入模式逐段写，已写出的字节数与 writev() 的语义相同。
+// 返回 EAGAIN 后调用者会从同一位置、以同样的数据重试，满足 OpenSSL 对重试的要求
+ssize_t tls_writev(SSL *ssl, const struct iovec *iov, int count) {
+    if (tls_ktls_send(ssl)) return writev(SSL_get_fd(ssl), iov, count);  // 内核负责加密，明文直接写
+
+    static __thread char merged[TLS_RECORD];
+    ssize_t total = 0;
+    int i = 0;
+    size_t skip = 0;
+    while (i < count && iov[i].iov_len == 0) ++i;
+    if (i + 1 < count && iov[i].iov_len < TLS_RECORD / 4) {
+        size_t head = iov[i].iov_len;
+        size_t body = std::min(iov[i + 1].iov_len, TLS_RECORD - head);
+        memcpy(merged, iov[i].iov_base, head);
+        memcpy(merged + head, iov[i + 1].iov_base, body);
+        ssize_t n = write_some(ssl, merged, head + body);
+        if (n < 0) return -1;
+        if ((size_t)n < head + body) return n;
+        total = n;
+        ++i;
+        skip = body;
+    }
+    for (; i < count; ++i, skip = 0) {
+        const char *p = (const char *)iov[i].iov_base + skip;
+        size_t len = iov[i].iov_len - skip;
+        while (len > 0) {
+            ssize_t n = write_some(ssl, p, len);
+            if (n < 0) return total > 0 ? total : -1;
+            total += n;
+            p += n;
+            len -= n;
+        }
+    }
+    return total;
+}
+
+ssize_t tls_sendfile(SSL *ssl, int file_fd, off_t offset, size_t len) {
+#ifndef OPENSSL_NO_KTLS
+    ERR_clear_error();
+    ossl_ssize_t n = SSL_sendfile(ssl, file_fd, offset, len, 0);
+    if (n >= 0) return n;
+    if (errno == EAGAIN || SSL_get_error(ssl, (int)n) == SSL_ERROR_WANT_WRITE) {
+        errno = EAGAIN;
+        return -1;
+    }
+    errno = EPIPE;
+    return -1;
+#else
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+bool tls_pending(SSL *ssl) { return SSL_pending(ssl) > 0; }
+
+bool tls_ktls_send(SSL *ssl) {
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+    return false;
+#endif
+}
+
+void tls_free(SSL *ssl, bool notify) {
+    if (!ssl) return;
+    if (notify && SSL_is_init_finished(ssl)) {
+        ERR_clear_error();
+        SSL_shutdown(ssl);  // 非阻塞，只尝试发送一次 close_notify，不等待对端回应
+    }
+    SSL_free(ssl);
+}
+
+// 只接受 http/1.1：HTTP/2 会话和 WebSocket 目前直接读写 socket，不经过 TLS
+static int select_alpn(SSL *, const unsigned char **out, unsigned char *outlen, const unsigned char *in,
+                       unsigned int inlen, void *) {
+    static const unsigned char http11[] = "http/1.1";
+    for (unsigned int i = 0; i < inlen; i += in[i] + 1) {
+        if (in[i] == 8 && i + 9 <= inlen && memcmp(in + i + 1, http11, 8) == 0) {
+            *out = in + i + 1;
+            *outlen = 8;
+            return SSL_TLSEXT_ERR_OK;
+        }
+    }
+    return SSL_TLSEXT_ERR_NOACK;
+}
+
+bool tls_server::init(const char *cert, const char *key, const ready_fn &ready, int close_log) {
+    m_close_log = close_log;
+    m_ready = ready;
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) return false;
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // 内核 TLS 支持 AES-GCM，优先使用；有 AES-NI 时 AES-128-GCM 也是用户态最快的
+    SSL_CTX_set_ciphersuites(ctx, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256");
+    SSL_CTX_set_cipher_list(ctx, "ECDHE+AESGCM:ECDHE+CHACHA20");
+    long options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_IGNORE_UNEXPECTED_EOF;
+#ifdef SSL_OP_ENABLE_KTLS
+    options |= SSL_OP_ENABLE_KTLS;
+#endif
+    SSL_CTX_set_options(ctx, options);
+    // 部分写入：大响应按记录陆续写出；空闲的 keep-alive 连接释放读写缓冲区
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, key, SSL_FILETYPE_PEM) != 1 || SSL_CTX_check_private_key(ctx) != 1) {
+        char err[256];
+        ERR_error_string_n(ERR_get_error(), err, sizeof(err));
+        LOG_ERROR("tls: cannot load %s / %s: %s", cert, key, err);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    // 会话恢复：TLS 1.2 客户端用会话 ID 查服务端缓存，TLS 1.3 客户端用票据（票据密钥由 OpenSSL 随机生成）
+    static const unsigned char sid_ctx[] = "tinywebserver";
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+    SSL_CTX_set_num_tickets(ctx, 1);  // HTTP/1.1 客户端一次只用一个票据，默认的 2 个多一次写
+    SSL_CTX_set_alpn_select_cb(ctx, select_alpn, NULL);
+
+    m_ctx = ctx;
+    event_hub::get_instance()->add_tick([this]() { tick(); });
+    LOG_INFO("tls: loaded %s", cert);
+    return true;
+}
+
+tls_server::~tls_server() {
+    if (m_ctx) SSL_CTX_free(m_ctx);
+}
+
+void tls_server::accept(int fd, const sockaddr_in &addr) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    // 握手的每一轮和每个 TLS 记录都是一次单独的写，开着 Nagle 时会与对端的延迟确认互相等待
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if ((size_t)fd >= m_handshakes_by_fd.size()) m_handshakes_by_fd.resize(fd + 1, NULL);
+    handshake *&h = m_handshakes_by_fd[fd];
+    if (!h) h = new handshake;
+    h->fd = fd;
+    h->addr = addr;
+    h->start = time(NULL);
+    h->ssl = SSL_new(m_ctx);
+    if (!h->ssl || SSL_set_fd(h->ssl, fd) != 1 || !event_hub::get_instance()->add(fd, EPOLLIN | EPOLLRDHUP, h)) {
+        LOG_ERROR("tls: cannot start handshake on fd %d", fd);
+        if (h->ssl) SSL_free(h->ssl);
+        h->ssl = NULL;
+        ::close(fd);
+        return;
+    }
+    SSL_set_accept_state(h->ssl);
+    h->active = true;
+    m_live.push_back(h);
+}
+
+void tls_server::handshake::on_io(int, uint32_t events) {
+    tls_server *server = tls_server::get_instance();
+    if (events & EPOLLERR)
+        server->fail(this, "socket error");
+    else
+        server->step(this);
+}
+
+void tls_server::step(handshake *h) {
+    ERR_clear_error();
+    int r = SSL_do_handshake(h->ssl);
+    if (r == 1) {
+        event_hub::get_instance()->del(h->fd);
+        h->active = false;
+        m_live.erase(std::find(m_live.begin(), m_live.end(), h));
+        ++m_handshakes;
+        if (SSL_session_reused(h->ssl)) ++m_resumed;
+        if (tls_ktls_send(h->ssl)) ++m_ktls;
+        SSL *ssl = h->ssl;
+        h->ssl = NULL;
+        m_ready(h->fd, h->addr, ssl);
+        return;
+    }
+    switch (SSL_get_error(h->ssl, r)) {
+        case SSL_ERROR_WANT_READ:
+            event_hub::get_instance()->mod(h->fd, EPOLLIN | EPOLLRDHUP);
+            return;
+        case SSL_ERROR_WANT_WRITE:
+            event_hub::get_instance()->mod(h->fd, EPOLLOUT);
+            return;
+        default: {
+            char err[256];
+            unsigned long e = ERR_get_error();
+            if (e)
+                ERR_error_string_n(e, err, sizeof(err));
+            else
+                snprintf(err, sizeof(err), "%s", "connection closed");
+            fail(h, err);
+        }
+    }
+}
+
+void tls_server::fail(handshake *h, const char *why) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &h->addr.sin_addr, ip, sizeof(ip));
+    LOG_INFO("tls: handshake with %s failed: %s", ip, why);
+    ++m_failures;
+    event_hub::get_instance()->del(h->fd);
+    ::close(h->fd);
+    SSL_free(h->ssl);
+    h->ssl = NULL;
+    h->active = false;
+    m_live.erase(std::find(m_live.begin(), m_live.end(), h));
+}
+
+// 握手迟迟不完成的连接占着 fd 和 SSL 对象，随定时器信号检查并断开
+void tls_server::tick() {
+    time_t now = time(NULL);
+    std::vector<handshake *> expired;
+    for (size_t i = 0; i < m_live.size(); ++i)
+        if (now - m_live[i]->start > TLS_HANDSHAKE_TIMEOUT) expired.push_back(m_live[i]);
+    for (size_t i = 0; i < expired.size(); ++i) fail(expired[i], "timeout");
+}
+
+#else  // 未启用 TLS 编译：http_conn 不会拿到 SSL 对象，读写函数不会被调用
+
+ssize_t tls_read(SSL *, void *, size_t) {
+    errno = EOPNOTSUPP;
+    return -1;
+}
+ssize_t tls_writev(SSL *, const struct iovec *, int) {
+    errno = EOPNOTSUPP;
+    return -1;
+}
+ssize_t tls_sendfile(SSL *, int, off_t, size_t) {
+    errno = EOPNOTSUPP;
+    return -1;
+}
+bool tls_pending(SSL *) { return false; }
+bool tls_ktls_send(SSL *) { return false; }
+void tls_free(SSL *, bool) {}
+
+bool tls_server::init(const char *, const char *, const ready_fn &, int close_log) {
+    m_close_log = close_log;
+    LOG_ERROR("%s", "tls: built without TLS support (make TLS=1)");
+    return false;
+}
+tls_server::~tls_server() {}
+void tls_server::accept(int fd, const sockaddr_in &) { ::close(fd); }
+void tls_server::handshake::on_io(int, uint32_t) {}
+void tls_server::step(handshake *) {}
+void tls_server::fail(handshake *, const char *) {}
+void tls_server::tick() {}
+
+#endif
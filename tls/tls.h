@@ -0,0 +1,115 @@
+/**
+ * @file tls.h
+ * @brief TLS 终结：第二个监听端口上的 HTTPS
+ *
+ * 省掉前置 TLS 代理多出来的一跳。
+ * 主要特点：
+ * 1. 握手在主循环中非阻塞地进行：新连接先经 event_hub 交给 tls_server，握手完成后才交给 http_conn，
+ *    之后的请求解析、处理函数、反向代理与明文连接走同一套代码，只有 socket 读写换成 tls_read()/tls_writev()
+ * 2. 会话恢复：服务端会话缓存（TLS 1.2 会话 ID）和会话票据（TLS 1.3 / 1.2）都开启，
+ *    恢复的握手省掉证书验证和密钥交换
+ * 3. 内核 TLS：OpenSSL 支持且内核加载了 tls 模块时，握手后把加密交给内核，
+ *    此时写操作直接 writev/splice 到 socket，静态文件用 SSL_sendfile 从页缓存零拷贝发送；
+ *    内核不支持时自动退回用户态加密
+ * 4. 编译开关 USE_TLS（makefile 中 TLS=1），关闭时 tls_server::init() 失败，服务器只提供明文端口
+ */
+
+#ifndef TLS_H
+#define TLS_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include <functional>
+#include <vector>
+
+#include "../upstream/event_hub.h"
+
+typedef struct ssl_st SSL;          // 与 OpenSSL 的声明一致，使用者不需要包含 OpenSSL 头文件
+typedef struct ssl_ctx_st SSL_CTX;
+
+static const int TLS_HANDSHAKE_TIMEOUT = 10;  // 握手超过多少秒未完成就断开
+
+// 以下函数供 http_conn 读写已完成握手的连接，返回值与 recv()/writev() 相同：
+// 暂时不能读写时返回 -1 且 errno 为 EAGAIN，对端关闭时 tls_read() 返回 0
+ssize_t tls_read(SSL *ssl, void *buf, size_t len);
+ssize_t tls_writev(SSL *ssl, const struct iovec *iov, int count);
+// 发送 file_fd 中 [offset, offset + len)，只在 tls_ktls_send() 为真时可用
+ssize_t tls_sendfile(SSL *ssl, int file_fd, off_t offset, size_t len);
+// OpenSSL 中是否还有已解密、尚未读走的数据，有时不会再触发读事件
+bool tls_pending(SSL *ssl);
+// 发送方向是否已交给内核加密
+bool tls_ktls_send(SSL *ssl);
+// 释放 SSL 对象，不关闭 socket。notify 为真时先尽力发送 close_notify；
+// socket 已关闭（fd 可能已被新连接复用）时必须为假
+void tls_free(SSL *ssl, bool notify);
+
+/**
+ * @brief TLS 握手管理（单例）
+ *
+ * 只在主循环线程中使用。
+ */
+class tls_server {
+   public:
+    // 握手完成：fd 已从 event_hub 注销，由回调交给 http_conn
+    typedef std::function<void(int fd, const sockaddr_in &addr, SSL *ssl)> ready_fn;
+
+    static tls_server *get_instance() {
+        static tls_server instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 加载证书和私钥，配置会话缓存、票据和内核 TLS，启动阶段调用
+     * @param cert PEM 格式的证书链
+     * @param key PEM 格式的私钥
+     * @param ready 握手完成的回调
+     * @return 证书或私钥无法加载、未启用 TLS 编译时返回 false
+     */
+    bool init(const char *cert, const char *key, const ready_fn &ready, int close_log);
+    // 接管新接受的连接并开始握手
+    void accept(int fd, const sockaddr_in &addr);
+
+    // 统计：完成的握手数、其中恢复会话的次数、使用内核 TLS 的次数、失败次数
+    uint64_t handshakes() const { return m_handshakes; }
+    uint64_t resumed() const { return m_resumed; }
+    uint64_t ktls() const { return m_ktls; }
+    uint64_t failures() const { return m_failures; }
+
+   private:
+    // 一条正在握手的连接，按 fd 常驻复用
+    struct handshake : public io_handler {
+        handshake() : fd(-1), ssl(NULL), start(0), active(false) {}
+        void on_io(int fd, uint32_t events);
+
+        int fd;
+        SSL *ssl;
+        sockaddr_in addr;
+        time_t start;  // 接受连接的时间
+        bool active;   // 是否正在握手
+    };
+
+    tls_server() : m_ctx(NULL), m_close_log(0), m_handshakes(0), m_resumed(0), m_ktls(0), m_failures(0) {}
+    ~tls_server();
+
+    void step(handshake *h);  // 推进握手
+    void fail(handshake *h, const char *why);
+    void tick();
+
+   private:
+    SSL_CTX *m_ctx;
+    int m_close_log;
+    ready_fn m_ready;
+    std::vector<handshake *> m_handshakes_by_fd;  // fd -> 握手状态
+    std::vector<handshake *> m_live;              // 正在握手的连接，用于超时检查
+    uint64_t m_handshakes;
+    uint64_t m_resumed;
+    uint64_t m_ktls;
+    uint64_t m_failures;
+};
+
+#endif
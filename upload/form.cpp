@@ -0,0 +1,437 @@
+/**
+ * @file form.cpp
+ * @brief 表单请求体流式解析的实现
+ */
+
+#include "form.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// 上传的文件和表单
+
+upload_file::~upload_file() {
+    if (m_fd >= 0) close(m_fd);
+    if (!m_temp_path.empty()) unlink(m_temp_path.c_str());
+}
+
+bool upload_file::open(const std::string &dir) {
+#ifdef O_TMPFILE
+    m_fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (m_fd >= 0) return true;
+#endif
+    // 文件系统不支持 O_TMPFILE：以 '.' 开头的名字，权限 0600，静态文件服务不会返回它
+    std::string path = dir + "/.upload-XXXXXX";
+    m_fd = mkostemp(&path[0], O_CLOEXEC);
+    if (m_fd < 0) return false;
+    m_temp_path = path;
+    return true;
+}
+
+bool upload_file::write_at(const char *data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(m_fd, data, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool upload_file::save(const char *path, mode_t mode) {
+    if (m_fd < 0 || fchmod(m_fd, mode) < 0) return false;
+    if (!m_temp_path.empty()) {
+        if (link(m_temp_path.c_str(), path) < 0) return false;
+        unlink(m_temp_path.c_str());
+        m_temp_path.clear();
+        return true;
+    }
+    // 没有名字的临时文件经 /proc 链接到目标路径，不需要 CAP_DAC_READ_SEARCH
+    char proc[32];
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", m_fd);
+    return linkat(AT_FDCWD, proc, AT_FDCWD, path, AT_SYMLINK_FOLLOW) == 0;
+}
+
+std::string_view upload_form::field(std::string_view name) const {
+    for (size_t i = 0; i < fields.size(); ++i)
+        if (fields[i].name == name) return fields[i].value;
+    return std::string_view();
+}
+
+upload_file *upload_form::file(std::string_view name) const {
+    for (size_t i = 0; i < files.size(); ++i)
+        if (files[i]->name == name) return files[i].get();
+    return NULL;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// multipart/form-data
+
+static bool starts_with_nocase(std::string_view s, std::string_view prefix) {
+    return s.size() >= prefix.size() && strncasecmp(s.data(), prefix.data(), prefix.size()) == 0;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+    return s;
+}
+
+// 在 "type; a=1; b=\"x;y\"" 这样的头部值中按名字（大小写不敏感）取参数，引号中的 ';' 不作分隔
+static bool header_param(std::string_view v, std::string_view key, std::string_view &out) {
+    size_t i = v.find(';');
+    while (i != std::string_view::npos && i < v.size()) {
+        ++i;
+        size_t eq = v.find('=', i);
+        if (eq == std::string_view::npos) return false;
+        std::string_view name = trim(v.substr(i, eq - i));
+        i = eq + 1;
+        while (i < v.size() && (v[i] == ' ' || v[i] == '\t')) ++i;
+        std::string_view value;
+        if (i < v.size() && v[i] == '"') {
+            size_t q = v.find('"', i + 1);
+            if (q == std::string_view::npos) return false;
+            value = v.substr(i + 1, q - i - 1);
+            i = q + 1;
+        } else {
+            size_t semi = v.find(';', i);
+            value = trim(v.substr(i, semi == std::string_view::npos ? std::string_view::npos : semi - i));
+            i = semi;
+        }
+        if (name.size() == key.size() && strncasecmp(name.data(), key.data(), key.size()) == 0) {
+            out = value;
+            return true;
+        }
+        if (i != std::string_view::npos) i = v.find(';', i);
+    }
+    return false;
+}
+
+bool multipart_parser::init(std::string_view content_type, part_handler *handler) {
+    std::string_view boundary;
+    if (!header_param(content_type, "boundary", boundary)) return false;
+    // RFC 2046 5.1.1：1 到 70 个字符，不含 CR、LF
+    if (boundary.empty() || boundary.size() > 70 || boundary.find_first_of("\r\n") != std::string_view::npos)
+        return false;
+    m_handler = handler;
+    m_delim = "\r\n--";
+    m_delim.append(boundary.data(), boundary.size());
+    m_state = MP_PREAMBLE;
+    m_match = 2;  // 请求体开头的分隔符前面没有 CRLF，当作已经匹配
+    m_head.clear();
+    return true;
+}
+
+bool multipart_parser::scan(const char *&p, const char *end, UPLOAD_STATUS &st) {
+    while (p < end) {
+        if (m_match == 0) {
+            const char *cr = (const char *)memchr(p, '\r', end - p);
+            const char *stop = cr ? cr : end;
+            if (m_state == MP_BODY && stop > p) {
+                st = m_handler->on_data(p, stop - p);
+                if (st != UPLOAD_MORE) return false;
+            }
+            p = stop;
+            if (!cr) return false;
+            m_match = 1;
+            ++p;
+            continue;
+        }
+        if (*p == m_delim[m_match]) {
+            ++p;
+            if (++m_match == m_delim.size()) {
+                m_match = 0;
+                return true;
+            }
+        } else {
+            // 已匹配的部分原来是数据。分隔符中只有第一个字节是 '\r'，当前字节从头重新匹配即可
+            if (m_state == MP_BODY) {
+                st = m_handler->on_data(m_delim.data(), m_match);
+                if (st != UPLOAD_MORE) return false;
+            }
+            m_match = 0;
+        }
+    }
+    return false;
+}
+
+UPLOAD_STATUS multipart_parser::feed(const char *data, size_t len) {
+    const char *p = data, *end = data + len;
+    while (p < end) {
+        switch (m_state) {
+            case MP_PREAMBLE:
+            case MP_BODY: {
+                UPLOAD_STATUS st = UPLOAD_MORE;
+                if (scan(p, end, st)) {
+                    if (m_state == MP_BODY && (st = m_handler->on_part_end()) != UPLOAD_MORE) return st;
+                    m_state = MP_BOUNDARY;
+                } else if (st != UPLOAD_MORE) {
+                    return st;
+                }
+                break;
+            }
+            case MP_BOUNDARY: {
+                char c = *p++;
+                if (c == '\r')
+                    m_state = MP_BOUNDARY_LF;
+                else if (c == '-')
+                    m_state = MP_CLOSE;
+                else if (c != ' ' && c != '\t')  // 分隔符之后允许有空白（transport-padding）
+                    return UPLOAD_BAD;
+                break;
+            }
+            case MP_BOUNDARY_LF:
+                if (*p++ != '\n') return UPLOAD_BAD;
+                m_head.clear();
+                m_state = MP_HEAD;
+                break;
+            case MP_CLOSE:
+                if (*p++ != '-') return UPLOAD_BAD;
+                m_state = MP_EPILOGUE;
+                break;
+            case MP_HEAD: {
+                // 按行追加，读到空行时头部结束
+                const char *lf = (const char *)memchr(p, '\n', end - p);
+                const char *stop = lf ? lf + 1 : end;
+                if (m_head.size() + (stop - p) > MAX_PART_HEAD) return UPLOAD_BAD;
+                m_head.append(p, stop - p);
+                p = stop;
+                size_t n = m_head.size();
+                if (lf && n >= 2 && m_head[n - 2] == '\r' &&
+                    (n == 2 || (n >= 4 && m_head.compare(n - 4, 4, "\r\n\r\n") == 0))) {
+                    UPLOAD_STATUS st = begin_part();
+                    if (st != UPLOAD_MORE) return st;
+                    m_match = 0;
+                    m_state = MP_BODY;
+                }
+                break;
+            }
+            case MP_EPILOGUE:
+                p = end;
+                break;
+        }
+    }
+    return UPLOAD_MORE;
+}
+
+// 解析一个部分的头部：Content-Disposition 给出字段名和文件名，Content-Type 原样交给处理者
+UPLOAD_STATUS multipart_parser::begin_part() {
+    std::string_view head(m_head), disposition, type;
+    while (!head.empty()) {
+        size_t eol = head.find("\r\n");
+        std::string_view line = head.substr(0, eol);
+        head.remove_prefix(eol + 2);
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = trim(line.substr(colon + 1));
+        if (name.size() == 19 && strncasecmp(name.data(), "Content-Disposition", 19) == 0)
+            disposition = value;
+        else if (name.size() == 12 && strncasecmp(name.data(), "Content-Type", 12) == 0)
+            type = value;
+    }
+    std::string_view field, filename;
+    if (!starts_with_nocase(disposition, "form-data") || !header_param(disposition, "name", field))
+        return UPLOAD_BAD;
+    bool has_filename = header_param(disposition, "filename", filename);
+    if (has_filename) {
+        size_t slash = filename.find_last_of("/\\");  // 部分浏览器会带上客户端的完整路径
+        if (slash != std::string_view::npos) filename.remove_prefix(slash + 1);
+    }
+    return m_handler->on_part(field, filename, has_filename, type);
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// application/x-www-form-urlencoded
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+void urlencoded_parser::init(std::vector<form_field> *fields, size_t max_bytes) {
+    m_fields = fields;
+    m_max_bytes = max_bytes;
+    m_bytes = 0;
+    m_cur = form_field();
+    m_in_value = false;
+    m_hex_digits = -1;
+}
+
+UPLOAD_STATUS urlencoded_parser::put(char c) {
+    if (++m_bytes > m_max_bytes) return UPLOAD_TOO_LARGE;
+    (m_in_value ? m_cur.value : m_cur.name).push_back(c);
+    return UPLOAD_MORE;
+}
+
+void urlencoded_parser::end_field() {
+    if (!m_cur.name.empty() || m_in_value) m_fields->push_back(std::move(m_cur));
+    m_cur = form_field();
+    m_in_value = false;
+}
+
+UPLOAD_STATUS urlencoded_parser::feed(const char *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        char c = data[i];
+        UPLOAD_STATUS st = UPLOAD_MORE;
+        if (m_hex_digits >= 0) {
+            int d = hex_value(c);
+            if (d < 0) return UPLOAD_BAD;
+            m_hex = m_hex * 16 + d;
+            if (++m_hex_digits == 2) {
+                m_hex_digits = -1;
+                st = put((char)m_hex);
+            }
+        } else if (c == '&') {
+            end_field();
+        } else if (c == '=' && !m_in_value) {
+            m_in_value = true;
+        } else if (c == '%') {
+            m_hex = 0;
+            m_hex_digits = 0;
+        } else {
+            st = put(c == '+' ? ' ' : c);
+        }
+        if (st != UPLOAD_MORE) return st;
+    }
+    return UPLOAD_MORE;
+}
+
+UPLOAD_STATUS urlencoded_parser::finish() {
+    if (m_hex_digits >= 0) return UPLOAD_BAD;  // 请求体在 %XX 中间结束
+    end_field();
+    return UPLOAD_DONE;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
+
+
+/*↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓*/
+// upload_session
+
+upload_session::upload_session(const upload_limits &limits)
+    : m_limits(limits),
+      m_multipart(false),
+      m_form(std::make_shared<upload_form>()),
+      m_body(0),
+      m_field_bytes(0),
+      m_field(NULL),
+      m_file(NULL),
+      m_skip(false),
+      m_buf(NULL),
+      m_buf_len(0),
+      m_status(UPLOAD_MORE) {}
+
+upload_session::~upload_session() { delete[] m_buf; }
+
+bool upload_session::start(std::string_view content_type) {
+    content_type = trim(content_type);
+    if (starts_with_nocase(content_type, "multipart/form-data")) {
+        m_multipart = true;
+        return m_multipart_parser.init(content_type, this);
+    }
+    if (starts_with_nocase(content_type, "application/x-www-form-urlencoded")) {
+        m_urlencoded_parser.init(&m_form->fields, m_limits.max_fields);
+        return true;
+    }
+    return false;
+}
+
+UPLOAD_STATUS upload_session::feed(const char *data, size_t len) {
+    if (m_status != UPLOAD_MORE) return m_status;
+    m_body += len;
+    if (m_body > m_limits.max_body)
+        m_status = UPLOAD_TOO_LARGE;
+    else
+        m_status = m_multipart ? m_multipart_parser.feed(data, len) : m_urlencoded_parser.feed(data, len);
+    return m_status;
+}
+
+UPLOAD_STATUS upload_session::finish() {
+    if (m_status != UPLOAD_MORE) return m_status;
+    m_status = m_multipart ? m_multipart_parser.finish() : m_urlencoded_parser.finish();
+    return m_status;
+}
+
+UPLOAD_STATUS upload_session::on_part(std::string_view name, std::string_view filename, bool has_filename,
+                                      std::string_view content_type) {
+    if (has_filename) {
+        if (filename.empty()) {  // 没有选择文件的文件控件，浏览器仍会发送一个空的部分
+            m_skip = true;
+            return UPLOAD_MORE;
+        }
+        if (m_form->files.size() >= (size_t)m_limits.max_files) return UPLOAD_TOO_LARGE;
+        std::unique_ptr<upload_file> f(new upload_file);
+        if (!f->open(m_limits.dir)) return UPLOAD_IO_ERROR;
+        f->name = name;
+        f->filename = filename;
+        f->content_type = content_type;
+        m_file = f.get();
+        m_form->files.push_back(std::move(f));
+        return UPLOAD_MORE;
+    }
+    m_field_bytes += name.size();
+    if (m_field_bytes > m_limits.max_fields) return UPLOAD_TOO_LARGE;
+    m_form->fields.push_back(form_field());
+    m_field = &m_form->fields.back();
+    m_field->name = name;
+    return UPLOAD_MORE;
+}
+
+UPLOAD_STATUS upload_session::on_data(const char *data, size_t len) {
+    if (m_file) {
+        if (m_file->size + m_buf_len + len > m_limits.max_file) return UPLOAD_TOO_LARGE;
+        if (!m_buf) m_buf = new char[WRITE_BUFFER];
+        while (len > 0) {
+            size_t n = std::min(len, WRITE_BUFFER - m_buf_len);
+            memcpy(m_buf + m_buf_len, data, n);
+            m_buf_len += n;
+            data += n;
+            len -= n;
+            if (m_buf_len == WRITE_BUFFER) {
+                UPLOAD_STATUS st = flush();
+                if (st != UPLOAD_MORE) return st;
+            }
+        }
+    } else if (m_field) {
+        m_field_bytes += len;
+        if (m_field_bytes > m_limits.max_fields) return UPLOAD_TOO_LARGE;
+        m_field->value.append(data, len);
+    }
+    return UPLOAD_MORE;
+}
+
+UPLOAD_STATUS upload_session::flush() {
+    if (m_buf_len == 0) return UPLOAD_MORE;
+    if (!m_file->write_at(m_buf, m_buf_len, m_file->size)) return UPLOAD_IO_ERROR;
+    m_file->size += m_buf_len;
+    m_buf_len = 0;
+    return UPLOAD_MORE;
+}
+
+UPLOAD_STATUS upload_session::on_part_end() {
+    UPLOAD_STATUS st = m_file ? flush() : UPLOAD_MORE;
+    m_file = NULL;
+    m_field = NULL;
+    m_skip = false;
+    return st;
+}
+/*↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑↑*/
@@ -0,0 +1,218 @@
+/**
+ * @file form.h
+ * @brief 表单请求体的流式解析：multipart/form-data 与 application/x-www-form-urlencoded
+ *
+ * 请求体不再整个放进读缓冲区，每读到一段就交给 upload_session，读缓冲区随即腾出来接收后面的数据。
+ * 主要特点：
+ * 1. multipart 解析器是增量的状态机，分隔符可以跨越两次 feed()；只有 '\r' 可能开始分隔符，
+ *    数据段用 memchr 跳过
+ * 2. 文件部分边到边写：攒满 64KB 写缓冲区就 pwrite 到临时文件，整个上传占用的内存与文件大小无关
+ * 3. 临时文件优先用 O_TMPFILE 创建，没有名字，进程崩溃或请求失败都不留垃圾；
+ *    处理函数调用 upload_file::save() 才把它链接到目标路径
+ * 4. 配额：请求体总长度、单个文件大小、文件个数、普通字段占用的内存分别限制，超出时回复 413
+ */
+
+#ifndef FORM_H
+#define FORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 上传接口的配额，随路由注册
+struct upload_limits {
+    size_t max_body = 16 << 20;   // 请求体总长度上限
+    size_t max_file = 8 << 20;    // 单个文件的大小上限
+    int max_files = 8;            // 文件个数上限
+    size_t max_fields = 64 << 10; // 普通字段的名字和值合计上限，这部分保存在内存中
+    std::string dir = "/tmp";     // 临时文件所在目录，应与 save() 的目标在同一文件系统
+};
+
+// 解析进度和结果
+enum UPLOAD_STATUS {
+    UPLOAD_MORE = 0,   // 请求体尚未结束
+    UPLOAD_DONE,       // 请求体完整，表单可用
+    UPLOAD_BAD,        // 格式错误，回复 400
+    UPLOAD_TOO_LARGE,  // 超出配额，回复 413
+    UPLOAD_IO_ERROR    // 临时文件创建或写入失败，回复 500
+};
+
+struct form_field {
+    std::string name;
+    std::string value;
+};
+
+/**
+ * @brief 上传的一个文件，内容在临时文件中
+ *
+ * 对象销毁时关闭临时文件；没有 save() 的文件随之删除。
+ */
+class upload_file {
+   public:
+    upload_file() : size(0), m_fd(-1) {}
+    ~upload_file();
+
+    // 打开 dir 下的临时文件
+    bool open(const std::string &dir);
+    // 把 [offset, offset + len) 写入临时文件
+    bool write_at(const char *data, size_t len, uint64_t offset);
+
+    // 把临时文件保存到 path（与临时文件在同一文件系统），path 已存在时失败
+    bool save(const char *path, mode_t mode = 0644);
+    // 临时文件的描述符，可以从头读取内容
+    int fd() const { return m_fd; }
+
+    std::string name;          // 表单中的字段名
+    std::string filename;      // 客户端给出的文件名，已去掉目录部分
+    std::string content_type;  // 该部分的 Content-Type，没有时为空
+    uint64_t size;             // 文件大小
+
+   private:
+    upload_file(const upload_file &) = delete;
+    upload_file &operator=(const upload_file &) = delete;
+
+    int m_fd;                // 临时文件
+    std::string m_temp_path; // 不支持 O_TMPFILE 时退回有名字的临时文件，保存前一直存在
+};
+
+// 解析完成的表单，处理函数经 http_request::form 访问
+class upload_form {
+   public:
+    // 按名字查找普通字段，没有时返回空
+    std::string_view field(std::string_view name) const;
+    // 按名字查找文件，没有时返回 NULL
+    upload_file *file(std::string_view name) const;
+
+    std::vector<form_field> fields;
+    std::vector<std::unique_ptr<upload_file>> files;
+};
+
+/**
+ * @brief multipart/form-data 的增量解析器（RFC 7578）
+ *
+ * 只负责切分，每个部分的头部和数据交给 part_handler。
+ */
+class multipart_parser {
+   public:
+    class part_handler {
+       public:
+        virtual ~part_handler() {}
+        // 一个部分的头部已解析；has_filename 为真表示这是文件。返回非 UPLOAD_MORE 时停止解析
+        virtual UPLOAD_STATUS on_part(std::string_view name, std::string_view filename, bool has_filename,
+                                      std::string_view content_type) = 0;
+        virtual UPLOAD_STATUS on_data(const char *data, size_t len) = 0;
+        virtual UPLOAD_STATUS on_part_end() = 0;
+    };
+
+    static const size_t MAX_PART_HEAD = 8192;  // 一个部分的头部上限
+
+    multipart_parser() : m_handler(NULL), m_state(MP_PREAMBLE), m_match(0) {}
+
+    // 从 Content-Type 中取出 boundary 并开始解析，boundary 缺失或不合法时返回 false
+    bool init(std::string_view content_type, part_handler *handler);
+    // 解析下一段数据
+    UPLOAD_STATUS feed(const char *data, size_t len);
+    // 请求体结束，没有见到结束分隔符时返回 UPLOAD_BAD
+    UPLOAD_STATUS finish() const { return m_state == MP_EPILOGUE ? UPLOAD_DONE : UPLOAD_BAD; }
+
+   private:
+    enum STATE {
+        MP_PREAMBLE = 0,  // 第一个分隔符之前，丢弃
+        MP_BOUNDARY,      // 分隔符之后：CRLF 开始下一部分，"--" 表示结束
+        MP_BOUNDARY_LF,   // 分隔符之后的 \n
+        MP_CLOSE,         // 结束分隔符的第二个 '-'
+        MP_HEAD,          // 部分的头部
+        MP_BODY,          // 部分的数据
+        MP_EPILOGUE       // 结束分隔符之后，丢弃
+    };
+
+    // 在数据中查找分隔符，分隔符之前的字节在 MP_BODY 状态下交给 on_data()；找到时返回 true
+    bool scan(const char *&p, const char *end, UPLOAD_STATUS &st);
+    UPLOAD_STATUS begin_part();
+
+   private:
+    part_handler *m_handler;
+    STATE m_state;
+    std::string m_delim;  // "\r\n--" + boundary
+    size_t m_match;       // 已匹配的分隔符前缀长度，可能跨越两次 feed()
+    std::string m_head;   // 当前部分的头部
+};
+
+/**
+ * @brief application/x-www-form-urlencoded 的增量解析器
+ *
+ * 边解析边解码 %XX 和 '+'，字段追加到 fields，名字和值合计超过 max_bytes 时返回 UPLOAD_TOO_LARGE。
+ */
+class urlencoded_parser {
+   public:
+    urlencoded_parser() : m_fields(NULL), m_max_bytes(0), m_bytes(0), m_in_value(false), m_hex(0), m_hex_digits(-1) {}
+
+    void init(std::vector<form_field> *fields, size_t max_bytes);
+    UPLOAD_STATUS feed(const char *data, size_t len);
+    UPLOAD_STATUS finish();
+
+   private:
+    UPLOAD_STATUS put(char c);
+    void end_field();
+
+   private:
+    std::vector<form_field> *m_fields;
+    size_t m_max_bytes;
+    size_t m_bytes;     // 已保存的字节数
+    form_field m_cur;   // 正在解析的字段
+    bool m_in_value;    // 已读到 '='
+    int m_hex;          // %XX 已读到的值
+    int m_hex_digits;   // %XX 已读到的十六进制位数，-1 表示不在 %XX 中
+};
+
+/**
+ * @brief 一个上传请求的解析状态
+ *
+ * 由解析请求的线程独占使用。文件数据经 64KB 写缓冲区 pwrite 到临时文件。
+ */
+class upload_session : private multipart_parser::part_handler {
+   public:
+    static const size_t WRITE_BUFFER = 64 * 1024;
+
+    explicit upload_session(const upload_limits &limits);
+    ~upload_session();
+
+    // 按请求的 Content-Type 选择解析器，不是两种表单类型或 multipart 缺少 boundary 时返回 false
+    bool start(std::string_view content_type);
+    // 解析下一段请求体
+    UPLOAD_STATUS feed(const char *data, size_t len);
+    // 请求体结束，返回 UPLOAD_DONE 后 form() 可用
+    UPLOAD_STATUS finish();
+    // 解析完成的表单，所有权交给调用者
+    std::shared_ptr<upload_form> form() { return m_form; }
+
+   private:
+    UPLOAD_STATUS on_part(std::string_view name, std::string_view filename, bool has_filename,
+                          std::string_view content_type) override;
+    UPLOAD_STATUS on_data(const char *data, size_t len) override;
+    UPLOAD_STATUS on_part_end() override;
+    // 把写缓冲区中的数据写入当前文件
+    UPLOAD_STATUS flush();
+
+   private:
+    const upload_limits &m_limits;  // 指向路由表，服务器运行期间有效
+    bool m_multipart;
+    multipart_parser m_multipart_parser;
+    urlencoded_parser m_urlencoded_parser;
+    std::shared_ptr<upload_form> m_form;
+    size_t m_body;              // 已收到的请求体字节数
+    size_t m_field_bytes;       // 普通字段已占用的字节数
+    form_field *m_field;        // 正在接收的普通字段
+    upload_file *m_file;        // 正在接收的文件
+    bool m_skip;                // 丢弃当前部分（未选择文件的文件控件）
+    char *m_buf;                // 写缓冲区，第一次收到文件数据时分配
+    size_t m_buf_len;           // 写缓冲区中的字节数
+    UPLOAD_STATUS m_status;     // 已出错时保留错误，之后的 feed() 直接返回
+};
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ * @file picture_routes.cpp
+ * @brief 图片上传接口的实现
+ */
+
+#include "picture_routes.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+static const size_t MAX_PICTURE = 8 << 20;  // 单张图片的上限
+
+static std::string g_dir;  // 保存图片的目录，启动时确定，之后只读
+
+// 按文件开头的魔数判断图片类型，返回扩展名；不是认识的图片时返回 NULL。
+// 不相信客户端给的文件名和 Content-Type
+static const char *picture_ext(const upload_file &f) {
+    unsigned char magic[12];
+    if (pread(f.fd(), magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)) return NULL;
+    if (magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF) return ".jpg";
+    if (memcmp(magic, "\x89PNG\r\n\x1a\n", 8) == 0) return ".png";
+    if (memcmp(magic, "GIF87a", 6) == 0 || memcmp(magic, "GIF89a", 6) == 0) return ".gif";
+    if (memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WEBP", 4) == 0) return ".webp";
+    return NULL;
+}
+
+static void upload_picture(http_request &req, http_response &res) {
+    upload_file *f = req.form ? req.form->file("picture") : NULL;
+    const char *ext = f ? picture_ext(*f) : NULL;
+    if (!ext) {
+        res.set_status(400);
+        res.send("Please choose a JPEG, PNG, GIF or WebP picture.\n");
+        return;
+    }
+    // 文件名由服务器生成，客户端给的文件名可能重复或带有特殊字符
+    static std::atomic<unsigned> seq(0);
+    char name[64];
+    snprintf(name, sizeof(name), "%ld-%u%s", (long)time(NULL), seq++, ext);
+    std::string path = g_dir + "/" + name;
+    if (!f->save(path.c_str())) {
+        res.set_status(500);
+        res.send("Failed to save the picture.\n");
+        return;
+    }
+    res.set_status(303);
+    res.set_header("Location", std::string("/uploads/") + name);
+    res.send("");
+}
+
+bool picture_routes(http_conn::router &r, const char *doc_root) {
+    g_dir = std::string(doc_root) + "/uploads";
+    // 目录建不起来时接口仍然注册，上传时创建临时文件失败，回复 500
+    mkdir(g_dir.c_str(), 0755);
+
+    upload_limits limits;
+    limits.max_body = MAX_PICTURE + 64 * 1024;  // 留出 multipart 头部和其他字段的余量
+    limits.max_file = MAX_PICTURE;
+    limits.max_files = 1;
+    limits.max_fields = 4096;
+    limits.dir = g_dir;  // 临时文件与目标在同一文件系统，保存只是建立链接
+    return http_conn::add_upload(r, "/upload/picture", 1 << http_conn::POST, HANDLER_INLINE, limits, upload_picture);
+}
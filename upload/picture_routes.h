@@ -0,0 +1,17 @@
+/**
+ * @file picture_routes.h
+ * @brief 图片上传接口
+ *
+ * 图片页面的表单以 multipart/form-data 提交到 /upload/picture，文件边读边写入临时文件，
+ * 确认是图片后保存到文档根目录下的 uploads/，回复 303 跳转到保存后的图片。
+ */
+
+#ifndef PICTURE_ROUTES_H
+#define PICTURE_ROUTES_H
+
+#include "../http/http_conn.h"
+
+// 向路由表注册图片上传接口，doc_root 为文档根目录；路由冲突时返回 false
+bool picture_routes(http_conn::router &r, const char *doc_root);
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * @file event_hub.cpp
+ * @brief 主事件循环接入点的实现
+ */
+
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include "event_hub.h"
+
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "../log/log.h"
+
+event_hub::event_hub() : m_epollfd(-1), m_eventfd(-1), m_close_log(0), m_loop_thread(0) {
+    memset(m_handlers, 0, sizeof(m_handlers));
+}
+
+bool event_hub::init(int epollfd, int close_log) {
+    m_epollfd = epollfd;
+    m_close_log = close_log;
+    m_loop_thread = pthread_self();
+    m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_eventfd < 0) {
+        LOG_ERROR("%s", "create eventfd failure");
+        return false;
+    }
+    // eventfd 不用 EPOLLONESHOT，读空计数后一直保持注册
+    epoll_event event;
+    event.data.fd = m_eventfd;
+    event.events = EPOLLIN;
+    return epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_eventfd, &event) == 0;
+}
+
+bool event_hub::add(int fd, uint32_t events, io_handler *handler) {
+    if (fd < 0 || fd >= MAX_FD) return false;
+    m_handlers[fd] = handler;
+    epoll_event event;
+    event.data.fd = fd;
+    event.events = events | EPOLLONESHOT;
+    if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        m_handlers[fd] = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool event_hub::adopt(int fd, uint32_t events, io_handler *handler) {
+    if (fd < 0 || fd >= MAX_FD) return false;
+    m_handlers[fd] = handler;
+    if (!mod(fd, events)) {
+        m_handlers[fd] = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool event_hub::mod(int fd, uint32_t events) {
+    epoll_event event;
+    event.data.fd = fd;
+    event.events = events | EPOLLONESHOT;
+    return epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void event_hub::del(int fd) {
+    if (fd < 0 || fd >= MAX_FD) return;
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, 0);
+    m_handlers[fd] = NULL;
+}
+
+bool event_hub::dispatch(int fd, uint32_t events) {
+    if (fd == m_eventfd) {
+        uint64_t count;
+        while (read(m_eventfd, &count, sizeof(count)) > 0) {
+        }
+        run_tasks();
+        return true;
+    }
+    if (fd < 0 || fd >= MAX_FD || !m_handlers[fd]) return false;
+    m_handlers[fd]->on_io(fd, events);
+    return true;
+}
+
+void event_hub::post(const std::function<void()> &task) {
+    m_task_lock.lock();
+    bool wake = m_tasks.empty();  // 队列非空说明已经唤醒过，还没来得及执行
+    m_tasks.push_back(task);
+    m_task_lock.unlock();
+    if (wake) {
+        uint64_t one = 1;
+        ::write(m_eventfd, &one, sizeof(one));
+    }
+}
+
+void event_hub::run_in_loop(const std::function<void()> &task) {
+    if (in_loop())
+        task();
+    else
+        post(task);
+}
+
+bool event_hub::in_loop() const { return pthread_equal(m_loop_thread, pthread_self()); }
+
+void event_hub::run_tasks() {
+    std::vector<std::function<void()> > tasks;
+    m_task_lock.lock();
+    tasks.swap(m_tasks);
+    m_task_lock.unlock();
+    for (size_t i = 0; i < tasks.size(); ++i) tasks[i]();
+}
+
+void event_hub::tick() {
+    for (size_t i = 0; i < m_ticks.size(); ++i) m_ticks[i]();
+}
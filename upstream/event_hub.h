@@ -0,0 +1,89 @@
+/**
+ * @file event_hub.h
+ * @brief 把客户端连接以外的 fd 接入主事件循环
+ *
+ * 反向代理等模块需要在主 epoll 中注册自己的 socket（上游连接、健康检查），事件到达时由主循环
+ * 回调对应的 io_handler，不再为每个模块单开线程。
+ * 主要特点：
+ * 1. 按 fd 下标保存处理者，主循环分派事件只需一次数组访问
+ * 2. 所有注册的 fd 都使用 EPOLLONESHOT，处理者每次显式地重新注册关心的事件
+ * 3. 其他线程通过 post() 投递任务，eventfd 唤醒主循环后在主循环线程中执行，
+ *    因此各模块的内部状态只在主循环线程中访问，不需要加锁
+ * 4. tick() 随定时器信号每 TIMESLOT 秒调用一次，用于健康检查和超时清理
+ */
+
+#ifndef EVENT_HUB_H
+#define EVENT_HUB_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "../lock/locker.h"
+
+// 事件处理者，回调在主循环线程中执行，不能阻塞
+class io_handler {
+   public:
+    virtual ~io_handler() {}
+    virtual void on_io(int fd, uint32_t events) = 0;
+};
+
+class event_hub {
+   public:
+    static const int MAX_FD = 65536;  // 与 webserver 的连接数上限一致
+
+    static event_hub *get_instance() {
+        static event_hub instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 绑定主循环的 epoll 实例并注册唤醒用的 eventfd，必须在主循环线程中调用
+     * @param epollfd 主循环的 epoll 文件描述符
+     * @param close_log 日志开关
+     */
+    bool init(int epollfd, int close_log);
+
+    // 注册 fd 并关心 events（会自动加上 EPOLLONESHOT），fd 需为非阻塞
+    bool add(int fd, uint32_t events, io_handler *handler);
+    // 接管已在主 epoll 中注册的 fd（例如升级为 WebSocket 的客户端连接），改由 handler 处理
+    bool adopt(int fd, uint32_t events, io_handler *handler);
+    // 重新注册 fd 关心的事件
+    bool mod(int fd, uint32_t events);
+    // 取消注册，不关闭 fd
+    void del(int fd);
+
+    // 主循环调用：fd 属于本模块时分派事件并返回 true
+    bool dispatch(int fd, uint32_t events);
+
+    // 投递任务到主循环线程执行，任何线程都可以调用
+    void post(const std::function<void()> &task);
+    // 在主循环线程中立即执行或投递：当前就在主循环线程时直接执行
+    void run_in_loop(const std::function<void()> &task);
+    bool in_loop() const;
+
+    // 注册周期回调，只能在启动阶段调用
+    void add_tick(const std::function<void()> &fn) { m_ticks.push_back(fn); }
+    // 主循环每 TIMESLOT 秒调用一次
+    void tick();
+
+   private:
+    event_hub();
+    ~event_hub() {}
+
+    // 执行投递过来的任务
+    void run_tasks();
+
+   private:
+    int m_epollfd;                                 // 主循环的 epoll
+    int m_eventfd;                                 // 唤醒主循环
+    int m_close_log;                               // 日志开关
+    pthread_t m_loop_thread;                       // 主循环线程，即调用 init() 的线程
+    io_handler *m_handlers[MAX_FD];                // fd -> 处理者
+    locker m_task_lock;                            // 保护 m_tasks
+    std::vector<std::function<void()> > m_tasks;   // 待执行的任务
+    std::vector<std::function<void()> > m_ticks;   // 周期回调
+};
+
+#endif
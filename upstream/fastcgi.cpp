@@ -0,0 +1,1018 @@
+/**
+ * @file fastcgi.cpp
+ * @brief FastCGI 客户端的实现
+ */
+
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include "fastcgi.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+
+#include "../log/log.h"
+
+// 记录类型，见 FastCGI 规范
+enum FCGI_TYPE {
+    FCGI_BEGIN_REQUEST = 1,
+    FCGI_ABORT_REQUEST = 2,
+    FCGI_END_REQUEST = 3,
+    FCGI_PARAMS = 4,
+    FCGI_STDIN = 5,
+    FCGI_STDOUT = 6,
+    FCGI_STDERR = 7,
+    FCGI_GET_VALUES = 9,
+    FCGI_GET_VALUES_RESULT = 10
+};
+
+// FCGI_END_REQUEST 的 protocolStatus
+enum FCGI_PROTOCOL_STATUS {
+    FCGI_REQUEST_COMPLETE = 0,
+    FCGI_CANT_MPX_CONN = 1,
+    FCGI_OVERLOADED = 2,
+    FCGI_UNKNOWN_ROLE = 3
+};
+
+static const int FCGI_VERSION_1 = 1;
+static const int FCGI_RESPONDER = 1;
+static const int FCGI_KEEP_CONN = 1;
+static const size_t FCGI_HEADER_LEN = 8;
+static const size_t FCGI_CHUNK = 32768;  // 流记录的分段大小，8 的倍数，不需要填充
+
+static const size_t MAX_CONNS = 16;            // 每个应用最多的连接数
+static const size_t MPX_LIMIT = 16;            // 支持多路复用时每条连接同时进行的请求数
+static const size_t MAX_PENDING = 1024;        // 排队等待连接的请求上限
+static const size_t MAX_HEAD_SIZE = 16 * 1024; // CGI 响应头的最大长度
+static const size_t MAX_BACKLOG = 256 * 1024;  // 客户端发送缓冲区积压超过该值时暂停读连接
+static const size_t MAX_BODY_BACKLOG = 256 * 1024;  // 请求体还没写进连接的字节数超过该值时暂停读客户端
+static const size_t MAX_CHUNKED_BODY = 8 * 1024 * 1024;  // 分块请求体要收齐才知道 CONTENT_LENGTH，最多缓存这么多
+static const time_t SESSION_TIMEOUT = 60;      // 请求多久没有任何进展视为超时（秒）
+static const int MAX_TRIES = 2;                // 连接失效时幂等请求最多尝试的次数
+
+static void append_record(std::string &out, int type, int id, const char *data, size_t len) {
+    size_t pad = (8 - len % 8) % 8;
+    unsigned char h[FCGI_HEADER_LEN] = {(unsigned char)FCGI_VERSION_1, (unsigned char)type,
+                                        (unsigned char)(id >> 8),      (unsigned char)id,
+                                        (unsigned char)(len >> 8),     (unsigned char)len,
+                                        (unsigned char)pad,            0};
+    out.append((const char *)h, sizeof(h));
+    out.append(data, len);
+    out.append(pad, '\0');
+}
+
+// 流记录按 FCGI_CHUNK 分段
+static void append_records(std::string &out, int type, int id, std::string_view data) {
+    for (size_t pos = 0; pos < data.size(); pos += FCGI_CHUNK) {
+        size_t n = data.size() - pos < FCGI_CHUNK ? data.size() - pos : FCGI_CHUNK;
+        append_record(out, type, id, data.data() + pos, n);
+    }
+}
+
+// 完整的流：分段后以一个空记录结束
+static void append_stream(std::string &out, int type, int id, std::string_view data) {
+    append_records(out, type, id, data);
+    append_record(out, type, id, "", 0);
+}
+
+// 名值对的长度：小于 128 用 1 字节，否则 4 字节且最高位为 1
+static void append_length(std::string &out, size_t len) {
+    if (len < 128) {
+        out.push_back((char)len);
+        return;
+    }
+    unsigned char b[4] = {(unsigned char)((len >> 24) | 0x80), (unsigned char)(len >> 16), (unsigned char)(len >> 8),
+                          (unsigned char)len};
+    out.append((const char *)b, 4);
+}
+
+static void append_param(std::string &out, std::string_view name, std::string_view value) {
+    append_length(out, name.size());
+    append_length(out, value.size());
+    out.append(name.data(), name.size());
+    out.append(value.data(), value.size());
+}
+
+static bool read_length(std::string_view &in, size_t &len) {
+    if (in.empty()) return false;
+    unsigned char c = in[0];
+    if (c < 128) {
+        len = c;
+        in.remove_prefix(1);
+        return true;
+    }
+    if (in.size() < 4) return false;
+    len = ((size_t)(c & 0x7f) << 24) | ((size_t)(unsigned char)in[1] << 16) | ((size_t)(unsigned char)in[2] << 8) |
+          (unsigned char)in[3];
+    in.remove_prefix(4);
+    return true;
+}
+
+static bool ieq(std::string_view a, const char *b) {
+    size_t n = strlen(b);
+    return a.size() == n && strncasecmp(a.data(), b, n) == 0;
+}
+
+static std::string_view trim(std::string_view v) {
+    while (!v.empty() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+    while (!v.empty() && (v.back() == ' ' || v.back() == '\t' || v.back() == '\r')) v.remove_suffix(1);
+    return v;
+}
+
+class fcgi_conn;
+class fcgi_session;
+
+// 一个 FastCGI 应用：连接池和等待连接的请求队列
+class fcgi_app {
+   public:
+    fcgi_app(const std::string &prefix, const std::string &doc_root, const sockaddr_un &addr, int close_log)
+        : prefix(prefix), doc_root(doc_root), m_addr(addr), m_mpx_limit(1), m_probed(false), m_close_log(close_log) {}
+
+    void submit(const std::shared_ptr<fcgi_session> &session);  // 排队，之后调用 schedule()
+    void schedule();                                           // 把排队的请求分配到有空位的连接
+    void conn_closed(fcgi_conn *conn);
+    void set_mpx(bool mpx);
+    size_t mpx_limit() const { return m_mpx_limit; }
+    void tick(time_t now);
+
+    std::string prefix;    // 路由前缀，用于日志
+    std::string doc_root;  // 所属虚拟主机的文档根目录，用于生成 SCRIPT_FILENAME
+
+   private:
+    fcgi_conn *open(bool probe);
+
+   private:
+    sockaddr_un m_addr;                                   // 应用的 Unix socket 地址
+    size_t m_mpx_limit;                                   // 每条连接同时进行的请求数
+    bool m_probed;                                        // 是否已询问过 FCGI_MPXS_CONNS
+    std::vector<fcgi_conn *> m_conns;                     // 所有连接，包括探测连接
+    std::deque<std::shared_ptr<fcgi_session> > m_pending;  // 等待连接的请求
+    int m_close_log;                                      // 日志开关
+};
+
+// 到应用的一条连接
+class fcgi_conn : public io_handler {
+   public:
+    fcgi_conn(fcgi_app *app, int fd, bool connecting, bool probe, int close_log)
+        : m_app(app),
+          m_fd(fd),
+          m_connecting(connecting),
+          m_probe(probe),
+          m_paused(0),
+          m_opened(time(NULL)),
+          m_out_sent(0),
+          m_close_log(close_log) {}
+
+    void on_io(int fd, uint32_t events);
+
+    void start(const std::shared_ptr<fcgi_session> &session);  // 分配请求编号并编码请求
+    void send_stdin(uint16_t id, std::string_view data, bool end);  // 追加后到的请求体，end 时结束 FCGI_STDIN
+    void abort_request(uint16_t id);                           // 放弃一个请求，之后它的输出都丢弃
+    void pause() { ++m_paused; }                               // 某个请求的客户端积压过多，暂停读
+    void resume();
+    bool check_timeouts(time_t now);                           // 返回 false 表示连接已关闭
+    void send_get_values();
+
+    size_t active() const { return m_slots.size(); }
+    bool probe() const { return m_probe; }
+
+   private:
+    struct slot {
+        uint16_t id;                            // 请求编号
+        std::shared_ptr<fcgi_session> session;  // 为空表示已放弃，等待 FCGI_END_REQUEST
+    };
+
+    bool flush();
+    bool read();
+    bool parse();
+    bool handle(int type, uint16_t id, std::string_view content);
+    void update();
+    void close_conn(const char *why);  // 释放连接对象，调用后不能再访问成员
+    slot *find(uint16_t id);
+
+   private:
+    fcgi_app *m_app;            // 所属应用
+    int m_fd;                   // Unix socket
+    bool m_connecting;          // 是否还在建立连接
+    bool m_probe;               // 只用于询问 FCGI_MPXS_CONNS
+    int m_paused;               // 暂停读的请求数
+    time_t m_opened;            // 建立时间
+    std::string m_out;          // 待发送的记录
+    size_t m_out_sent;          // m_out 中已发送的字节数
+    std::string m_in;           // 尚未组成完整记录的数据
+    std::vector<slot> m_slots;  // 进行中的请求
+    int m_close_log;            // 日志开关
+};
+
+// 一次 FastCGI 请求
+class fcgi_session : public stream_owner, public body_reader, public std::enable_shared_from_this<fcgi_session> {
+   public:
+    fcgi_session(fcgi_app *app, const std::shared_ptr<http_response> &res, std::string &params, std::string_view body,
+                 bool idempotent, int close_log)
+        : last_active(time(NULL)),
+          m_app(app),
+          m_res(res),
+          m_body(body),
+          m_body_open(false),
+          m_body_length(0),
+          m_body_sent(false),
+          m_body_unsent(0),
+          m_body_queued(0),
+          m_want_body(false),
+          m_idempotent(idempotent),
+          m_tries(0),
+          m_conn(NULL),
+          m_id(0),
+          m_state(S_WAIT),
+          m_remaining(-1),
+          m_got_output(false),
+          m_paused(false),
+          m_want_drain(false),
+          m_close_log(close_log) {
+        m_params.swap(params);
+    }
+
+    void bind(fcgi_conn *conn, uint16_t id);
+    void detach() { m_conn = NULL; }
+    void encode(std::string &out, uint16_t id);
+    // 请求体还在从客户端读，length 为 Content-Length，分块传输时为 -1。在读请求的线程中调用
+    void open_body(long length);
+    bool on_body(std::string_view data);  // 读请求的线程
+    void on_body_end(bool complete);      // 读请求的线程
+    void body_drained();                  // 连接的发送缓冲区已发空
+    void on_stdout(std::string_view data);
+    void on_end(int protocol_status);
+    void on_conn_lost();
+    void on_drain();
+    void fail(int status, const char *why);
+    bool finished() const { return m_state == S_DONE || m_state == S_DISCARD; }
+    bool paused() const { return m_paused; }
+    void unpause() { m_paused = false; }
+
+    time_t last_active;  // 最近一次有进展的时间
+
+   private:
+    enum STATE {
+        S_WAIT = 0,  // 排队等待连接
+        S_HEAD,      // 读取 CGI 响应头
+        S_BODY,      // 转发响应体
+        S_DISCARD,   // 客户端已断开或已回复错误，丢弃剩余输出
+        S_DONE       // 已结束
+    };
+
+    bool parse_head(std::string_view head);
+    void write(std::string_view data);
+    void resume();
+    void append_body(const std::string &data);
+    void close_body(bool complete);
+    void end_stdin();
+
+   private:
+    fcgi_app *m_app;                       // 所属应用
+    std::shared_ptr<http_response> m_res;  // 推迟完成的响应
+    std::string m_params;                  // 编码好的 FCGI_PARAMS 内容
+    std::string m_body;                    // 请求体；流式读取时为还没交给连接的部分
+    bool m_body_open;                      // 请求体还在从客户端读
+    long m_body_length;                    // 流式请求体的 Content-Length，分块传输时为 -1
+    bool m_body_sent;                      // 部分请求体已交给连接且不再保留，不能重试
+    size_t m_body_unsent;                  // 交给连接后还没确认发出的请求体字节数
+    std::atomic<size_t> m_body_queued;     // 已从客户端读到而还没发给应用的请求体字节数
+    std::atomic<bool> m_want_body;         // 读请求的线程因积压暂停，等待 resume_body()
+    bool m_idempotent;                     // 连接失效时可以安全重试
+    int m_tries;                           // 已尝试次数
+    fcgi_conn *m_conn;                     // 当前连接
+    uint16_t m_id;                         // 当前请求编号
+    STATE m_state;                         // 状态
+    std::string m_head;                    // CGI 响应头缓冲
+    std::string m_reason;                  // 原因短语，http_response 只保存指针
+    long m_remaining;                      // 应用给出 Content-Length 时剩余的字节数，否则为 -1
+    bool m_got_output;                     // 是否收到过输出
+    bool m_paused;                         // 因客户端积压暂停读连接
+    std::atomic<bool> m_want_drain;        // 等待客户端发送缓冲区发空
+    int m_close_log;                       // 日志开关
+};
+
+void fcgi_session::bind(fcgi_conn *conn, uint16_t id) {
+    m_conn = conn;
+    m_id = id;
+    m_state = S_HEAD;
+    ++m_tries;
+    last_active = time(NULL);
+}
+
+void fcgi_session::encode(std::string &out, uint16_t id) {
+    char begin[8] = {0, (char)FCGI_RESPONDER, (char)FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+    out.reserve(out.size() + 64 + m_params.size() + m_body.size() + m_body.size() / FCGI_CHUNK * 8);
+    append_record(out, FCGI_BEGIN_REQUEST, id, begin, sizeof(begin));
+    append_stream(out, FCGI_PARAMS, id, m_params);
+    if (!m_body_open) {
+        append_stream(out, FCGI_STDIN, id, m_body);  // 请求体已经完整，连接失效时可以重新编码
+        return;
+    }
+    // 请求体还在读：先写出已经到达的部分，后面的由 append_body 经 send_stdin 追加
+    append_records(out, FCGI_STDIN, id, m_body);
+    m_body_unsent += m_body.size();
+    std::string().swap(m_body);
+    m_body_sent = true;
+}
+
+void fcgi_session::open_body(long length) {
+    m_body_open = true;
+    m_body_length = length;
+}
+
+// 请求体经主循环交给会话，与响应方向一样只在主循环线程中访问会话状态。
+// 积压超过 MAX_BODY_BACKLOG 时返回 false 让连接暂停读客户端，连接发空后由 body_drained 恢复
+bool fcgi_session::on_body(std::string_view data) {
+    std::shared_ptr<fcgi_session> self = shared_from_this();
+    std::string chunk(data);
+    event_hub::get_instance()->post([self, chunk]() { self->append_body(chunk); });
+    if (m_body_length < 0) return true;  // 分块请求体在会话中攒齐，由 MAX_CHUNKED_BODY 限制
+    m_body_queued += data.size();
+    // 先声明等待再复查积压，避免在两步之间发完而错过恢复
+    if (m_body_queued > MAX_BODY_BACKLOG) {
+        m_want_body = true;
+        if (m_body_queued > MAX_BODY_BACKLOG) return false;
+        m_want_body = false;
+    }
+    return true;
+}
+
+void fcgi_session::on_body_end(bool complete) {
+    std::shared_ptr<fcgi_session> self = shared_from_this();
+    event_hub::get_instance()->post([self, complete]() { self->close_body(complete); });
+}
+
+void fcgi_session::append_body(const std::string &data) {
+    if (finished() || !m_body_open) return;  // 已结束，积压不再减少，读请求的线程随之暂停
+    last_active = time(NULL);
+    if (m_conn) {
+        m_conn->send_stdin(m_id, data, false);
+        m_body_unsent += data.size();
+        return;
+    }
+    m_body.append(data);  // 还在排队或分块请求体还没收齐
+    if (m_body_length < 0 && m_body.size() > MAX_CHUNKED_BODY) fail(413, "chunked request body too large");
+}
+
+void fcgi_session::close_body(bool complete) {
+    if (finished() || !m_body_open) return;
+    if (!complete) {
+        fail(502, "client request body incomplete");
+        return;
+    }
+    last_active = time(NULL);
+    m_body_open = false;
+    if (m_body_length < 0) {
+        // 分块请求体收齐后长度才确定，这时才开始排队
+        append_param(m_params, "CONTENT_LENGTH", std::to_string(m_body.size()));
+        m_app->submit(shared_from_this());
+        m_app->schedule();
+        return;
+    }
+    if (m_conn) m_conn->send_stdin(m_id, std::string_view(), true);
+}
+
+void fcgi_session::body_drained() {
+    if (m_body_unsent == 0) return;
+    m_body_queued -= m_body_unsent;
+    m_body_unsent = 0;
+    if (m_body_queued <= MAX_BODY_BACKLOG && m_want_body.exchange(false)) m_res->resume_body();
+}
+
+// 请求提前结束时，应用可能还在等请求体：结束 FCGI_STDIN，不再转发剩下的部分
+void fcgi_session::end_stdin() {
+    if (m_body_open && m_conn) m_conn->send_stdin(m_id, std::string_view(), true);
+    m_body_open = false;
+}
+
+void fcgi_session::on_stdout(std::string_view data) {
+    last_active = time(NULL);
+    m_got_output = true;
+    if (m_state == S_BODY) {
+        write(data);
+        return;
+    }
+    if (m_state != S_HEAD) return;
+
+    m_head.append(data.data(), data.size());
+    // CGI 头部以空行结束，应用可能只用 \n 换行
+    size_t end = m_head.find("\r\n\r\n"), skip = 4;
+    size_t lf = m_head.find("\n\n");
+    if (lf != std::string::npos && (end == std::string::npos || lf < end)) {
+        end = lf;
+        skip = 2;
+    }
+    if (end == std::string::npos) {
+        if (m_head.size() > MAX_HEAD_SIZE) fail(502, "header too large");
+        return;
+    }
+    std::string head;
+    head.swap(m_head);
+    if (!parse_head(std::string_view(head.data(), end))) {
+        fail(502, "bad header");
+        return;
+    }
+    m_state = S_BODY;
+    m_res->attach(shared_from_this());  // 接收发送缓冲区发空的通知，用于背压
+    write(std::string_view(head.data() + end + skip, head.size() - end - skip));
+}
+
+bool fcgi_session::parse_head(std::string_view head) {
+    int status = 200;
+    bool has_status = false, has_location = false;
+    size_t pos = 0;
+    while (pos < head.size()) {
+        size_t next = head.find('\n', pos);
+        if (next == std::string_view::npos) next = head.size();
+        std::string_view line = head.substr(pos, next - pos);
+        pos = next + 1;
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = trim(line.substr(0, colon));
+        std::string_view value = trim(line.substr(colon + 1));
+        if (ieq(name, "Status")) {
+            // "404 Not Found"
+            if (value.size() < 3) return false;
+            status = atoi(std::string(value.substr(0, 3)).c_str());
+            if (status < 100 || status > 999) return false;
+            m_reason = std::string(trim(value.substr(3)));
+            has_status = true;
+        } else if (ieq(name, "Content-Type")) {
+            m_res->set_content_type(value);
+        } else if (ieq(name, "Content-Length")) {
+            m_remaining = strtol(std::string(value).c_str(), NULL, 10);
+            if (m_remaining < 0) return false;
+            m_res->set_content_length(m_remaining);
+        } else if (ieq(name, "Connection") || ieq(name, "Transfer-Encoding") || ieq(name, "Keep-Alive")) {
+            // 逐跳头部由服务器自己生成
+        } else {
+            if (ieq(name, "Location")) has_location = true;
+            m_res->set_header(name, value);
+        }
+    }
+    if (!has_status && has_location) status = 302;  // CGI 规范：只有 Location 时为重定向
+    m_res->set_status(status, m_reason.empty() ? NULL : m_reason.c_str());
+    return true;
+}
+
+void fcgi_session::write(std::string_view data) {
+    if (m_remaining >= 0) {  // 多出声明长度的部分丢弃
+        if ((long)data.size() > m_remaining) data = data.substr(0, m_remaining);
+        m_remaining -= data.size();
+    }
+    if (!m_res->write(data)) {
+        // 客户端已经断开，剩余输出丢弃
+        m_state = S_DISCARD;
+        end_stdin();
+        if (m_conn) m_conn->abort_request(m_id);
+        return;
+    }
+    // 客户端跟不上时暂停读这条连接，发送缓冲区发空后由 on_drain 恢复。
+    // 先声明等待再复查积压，避免在两步之间发空而错过通知
+    if (m_res->backlog() > MAX_BACKLOG && m_conn) {
+        m_want_drain = true;
+        if (m_res->backlog() > MAX_BACKLOG) {
+            m_paused = true;
+            m_conn->pause();
+            return;
+        }
+        m_want_drain = false;
+    }
+}
+
+void fcgi_session::on_drain() {
+    if (!m_want_drain.exchange(false)) return;
+    std::shared_ptr<fcgi_session> self = shared_from_this();
+    event_hub::get_instance()->post([self]() { self->resume(); });
+}
+
+void fcgi_session::resume() {
+    last_active = time(NULL);
+    if (!m_paused) return;
+    m_paused = false;
+    if (m_conn) m_conn->resume();
+}
+
+void fcgi_session::on_end(int protocol_status) {
+    m_conn = NULL;
+    m_body_open = false;  // 应用没读完请求体就结束了请求，剩下的部分不再转发
+    if (finished()) {
+        m_state = S_DONE;
+        return;
+    }
+    if (protocol_status == FCGI_CANT_MPX_CONN && !m_got_output && !m_body_sent) {
+        // 应用实际不支持多路复用，退回每条连接一个请求后重新排队
+        m_app->set_mpx(false);
+        m_state = S_WAIT;
+        m_app->submit(shared_from_this());
+        return;
+    }
+    if (protocol_status == FCGI_OVERLOADED) {
+        fail(503, "application overloaded");
+        return;
+    }
+    if (protocol_status != FCGI_REQUEST_COMPLETE) {
+        fail(502, "request rejected");
+        return;
+    }
+    if (m_state == S_HEAD) {
+        fail(502, "incomplete header");
+        return;
+    }
+    if (m_remaining > 0) {
+        fail(502, "response shorter than Content-Length");
+        return;
+    }
+    m_res->end();
+    m_state = S_DONE;
+}
+
+// 应用回收了空闲连接等情况下，还没有任何输出的幂等请求换一条连接重试
+void fcgi_session::on_conn_lost() {
+    m_conn = NULL;
+    m_paused = false;
+    if (finished()) {
+        m_state = S_DONE;
+        return;
+    }
+    if (!m_got_output && !m_body_sent && m_idempotent && m_tries < MAX_TRIES) {
+        m_state = S_WAIT;
+        m_app->submit(shared_from_this());
+        return;
+    }
+    fail(502, "connection lost");
+}
+
+void fcgi_session::fail(int status, const char *why) {
+    LOG_ERROR("fastcgi %s: %s", m_app->prefix.c_str(), why);
+    if (m_state == S_WAIT || m_state == S_HEAD) {
+        m_res->set_status(status);
+        m_res->set_content_type("text/plain; charset=utf-8");
+        if (status == 503)
+            m_res->send("Service Unavailable\n");
+        else if (status == 413)
+            m_res->send("Payload Too Large\n");
+        else if (status == 504)
+            m_res->send("Gateway Timeout\n");
+        else
+            m_res->send("Bad Gateway\n");
+    } else {
+        m_res->abort();  // 响应头已经发出，只能断开连接
+    }
+    m_state = S_DISCARD;
+    end_stdin();
+    if (m_conn) m_conn->abort_request(m_id);
+}
+
+void fcgi_conn::on_io(int, uint32_t events) {
+    if (m_connecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err || (events & EPOLLERR)) {
+            close_conn("connect");
+            return;
+        }
+        m_connecting = false;
+    }
+    if (!flush()) return;
+    if (m_paused > 0) {
+        // 暂停期间不读；挂断事件留到恢复后再处理，这里不重新注册读事件以免反复触发
+        if (m_out_sent < m_out.size()) update();
+        return;
+    }
+    if (!read()) return;
+    update();
+}
+
+bool fcgi_conn::flush() {
+    if (m_connecting) return true;
+    while (m_out_sent < m_out.size()) {
+        ssize_t n = send(m_fd, m_out.data() + m_out_sent, m_out.size() - m_out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return true;
+            close_conn("send");
+            return false;
+        }
+        m_out_sent += n;
+    }
+    if (m_out.capacity() > 1024 * 1024)
+        std::string().swap(m_out);  // 大请求体的缓冲区不长期占用
+    else
+        m_out.clear();
+    m_out_sent = 0;
+    // 请求体的积压已经写进 socket，暂停读客户端的请求可以继续
+    for (size_t i = 0; i < m_slots.size(); ++i)
+        if (m_slots[i].session) m_slots[i].session->body_drained();
+    return true;
+}
+
+bool fcgi_conn::read() {
+    char *buf = fcgi_engine::get_instance()->buffer();
+    while (m_paused == 0) {
+        ssize_t n = recv(m_fd, buf, fcgi_engine::BUFFER_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return true;
+            close_conn("recv");
+            return false;
+        }
+        if (n == 0) {
+            // 空闲连接被应用回收是正常的，不记日志
+            close_conn(m_slots.empty() ? NULL : "closed by application");
+            return false;
+        }
+        m_in.append(buf, n);
+        if (!parse()) return false;
+    }
+    return true;
+}
+
+bool fcgi_conn::parse() {
+    size_t pos = 0;
+    while (m_paused == 0 && m_in.size() - pos >= FCGI_HEADER_LEN) {
+        const unsigned char *h = (const unsigned char *)m_in.data() + pos;
+        if (h[0] != FCGI_VERSION_1) {
+            close_conn("bad record version");
+            return false;
+        }
+        size_t len = ((size_t)h[4] << 8) | h[5];
+        size_t total = FCGI_HEADER_LEN + len + h[6];
+        if (m_in.size() - pos < total) break;
+        int type = h[1];
+        uint16_t id = (uint16_t)((h[2] << 8) | h[3]);
+        std::string_view content(m_in.data() + pos + FCGI_HEADER_LEN, len);
+        pos += total;
+        if (!handle(type, id, content)) return false;
+    }
+    m_in.erase(0, pos);
+    return true;
+}
+
+bool fcgi_conn::handle(int type, uint16_t id, std::string_view content) {
+    switch (type) {
+        case FCGI_STDOUT: {
+            slot *s = find(id);
+            if (s && s->session && !content.empty()) {
+                std::shared_ptr<fcgi_session> session = s->session;  // 处理中可能被 abort_request 释放
+                session->on_stdout(content);
+            }
+            return true;
+        }
+        case FCGI_STDERR:
+            if (!content.empty()) {
+                std::string text(content);  // 二进制日志按 '\0' 取字符串长度
+                LOG_WARN("fastcgi %s stderr: %s", m_app->prefix.c_str(), text.c_str());
+            }
+            return true;
+        case FCGI_END_REQUEST: {
+            if (content.size() < 8) {
+                close_conn("bad end request");
+                return false;
+            }
+            int protocol_status = (unsigned char)content[4];
+            for (size_t i = 0; i < m_slots.size(); ++i) {
+                if (m_slots[i].id != id) continue;
+                std::shared_ptr<fcgi_session> session = m_slots[i].session;
+                m_slots.erase(m_slots.begin() + i);
+                if (session) session->on_end(protocol_status);
+                m_app->schedule();  // 空出了位置
+                break;
+            }
+            return true;
+        }
+        case FCGI_GET_VALUES_RESULT: {
+            std::string_view in = content;
+            size_t name_len, value_len;
+            while (read_length(in, name_len) && read_length(in, value_len) && in.size() >= name_len + value_len) {
+                std::string_view name = in.substr(0, name_len);
+                std::string_view value = in.substr(name_len, value_len);
+                in.remove_prefix(name_len + value_len);
+                if (name == "FCGI_MPXS_CONNS") m_app->set_mpx(value == "1");
+            }
+            if (m_probe) {
+                close_conn(NULL);
+                return false;
+            }
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
+// 读事件在没有暂停时一直关注，空闲连接被应用关闭时可以及时发现
+void fcgi_conn::update() {
+    uint32_t events = 0;
+    if (m_paused == 0) events |= EPOLLIN | EPOLLRDHUP;
+    if (m_connecting || m_out_sent < m_out.size()) events |= EPOLLOUT;
+    if (events) event_hub::get_instance()->mod(m_fd, events);
+}
+
+fcgi_conn::slot *fcgi_conn::find(uint16_t id) {
+    for (size_t i = 0; i < m_slots.size(); ++i)
+        if (m_slots[i].id == id) return &m_slots[i];
+    return NULL;
+}
+
+void fcgi_conn::start(const std::shared_ptr<fcgi_session> &session) {
+    uint16_t id = 1;
+    while (find(id)) ++id;
+    slot s;
+    s.id = id;
+    s.session = session;
+    m_slots.push_back(s);
+    session->bind(this, id);
+    session->encode(m_out, id);
+    update();
+}
+
+void fcgi_conn::send_stdin(uint16_t id, std::string_view data, bool end) {
+    append_records(m_out, FCGI_STDIN, id, data);
+    if (end) append_record(m_out, FCGI_STDIN, id, "", 0);
+    update();
+}
+
+void fcgi_conn::send_get_values() {
+    std::string body;
+    append_param(body, "FCGI_MPXS_CONNS", "");
+    append_record(m_out, FCGI_GET_VALUES, 0, body.data(), body.size());
+}
+
+// 多路复用的连接上发送 FCGI_ABORT_REQUEST，不影响同一连接上的其他请求；
+// 否则继续读完这个请求的输出再复用连接
+void fcgi_conn::abort_request(uint16_t id) {
+    if (m_app->mpx_limit() <= 1) return;
+    slot *s = find(id);
+    if (!s || !s->session) return;
+    s->session->detach();
+    s->session.reset();
+    append_record(m_out, FCGI_ABORT_REQUEST, id, "", 0);
+    update();
+}
+
+void fcgi_conn::resume() {
+    if (m_paused > 0) --m_paused;
+    if (m_paused > 0) return;
+    if (!parse()) return;  // 先处理暂停时已经读到的数据
+    update();
+}
+
+bool fcgi_conn::check_timeouts(time_t now) {
+    if (m_probe) {
+        // 应用不回答 FCGI_GET_VALUES，保持按不支持多路复用处理
+        if (now - m_opened > SESSION_TIMEOUT) {
+            close_conn(NULL);
+            return false;
+        }
+        return true;
+    }
+    bool unpaused = false;
+    std::vector<slot> slots = m_slots;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        std::shared_ptr<fcgi_session> session = slots[i].session;
+        if (!session || session->finished() || now - session->last_active <= SESSION_TIMEOUT) continue;
+        if (m_app->mpx_limit() <= 1) {
+            // 一条连接只跑一个请求，直接关闭连接让应用停止处理
+            close_conn("timeout");
+            return false;
+        }
+        if (session->paused()) {
+            session->unpause();
+            --m_paused;
+            unpaused = true;
+        }
+        session->fail(504, "timeout");  // 多路复用时发送 FCGI_ABORT_REQUEST
+    }
+    if (unpaused && m_paused == 0) {
+        if (!parse()) return false;
+        update();
+    }
+    return true;
+}
+
+void fcgi_conn::close_conn(const char *why) {
+    if (why) LOG_WARN("fastcgi %s: %s", m_app->prefix.c_str(), why);
+    fcgi_app *app = m_app;
+    app->conn_closed(this);
+    event_hub::get_instance()->del(m_fd);
+    close(m_fd);
+    std::vector<slot> slots;
+    slots.swap(m_slots);
+    delete this;
+    for (size_t i = 0; i < slots.size(); ++i)
+        if (slots[i].session) slots[i].session->on_conn_lost();
+    app->schedule();  // 重试的请求换新连接
+}
+
+void fcgi_app::submit(const std::shared_ptr<fcgi_session> &session) {
+    if (m_pending.size() >= MAX_PENDING) {
+        session->fail(503, "queue full");
+        return;
+    }
+    m_pending.push_back(session);
+}
+
+void fcgi_app::schedule() {
+    if (!m_probed) {
+        // 单独用一条连接询问是否支持多路复用：有的应用（如 php-fpm）回答后就关闭连接。结果到达前按不支持处理
+        m_probed = true;
+        fcgi_conn *probe = open(true);
+        if (probe) probe->send_get_values();
+    }
+    while (!m_pending.empty()) {
+        fcgi_conn *conn = NULL;
+        size_t workers = 0;
+        for (size_t i = 0; i < m_conns.size(); ++i) {
+            if (m_conns[i]->probe()) continue;
+            ++workers;
+            if (!conn && m_conns[i]->active() < m_mpx_limit) conn = m_conns[i];
+        }
+        if (!conn && workers < MAX_CONNS) conn = open(false);
+        if (!conn) {
+            if (workers > 0) break;  // 等待连接空出位置
+            std::shared_ptr<fcgi_session> session = m_pending.front();
+            m_pending.pop_front();
+            session->fail(502, "cannot connect");
+            continue;
+        }
+        std::shared_ptr<fcgi_session> session = m_pending.front();
+        m_pending.pop_front();
+        if (session->finished()) continue;  // 排队期间已经失败（如客户端的请求体没有读完）
+        conn->start(session);
+    }
+}
+
+fcgi_conn *fcgi_app::open(bool probe) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+    int ret = connect(fd, (struct sockaddr *)&m_addr, sizeof(m_addr));
+    if (ret < 0 && errno != EINPROGRESS) {
+        LOG_WARN("fastcgi %s: connect %s: %s", prefix.c_str(), m_addr.sun_path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    fcgi_conn *conn = new fcgi_conn(this, fd, ret < 0, probe, m_close_log);
+    if (!event_hub::get_instance()->add(fd, EPOLLOUT, conn)) {
+        close(fd);
+        delete conn;
+        return NULL;
+    }
+    m_conns.push_back(conn);
+    return conn;
+}
+
+void fcgi_app::conn_closed(fcgi_conn *conn) {
+    for (size_t i = 0; i < m_conns.size(); ++i) {
+        if (m_conns[i] == conn) {
+            m_conns.erase(m_conns.begin() + i);
+            return;
+        }
+    }
+}
+
+void fcgi_app::set_mpx(bool mpx) {
+    size_t limit = mpx ? MPX_LIMIT : 1;
+    if (limit == m_mpx_limit) return;
+    m_mpx_limit = limit;
+    LOG_INFO("fastcgi %s: multiplexing %s", prefix.c_str(), mpx ? "on" : "off");
+    schedule();
+}
+
+void fcgi_app::tick(time_t now) {
+    while (!m_pending.empty() && now - m_pending.front()->last_active > SESSION_TIMEOUT) {
+        std::shared_ptr<fcgi_session> session = m_pending.front();
+        m_pending.pop_front();
+        if (!session->finished()) session->fail(504, "timeout in queue");
+    }
+    std::vector<fcgi_conn *> conns = m_conns;  // 检查过程中连接可能被关闭
+    for (size_t i = 0; i < conns.size(); ++i) conns[i]->check_timeouts(now);
+}
+
+fcgi_engine::~fcgi_engine() {
+    for (size_t i = 0; i < m_apps.size(); ++i) delete m_apps[i];
+}
+
+bool fcgi_engine::configure(http_conn::router &r, const std::vector<std::string> &specs, const char *doc_root,
+                            int close_log) {
+    m_close_log = close_log;
+    for (size_t i = 0; i < specs.size(); ++i) {
+        const std::string &spec = specs[i];
+        size_t eq = spec.find('=');
+        if (eq == std::string::npos || spec[0] != '/') return false;
+        std::string prefix = spec.substr(0, eq);
+        std::string path = spec.substr(eq + 1);
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+        memcpy(addr.sun_path, path.c_str(), path.size());
+
+        while (prefix.size() > 1 && prefix[prefix.size() - 1] == '/') prefix.erase(prefix.size() - 1);
+        fcgi_app *app = new fcgi_app(prefix, doc_root, addr, close_log);
+        m_apps.push_back(app);
+
+        handler_fn fn = [app](http_request &req, http_response &res) {
+            fcgi_engine::get_instance()->forward(app, req, res);
+        };
+        std::string pattern = prefix;
+        // 请求体边读边以 FCGI_STDIN 转发，不受读缓冲区大小限制
+        if (pattern != "/" && !http_conn::add_body_stream(r, pattern.c_str(), ~0, fn)) return false;
+        if (pattern[pattern.size() - 1] != '/') pattern += '/';
+        pattern += "*rest";
+        if (!http_conn::add_body_stream(r, pattern.c_str(), ~0, fn)) return false;
+        LOG_INFO("fastcgi %s -> %s", prefix.c_str(), path.c_str());
+    }
+    if (!specs.empty() && !m_started) {
+        m_started = true;
+        event_hub::get_instance()->add_tick([this]() { tick(); });
+    }
+    return true;
+}
+
+void fcgi_engine::forward(fcgi_app *app, http_request &req, http_response &res) {
+    // SCRIPT_FILENAME 是文档根目录加请求路径，含 ".." 的路径会让应用执行根目录之外的脚本
+    if (!http_conn::safe_path(req.path.data(), req.path.size())) {
+        res.set_status(404);
+        res.send("The requested file was not found on this server.\n");
+        return;
+    }
+    std::string params;
+    params.reserve(1024);
+    std::string uri(req.path);
+    if (!req.query.empty()) uri.append("?").append(req.query);
+
+    append_param(params, "GATEWAY_INTERFACE", "CGI/1.1");
+    append_param(params, "SERVER_SOFTWARE", "TinyWebServer");
+    append_param(params, "SERVER_PROTOCOL", req.version);
+    append_param(params, "REQUEST_METHOD", req.method);
+    append_param(params, "REQUEST_URI", uri);
+    append_param(params, "DOCUMENT_URI", req.path);
+    append_param(params, "DOCUMENT_ROOT", app->doc_root);
+    append_param(params, "SCRIPT_NAME", req.path);
+    append_param(params, "SCRIPT_FILENAME", app->doc_root + std::string(req.path));
+    append_param(params, "QUERY_STRING", req.query);
+    append_param(params, "REMOTE_ADDR", req.remote_addr);
+    append_param(params, "SERVER_PORT", std::to_string(req.tls ? m_tls_port : m_port));
+    if (req.tls) append_param(params, "HTTPS", "on");  // 应用据此生成 https 链接
+    append_param(params, "REDIRECT_STATUS", "200");  // php-cgi 的 cgi.force_redirect 需要
+    if (req.body_length >= 0) append_param(params, "CONTENT_LENGTH", std::to_string(req.body_length));
+
+    // 其余头部按 CGI 规范转成 HTTP_ 变量
+    std::string name;
+    for (int i = 0; i < req.header_count; ++i) {
+        const http_header &h = req.headers[i];
+        if (ieq(h.name, "Content-Type")) {
+            append_param(params, "CONTENT_TYPE", h.value);
+            continue;
+        }
+        // Proxy 头会被当作 HTTP_PROXY 环境变量，导致应用的出站请求被劫持（httpoxy），丢弃
+        if (ieq(h.name, "Content-Length") || ieq(h.name, "Proxy")) continue;
+        if (ieq(h.name, "Host")) {
+            std::string_view host = h.value;
+            size_t colon = host.rfind(':');
+            if (colon != std::string_view::npos && host.find(']', colon) == std::string_view::npos)
+                host = host.substr(0, colon);
+            append_param(params, "SERVER_NAME", host);
+        }
+        name.assign("HTTP_");
+        for (size_t j = 0; j < h.name.size(); ++j) {
+            char c = h.name[j];
+            name.push_back(c == '-' ? '_' : (c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c));
+        }
+        append_param(params, name, h.value);
+    }
+
+    bool idempotent = req.method == "GET" || req.method == "HEAD";
+    std::shared_ptr<http_response> deferred = res.defer();
+    std::shared_ptr<fcgi_session> session =
+        std::make_shared<fcgi_session>(app, deferred, params, req.body, idempotent, m_close_log);
+    if (req.body_streamed) session->open_body(req.body_length);
+    // 分块请求体的长度要收齐后才知道，由 close_body 排队
+    if (req.body_length >= 0) {
+        event_hub::get_instance()->post([app, session]() {
+            app->submit(session);
+            app->schedule();
+        });
+    }
+    // 请求体随后由读请求的线程交给会话，经主循环以 FCGI_STDIN 转发
+    if (req.body_streamed && !deferred->read_body(session)) session->on_body_end(false);
+}
+
+void fcgi_engine::tick() {
+    time_t now = time(NULL);
+    for (size_t i = 0; i < m_apps.size(); ++i) m_apps[i]->tick(now);
+}
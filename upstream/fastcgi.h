@@ -0,0 +1,81 @@
+/**
+ * @file fastcgi.h
+ * @brief FastCGI 客户端
+ *
+ * 把匹配某个前缀的请求交给本地的 FastCGI 进程池（php-fpm 等）处理，动态页面不再需要每个请求创建进程。
+ * 主要特点：
+ * 1. 与反向代理一样通过 event_hub 接入主 epoll，连接和请求状态只在主循环线程中访问
+ * 2. 每个应用维护若干条 Unix socket 长连接（FCGI_KEEP_CONN）。启动后先用 FCGI_GET_VALUES 询问
+ *    FCGI_MPXS_CONNS，应用支持多路复用时一条连接上同时进行多个请求，否则一条连接同时只进行一个
+ * 3. 连接都忙且已达上限时请求排队，队列满时回复 503
+ * 4. 请求头编码进连接的发送缓冲区，请求体边读边以 FCGI_STDIN 追加，还没写进连接的部分积压过多时暂停读客户端；
+ *    FCGI_STDOUT 解析出 CGI 头部后边到边转发给客户端，客户端积压过多时暂停读这条连接
+ * 5. 命令行 -f 配置，格式为 前缀=socket路径，例如
+ *        -f /php=/run/php/php-fpm.sock
+ *    SCRIPT_FILENAME 为文档根目录加请求路径
+ */
+
+#ifndef FASTCGI_H
+#define FASTCGI_H
+
+#include <string>
+#include <vector>
+
+#include "../http/http_conn.h"
+#include "event_hub.h"
+
+class fcgi_app;
+
+/**
+ * @brief FastCGI 客户端（单例）
+ *
+ * forward() 在工作线程中调用，其余都在主循环线程中执行。
+ */
+class fcgi_engine {
+   public:
+    static fcgi_engine *get_instance() {
+        static fcgi_engine instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 解析 -f 配置并注册路由
+     * @param r 路由表
+     * @param specs 每项形如 前缀=socket路径
+     * @param doc_root 路由表所属虚拟主机的文档根目录，用于生成 SCRIPT_FILENAME；
+     *                 每个虚拟主机调用一次
+     * @param close_log 日志开关
+     * @return 配置格式错误或路由冲突时返回 false
+     */
+    bool configure(http_conn::router &r, const std::vector<std::string> &specs, const char *doc_root,
+                   int close_log);
+    // 服务器的 HTTP 和 HTTPS 监听端口（0 表示不启用），按请求到达的连接填 SERVER_PORT
+    void set_ports(int port, int tls_port) {
+        m_port = port;
+        m_tls_port = tls_port;
+    }
+
+    // 处理函数：编码 FastCGI 参数，推迟响应，交给主循环排队发送
+    void forward(fcgi_app *app, http_request &req, http_response &res);
+
+    // 主循环线程共用的读缓冲区
+    char *buffer() { return m_buf; }
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    int close_log() const { return m_close_log; }
+
+   private:
+    fcgi_engine() : m_close_log(0), m_started(false), m_port(0), m_tls_port(0) {}
+    ~fcgi_engine();
+
+    void tick();
+
+   private:
+    int m_close_log;                 // 日志开关
+    bool m_started;                  // 是否已注册周期回调
+    int m_port;                      // HTTP 监听端口
+    int m_tls_port;                  // HTTPS 监听端口
+    std::vector<fcgi_app *> m_apps;  // 所有应用
+    char m_buf[BUFFER_SIZE];         // 读连接的缓冲区
+};
+
+#endif
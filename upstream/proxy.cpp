@@ -0,0 +1,1021 @@
+/**
+ * @file proxy.cpp
+ * @brief 反向代理的实现
+ */
+
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include "proxy.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "../http/chunked.h"
+#include "../log/log.h"
+
+static const int MAX_FAILS = 3;                 // 连续失败多少次后标记为不可用
+static const size_t MAX_IDLE_PER_SERVER = 32;   // 每个上游服务器最多保留的空闲长连接
+static const size_t MAX_HEAD_SIZE = 16 * 1024;  // 上游响应头的最大长度
+static const size_t MAX_BACKLOG = 256 * 1024;   // 客户端发送缓冲区积压超过该值时暂停读上游
+static const size_t MAX_BODY_BACKLOG = 256 * 1024;  // 请求体还没发给上游的字节数超过该值时暂停读客户端
+static const size_t MAX_PIPES = 64;             // 管道池大小
+static const size_t SPLICE_CHUNK = 64 * 1024;   // 每次 splice 的最大字节数，不超过管道容量
+static const time_t SESSION_TIMEOUT = 60;       // 代理请求多久没有任何进展视为超时（秒）
+
+static bool ieq(std::string_view a, const char *b) {
+    size_t n = strlen(b);
+    return a.size() == n && strncasecmp(a.data(), b, n) == 0;
+}
+
+// 逐跳头部只对一跳连接有意义，不转发；Content-Length 和 Transfer-Encoding 由代理按实际情况重新生成
+static bool hop_by_hop(std::string_view name) {
+    static const char *names[] = {"Connection", "Keep-Alive", "Proxy-Connection", "TE", "Trailer",
+                                  "Transfer-Encoding", "Upgrade", "Content-Length", "Expect"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+        if (ieq(name, names[i])) return true;
+    return false;
+}
+
+static bool contains_token(std::string_view value, const char *token) {
+    size_t n = strlen(token);
+    for (size_t i = 0; i + n <= value.size(); ++i)
+        if (strncasecmp(value.data() + i, token, n) == 0) return true;
+    return false;
+}
+
+static std::string_view trim(std::string_view v) {
+    while (!v.empty() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+    while (!v.empty() && (v.back() == ' ' || v.back() == '\t')) v.remove_suffix(1);
+    return v;
+}
+
+// 上游连接
+class upstream_conn : public io_handler {
+   public:
+    upstream_conn(int fd, upstream_server *server) : fd(fd), server(server), connecting(true), reused(false) {}
+
+    void on_io(int fd, uint32_t events);
+
+    int fd;                                   // socket
+    upstream_server *server;                  // 所属服务器
+    bool connecting;                          // 是否还在建立连接
+    bool reused;                              // 是否是从连接池取出的长连接
+    std::shared_ptr<proxy_session> session;   // 正在处理的请求，空闲时为空
+};
+
+// 一次代理请求
+class proxy_session : public stream_owner, public body_reader, public std::enable_shared_from_this<proxy_session> {
+   public:
+    proxy_session(upstream_group *group, const std::shared_ptr<http_response> &res, std::string &request,
+                  bool idempotent, bool head_only, int close_log);
+
+    void start();                       // 选择上游并发送请求
+    void on_upstream(uint32_t events);  // 上游连接上的事件
+    void on_drain();                    // 客户端发送缓冲区发空，可能在任意线程
+    void expire();                      // 超时
+    // 请求体还在从客户端读（chunked 为 true 时按分块编码转发），在读请求的线程中调用
+    void open_body(bool chunked);
+    bool on_body(std::string_view data);     // 读请求的线程
+    void on_body_end(bool complete);         // 读请求的线程
+
+    time_t last_active;                                          // 最近一次有进展的时间
+    std::list<std::shared_ptr<proxy_session> >::iterator self;  // 在 proxy_engine 列表中的位置
+
+   private:
+    enum STATE {
+        S_CONNECT = 0,  // 等待连接建立
+        S_SEND,         // 发送请求
+        S_HEAD,         // 读取响应头
+        S_BODY,         // 经发送缓冲区转发响应体
+        S_SPLICE,       // 经管道 splice 转发响应体
+        S_DONE          // 已结束
+    };
+    enum FRAMING {
+        BODY_NONE = 0,  // 没有响应体
+        BODY_LENGTH,    // Content-Length
+        BODY_CHUNKED,   // 分块传输
+        BODY_CLOSE      // 以关闭连接为结束
+    };
+
+    void send_request();
+    void append_body(const std::string &data);
+    void close_body(bool complete);
+    void read_upstream();
+    bool parse_head(size_t head_len);
+    bool forward_body(char *data, size_t len);
+    void pump();
+    void resume();
+    void finish();
+    void retry_or_fail(const char *why);
+    void fail(int status, const char *why);
+    void cleanup(bool reusable);
+
+   private:
+    upstream_group *m_group;                // 上游组
+    std::shared_ptr<http_response> m_res;   // 推迟完成的响应
+    std::string m_out;                      // 发给上游的请求
+    size_t m_out_sent;                      // 已发送字节数
+    bool m_body_open;                       // 请求体还在从客户端读，后面的数据由 append_body 追加到 m_out
+    bool m_body_chunked;                    // 请求体按分块编码转发
+    bool m_trimmed;                         // m_out 中已发送的部分被丢弃过，不能再重试
+    bool m_body_cut;                        // 上游提前响应，请求体没有发完
+    size_t m_body_unsent;                   // 追加到 m_out 后还没全部发出的请求体字节数
+    std::atomic<size_t> m_body_queued;      // 已从客户端读到而还没发给上游的请求体字节数
+    std::atomic<bool> m_want_body;          // 读请求的线程因积压暂停，等待 resume_body()
+    bool m_idempotent;                      // 请求可以安全重试
+    bool m_head_only;                       // HEAD 请求，响应没有响应体
+    int m_tries;                            // 已尝试次数
+    upstream_server *m_server;              // 当前上游服务器
+    upstream_conn *m_conn;                  // 当前上游连接
+    STATE m_state;                          // 状态
+    std::string m_head;                     // 响应头缓冲
+    std::string m_reason;                   // 原因短语，http_response 只保存指针
+    bool m_head_forwarded;                  // 响应头是否已交给客户端
+    FRAMING m_framing;                      // 响应体的边界
+    long m_remaining;                       // BODY_LENGTH 剩余字节数
+    chunked_decoder m_decoder;              // BODY_CHUNKED 解码器
+    bool m_upstream_keepalive;              // 上游连接能否复用
+    bool m_paused;                          // 因客户端积压暂停读上游
+    std::atomic<bool> m_want_drain;         // 等待客户端发送缓冲区发空
+    int m_pipe[2];                          // splice 用的管道
+    bool m_has_pipe;                        // 是否持有管道
+    size_t m_pipe_bytes;                    // 管道中尚未发给客户端的字节数
+    int m_close_log;                        // 日志开关
+};
+
+void upstream_conn::on_io(int, uint32_t events) {
+    if (session) {
+        std::shared_ptr<proxy_session> s = session;
+        s->on_upstream(events);
+        return;
+    }
+    // 空闲连接上有事件：上游关闭了连接或发来了多余的数据，都不能再复用
+    std::vector<upstream_conn *> &idle = server->idle;
+    for (size_t i = 0; i < idle.size(); ++i) {
+        if (idle[i] == this) {
+            idle.erase(idle.begin() + i);
+            break;
+        }
+    }
+    event_hub::get_instance()->del(fd);
+    close(fd);
+    delete this;
+}
+
+proxy_session::proxy_session(upstream_group *group, const std::shared_ptr<http_response> &res, std::string &request,
+                             bool idempotent, bool head_only, int close_log)
+    : last_active(time(NULL)),
+      m_group(group),
+      m_res(res),
+      m_out_sent(0),
+      m_body_open(false),
+      m_body_chunked(false),
+      m_trimmed(false),
+      m_body_cut(false),
+      m_body_unsent(0),
+      m_body_queued(0),
+      m_want_body(false),
+      m_idempotent(idempotent),
+      m_head_only(head_only),
+      m_tries(0),
+      m_server(NULL),
+      m_conn(NULL),
+      m_state(S_CONNECT),
+      m_head_forwarded(false),
+      m_framing(BODY_NONE),
+      m_remaining(0),
+      m_upstream_keepalive(false),
+      m_paused(false),
+      m_want_drain(false),
+      m_has_pipe(false),
+      m_pipe_bytes(0),
+      m_close_log(close_log) {
+    m_out.swap(request);
+}
+
+void proxy_session::start() {
+    proxy_engine *engine = proxy_engine::get_instance();
+    ++m_tries;
+    m_server = m_group->pick(m_server);
+    if (!m_server) {
+        fail(502, "no upstream server");
+        return;
+    }
+    m_conn = engine->acquire(m_server);
+    if (!m_conn) {
+        engine->server_failed(m_server);
+        retry_or_fail("connect");
+        return;
+    }
+    m_conn->session = shared_from_this();
+    ++m_server->active;
+    m_out_sent = 0;
+    m_head.clear();
+    if (m_conn->connecting) {
+        m_state = S_CONNECT;  // 连接建立后 on_upstream 收到写事件
+    } else {
+        m_state = S_SEND;
+        send_request();
+    }
+}
+
+void proxy_session::on_upstream(uint32_t events) {
+    std::shared_ptr<proxy_session> guard = shared_from_this();
+    last_active = time(NULL);
+    switch (m_state) {
+        case S_CONNECT: {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(m_conn->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err || (events & EPOLLERR)) {
+                proxy_engine::get_instance()->server_failed(m_server);
+                retry_or_fail("connect");
+                return;
+            }
+            m_conn->connecting = false;
+            proxy_engine::get_instance()->server_ok(m_server);
+            m_state = S_SEND;
+            send_request();
+            break;
+        }
+        case S_SEND:
+            if (m_body_open && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                // 请求体还没发完上游就回了响应（如拒绝过大的请求体）：不再转发剩下的请求体，
+                // 连接上的请求不完整，响应读完后不能复用
+                m_body_open = false;
+                m_body_cut = true;
+                m_state = S_HEAD;
+                read_upstream();
+                break;
+            }
+            send_request();
+            break;
+        case S_HEAD:
+        case S_BODY:
+            read_upstream();
+            break;
+        case S_SPLICE:
+            pump();
+            break;
+        default:
+            break;
+    }
+}
+
+void proxy_session::send_request() {
+    while (m_out_sent < m_out.size()) {
+        ssize_t n = send(m_conn->fd, m_out.data() + m_out_sent, m_out.size() - m_out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                // 请求体还在读时丢弃已发出的部分，m_out 只保存积压的数据
+                if (m_body_open && m_out_sent > 0) {
+                    m_out.erase(0, m_out_sent);
+                    m_out_sent = 0;
+                    m_trimmed = true;
+                }
+                // 请求体还在读时同时等待读事件，及时发现上游提前回的响应
+                event_hub::get_instance()->mod(m_conn->fd, m_body_open ? EPOLLOUT | EPOLLIN | EPOLLRDHUP : EPOLLOUT);
+                return;
+            }
+            retry_or_fail("send");
+            return;
+        }
+        m_out_sent += n;
+    }
+    if (m_body_open) {
+        // 积压已发完，读请求的线程可以继续。只等待上游提前回的响应，append_body 送来数据时再发
+        event_hub::get_instance()->mod(m_conn->fd, EPOLLIN | EPOLLRDHUP);
+        if (!m_out.empty()) m_trimmed = true;
+        m_out.clear();
+        m_out_sent = 0;
+        m_body_queued -= m_body_unsent;
+        m_body_unsent = 0;
+        if (m_body_queued <= MAX_BODY_BACKLOG && m_want_body.exchange(false)) m_res->resume_body();
+        return;
+    }
+    m_state = S_HEAD;
+    event_hub::get_instance()->mod(m_conn->fd, EPOLLIN | EPOLLRDHUP);
+}
+
+void proxy_session::open_body(bool chunked) {
+    m_body_open = true;
+    m_body_chunked = chunked;
+}
+
+// 请求体经主循环追加到发给上游的数据后面，与响应方向一样只在主循环线程中访问会话状态。
+// 积压超过 MAX_BODY_BACKLOG 时返回 false 让连接暂停读客户端，发完后由 send_request 恢复
+bool proxy_session::on_body(std::string_view data) {
+    std::shared_ptr<proxy_session> self = shared_from_this();
+    std::string chunk(data);
+    m_body_queued += data.size();
+    event_hub::get_instance()->post([self, chunk]() { self->append_body(chunk); });
+    // 先声明等待再复查积压，避免在两步之间发完而错过恢复
+    if (m_body_queued > MAX_BODY_BACKLOG) {
+        m_want_body = true;
+        if (m_body_queued > MAX_BODY_BACKLOG) return false;
+        m_want_body = false;
+    }
+    return true;
+}
+
+void proxy_session::on_body_end(bool complete) {
+    std::shared_ptr<proxy_session> self = shared_from_this();
+    event_hub::get_instance()->post([self, complete]() { self->close_body(complete); });
+}
+
+void proxy_session::append_body(const std::string &data) {
+    if (m_state == S_DONE || !m_body_open) return;  // 已结束或请求体已被放弃，积压不再减少，读请求的线程随之暂停
+    last_active = time(NULL);
+    if (m_body_chunked) {
+        char line[32];
+        int n = snprintf(line, sizeof(line), "%zx\r\n", data.size());
+        m_out.append(line, n).append(data).append("\r\n");
+    } else {
+        m_out.append(data);
+    }
+    m_body_unsent += data.size();
+    if (m_state == S_SEND) send_request();
+}
+
+void proxy_session::close_body(bool complete) {
+    if (m_state == S_DONE || !m_body_open) return;
+    if (!complete) {
+        fail(502, "client request body incomplete");
+        return;
+    }
+    last_active = time(NULL);
+    if (m_body_chunked) m_out.append("0\r\n\r\n");
+    m_body_open = false;
+    if (m_state == S_SEND) send_request();
+}
+
+void proxy_session::read_upstream() {
+    char *buf = proxy_engine::get_instance()->buffer();
+    while (true) {
+        ssize_t n = recv(m_conn->fd, buf, proxy_engine::BUFFER_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                event_hub::get_instance()->mod(m_conn->fd, EPOLLIN | EPOLLRDHUP);
+                return;
+            }
+            if (m_state == S_HEAD && m_head.empty())
+                retry_or_fail("recv");
+            else
+                fail(502, "recv");
+            return;
+        }
+        if (n == 0) {
+            if (m_state == S_HEAD) {
+                // 复用的长连接可能刚好被上游关闭，一个字节都没收到时可以重试
+                if (m_head.empty())
+                    retry_or_fail("upstream closed");
+                else
+                    fail(502, "upstream closed in header");
+            } else if (m_framing == BODY_CLOSE) {
+                m_upstream_keepalive = false;
+                finish();
+            } else {
+                m_upstream_keepalive = false;
+                fail(502, "upstream closed in body");
+            }
+            return;
+        }
+
+        if (m_state == S_HEAD) {
+            m_head.append(buf, n);
+            size_t end;
+            // 1xx 中间响应被丢弃后，缓冲区里可能紧跟着最终响应
+            while (m_state == S_HEAD && (end = m_head.find("\r\n\r\n")) != std::string::npos) {
+                if (!parse_head(end + 4)) return;
+            }
+            if (m_state == S_HEAD) {
+                if (m_head.size() > MAX_HEAD_SIZE) {
+                    fail(502, "upstream header too large");
+                    return;
+                }
+                continue;
+            }
+        } else if (!forward_body(buf, n)) {
+            return;
+        }
+        if (m_state == S_DONE || m_state == S_SPLICE) return;
+
+        // 客户端跟不上时暂停读上游，发送缓冲区发空后由 on_drain 恢复。
+        // 先声明等待再复查积压，避免在两步之间发空而错过通知
+        if (m_res->backlog() > MAX_BACKLOG) {
+            m_want_drain = true;
+            if (m_res->backlog() > MAX_BACKLOG) {
+                m_paused = true;
+                return;
+            }
+            m_want_drain = false;
+        }
+    }
+}
+
+bool proxy_session::parse_head(size_t head_len) {
+    std::string_view head(m_head.data(), head_len - 2);  // 保留最后一个头部行的 \r\n
+    size_t eol = head.find("\r\n");
+    std::string_view line = head.substr(0, eol);
+    if (line.size() < 12 || line.substr(0, 5) != "HTTP/" || line[8] != ' ') {
+        fail(502, "bad status line");
+        return false;
+    }
+    int status = 0;
+    for (int i = 9; i < 12; ++i) {
+        if (line[i] < '0' || line[i] > '9') {
+            fail(502, "bad status code");
+            return false;
+        }
+        status = status * 10 + (line[i] - '0');
+    }
+
+    if (status >= 100 && status < 200) {  // 中间响应，继续等最终响应
+        m_head.erase(0, head_len);
+        return true;
+    }
+
+    long content_length = -1;
+    bool chunked = false;
+    bool close = line.substr(0, 8) == "HTTP/1.0";  // HTTP/1.0 默认不保持连接
+    m_reason = line.size() > 13 ? std::string(line.substr(13)) : std::string();
+    m_res->set_status(status, m_reason.empty() ? NULL : m_reason.c_str());
+    m_res->set_content_type(std::string_view());  // 上游没有给出 Content-Type 时不补默认值
+
+    size_t pos = eol + 2;
+    while (pos < head.size()) {
+        size_t next = head.find("\r\n", pos);
+        std::string_view h = head.substr(pos, next - pos);
+        pos = next + 2;
+        size_t colon = h.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = trim(h.substr(0, colon));
+        std::string_view value = trim(h.substr(colon + 1));
+        if (ieq(name, "Content-Length")) {
+            content_length = strtol(std::string(value).c_str(), NULL, 10);
+        } else if (ieq(name, "Transfer-Encoding")) {
+            chunked = contains_token(value, "chunked");
+        } else if (ieq(name, "Connection")) {
+            if (contains_token(value, "close")) close = true;
+            if (contains_token(value, "keep-alive")) close = false;
+        } else if (ieq(name, "Content-Type")) {
+            m_res->set_content_type(value);
+        } else if (!hop_by_hop(name)) {
+            m_res->set_header(name, value);
+        }
+    }
+
+    m_upstream_keepalive = !close;
+    if (m_head_only || status == 204 || status == 304)
+        m_framing = BODY_NONE;
+    else if (chunked)
+        m_framing = BODY_CHUNKED;
+    else if (content_length >= 0)
+        m_framing = BODY_LENGTH;
+    else
+        m_framing = BODY_CLOSE;
+    if (m_framing == BODY_CLOSE) m_upstream_keepalive = false;
+
+    std::string leftover = m_head.substr(head_len);
+    std::string().swap(m_head);
+    m_head_forwarded = true;
+    std::shared_ptr<proxy_session> self = shared_from_this();
+
+    if (m_framing == BODY_NONE) {
+        if (!leftover.empty()) m_upstream_keepalive = false;
+        // HEAD 和 304 原样转发上游声明的长度，204 不能带长度相关的头部
+        long length = http_response::LENGTH_NONE;
+        if (status != 204) {
+            if (content_length >= 0)
+                length = content_length;
+            else if (chunked && m_head_only)
+                length = http_response::LENGTH_CHUNKED;
+        }
+        m_res->send_head(length);
+        finish();
+        return false;
+    }
+
+    m_res->attach(self);  // 接收发送缓冲区发空的通知，用于背压和 splice
+    if (m_framing == BODY_LENGTH) {
+        m_res->set_content_length(content_length);
+        size_t take = leftover.size() < (size_t)content_length ? leftover.size() : content_length;
+        if (leftover.size() > take) m_upstream_keepalive = false;  // 上游多发了数据
+        m_remaining = content_length - take;
+        if (m_remaining > 0 && proxy_engine::get_instance()->get_pipe(m_pipe)) {
+            // 头部和已读到的部分经发送缓冲区发出，发空后 on_drain 开始 splice
+            m_has_pipe = true;
+            m_state = S_SPLICE;
+            m_want_drain = true;
+            if (!m_res->write(std::string_view(leftover.data(), take))) {
+                cleanup(false);
+                return false;
+            }
+            return true;
+        }
+        m_state = S_BODY;
+        if (!m_res->write(std::string_view(leftover.data(), take))) {
+            cleanup(false);
+            return false;
+        }
+        if (m_remaining == 0) {
+            finish();
+            return false;
+        }
+        return true;
+    }
+
+    m_state = S_BODY;
+    m_decoder.reset();
+    if (leftover.empty()) {
+        // 先把头部发给客户端
+        if (!m_res->write(std::string_view())) {
+            cleanup(false);
+            return false;
+        }
+        return true;
+    }
+    return forward_body(&leftover[0], leftover.size());
+}
+
+bool proxy_session::forward_body(char *data, size_t len) {
+    std::string_view out;
+    bool done = false;
+    switch (m_framing) {
+        case BODY_LENGTH: {
+            size_t take = len < (size_t)m_remaining ? len : m_remaining;
+            if (len > take) m_upstream_keepalive = false;
+            m_remaining -= take;
+            out = std::string_view(data, take);
+            done = m_remaining == 0;
+            break;
+        }
+        case BODY_CHUNKED: {
+            long pos = 0, end = 0;
+            chunked_decoder::STATUS status = m_decoder.decode(data, pos, len, end, LONG_MAX);
+            if (status == chunked_decoder::CHUNK_ERROR) {
+                fail(502, "bad chunk from upstream");
+                return false;
+            }
+            if (status == chunked_decoder::CHUNK_DONE) {
+                if ((size_t)pos < len) m_upstream_keepalive = false;
+                done = true;
+            }
+            out = std::string_view(data, end);
+            break;
+        }
+        default:
+            out = std::string_view(data, len);
+            break;
+    }
+    if (!out.empty() && !m_res->write(out)) {
+        cleanup(false);  // 客户端已经断开
+        return false;
+    }
+    if (done) {
+        finish();
+        return false;
+    }
+    return true;
+}
+
+// 经管道把响应体从上游 socket 搬到客户端 socket，两边任何一边暂时不可用就等待对应的事件
+void proxy_session::pump() {
+    while (true) {
+        if (m_pipe_bytes > 0) {
+            ssize_t n = m_res->splice_from(m_pipe[0], m_pipe_bytes);
+            if (n > 0) {
+                m_pipe_bytes -= n;
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN) {
+                m_want_drain = true;
+                if (!m_res->wake()) cleanup(false);
+                return;
+            }
+            cleanup(false);  // 客户端已经断开
+            return;
+        }
+        if (m_remaining == 0) {
+            finish();
+            return;
+        }
+        size_t want = (size_t)m_remaining < SPLICE_CHUNK ? m_remaining : SPLICE_CHUNK;
+        ssize_t n = splice(m_conn->fd, NULL, m_pipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            m_remaining -= n;
+            m_pipe_bytes += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) {
+            event_hub::get_instance()->mod(m_conn->fd, EPOLLIN | EPOLLRDHUP);
+            return;
+        }
+        m_upstream_keepalive = false;
+        fail(502, n == 0 ? "upstream closed in body" : "splice");
+        return;
+    }
+}
+
+void proxy_session::on_drain() {
+    if (!m_want_drain.exchange(false)) return;
+    std::shared_ptr<proxy_session> self = shared_from_this();
+    event_hub::get_instance()->post([self]() { self->resume(); });
+}
+
+void proxy_session::resume() {
+    last_active = time(NULL);
+    if (m_state == S_SPLICE) {
+        pump();
+    } else if (m_state == S_BODY && m_paused) {
+        m_paused = false;
+        read_upstream();
+    }
+}
+
+void proxy_session::expire() {
+    std::shared_ptr<proxy_session> guard = shared_from_this();
+    if (m_state == S_CONNECT) proxy_engine::get_instance()->server_failed(m_server);
+    m_upstream_keepalive = false;
+    fail(504, "upstream timeout");
+}
+
+void proxy_session::finish() {
+    m_res->end();
+    cleanup(m_upstream_keepalive && !m_body_cut);
+}
+
+// 连接失败或复用的长连接已被关闭时换一个上游重试。已经发出过请求的非幂等请求不重试，避免重复执行
+void proxy_session::retry_or_fail(const char *why) {
+    std::shared_ptr<proxy_session> guard = shared_from_this();
+    LOG_WARN("proxy %s: %s", m_server ? m_server->name.c_str() : "-", why);
+    bool sent = m_out_sent > 0;
+    if (m_conn) {
+        --m_server->active;
+        proxy_engine::get_instance()->release(m_conn, false);
+        m_conn = NULL;
+    }
+    // 已发出的请求体被丢弃后无法重发
+    if (!m_trimmed && m_tries <= (int)m_group->servers().size() && (!sent || m_idempotent)) {
+        start();
+        return;
+    }
+    fail(502, why);
+}
+
+void proxy_session::fail(int status, const char *why) {
+    std::shared_ptr<proxy_session> guard = shared_from_this();
+    LOG_ERROR("proxy %s: %s", m_server ? m_server->name.c_str() : "-", why);
+    if (!m_head_forwarded) {
+        m_res->set_status(status);
+        m_res->set_content_type("text/plain; charset=utf-8");
+        m_res->send(status == 504 ? "Gateway Timeout\n" : "Bad Gateway\n");
+    } else {
+        m_res->abort();  // 响应头已经发出，只能断开连接让客户端知道响应不完整
+    }
+    cleanup(false);
+}
+
+void proxy_session::cleanup(bool reusable) {
+    if (m_state == S_DONE) return;
+    std::shared_ptr<proxy_session> guard = shared_from_this();
+    m_state = S_DONE;
+    proxy_engine *engine = proxy_engine::get_instance();
+    if (m_conn) {
+        --m_server->active;
+        engine->release(m_conn, reusable && m_pipe_bytes == 0);
+        m_conn = NULL;
+    }
+    if (m_has_pipe) {
+        engine->put_pipe(m_pipe, m_pipe_bytes == 0);
+        m_has_pipe = false;
+    }
+    engine->session_end(this);
+}
+
+upstream_group::~upstream_group() {
+    for (size_t i = 0; i < m_servers.size(); ++i) delete m_servers[i];
+}
+
+// 健康检查的连接结果
+class health_probe : public io_handler {
+   public:
+    void on_io(int fd, uint32_t events);
+};
+
+static health_probe g_probe;
+
+bool upstream_group::add_server(const std::string &host_port) {
+    size_t colon = host_port.rfind(':');
+    if (colon == std::string::npos) return false;
+    std::string host = host_port.substr(0, colon);
+    int port = atoi(host_port.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) return false;
+
+    upstream_server *server = new upstream_server;
+    memset(&server->addr, 0, sizeof(server->addr));
+    server->addr.sin_family = AF_INET;
+    server->addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &server->addr.sin_addr) != 1) {
+        delete server;
+        return false;
+    }
+    server->name = host_port;
+    server->healthy = true;
+    server->fails = 0;
+    server->active = 0;
+    server->probe_fd = -1;
+    m_servers.push_back(server);
+    return true;
+}
+
+upstream_server *upstream_group::pick(const upstream_server *avoid) {
+    size_t n = m_servers.size();
+    if (n == 0) return NULL;
+    upstream_server *best = NULL;
+    for (size_t i = 0; i < n; ++i) {
+        upstream_server *s = m_servers[(m_next + i) % n];
+        if (!s->healthy || (s == avoid && n > 1)) continue;
+        if (m_balance == BALANCE_ROUND_ROBIN) {
+            best = s;
+            break;
+        }
+        if (!best || s->active < best->active) best = s;  // 最少连接，相同时按轮询顺序
+    }
+    m_next = (m_next + 1) % n;
+    if (best) return best;
+    // 全部不可用：仍然选一个去试，成功后它会重新被标记为可用
+    for (size_t i = 0; i < n; ++i)
+        if (m_servers[i] != avoid) return m_servers[i];
+    return m_servers[0];
+}
+
+proxy_engine::~proxy_engine() {
+    for (size_t i = 0; i < m_groups.size(); ++i) delete m_groups[i];
+}
+
+bool proxy_engine::configure(http_conn::router &r, const std::vector<std::string> &specs, int close_log) {
+    m_close_log = close_log;
+    for (size_t i = 0; i < specs.size(); ++i) {
+        const std::string &spec = specs[i];
+        size_t eq = spec.find('=');
+        if (eq == std::string::npos || spec[0] != '/') return false;
+        std::string prefix = spec.substr(0, eq);
+        std::string servers = spec.substr(eq + 1);
+
+        BALANCE balance = BALANCE_ROUND_ROBIN;
+        size_t at = servers.rfind('@');
+        if (at != std::string::npos) {
+            std::string mode = servers.substr(at + 1);
+            if (mode == "lc")
+                balance = BALANCE_LEAST_CONN;
+            else if (mode != "rr")
+                return false;
+            servers.erase(at);
+        }
+
+        upstream_group *group = new upstream_group(balance);
+        m_groups.push_back(group);
+        size_t pos = 0;
+        while (pos <= servers.size()) {
+            size_t comma = servers.find(',', pos);
+            if (comma == std::string::npos) comma = servers.size();
+            if (!group->add_server(servers.substr(pos, comma - pos))) return false;
+            pos = comma + 1;
+        }
+        while (prefix.size() > 1 && prefix[prefix.size() - 1] == '/') prefix.erase(prefix.size() - 1);
+        if (!proxy_pass(r, prefix.c_str(), group)) return false;
+        LOG_INFO("proxy %s -> %s", prefix.c_str(), servers.c_str());
+    }
+    if (!specs.empty() && !m_started) {
+        m_started = true;
+        event_hub::get_instance()->add_tick([this]() { tick(); });
+    }
+    return true;
+}
+
+bool proxy_engine::proxy_pass(http_conn::router &r, const char *pattern, upstream_group *group) {
+    handler_fn fn = [group](http_request &req, http_response &res) {
+        proxy_engine::get_instance()->forward(group, req, res);
+    };
+    std::string p(pattern);
+    bool ok = true;
+    // 请求体边读边转发，不受读缓冲区大小限制
+    if (p != "/") ok = http_conn::add_body_stream(r, p.c_str(), ~0, fn);
+    if (p[p.size() - 1] != '/') p += '/';
+    p += "*rest";
+    return http_conn::add_body_stream(r, p.c_str(), ~0, fn) && ok;
+}
+
+void proxy_engine::forward(upstream_group *group, http_request &req, http_response &res) {
+    std::string out;
+    out.reserve(512 + req.body.size());
+    out.append(req.method).append(" ").append(req.path);
+    if (!req.query.empty()) out.append("?").append(req.query);
+    out.append(" HTTP/1.1\r\n");
+
+    std::string forwarded_for;
+    for (int i = 0; i < req.header_count; ++i) {
+        const http_header &h = req.headers[i];
+        if (hop_by_hop(h.name)) continue;
+        if (ieq(h.name, "X-Forwarded-For")) {
+            forwarded_for.assign(h.value).append(", ");
+            continue;
+        }
+        if (ieq(h.name, "X-Forwarded-Proto")) continue;  // 客户端到本服务器这一跳的协议由这里给出
+        out.append(h.name).append(": ").append(h.value).append("\r\n");
+    }
+    forwarded_for.append(req.remote_addr);
+    out.append("X-Forwarded-For: ").append(forwarded_for).append("\r\n");
+    out.append(req.tls ? "X-Forwarded-Proto: https\r\n" : "X-Forwarded-Proto: http\r\n");
+    if (req.body_length < 0)
+        out.append("Transfer-Encoding: chunked\r\n");  // 客户端用分块传输，长度未知，原样分块转发
+    else if (req.body_length > 0 || req.method == "POST" || req.method == "PUT")
+        out.append("Content-Length: ").append(std::to_string(req.body_length)).append("\r\n");
+    out.append("Connection: keep-alive\r\n\r\n");
+    out.append(req.body);
+
+    bool idempotent = req.method == "GET" || req.method == "HEAD";
+    std::shared_ptr<http_response> deferred = res.defer();
+    std::shared_ptr<proxy_session> session = std::make_shared<proxy_session>(
+        group, deferred, out, idempotent, req.method == "HEAD", m_close_log);
+    if (req.body_streamed) session->open_body(req.body_length < 0);
+    event_hub::get_instance()->post([session]() {
+        proxy_engine::get_instance()->session_begin(session);
+        session->start();
+    });
+    // 请求体随后由读请求的线程交给会话，经主循环追加到发给上游的数据后面
+    if (req.body_streamed && !deferred->read_body(session)) session->on_body_end(false);
+}
+
+upstream_conn *proxy_engine::acquire(upstream_server *server) {
+    if (!server->idle.empty()) {
+        upstream_conn *conn = server->idle.back();
+        server->idle.pop_back();
+        conn->reused = true;
+        return conn;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int ret = connect(fd, (struct sockaddr *)&server->addr, sizeof(server->addr));
+    if (ret < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return NULL;
+    }
+    upstream_conn *conn = new upstream_conn(fd, server);
+    conn->connecting = ret < 0;
+    if (!event_hub::get_instance()->add(fd, conn->connecting ? EPOLLOUT : EPOLLIN | EPOLLRDHUP, conn)) {
+        close(fd);
+        delete conn;
+        return NULL;
+    }
+    return conn;
+}
+
+void proxy_engine::release(upstream_conn *conn, bool reusable) {
+    conn->session.reset();
+    upstream_server *server = conn->server;
+    if (reusable && server->healthy && server->idle.size() < MAX_IDLE_PER_SERVER) {
+        // 空闲时也监听读事件，上游关闭连接时及时清理
+        if (event_hub::get_instance()->mod(conn->fd, EPOLLIN | EPOLLRDHUP)) {
+            server->idle.push_back(conn);
+            return;
+        }
+    }
+    event_hub::get_instance()->del(conn->fd);
+    close(conn->fd);
+    delete conn;
+}
+
+void proxy_engine::server_failed(upstream_server *server) {
+    if (++server->fails < MAX_FAILS || !server->healthy) return;
+    server->healthy = false;
+    LOG_WARN("upstream %s marked down", server->name.c_str());
+    // 不可用服务器的空闲连接多半也已失效
+    while (!server->idle.empty()) {
+        upstream_conn *conn = server->idle.back();
+        server->idle.pop_back();
+        event_hub::get_instance()->del(conn->fd);
+        close(conn->fd);
+        delete conn;
+    }
+}
+
+void proxy_engine::server_ok(upstream_server *server) {
+    server->fails = 0;
+    if (server->healthy) return;
+    server->healthy = true;
+    LOG_INFO("upstream %s marked up", server->name.c_str());
+}
+
+void proxy_engine::session_begin(const std::shared_ptr<proxy_session> &session) {
+    m_sessions.push_front(session);
+    session->self = m_sessions.begin();
+}
+
+void proxy_engine::session_end(proxy_session *session) { m_sessions.erase(session->self); }
+
+bool proxy_engine::get_pipe(int fds[2]) {
+    if (!m_pipes.empty()) {
+        fds[0] = m_pipes.back().first;
+        fds[1] = m_pipes.back().second;
+        m_pipes.pop_back();
+        return true;
+    }
+    return pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0;
+}
+
+void proxy_engine::put_pipe(int fds[2], bool clean) {
+    // 管道里还有残留数据的不能复用
+    if (clean && m_pipes.size() < MAX_PIPES) {
+        m_pipes.push_back(std::make_pair(fds[0], fds[1]));
+        return;
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 每 TIMESLOT 秒：清理超时的代理请求，对每个上游服务器做一次连接探测
+void proxy_engine::tick() {
+    time_t now = time(NULL);
+    std::list<std::shared_ptr<proxy_session> >::iterator it = m_sessions.begin();
+    while (it != m_sessions.end()) {
+        std::shared_ptr<proxy_session> s = *it++;  // expire() 会把自己从列表中删除
+        if (now - s->last_active > SESSION_TIMEOUT) s->expire();
+    }
+    for (size_t i = 0; i < m_groups.size(); ++i) {
+        std::vector<upstream_server *> &servers = m_groups[i]->servers();
+        for (size_t j = 0; j < servers.size(); ++j) probe(servers[j]);
+    }
+}
+
+upstream_server *proxy_engine::find_probe(int fd) {
+    for (size_t i = 0; i < m_groups.size(); ++i) {
+        std::vector<upstream_server *> &servers = m_groups[i]->servers();
+        for (size_t j = 0; j < servers.size(); ++j)
+            if (servers[j]->probe_fd == fd) return servers[j];
+    }
+    return NULL;
+}
+
+// 探测结果在 health_probe::on_io 中处理，上一轮探测到现在还没有结果视为失败
+void proxy_engine::probe(upstream_server *server) {
+    if (server->probe_fd >= 0) {
+        event_hub::get_instance()->del(server->probe_fd);
+        close(server->probe_fd);
+        server->probe_fd = -1;
+        server_failed(server);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || fd >= event_hub::MAX_FD) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    int ret = connect(fd, (struct sockaddr *)&server->addr, sizeof(server->addr));
+    if (ret == 0) {
+        close(fd);
+        server_ok(server);
+        return;
+    }
+    if (errno != EINPROGRESS || !event_hub::get_instance()->add(fd, EPOLLOUT, &g_probe)) {
+        close(fd);
+        server_failed(server);
+        return;
+    }
+    server->probe_fd = fd;
+}
+
+void health_probe::on_io(int fd, uint32_t events) {
+    proxy_engine *engine = proxy_engine::get_instance();
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    event_hub::get_instance()->del(fd);
+    close(fd);
+    upstream_server *server = engine->find_probe(fd);
+    if (!server) return;
+    server->probe_fd = -1;
+    if (err || (events & EPOLLERR))
+        engine->server_failed(server);
+    else
+        engine->server_ok(server);
+}
@@ -0,0 +1,127 @@
+/**
+ * @file proxy.h
+ * @brief 反向代理
+ *
+ * 把匹配某个前缀的请求转发给一组上游 HTTP 服务器，相当于 nginx 的 proxy_pass。
+ * 主要特点：
+ * 1. 上游 socket 是非阻塞的，通过 event_hub 注册在主 epoll 中，所有代理状态只在主循环线程中访问
+ * 2. 每个上游服务器维护一个长连接池，响应读完且上游没有要求关闭时连接回到池中复用
+ * 3. 支持轮询和最少连接两种均衡方式；连接失败计入被动健康检查，另有每 TIMESLOT 秒一次的主动探测
+ * 4. 上游响应带 Content-Length 时，响应体经管道 splice 直接从上游 socket 搬到客户端 socket，
+ *    不经过用户态；分块或以关闭为结束的响应体解码后经发送缓冲区转发，发送缓冲区积压过多时暂停读上游
+ * 5. HTTP/1.1 的请求体边读边经主循环追加到发给上游的数据后面，积压超过 256KB 时暂停读客户端
+ * 6. 命令行 -x 配置，格式为 前缀=host:port[,host:port...][@rr|@lc]，例如
+ *        -x /api=127.0.0.1:8001,127.0.0.1:8002@lc
+ */
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <netinet/in.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../http/http_conn.h"
+#include "event_hub.h"
+
+class upstream_conn;
+class proxy_session;
+
+// 均衡方式
+enum BALANCE {
+    BALANCE_ROUND_ROBIN = 0,  // 轮询
+    BALANCE_LEAST_CONN        // 最少连接
+};
+
+struct upstream_server {
+    std::string name;                   // host:port，用于日志
+    sockaddr_in addr;                   // 上游地址
+    bool healthy;                       // 是否可用
+    int fails;                          // 连续失败次数，达到上限后标记为不可用
+    int active;                         // 正在处理请求的连接数
+    std::vector<upstream_conn *> idle;  // 空闲的长连接
+    int probe_fd;                       // 进行中的健康检查 socket，-1 表示没有
+};
+
+class upstream_group {
+   public:
+    explicit upstream_group(BALANCE balance) : m_balance(balance), m_next(0) {}
+    ~upstream_group();
+
+    // 添加上游服务器，只接受 IPv4 地址 "a.b.c.d:port"
+    bool add_server(const std::string &host_port);
+    // 按均衡方式选择一个服务器，尽量避开 avoid；全部不可用时仍然返回一个，让请求去试
+    upstream_server *pick(const upstream_server *avoid);
+
+    std::vector<upstream_server *> &servers() { return m_servers; }
+
+   private:
+    BALANCE m_balance;                       // 均衡方式
+    size_t m_next;                           // 轮询位置
+    std::vector<upstream_server *> m_servers;  // 上游服务器
+};
+
+/**
+ * @brief 反向代理（单例）
+ *
+ * forward() 在工作线程中调用，其余方法都在主循环线程中执行。
+ */
+class proxy_engine {
+   public:
+    static proxy_engine *get_instance() {
+        static proxy_engine instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 解析 -x 配置并注册代理路由
+     * @param r 路由表
+     * @param specs 每项形如 前缀=host:port[,host:port...][@rr|@lc]
+     * @param close_log 日志开关
+     * @return 配置格式错误或路由冲突时返回 false
+     */
+    bool configure(http_conn::router &r, const std::vector<std::string> &specs, int close_log);
+
+    // 注册一条代理路由：pattern 精确匹配的路径和 pattern/ 下的所有路径都转发给 group
+    bool proxy_pass(http_conn::router &r, const char *pattern, upstream_group *group);
+
+    // 处理函数：构造上游请求，推迟响应，交给主循环发送
+    void forward(upstream_group *group, http_request &req, http_response &res);
+
+    // 以下只在主循环线程中调用
+    upstream_conn *acquire(upstream_server *server);
+    void release(upstream_conn *conn, bool reusable);
+    void server_failed(upstream_server *server);
+    void server_ok(upstream_server *server);
+    void session_begin(const std::shared_ptr<proxy_session> &session);
+    void session_end(proxy_session *session);
+    // 管道池，splice 用
+    bool get_pipe(int fds[2]);
+    void put_pipe(int fds[2], bool clean);
+    // 主循环线程共用的读缓冲区
+    char *buffer() { return m_buf; }
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    int close_log() const { return m_close_log; }
+    // 按健康检查 socket 找到对应的服务器
+    upstream_server *find_probe(int fd);
+
+   private:
+    proxy_engine() : m_close_log(0), m_started(false) {}
+    ~proxy_engine();
+
+    void tick();
+    void probe(upstream_server *server);
+
+   private:
+    int m_close_log;                                        // 日志开关
+    bool m_started;                                         // 是否已注册周期回调
+    std::vector<upstream_group *> m_groups;                 // 所有上游组
+    std::list<std::shared_ptr<proxy_session> > m_sessions;  // 进行中的代理请求，用于超时清理
+    std::vector<std::pair<int, int> > m_pipes;              // 空闲的管道
+    char m_buf[BUFFER_SIZE];                                // 读上游的缓冲区
+};
+
+#endif
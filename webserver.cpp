@@ -18,20 +18,29 @@ WebServer::WebServer() {
 
     // 定时器
     users_timer = new client_data[MAX_FD];  // 为每个客户端连接都创建定时器
+
+    m_vhosts = NULL;      // 由 static_cache() 创建
+    m_tls_listenfd = -1;  // 由 eventListen() 创建
+    m_batch_len = 0;
 }
 
 WebServer::~WebServer() {
     close(m_epollfd);
     close(m_listenfd);
+    if (m_tls_listenfd >= 0) close(m_tls_listenfd);
     close(m_pipefd[1]);
     close(m_pipefd[0]);
     delete[] users;
     delete[] users_timer;
     delete m_pool;
+    delete m_vhosts;
 }
 
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write,
-    int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model) {
+    int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model,
+    int compress_threads, int handler_threads, const vector<string> &proxy_specs,
+    const vector<string> &fastcgi_specs, const vector<string> &vhost_specs, int tls_port, const string &tls_cert, const string &tls_key,
+    const string &log_levels, int log_segment_mb, const string &log_backpressure, int access_format, int ws_topics) {
     m_port = port;
     m_user = user;
     m_passWord = passWord;
@@ -43,6 +52,19 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     m_TRIGMode = trigmode;
     m_close_log = close_log;
     m_actormodel = actor_model;
+    m_compress_threads = compress_threads;
+    m_handler_threads = handler_threads;
+    m_proxy_specs = proxy_specs;
+    m_fastcgi_specs = fastcgi_specs;
+    m_vhost_specs = vhost_specs;
+    m_tls_port = tls_port;
+    m_tls_cert = tls_cert;
+    m_tls_key = tls_key;
+    m_log_levels = log_levels;
+    m_log_segment_mb = log_segment_mb;
+    m_log_backpressure = log_backpressure;
+    m_access_format = access_format;
+    m_ws_topics = ws_topics;
 }
 
 void WebServer::trig_mode() {
@@ -72,12 +94,105 @@ void WebServer::trig_mode() {
 void WebServer::log_write() {
     if (0 == m_close_log)  // 是否启用日志（0启用/1关闭）
     {
+        // 日志段：写满或达到行数时切换，旧段在后台线程中压缩
+        log_segment_policy segments;
+        segments.size = (size_t)m_log_segment_mb << 20;
+        Log::get_instance()->set_segment_policy(segments);
+        // 环满时的处理方式，日志尚未打开，错误只能输出到标准错误
+        if (!Log::get_instance()->set_backpressure(m_log_backpressure.c_str())) {
+            fprintf(stderr, "无效的日志环满处理方式：%s\n", m_log_backpressure.c_str());
+            exit(1);
+        }
         // 初始化日志
-        if (1 == m_log_write)  // 日志写入方式（0同步/1异步）
+        if (1 == m_log_write)  // 日志写入方式（0同步/1异步/2二进制）
             Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000, 800);
+        else if (2 == m_log_write)  // 二进制日志，用 logdecode 解码
+            Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000, 800, true);
         else
             Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000, 0);
+        // 各模块的级别，运行中可用 SIGUSR1/SIGUSR2 整体调高/调低，或经 /admin/log 修改
+        if (!Log::set_levels(m_log_levels.c_str())) {
+            LOG_ERROR("%s", "invalid log level config");
+            fprintf(stderr, "无效的日志级别配置：%s\n", m_log_levels.c_str());
+            exit(1);
+        }
+    }
+    // 访问日志不受 -c 影响，有自己的文件和写线程
+    if (!access_log::get_instance()->init("./AccessLog", (access_format)m_access_format)) {
+        fprintf(stderr, "无法打开访问日志\n");
+        exit(1);
+    }
+}
+
+// 虚拟主机和静态文件缓存
+void WebServer::static_cache() {
+    m_vhosts = new vhost_table;
+    // 默认主机即 ./root，最多缓存1024个文件，即时压缩结果最多占用32MB内存
+    m_vhosts->add_default(m_root, 1024, 32 << 20, m_close_log);
+    // -v 指定的主机各有一份缓存，配置格式错误、目录不存在或名字重复时退出
+    if (!m_vhosts->configure(m_vhost_specs, m_close_log)) {
+        LOG_ERROR("%s", "invalid vhost config");
+        fprintf(stderr, "无效的虚拟主机配置\n");
+        exit(1);
+    }
+    http_conn::m_vhosts = m_vhosts;  // 将虚拟主机表传递给HTTP连接类
+    // 后台压缩线程，最多积压256个压缩任务，积压满时请求直接发送原文
+    compressor::get_instance()->init(m_compress_threads, 256, m_close_log);
+}
+
+// 把 -x/-f 配置按虚拟主机分组：以 '/' 开头的属于默认主机，"主机名/前缀=..." 属于该主机，主机名不存在时返回 false
+static bool split_specs(const vector<string> &specs, const vhost_table &vhosts, map<vhost *, vector<string> > &out) {
+    for (size_t i = 0; i < specs.size(); ++i) {
+        const string &spec = specs[i];
+        if (!spec.empty() && spec[0] == '/') {
+            out[vhosts.default_host()].push_back(spec);
+            continue;
+        }
+        size_t slash = spec.find('/');
+        if (slash == string::npos || slash == 0 || slash > spec.find('=')) return false;
+        string name = spec.substr(0, slash);
+        for (size_t j = 0; j < name.size(); ++j) name[j] = tolower((unsigned char)name[j]);
+        vhost *host = vhosts.lookup(name.data(), name.size());
+        if (!host) return false;
+        out[host].push_back(spec.substr(slash));
+    }
+    return true;
+}
+
+void WebServer::route_table() {
+    // 内置路由只注册在默认主机上，与已有路由冲突说明注册代码有误，直接退出
+    http_conn::router &r = m_vhosts->default_host()->router;
+    // 主题广播接口不做鉴权，任何客户端都能向任意主题发布，只在 -W 1 时注册（如 ws_bench 压测）
+    if (!http_conn::default_routes(r) || !account_routes(r) || (m_ws_topics && !topic_routes(r)) ||
+        !picture_routes(r, m_root) || !log_routes(r)) {
+        LOG_ERROR("%s", "route table conflict");
+        exit(1);
+    }
+    map<vhost *, vector<string> > proxy_specs, fastcgi_specs;
+    bool proxy_ok = split_specs(m_proxy_specs, *m_vhosts, proxy_specs);
+    bool fastcgi_ok = split_specs(m_fastcgi_specs, *m_vhosts, fastcgi_specs);
+    fcgi_engine::get_instance()->set_ports(m_port, m_tls_port);
+    const vector<vhost *> &hosts = m_vhosts->hosts();
+    for (size_t i = 0; i < hosts.size(); ++i) {
+        vhost *host = hosts[i];
+        // 反向代理路由，配置格式错误、主机名不存在或与已有路由冲突时退出
+        if (!proxy_ok || !proxy_engine::get_instance()->configure(host->router, proxy_specs[host], m_close_log)) {
+            LOG_ERROR("%s", "invalid proxy config");
+            fprintf(stderr, "无效的反向代理配置\n");
+            exit(1);
+        }
+        // FastCGI 路由，SCRIPT_FILENAME 相对于所属主机的文档根目录
+        if (!fastcgi_ok || !fcgi_engine::get_instance()->configure(host->router, fastcgi_specs[host],
+                                                                  host->doc_root.c_str(), m_close_log)) {
+            LOG_ERROR("%s", "invalid fastcgi config");
+            fprintf(stderr, "无效的 FastCGI 配置\n");
+            exit(1);
+        }
     }
+    ws_server::get_instance()->init(m_close_log);  // WebSocket 保活检查
+    h2_server::get_instance()->init(m_close_log);  // HTTP/2 与 HTTP/1.1 共用虚拟主机表
+    // 阻塞处理函数线程，最多积压1024个任务，积压满时直接回复503
+    handler_pool::get_instance()->init(m_handler_threads, 1024, m_close_log);
 }
 
 void WebServer::sql_pool() {
@@ -95,20 +210,20 @@ void WebServer::thread_pool() {
     m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
 }
 
-void WebServer::eventListen() {
+int WebServer::listen_socket(int port) {
     // 创建一个监听套接字，PF_INET表示IPv4协议，SOCK_STREAM表示TCP协议
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(m_listenfd >= 0);  // 确保套接字创建成功
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    assert(listenfd >= 0);  // 确保套接字创建成功
 
     // 设置套接字的优雅关闭选项
     if (0 == m_OPT_LINGER) {
         // 如果m_OPT_LINGER为0，表示立即关闭连接，不等待未发送的数据
         struct linger tmp = {0, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     } else if (1 == m_OPT_LINGER) {
         // 如果m_OPT_LINGER为1，表示优雅关闭连接，等待未发送的数据
         struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
     int ret = 0;                                  // 用于存储函数调用的返回值
@@ -116,19 +231,25 @@ void WebServer::eventListen() {
     bzero(&address, sizeof(address));             // 清空地址结构
     address.sin_family = AF_INET;                 // 设置地址族为IPv4
     address.sin_addr.s_addr = htonl(INADDR_ANY);  // 设置IP地址为任意地址
-    address.sin_port = htons(m_port);  // 设置端口号，m_port为服务器监听的端口
+    address.sin_port = htons(port);  // 设置端口号
 
     // 设置套接字选项，允许地址重用
     int flag = 1;
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
 
     // 将套接字绑定到指定的地址和端口
-    ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
+    ret = bind(listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(ret >= 0);  // 确保绑定成功
 
     // 开始监听连接请求，5表示等待连接队列的最大长度
-    ret = listen(m_listenfd, 5);
+    ret = listen(listenfd, 5);
     assert(ret >= 0);  // 确保监听成功
+    return listenfd;
+}
+
+void WebServer::eventListen() {
+    int ret = 0;  // 用于存储函数调用的返回值
+    m_listenfd = listen_socket(m_port);
 
     // 初始化工具类，设置定时器的时间间隔为TIMESLOT
     utils.init(TIMESLOT);
@@ -137,6 +258,9 @@ void WebServer::eventListen() {
     epoll_event events[MAX_EVENT_NUMBER];
     m_epollfd = epoll_create(5);
     assert(m_epollfd != -1);  // 确保epoll创建成功
+    // 上游连接等非客户端 fd 也注册在这个epoll中，由 event_hub 分派
+    ret = event_hub::get_instance()->init(m_epollfd, m_close_log);
+    assert(ret);
 
     // 将监听套接字添加到epoll事件表中，监听其读事件
     // 参数：
@@ -145,6 +269,24 @@ void WebServer::eventListen() {
     // false：是否只监听一次
     // m_LISTENTrigmode：listenfd触发模式（0 LT/1 ET））
     utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
+
+    // HTTPS 端口：握手完成的连接与明文连接一样交给 http_conn，证书无法加载时退出
+    if (m_tls_port > 0) {
+        tls_server::ready_fn ready = [this](int fd, const sockaddr_in &addr, SSL *ssl) {
+            if (http_conn::m_user_count >= MAX_FD) {
+                tls_free(ssl, false);
+                close(fd);
+                return;
+            }
+            timer(fd, addr, ssl);
+        };
+        if (!tls_server::get_instance()->init(m_tls_cert.c_str(), m_tls_key.c_str(), ready, m_close_log)) {
+            fprintf(stderr, "无法启用 HTTPS，请检查证书和私钥\n");
+            exit(1);
+        }
+        m_tls_listenfd = listen_socket(m_tls_port);
+        utils.addfd(m_epollfd, m_tls_listenfd, false, m_LISTENTrigmode);
+    }
     http_conn::m_epollfd = m_epollfd;  // 将epoll文件描述符传递给HTTP连接类
 
     // 创建一对UNIX域套接字，用于进程间通信
@@ -165,17 +307,22 @@ void WebServer::eventListen() {
     // 设置SIGTERM信号的处理函数，用于处理终止信号
     utils.addsig(SIGTERM, utils.sig_handler, false);
 
+    // SIGUSR1 把所有模块的日志级别调高一级（更安静），SIGUSR2 调低一级
+    utils.addsig(SIGUSR1, utils.sig_handler, false);
+    utils.addsig(SIGUSR2, utils.sig_handler, false);
+
     // 启动定时器，每隔TIMESLOT秒触发一次SIGALRM信号
     alarm(TIMESLOT);
+    http_date::update(time(NULL));  // 响应头中的 Date，之后由事件循环每秒更新
 
     // 将管道的文件描述符和epoll文件描述符传递给工具类
     Utils::u_pipefd = m_pipefd;
     Utils::u_epollfd = m_epollfd;
 }
 
-void WebServer::timer(int connfd, struct sockaddr_in client_address) {
-    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user,
-        m_passWord, m_databaseName);
+void WebServer::timer(int connfd, struct sockaddr_in client_address, SSL *ssl) {
+    users[connfd].init(connfd, client_address, m_CONNTrigmode, m_close_log, m_user,
+        m_passWord, m_databaseName, ssl);
 
     // 初始化client_data数据
     // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
@@ -203,27 +350,29 @@ void WebServer::adjust_timer(util_timer *timer) {
     timer->expire = cur + 3 * TIMESLOT;  // 也即超时时间为3*TIMESLOT=15秒
     utils.m_timer_lst.adjust_timer(timer);
 
-    LOG_INFO("%s", "adjust timer once");
+    LOG_AT(LOG_MOD_TIMER, LOG_LEVEL_INFO, "%s", "adjust timer once");
 }
 
 void WebServer::deal_timer(util_timer *timer, int sockfd) {
+    users[sockfd].close_tls();             // socket 关闭前发送 close_notify
     timer->cb_func(&users_timer[sockfd]);  // 调用定时器的回调函数，处理超时事件
     if (timer) {
         utils.m_timer_lst.del_timer(timer);  // 如果定时器存在，从定时器链表中删除该定时器
     }
 
-    LOG_INFO("close fd %d",
-        users_timer[sockfd].sockfd);  // 记录日志，关闭文件描述符
+    LOG_AT(LOG_MOD_TIMER, LOG_LEVEL_INFO, "close fd %d",
+           users_timer[sockfd].sockfd);  // 记录日志，关闭文件描述符
 }
 
 // 根据服务器的监听模式（水平触发 LT 或边缘触发
 // ET）来接受客户端连接，并为每个新连接创建定时器。
-bool WebServer::dealclientdata() {
+// HTTPS 端口上的连接先交给 tls_server 握手，完成后再创建定时器。
+bool WebServer::dealclientdata(int listenfd) {
     struct sockaddr_in client_address;                     // 用于存储客户端的地址信息
     socklen_t client_addrlength = sizeof(client_address);  // 客户端地址结构体的大小
 
     if (0 == m_LISTENTrigmode) {  // 如果监听模式为水平触发（LT）
-        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address,
+        int connfd = accept(listenfd, (struct sockaddr *)&client_address,
             &client_addrlength);  // 接受客户端连接，返回连接的文件描述符
         if (connfd < 0) {         // 如果接受连接失败
             LOG_ERROR("%s:errno is:%d", "accept error", errno);  // 记录错误日志
@@ -235,10 +384,13 @@ bool WebServer::dealclientdata() {
             LOG_ERROR("%s", "Internal server busy");  // 记录错误日志
             return false;                             // 返回 false，表示处理失败
         }
-        timer(connfd, client_address);  // 为新的连接创建定时器
+        if (listenfd == m_tls_listenfd)
+            tls_server::get_instance()->accept(connfd, client_address);
+        else
+            timer(connfd, client_address);  // 为新的连接创建定时器
     } else {                            // 如果监听模式为边缘触发（ET）
         while (1) {
-            int connfd = accept(m_listenfd, (struct sockaddr *)&client_address,
+            int connfd = accept(listenfd, (struct sockaddr *)&client_address,
                 &client_addrlength);  // 接受客户端连接，返回连接的文件描述符
             if (connfd < 0) {         // 如果接受连接失败
                 LOG_ERROR("%s:errno is:%d", "accept error",
@@ -251,7 +403,10 @@ bool WebServer::dealclientdata() {
                 LOG_ERROR("%s", "Internal server busy");  // 记录错误日志
                 break;                                    // 跳出循环
             }
-            timer(connfd, client_address);  // 为新的连接创建定时器
+            if (listenfd == m_tls_listenfd)
+                tls_server::get_instance()->accept(connfd, client_address);
+            else
+                timer(connfd, client_address);  // 为新的连接创建定时器
         }
         return false;  // 返回 false，表示处理失败
     }
@@ -280,6 +435,13 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server) {
                     stop_server = true;  // 设置 stop_server 标志为 true
                     break;               // 跳出 switch
                 }
+                case SIGUSR1:
+                case SIGUSR2: {
+                    Log::shift_levels(signals[i] == SIGUSR1 ? 1 : -1);
+                    // 调整之后的级别可能已高于 WARN，用 stderr 保证能看到
+                    fprintf(stderr, "log levels: %s\n", Log::levels().c_str());
+                    break;
+                }
             }
         }
     }
@@ -296,7 +458,9 @@ void WebServer::dealwithread(int sockfd) {
         }
 
         // 若监测到读事件，将该事件放入请求队列
-        m_pool->append(users + sockfd, 0);  // 将读事件添加到线程池的任务队列中
+        users[sockfd].mark_queued();  // 访问日志的排队计时
+        if (!m_pool->append(users + sockfd, 0))  // 将读事件添加到线程池的任务队列中
+            LOG_AT(LOG_MOD_POOL, LOG_LEVEL_WARN, "thread pool queue full, fd %d", sockfd);
 
         while (true) {                                // 循环等待事件处理完成
             if (1 == users[sockfd].improv) {          // 如果事件处理完成
@@ -314,8 +478,9 @@ void WebServer::dealwithread(int sockfd) {
             LOG_INFO("deal with the client(%s)",
                 inet_ntoa(users[sockfd].get_address()->sin_addr));  // 记录日志，处理客户端数据
 
-            // 若监测到读事件，将该事件放入请求队列
-            m_pool->append_p(users + sockfd);  // 将读事件添加到线程池的任务队列中
+            // 若监测到读事件，将该事件放入请求队列；这一轮的事件处理完后由 submit_batch() 一起提交
+            users[sockfd].mark_queued();
+            m_batch[m_batch_len++] = users + sockfd;
 
             if (timer) {              // 如果定时器存在
                 adjust_timer(timer);  // 调整定时器的时间
@@ -326,6 +491,14 @@ void WebServer::dealwithread(int sockfd) {
     }
 }
 
+void WebServer::submit_batch() {
+    if (m_batch_len == 0) return;
+    int n = m_pool->append_batch(m_batch, m_batch_len);  // 只唤醒一次工作线程
+    for (int i = n; i < m_batch_len; ++i)
+        LOG_AT(LOG_MOD_POOL, LOG_LEVEL_WARN, "thread pool queue full, fd %d", (int)(m_batch[i] - users));
+    m_batch_len = 0;
+}
+
 void WebServer::dealwithwrite(int sockfd) {
     util_timer *timer = users_timer[sockfd].timer;  // 获取与 sockfd 对应的定时器
 
@@ -335,7 +508,8 @@ void WebServer::dealwithwrite(int sockfd) {
             adjust_timer(timer);  // 调整定时器的时间
         }
 
-        m_pool->append(users + sockfd, 1);  // 将写事件添加到线程池的任务队列中
+        if (!m_pool->append(users + sockfd, 1))  // 将写事件添加到线程池的任务队列中
+            LOG_AT(LOG_MOD_POOL, LOG_LEVEL_WARN, "thread pool queue full, fd %d", sockfd);
 
         while (true) {                                // 循环等待事件处理完成
             if (1 == users[sockfd].improv) {          // 如果事件处理完成
@@ -347,12 +521,14 @@ void WebServer::dealwithwrite(int sockfd) {
                 break;                     // 跳出循环
             }
         }
+        handoff(sockfd);
     } else {  // 如果当前是 proactor 模式
         // proactor
         if (users[sockfd].write()) {  // 如果成功写入数据
             LOG_INFO("send data to the client(%s)",
                 inet_ntoa(users[sockfd].get_address()->sin_addr));  // 记录日志，发送数据给客户端
 
+            if (handoff(sockfd)) return;
             if (timer) {              // 如果定时器存在
                 adjust_timer(timer);  // 调整定时器的时间
             }
@@ -362,6 +538,16 @@ void WebServer::dealwithwrite(int sockfd) {
     }
 }
 
+// 101 响应发完的连接交给 ws_server：摘下 HTTP 定时器，之后的保活由 ws_server 的 ping 负责
+bool WebServer::handoff(int sockfd) {
+    if (!users[sockfd].detached()) return false;
+    util_timer *timer = users_timer[sockfd].timer;
+    if (timer) utils.m_timer_lst.del_timer(timer);
+    users_timer[sockfd].timer = NULL;
+    users[sockfd].handoff();
+    return true;
+}
+
 void WebServer::eventLoop() {
     bool timeout = false;      // 用于标记是否超时
     bool stop_server = false;  // 用于标记是否停止服务器
@@ -372,14 +558,19 @@ void WebServer::eventLoop() {
             LOG_ERROR("%s", "epoll failure");  // 记录错误日志
             break;                             // 跳出循环
         }
+        // 处理这一批事件之前刷新 Date，同一秒内只比较一次秒数；
+        // 空闲时循环最多阻塞到下一次 SIGALRM，之后第一批事件前就会刷新
+        http_date::update(time(NULL));
 
         for (int i = 0; i < number; i++) {   // 遍历所有发生的事件
             int sockfd = events[i].data.fd;  // 获取事件对应的文件描述符
 
             // 处理新到的客户连接
-            if (sockfd == m_listenfd) {        // 如果是监听 socket 的事件
-                bool flag = dealclientdata();  // 处理客户端连接
+            if (sockfd == m_listenfd || sockfd == m_tls_listenfd) {  // 如果是监听 socket 的事件
+                bool flag = dealclientdata(sockfd);                    // 处理客户端连接
                 if (false == flag) continue;   // 如果处理失败，继续下一个事件
+            } else if (event_hub::get_instance()->dispatch(sockfd, events[i].events)) {
+                // 上游连接、健康检查和跨线程任务，已由 event_hub 处理
             } else if (events[i].events &
                        (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {  // 如果发生错误或连接关闭
                 // 服务器端关闭连接，移除对应的定时器
@@ -399,10 +590,14 @@ void WebServer::eventLoop() {
                 dealwithwrite(sockfd);                 // 处理写事件
             }
         }
+        submit_batch();  // 这一轮读到数据的连接一次交给线程池
         if (timeout) {                     // 如果超时
             utils.timer_handler();         // 处理定时器事件
-            LOG_INFO("%s", "timer tick");  // 记录日志，定时器触发
+            event_hub::get_instance()->tick();  // 健康检查和代理请求超时
+            LOG_AT(LOG_MOD_TIMER, LOG_LEVEL_INFO, "%s", "timer tick");  // 记录日志，定时器触发
+            if (0 == m_close_log) Log::get_instance()->flush();  // 日志很少时也在一个 TIMESLOT 内刷新
             timeout = false;               // 重置超时标志
         }
     }
+    if (0 == m_close_log) Log::get_instance()->sync();  // 退出前把日志写完并落盘
 }
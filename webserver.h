@@ -13,9 +13,18 @@
 
 #include <cassert>
 
+#include "./CGImysql/account.h"       // 登录和注册接口
 #include "./http/http_conn.h"         // HTTP连接处理类
+#include "./http/vhost.h"             // 虚拟主机
 #include "./threadpool/threadpool.h"  // 线程池实现
+#include "./upload/picture_routes.h"  // 图片上传
+#include "./tls/tls.h"                // TLS 握手
+#include "./upstream/event_hub.h"     // 非客户端 fd 的事件分派
+#include "./upstream/fastcgi.h"       // FastCGI 客户端
+#include "./upstream/proxy.h"         // 反向代理
+#include "./websocket/topic_routes.h" // WebSocket 主题广播
 #include "./log/log.h"  // 显式声明对Log类的依赖
+#include "./log/log_routes.h"  // 日志级别管理接口
 
 // 全局常量定义
 const int MAX_FD = 65536;            // 最大文件描述符数量（限制并发连接数）
@@ -30,32 +39,46 @@ class WebServer {
     // 初始化服务器配置
     void init(int port, string user, string passWord, string databaseName,
               int log_write, int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, int compress_threads,
+              int handler_threads, const vector<string> &proxy_specs,
+              const vector<string> &fastcgi_specs, const vector<string> &vhost_specs, int tls_port, const string &tls_cert,
+              const string &tls_key, const string &log_levels, int log_segment_mb,
+              const string &log_backpressure, int access_format, int ws_topics);
 
     // 核心功能模块初始化
     void thread_pool();  // 初始化线程池
     void sql_pool();     // 初始化数据库连接池
     void log_write();    // 初始化日志系统
+    void static_cache(); // 初始化虚拟主机表、各主机的静态文件缓存和后台压缩线程
+    void route_table();  // 初始化各主机的路由表、阻塞处理函数线程池、反向代理和 FastCGI
     void trig_mode();    // 设置触发模式（LT/ET）
     void eventListen();  // 启动监听socket
+    int listen_socket(int port);  // 创建绑定到 port 的监听socket
     void eventLoop();    // 主事件循环
 
     // 定时器管理
-    void timer(int connfd, struct sockaddr_in client_address);  // 创建定时器
+    void timer(int connfd, struct sockaddr_in client_address, SSL *ssl = NULL);  // 创建定时器
     void adjust_timer(util_timer *timer);                       // 调整定时器
     void deal_timer(util_timer *timer, int sockfd);  // 处理超时定时器
 
     // 事件处理
-    bool dealclientdata();                                  // 处理新客户端连接
+    bool dealclientdata(int listenfd);                      // 处理新客户端连接
     bool dealwithsignal(bool &timeout, bool &stop_server);  // 处理信号
     void dealwithread(int sockfd);                          // 处理读事件
     void dealwithwrite(int sockfd);                         // 处理写事件
+    void submit_batch();                                    // 把这一轮攒下的读任务一次交给线程池
+    bool handoff(int sockfd);                               // 把升级为 WebSocket 的连接交给 ws_server
 
    public:
     // ---------- 基础配置 ----------
     int m_port;        // 服务器监听端口
     char *m_root;      // 服务器根目录路径
-    int m_log_write;   // 日志写入方式（0同步/1异步）
+    int m_log_write;   // 日志写入方式（0同步/1异步/2二进制）
+    string m_log_levels; // 日志级别配置，格式见 Log::set_levels()
+    int m_log_segment_mb; // 日志段大小（MB），0 表示用 stdio 写日志文件
+    string m_log_backpressure; // 异步日志环满时的处理方式，格式见 Log::set_backpressure()
+    int m_access_format; // 访问日志格式（access_format），与 m_close_log 无关
+    int m_ws_topics;     // 是否注册 WebSocket 主题广播接口
     int m_close_log;   // 是否关闭日志（0不关闭/1关闭）
     int m_actormodel;  // 并发模型（0 Proactor/1 Reactor）
 
@@ -71,9 +94,27 @@ class WebServer {
     string m_databaseName;        // 数据库名
     int m_sql_num;                // 数据库连接池大小
 
+    // ---------- 虚拟主机和静态文件缓存相关 ----------
+    vhost_table *m_vhosts;          // 虚拟主机表，每个主机有自己的文档根目录、路由表和文件缓存，所有连接共享
+    vector<string> m_vhost_specs;   // 虚拟主机配置，每项为 名字[,别名]=目录[@缓存MB[:缓存文件数]]
+    int m_compress_threads;         // 后台压缩线程数（0 表示只使用预压缩文件）
+
+    // ---------- 路由相关 ----------
+    int m_handler_threads;        // 阻塞处理函数线程数（0 表示在工作线程中执行）
+    vector<string> m_proxy_specs; // 反向代理配置，每项为 [主机名]前缀=host:port[,...][@rr|@lc]
+    vector<string> m_fastcgi_specs; // FastCGI 配置，每项为 [主机名]前缀=socket路径
+
+    // ---------- TLS 相关 ----------
+    int m_tls_port;      // HTTPS 端口（0 表示不启用）
+    string m_tls_cert;   // PEM 证书链路径
+    string m_tls_key;    // PEM 私钥路径
+    int m_tls_listenfd;  // HTTPS 监听socket，未启用时为 -1
+
     // ---------- 线程池相关 ----------
     threadpool<http_conn> *m_pool;  // 线程池指针
     int m_thread_num;               // 线程池线程数量
+    http_conn *m_batch[MAX_EVENT_NUMBER];  // Proactor 模式下这一轮 epoll_wait 读完数据、等待交给线程池的连接
+    int m_batch_len;
 
     // ---------- epoll事件相关 ----------
     epoll_event events[MAX_EVENT_NUMBER];  // 存储epoll返回的事件
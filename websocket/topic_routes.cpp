@@ -0,0 +1,21 @@
+/**
+ * @file topic_routes.cpp
+ * @brief 主题广播接口的实现
+ */
+
+#include "topic_routes.h"
+
+static const size_t MAX_TOPIC_MESSAGE = 64 * 1024;  // 广播消息的最大长度
+
+bool topic_routes(http_conn::router &r) {
+    ws_endpoint topic;
+    topic.max_message = MAX_TOPIC_MESSAGE;
+    topic.on_open = [](ws_conn &conn) { conn.subscribe(std::string(conn.param("topic"))); };
+    topic.on_message = [](ws_conn &conn, std::string_view data, bool binary) {
+        // 帧只编码一次，所有订阅者共享
+        std::shared_ptr<const std::string> frame =
+            std::make_shared<const std::string>(ws_frame(binary ? WS_BINARY : WS_TEXT, data));
+        ws_server::get_instance()->publish_frame(std::string(conn.param("topic")), frame);
+    };
+    return http_conn::add_websocket(r, "/ws/:topic", topic);
+}
@@ -0,0 +1,17 @@
+/**
+ * @file topic_routes.h
+ * @brief 基于 WebSocket 的主题广播接口
+ *
+ * /ws/:topic 握手后订阅 topic，连接上收到的每条消息原样发布给该主题的所有订阅者（包括发送者）。
+ * 仪表盘页面订阅主题，后台任务经 ws_server::publish() 推送更新，不再每秒轮询。
+ */
+
+#ifndef TOPIC_ROUTES_H
+#define TOPIC_ROUTES_H
+
+#include "../http/http_conn.h"
+
+// 向路由表注册主题广播接口，路由冲突时返回 false
+bool topic_routes(http_conn::router &r);
+
+#endif
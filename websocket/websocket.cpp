@@ -0,0 +1,651 @@
+/**
+ * @file websocket.cpp
+ * @brief WebSocket 服务端的实现
+ */
+
+#define LOG_MODULE LOG_MOD_HTTP
+
+#include "websocket.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "../http/http_conn.h"
+#include "../log/log.h"
+
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const int MAX_READS = 16;  // 一次事件最多读多少次，避免一条连接独占主循环
+static const int MAX_IOV = 64;    // 一次 writev 最多发送的帧数
+
+static inline uint32_t rol(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+
+// SHA-1，只用于握手时计算 Sec-WebSocket-Accept
+static void sha1(const unsigned char *data, size_t len, unsigned char out[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    size_t total = ((len + 8) / 64 + 1) * 64;
+    std::string msg(total, '\0');
+    memcpy(&msg[0], data, len);
+    msg[len] = (char)0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; ++i) msg[total - 1 - i] = (char)(bits >> (8 * i));
+
+    const unsigned char *p = (const unsigned char *)msg.data();
+    for (size_t off = 0; off < total; off += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+            w[i] = ((uint32_t)p[off + 4 * i] << 24) | ((uint32_t)p[off + 4 * i + 1] << 16) |
+                   ((uint32_t)p[off + 4 * i + 2] << 8) | p[off + 4 * i + 3];
+        for (int i = 16; i < 80; ++i) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 5; ++i) {
+        out[4 * i] = (unsigned char)(h[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(h[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(h[i] >> 8);
+        out[4 * i + 3] = (unsigned char)h[i];
+    }
+}
+
+void ws_accept_key(std::string_view key, char *out) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string input(key);
+    input += WS_GUID;
+    unsigned char digest[21];
+    sha1((const unsigned char *)input.data(), input.size(), digest);
+    digest[20] = 0;
+
+    // base64：20 字节摘要编码为 28 个字符，最后一组只有 2 字节，补一个 '='
+    char *q = out;
+    for (int i = 0; i < 21; i += 3) {
+        uint32_t v = (digest[i] << 16) | (digest[i + 1] << 8) | digest[i + 2];
+        *q++ = table[(v >> 18) & 63];
+        *q++ = table[(v >> 12) & 63];
+        *q++ = table[(v >> 6) & 63];
+        *q++ = table[v & 63];
+    }
+    out[WS_ACCEPT_LEN - 1] = '=';
+    out[WS_ACCEPT_LEN] = '\0';
+}
+
+size_t ws_frame_header(char *out, int opcode, size_t len) {
+    out[0] = (char)(0x80 | opcode);
+    if (len < 126) {
+        out[1] = (char)len;
+        return 2;
+    }
+    if (len <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = (char)(len >> 8);
+        out[3] = (char)len;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; ++i) out[2 + i] = (char)((uint64_t)len >> (56 - 8 * i));
+    return 10;
+}
+
+std::string ws_frame(int opcode, std::string_view payload) {
+    char head[WS_MAX_HEADER];
+    size_t n = ws_frame_header(head, opcode, payload.size());
+    std::string frame;
+    frame.reserve(n + payload.size());
+    frame.append(head, n);
+    frame.append(payload.data(), payload.size());
+    return frame;
+}
+
+void ws_unmask(char *data, size_t len, const unsigned char key[4], size_t offset) {
+    // 把掩码按 offset 旋转，使 rotated[0] 对应 data[0]
+    unsigned char rotated[4];
+    for (int i = 0; i < 4; ++i) rotated[i] = key[(offset + i) & 3];
+    uint32_t mask32;
+    memcpy(&mask32, rotated, 4);
+
+    unsigned char *p = (unsigned char *)data;
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i m256 = _mm256_set1_epi32((int)mask32);
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_xor_si256(v, m256));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i m128 = _mm_set1_epi32((int)mask32);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        _mm_storeu_si128((__m128i *)(p + i), _mm_xor_si128(v, m128));
+    }
+#elif defined(__ARM_NEON)
+    uint8x16_t m128 = vreinterpretq_u8_u32(vdupq_n_u32(mask32));
+    for (; i + 16 <= len; i += 16) vst1q_u8(p + i, veorq_u8(vld1q_u8(p + i), m128));
+#endif
+    // 每处理 4 的倍数个字节，掩码的相位不变
+    uint64_t mask64 = ((uint64_t)mask32 << 32) | mask32;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        v ^= mask64;
+        memcpy(p + i, &v, 8);
+    }
+    for (; i < len; ++i) p[i] ^= rotated[i & 3];
+}
+
+bool ws_utf8_valid(const char *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i = 0;
+    while (i < len) {
+        // 常见的 ASCII 文本每次检查 8 字节
+        if (i + 8 <= len) {
+            uint64_t v;
+            memcpy(&v, p + i, 8);
+            if (!(v & 0x8080808080808080ULL)) {
+                i += 8;
+                continue;
+            }
+        }
+        unsigned char c = p[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t n;
+        unsigned char lo = 0x80, hi = 0xBF;  // 第二个字节的范围，排除过长编码、代理项和超出范围的码点
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else {
+            return false;
+        }
+        if (len - i <= n) return false;  // 不完整的多字节序列
+        if (p[i + 1] < lo || p[i + 1] > hi) return false;
+        for (size_t k = 2; k <= n; ++k)
+            if ((p[i + k] & 0xC0) != 0x80) return false;
+        i += n + 1;
+    }
+    return true;
+}
+
+ws_conn::ws_conn(int fd, uint64_t id, std::unique_ptr<ws_upgrade> info, int close_log)
+    : m_fd(fd),
+      m_id(id),
+      m_info(std::move(*info)),
+      m_in(std::move(m_info.pending)),
+      m_msg_opcode(0),
+      m_out_bytes(0),
+      m_armed(0),
+      m_closing(false),
+      m_dead(false),
+      m_last_rx(time(NULL)),
+      m_ping_sent(false),
+      m_close_log(close_log) {}
+
+std::string_view ws_conn::param(std::string_view name) const {
+    for (size_t i = 0; i < m_info.params.size(); ++i)
+        if (m_info.params[i].first == name) return m_info.params[i].second;
+    return std::string_view();
+}
+
+bool ws_conn::send(std::string_view data, bool binary) {
+    if (m_dead || m_closing) return false;
+    return enqueue(std::make_shared<const std::string>(ws_frame(binary ? WS_BINARY : WS_TEXT, data)));
+}
+
+void ws_conn::close(int code, std::string_view reason) {
+    if (m_dead || m_closing) return;
+    char payload[125];
+    payload[0] = (char)(code >> 8);
+    payload[1] = (char)code;
+    size_t n = reason.size() < sizeof(payload) - 2 ? reason.size() : sizeof(payload) - 2;
+    memcpy(payload + 2, reason.data(), n);
+    send_control(WS_CLOSE, std::string_view(payload, n + 2));
+    m_closing = true;
+    if (m_out.empty())
+        kill();
+    else
+        arm();
+}
+
+void ws_conn::subscribe(const std::string &topic) {
+    for (size_t i = 0; i < m_subs.size(); ++i)
+        if (m_subs[i].topic == topic) return;
+    std::vector<ws_conn *> &subs = ws_server::get_instance()->m_topics[topic];
+    subscription sub = {topic, subs.size()};
+    subs.push_back(this);
+    m_subs.push_back(sub);
+}
+
+void ws_conn::unsubscribe(const std::string &topic) {
+    for (size_t i = 0; i < m_subs.size(); ++i) {
+        if (m_subs[i].topic != topic) continue;
+        drop_subscription(m_subs[i]);
+        m_subs[i] = m_subs.back();
+        m_subs.pop_back();
+        return;
+    }
+}
+
+// 从主题的订阅者数组中删除：用最后一个订阅者填补空位，并更新它记录的下标
+void ws_conn::drop_subscription(const subscription &sub) {
+    ws_server *server = ws_server::get_instance();
+    auto it = server->m_topics.find(sub.topic);
+    if (it == server->m_topics.end()) return;
+    std::vector<ws_conn *> &subs = it->second;
+    ws_conn *last = subs.back();
+    subs[sub.index] = last;
+    subs.pop_back();
+    if (last != this) {
+        for (size_t i = 0; i < last->m_subs.size(); ++i) {
+            if (last->m_subs[i].topic == sub.topic) {
+                last->m_subs[i].index = sub.index;
+                break;
+            }
+        }
+    }
+    if (subs.empty()) server->m_topics.erase(it);
+}
+
+void ws_conn::on_io(int, uint32_t events) {
+    m_armed = 0;  // EPOLLONESHOT：事件触发后需要重新注册
+    if (m_dead) return;
+    if (events & EPOLLERR) {
+        kill();
+        return;
+    }
+    if ((events & EPOLLOUT) && !flush()) {
+        kill();
+        return;
+    }
+    if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && !read()) return;
+    if (m_dead) return;
+    if (m_closing && m_out.empty()) {
+        kill();
+        return;
+    }
+    arm();
+}
+
+bool ws_conn::read() {
+    char *buf = ws_server::get_instance()->buffer();
+    for (int round = 0; round < MAX_READS; ++round) {
+        ssize_t n = recv(m_fd, buf, ws_server::BUFFER_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            kill();
+            return false;
+        }
+        if (n == 0) {
+            kill();
+            return false;
+        }
+        m_last_rx = time(NULL);
+        m_ping_sent = false;
+        if (m_closing) continue;  // 已发出关闭帧，丢弃之后的数据，等待对方关闭
+
+        // 缓冲区中没有残留时直接在读缓冲区中解码，只把不完整的帧尾留下
+        size_t used = 0;
+        if (m_in.empty()) {
+            if (!parse(buf, n, used)) return false;
+            if (used < (size_t)n && !m_closing) m_in.assign(buf + used, n - used);
+        } else {
+            m_in.append(buf, n);
+            if (!parse(&m_in[0], m_in.size(), used)) return false;
+            m_in.erase(0, used);
+        }
+        if ((size_t)n < ws_server::BUFFER_SIZE) break;
+    }
+    return true;
+}
+
+bool ws_conn::parse(char *data, size_t len, size_t &used) {
+    size_t pos = 0;
+    while (!m_dead && !m_closing) {
+        size_t avail = len - pos;
+        if (avail < 2) break;
+        const unsigned char *p = (const unsigned char *)data + pos;
+        bool fin = p[0] & 0x80;
+        int opcode = p[0] & 0x0F;
+        if (p[0] & 0x70) {
+            fail(WS_CLOSE_PROTOCOL_ERROR, "reserved bits set");
+            break;
+        }
+        if (!(p[1] & 0x80)) {
+            fail(WS_CLOSE_PROTOCOL_ERROR, "unmasked client frame");
+            break;
+        }
+        uint64_t plen = p[1] & 0x7F;
+        size_t head = 2;
+        if (plen == 126) {
+            if (avail < 4) break;
+            plen = ((uint64_t)p[2] << 8) | p[3];
+            head = 4;
+        } else if (plen == 127) {
+            if (avail < 10) break;
+            plen = 0;
+            for (int i = 0; i < 8; ++i) plen = (plen << 8) | p[2 + i];
+            head = 10;
+        }
+        // 先检查长度再等待数据，超长的帧不会被缓冲
+        if (plen > m_info.endpoint->max_message) {
+            fail(WS_CLOSE_TOO_BIG, "frame too big");
+            break;
+        }
+        if (avail < head + 4 + plen) break;
+
+        unsigned char key[4];
+        memcpy(key, p + head, 4);
+        char *payload = data + pos + head + 4;
+        ws_unmask(payload, plen, key, 0);
+        pos += head + 4 + plen;
+        if (!handle_frame(opcode, fin, payload, plen)) break;
+    }
+    used = pos;
+    return !m_dead;
+}
+
+bool ws_conn::handle_frame(int opcode, bool fin, char *payload, size_t len) {
+    if ((opcode & 0x08) && (!fin || len > 125)) {
+        fail(WS_CLOSE_PROTOCOL_ERROR, "bad control frame");
+        return false;
+    }
+    switch (opcode) {
+        case WS_PING:
+            send_control(WS_PONG, std::string_view(payload, len));
+            return true;
+        case WS_PONG:
+            return true;
+        case WS_CLOSE: {
+            // 回应对方的关闭码，发完后关闭连接
+            int code = WS_CLOSE_NORMAL;
+            if (len >= 2) code = ((unsigned char)payload[0] << 8) | (unsigned char)payload[1];
+            close(code);
+            return false;
+        }
+        case WS_TEXT:
+        case WS_BINARY:
+            if (m_msg_opcode) {
+                fail(WS_CLOSE_PROTOCOL_ERROR, "expected continuation frame");
+                return false;
+            }
+            if (fin) {
+                if (opcode == WS_TEXT && !ws_utf8_valid(payload, len)) {
+                    fail(WS_CLOSE_INVALID_DATA, "invalid utf-8 in text message");
+                    return false;
+                }
+                deliver(std::string_view(payload, len), opcode == WS_BINARY);
+            } else {
+                m_msg_opcode = opcode;
+                m_msg.assign(payload, len);
+            }
+            return true;
+        case WS_CONTINUATION:
+            if (!m_msg_opcode) {
+                fail(WS_CLOSE_PROTOCOL_ERROR, "unexpected continuation frame");
+                return false;
+            }
+            if (m_msg.size() + len > m_info.endpoint->max_message) {
+                fail(WS_CLOSE_TOO_BIG, "message too big");
+                return false;
+            }
+            m_msg.append(payload, len);
+            if (fin) {
+                // 分片的文本消息合并后整体检查，码点可能跨两个分片
+                if (m_msg_opcode == WS_TEXT && !ws_utf8_valid(m_msg.data(), m_msg.size())) {
+                    fail(WS_CLOSE_INVALID_DATA, "invalid utf-8 in text message");
+                    return false;
+                }
+                deliver(m_msg, m_msg_opcode == WS_BINARY);
+                m_msg_opcode = 0;
+                m_msg.clear();
+            }
+            return true;
+        default:
+            fail(WS_CLOSE_PROTOCOL_ERROR, "unknown opcode");
+            return false;
+    }
+}
+
+void ws_conn::deliver(std::string_view data, bool binary) {
+    if (m_info.endpoint->on_message) m_info.endpoint->on_message(*this, data, binary);
+}
+
+void ws_conn::fail(int code, const char *why) {
+    LOG_WARN("websocket %s: %s", m_info.remote_addr.c_str(), why);
+    close(code, why);
+}
+
+void ws_conn::send_control(int opcode, std::string_view payload) {
+    enqueue(std::make_shared<const std::string>(ws_frame(opcode, payload)));
+}
+
+bool ws_conn::enqueue(const std::shared_ptr<const std::string> &frame) {
+    if (m_dead || m_closing) return false;
+    if (m_out.empty()) {
+        // 队列为空时直接发送，多数消息在这里就发完了，不需要注册写事件
+        ssize_t n = ::send(m_fd, frame->data(), frame->size(), MSG_NOSIGNAL);
+        if (n == (ssize_t)frame->size()) return true;
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                kill();
+                return false;
+            }
+            n = 0;
+        }
+        out_chunk chunk = {frame, (size_t)n};
+        m_out.push_back(chunk);
+        m_out_bytes += frame->size() - n;
+        arm();
+        return true;
+    }
+    if (m_out_bytes + frame->size() > ws_server::MAX_OUT_BYTES) {
+        LOG_WARN("websocket %s: slow consumer, %zu bytes pending", m_info.remote_addr.c_str(), m_out_bytes);
+        kill();
+        return false;
+    }
+    out_chunk chunk = {frame, 0};
+    m_out.push_back(chunk);
+    m_out_bytes += frame->size();
+    return true;
+}
+
+bool ws_conn::flush() {
+    struct iovec iov[MAX_IOV];
+    while (!m_out.empty()) {
+        int count = 0;
+        for (auto it = m_out.begin(); it != m_out.end() && count < MAX_IOV; ++it, ++count) {
+            iov[count].iov_base = (char *)it->data->data() + it->off;
+            iov[count].iov_len = it->data->size() - it->off;
+        }
+        ssize_t n = writev(m_fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        m_out_bytes -= n;
+        while (n > 0) {
+            out_chunk &front = m_out.front();
+            size_t left = front.data->size() - front.off;
+            if ((size_t)n < left) {
+                front.off += n;
+                break;
+            }
+            n -= left;
+            m_out.pop_front();
+        }
+    }
+    return true;
+}
+
+void ws_conn::arm() {
+    if (m_dead) return;
+    uint32_t want = EPOLLIN | EPOLLRDHUP | (m_out.empty() ? 0u : (uint32_t)EPOLLOUT);
+    if (want == m_armed) return;
+    if (event_hub::get_instance()->mod(m_fd, want)) m_armed = want;
+}
+
+void ws_conn::kill() {
+    if (m_dead) return;
+    m_dead = true;
+    ws_server::get_instance()->bury(this);
+}
+
+void ws_conn::destroy() {
+    if (m_info.endpoint->on_close) m_info.endpoint->on_close(*this);
+    while (!m_subs.empty()) {
+        drop_subscription(m_subs.back());
+        m_subs.pop_back();
+    }
+    ws_server::get_instance()->m_conns.erase(m_id);
+    event_hub::get_instance()->del(m_fd);
+    ::close(m_fd);
+    --http_conn::m_user_count;
+    delete this;
+}
+
+void ws_server::init(int close_log) {
+    m_close_log = close_log;
+    if (!m_started) {
+        event_hub::get_instance()->add_tick([this]() { tick(); });
+        m_started = true;
+    }
+}
+
+void ws_server::adopt(int fd, std::unique_ptr<ws_upgrade> info) {
+    // 广播的消息都很小，关掉 Nagle 以降低延迟
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    ws_conn *conn = new ws_conn(fd, m_next_id++, std::move(info), m_close_log);
+    m_conns[conn->m_id] = conn;
+    if (!event_hub::get_instance()->adopt(fd, EPOLLIN | EPOLLRDHUP, conn)) {
+        LOG_ERROR("websocket: adopt fd %d failed", fd);
+        m_conns.erase(conn->m_id);
+        ::close(fd);
+        --http_conn::m_user_count;
+        delete conn;
+        return;
+    }
+    conn->m_armed = EPOLLIN | EPOLLRDHUP;
+    if (conn->m_info.endpoint->on_open) conn->m_info.endpoint->on_open(*conn);
+    // 握手时已经读入的帧不会再触发读事件，这里先处理掉
+    if (!conn->m_in.empty() && !conn->m_dead) {
+        size_t used = 0;
+        if (conn->parse(&conn->m_in[0], conn->m_in.size(), used)) {
+            conn->m_in.erase(0, used);
+            if (conn->m_closing && conn->m_out.empty())
+                conn->kill();
+            else
+                conn->arm();
+        }
+    }
+}
+
+void ws_server::send(uint64_t id, std::string_view data, bool binary) {
+    std::shared_ptr<const std::string> frame =
+        std::make_shared<const std::string>(ws_frame(binary ? WS_BINARY : WS_TEXT, data));
+    event_hub::get_instance()->run_in_loop([this, id, frame]() {
+        auto it = m_conns.find(id);
+        if (it != m_conns.end()) it->second->enqueue(frame);
+    });
+}
+
+void ws_server::publish(const std::string &topic, std::string_view data, bool binary) {
+    std::shared_ptr<const std::string> frame =
+        std::make_shared<const std::string>(ws_frame(binary ? WS_BINARY : WS_TEXT, data));
+    event_hub::get_instance()->run_in_loop([this, topic, frame]() { publish_frame(topic, frame); });
+}
+
+size_t ws_server::publish_frame(const std::string &topic, const std::shared_ptr<const std::string> &frame) {
+    auto it = m_topics.find(topic);
+    if (it == m_topics.end()) return 0;
+    // 发送失败的订阅者只做标记，数组在遍历期间保持不变
+    std::vector<ws_conn *> &subs = it->second;
+    for (size_t i = 0; i < subs.size(); ++i) subs[i]->enqueue(frame);
+    return subs.size();
+}
+
+size_t ws_server::subscribers(const std::string &topic) const {
+    auto it = m_topics.find(topic);
+    return it == m_topics.end() ? 0 : it->second.size();
+}
+
+void ws_server::bury(ws_conn *conn) {
+    m_graveyard.push_back(conn);
+    if (m_graveyard.size() == 1) event_hub::get_instance()->post([this]() { sweep(); });
+}
+
+void ws_server::sweep() {
+    std::vector<ws_conn *> dead;
+    dead.swap(m_graveyard);
+    for (size_t i = 0; i < dead.size(); ++i) dead[i]->destroy();
+}
+
+void ws_server::tick() {
+    time_t now = time(NULL);
+    // 所有连接共用同一个 ping 帧
+    std::shared_ptr<const std::string> ping = std::make_shared<const std::string>(ws_frame(WS_PING, ""));
+    for (auto it = m_conns.begin(); it != m_conns.end(); ++it) {
+        ws_conn *conn = it->second;
+        if (conn->m_dead) continue;
+        time_t idle = now - conn->m_last_rx;
+        if (conn->m_closing || conn->m_ping_sent) {
+            if (idle >= WS_PING_INTERVAL + WS_PONG_TIMEOUT) conn->kill();
+        } else if (idle >= WS_PING_INTERVAL) {
+            conn->m_ping_sent = true;
+            conn->enqueue(ping);
+        }
+    }
+}
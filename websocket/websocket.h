@@ -0,0 +1,210 @@
+/**
+ * @file websocket.h
+ * @brief WebSocket 服务端
+ *
+ * 仪表盘之类每秒轮询的页面改用 WebSocket 后，一条长连接代替每秒一次的请求解析和定时器调整。
+ * 主要特点：
+ * 1. 握手由 http_conn 完成（路由类型 ROUTE_WEBSOCKET），101 响应发出后连接从 HTTP 定时器中摘下，
+ *    通过 event_hub 交给 ws_server，之后的读写、帧编解码都在主循环线程中进行，不占用工作线程
+ * 2. 帧解码在读缓冲区中原地进行，解掩码使用 SIMD（SSE2/AVX2/NEON），未分片的消息不复制直接交给回调；
+ *    文本消息交给回调前检查 UTF-8，不合法时以 1007 关闭（RFC 6455 8.1）
+ * 3. 发布/订阅：publish() 只编码一次帧，所有订阅者的发送队列共享同一块缓冲区（shared_ptr），
+ *    发送队列为空的订阅者直接 send，积压超过上限的慢订阅者被断开
+ * 4. 保活随定时器信号每 TIMESLOT 秒检查一次：空闲超过 WS_PING_INTERVAL 秒发 ping，
+ *    之后 WS_PONG_TIMEOUT 秒内没有收到任何数据则断开
+ * 5. 回调在主循环线程中执行，不能阻塞；其他线程通过 ws_server::send()/publish() 发送，内部投递到主循环
+ */
+
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../upstream/event_hub.h"
+
+// 帧操作码
+enum WS_OPCODE {
+    WS_CONTINUATION = 0x0,
+    WS_TEXT = 0x1,
+    WS_BINARY = 0x2,
+    WS_CLOSE = 0x8,
+    WS_PING = 0x9,
+    WS_PONG = 0xA
+};
+
+// 关闭码
+enum WS_CLOSE_CODE {
+    WS_CLOSE_NORMAL = 1000,
+    WS_CLOSE_GOING_AWAY = 1001,
+    WS_CLOSE_PROTOCOL_ERROR = 1002,
+    WS_CLOSE_INVALID_DATA = 1007,
+    WS_CLOSE_POLICY = 1008,
+    WS_CLOSE_TOO_BIG = 1009
+};
+
+static const size_t WS_MAX_HEADER = 10;      // 服务器帧头的最大长度（不加掩码）
+static const size_t WS_ACCEPT_LEN = 28;      // Sec-WebSocket-Accept 的长度
+static const int WS_PING_INTERVAL = 30;      // 空闲多少秒后发 ping
+static const int WS_PONG_TIMEOUT = 15;       // 发 ping 后多少秒内没有数据视为断开
+
+// 计算握手响应的 Sec-WebSocket-Accept，out 至少 WS_ACCEPT_LEN + 1 字节
+void ws_accept_key(std::string_view key, char *out);
+// 生成服务器帧头（FIN=1，不加掩码），返回帧头长度，out 至少 WS_MAX_HEADER 字节
+size_t ws_frame_header(char *out, int opcode, size_t len);
+// 编码一个完整的服务器帧
+std::string ws_frame(int opcode, std::string_view payload);
+// 原地解掩码，offset 为 data[0] 在负载中的位置
+void ws_unmask(char *data, size_t len, const unsigned char key[4], size_t offset);
+// 是否为合法的 UTF-8（拒绝过长编码、代理项和超过 U+10FFFF 的码点）
+bool ws_utf8_valid(const char *data, size_t len);
+
+class ws_conn;
+
+// WebSocket 接口：路由命中且握手成功后，连接上的事件回调这些函数
+struct ws_endpoint {
+    std::function<void(ws_conn &conn)> on_open;                                          // 握手完成
+    std::function<void(ws_conn &conn, std::string_view data, bool binary)> on_message;  // 收到完整消息
+    std::function<void(ws_conn &conn)> on_close;                                         // 连接关闭
+    size_t max_message = 1 << 20;  // 消息（含分片合并后）的最大长度，超过时以 1009 关闭
+};
+
+// 握手时从 HTTP 请求中保留下来的信息
+struct ws_upgrade {
+    const ws_endpoint *endpoint;                                // 路由对应的接口，服务器运行期间有效
+    std::string path;                                           // 请求路径
+    std::string query;                                          // 查询串
+    std::string remote_addr;                                    // 客户端 IP
+    std::vector<std::pair<std::string, std::string> > params;  // 路由参数
+    std::string pending;                                        // 客户端紧跟握手请求发来的数据
+};
+
+/**
+ * @brief 一条 WebSocket 连接
+ *
+ * 只在主循环线程中访问；回调之外需要发送时用 ws_server::send(id)。
+ */
+class ws_conn : public io_handler {
+   public:
+    uint64_t id() const { return m_id; }
+    const std::string &path() const { return m_info.path; }
+    const std::string &query() const { return m_info.query; }
+    const std::string &remote_addr() const { return m_info.remote_addr; }
+    // 按名字取路由参数，没有时返回空
+    std::string_view param(std::string_view name) const;
+
+    // 发送一条消息
+    bool send(std::string_view data, bool binary = false);
+    // 发送关闭帧，已排队的数据发完后关闭连接
+    void close(int code = WS_CLOSE_NORMAL, std::string_view reason = std::string_view());
+    // 订阅/退订主题，ws_server::publish() 发布的消息发给所有订阅者
+    void subscribe(const std::string &topic);
+    void unsubscribe(const std::string &topic);
+
+    void on_io(int fd, uint32_t events);
+
+   private:
+    friend class ws_server;
+
+    struct out_chunk {
+        std::shared_ptr<const std::string> data;  // 编码好的帧，可能被多个连接共享
+        size_t off;                               // 已发送的字节数
+    };
+    struct subscription {
+        std::string topic;  // 主题
+        size_t index;       // 在主题订阅者数组中的位置，用于 O(1) 退订
+    };
+
+    ws_conn(int fd, uint64_t id, std::unique_ptr<ws_upgrade> info, int close_log);
+    ~ws_conn() {}
+
+    bool enqueue(const std::shared_ptr<const std::string> &frame);  // 积压超过上限时返回 false
+    bool flush();                                                   // 出错时返回 false
+    bool read();                                                    // 连接已关闭时返回 false
+    bool parse(char *data, size_t len, size_t &used);               // 原地解码，used 为消耗的字节数
+    bool handle_frame(int opcode, bool fin, char *payload, size_t len);
+    void deliver(std::string_view data, bool binary);
+    void fail(int code, const char *why);
+    void arm();
+    void send_control(int opcode, std::string_view payload);
+    void drop_subscription(const subscription &sub);
+    void kill();     // 标记关闭，由 ws_server 稍后统一释放
+    void destroy();  // 释放连接，调用后不能再访问成员
+
+   private:
+    int m_fd;                                   // socket
+    uint64_t m_id;                              // 连接编号，不随 fd 复用
+    ws_upgrade m_info;                          // 握手信息
+    std::string m_in;                           // 尚未组成完整帧的数据
+    std::string m_msg;                          // 分片消息的合并缓冲
+    int m_msg_opcode;                           // 分片消息的类型，0 表示没有进行中的分片消息
+    std::deque<out_chunk> m_out;                // 发送队列
+    size_t m_out_bytes;                         // 发送队列中未发送的字节数
+    uint32_t m_armed;                           // 当前注册的事件，事件触发后为 0
+    bool m_closing;                             // 已发送关闭帧，发完后关闭连接
+    bool m_dead;                                // 已决定关闭，等待统一释放
+    time_t m_last_rx;                           // 最近一次收到数据的时间
+    bool m_ping_sent;                           // 是否已发出 ping 等待回应
+    std::vector<subscription> m_subs;           // 订阅的主题
+    int m_close_log;                            // 日志开关
+};
+
+/**
+ * @brief WebSocket 连接管理与发布/订阅（单例）
+ */
+class ws_server {
+   public:
+    static ws_server *get_instance() {
+        static ws_server instance;
+        return &instance;
+    }
+
+    // 注册保活检查，启动阶段调用
+    void init(int close_log);
+    // 接管已完成握手的 socket，主循环线程调用
+    void adopt(int fd, std::unique_ptr<ws_upgrade> info);
+
+    // 以下任意线程可调用，实际发送在主循环线程中进行
+    void send(uint64_t id, std::string_view data, bool binary = false);
+    void publish(const std::string &topic, std::string_view data, bool binary = false);
+
+    // 以下只在主循环线程中调用
+    // 把编码好的帧发给主题的所有订阅者，返回订阅者数量
+    size_t publish_frame(const std::string &topic, const std::shared_ptr<const std::string> &frame);
+    size_t connections() const { return m_conns.size(); }
+    size_t subscribers(const std::string &topic) const;
+
+    static const size_t MAX_OUT_BYTES = 4 * 1024 * 1024;  // 每个连接发送队列的积压上限
+    char *buffer() { return m_buf; }
+    static const size_t BUFFER_SIZE = 64 * 1024;
+
+   private:
+    friend class ws_conn;
+
+    ws_server() : m_next_id(1), m_close_log(0), m_started(false) {}
+    ~ws_server() {}
+
+    void tick();
+    void bury(ws_conn *conn);  // 推迟释放：发布过程中不能修改订阅者数组
+    void sweep();
+
+   private:
+    uint64_t m_next_id;                                              // 下一个连接编号
+    std::unordered_map<uint64_t, ws_conn *> m_conns;                 // 所有连接
+    std::unordered_map<std::string, std::vector<ws_conn *> > m_topics;  // 主题 -> 订阅者
+    std::vector<ws_conn *> m_graveyard;                              // 等待释放的连接
+    int m_close_log;                                                 // 日志开关
+    bool m_started;                                                  // 是否已注册周期回调
+    char m_buf[BUFFER_SIZE];                                         // 读连接的缓冲区
+};
+
+#endif